@@ -5,3 +5,9 @@ be compilable via VIGRA's build system.
 
 ATM, you seem to need "make geomap" since it is not part of the
 default build.  ("make cellimage" is another extension target.)
+
+The label image storage of GeoMap is chosen at build time: dense by
+default, or tiled / run-length encoded with -DWITH_TILED_LABEL_IMAGE=ON
+resp. -DWITH_RLE_LABEL_IMAGE=ON.  Use one build directory per variant
+and run "make test_geomap" in each of them to run python/test against
+that build.
@@ -27,7 +27,8 @@
 ##########################################################################
 
 import sys, time, copy
-from geomap import GeoMap, crackConnectionImage, crackEdgeGraph
+from geomap import GeoMap, crackConnectionImage, crackEdgeGraph, \
+     streamingCrackEdgeGraph
 import vigra
 from flag_constants import BORDER_PROTECTION
 import maputils
@@ -40,8 +41,18 @@ __all__ = ["crackEdgeMap", "crackEdgeGraph"]
 # --------------------------------------------------------------------
 
 def crackEdgeMap(labelImage, initLabelImage = True,
-                 eightConnectedRegions = True):
-    result = crackEdgeGraph(labelImage, eightConnectedRegions = eightConnectedRegions)
+                 eightConnectedRegions = True, streaming = False,
+                 threadCount = 1):
+    """If `streaming` is True, use streamingCrackEdgeGraph(), which
+    needs much less temporary memory for large label images (and
+    may trace horizontal strips in parallel, cf. `threadCount`)."""
+    if streaming:
+        result = streamingCrackEdgeGraph(
+            labelImage, eightConnectedRegions = eightConnectedRegions,
+            threadCount = threadCount)
+    else:
+        result = crackEdgeGraph(
+            labelImage, eightConnectedRegions = eightConnectedRegions)
     result.sortEdgesDirectly()
     result.initializeMap(initLabelImage)
 
@@ -0,0 +1,92 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Compares per-edge Python loops over tangentList() and
+resamplePolygonGaussianFilter() with the batch entry points
+batchTangentLists() and batchResamplePolygonGaussianFilter(), which
+process all edges of a GeoMap in C++ (in parallel), on the crack
+edge map of a label image of square blocks with random labels.
+
+usage: python benchmark_batch_polygons.py [size [blockSize [threadCount]]]"""
+
+import sys, time
+import numpy
+import geomap
+from maputils.crackConvert import crackEdgeMap
+from labelimages import blockLabels
+
+def ragged(points, offsets, label):
+    return points[offsets[label]:offsets[label+1]]
+
+def benchmark(size = 2000, blockSize = 32, threadCount = 0):
+    map = crackEdgeMap(blockLabels(size, blockSize), initLabelImage = False)
+    dx, skipPoints = 5, 1
+    edges = [edge for edge in map.edgeIter()
+             if len(edge) >= 2*dx + 2*skipPoints + 1]
+    print("%d edges (%d long enough for tangentList with dx = %d)" % (
+        map.edgeCount, len(edges), dx))
+
+    start = time.time()
+    tangents = [geomap.tangentList(edge, dx, skipPoints) for edge in edges]
+    print("tangentList() loop               %8.3fs" % (time.time() - start, ))
+
+    start = time.time()
+    points, offsets, status = geomap.batchTangentLists(
+        edges, dx, skipPoints, threadCount = threadCount)
+    print("batchTangentLists()              %8.3fs" % (time.time() - start, ))
+
+    if not status.all():
+        print("ERROR: %d edges not processed!" % (len(status) - status.sum(), ))
+    for i, edgeTangents in enumerate(tangents):
+        if not numpy.allclose(ragged(points, offsets, i), edgeTangents):
+            print("ERROR: different tangents for edge %d!" % edges[i].label())
+            break
+
+    scale, distance = 1.0, 0.5
+    edges = [edge for edge in map.edgeIter() if edge.length() > 4*scale]
+
+    start = time.time()
+    resampled = [geomap.resamplePolygonGaussianFilter(edge, scale, distance)
+                 for edge in edges]
+    print("resamplePolygonGaussianFilter()  %8.3fs" % (time.time() - start, ))
+
+    start = time.time()
+    points, offsets, status = geomap.batchResamplePolygonGaussianFilter(
+        edges, scale, distance, threadCount = threadCount)
+    print("batchResamplePolygonGaussian...  %8.3fs" % (time.time() - start, ))
+
+    if not status.all():
+        print("ERROR: %d edges not processed!" % (len(status) - status.sum(), ))
+    for i, poly in enumerate(resampled):
+        if not numpy.allclose(ragged(points, offsets, i), list(poly)):
+            print("ERROR: different resampled points for edge %d!" % (
+                edges[i].label(), ))
+            break
+
+if __name__ == "__main__":
+    args = [int(arg) for arg in sys.argv[1:]]
+    benchmark(*args)
@@ -0,0 +1,91 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+
+
+"""Measures construction, copying and destruction times of large
+GeoMaps, e.g. in order to compare cell allocation strategies.
+
+Along the way, it checks that copies are consistent and equal to
+their originals, and that cells referenced beyond the lifetime of
+their map (whose memory is kept by the map's cell arena) stay usable.
+
+usage: python benchmark_construction.py [size [repetitions]]"""
+
+import sys, time, copy
+import numpy
+import geomap
+
+def timed(label, f, *args):
+    start = time.time()
+    result = f(*args)
+    print("%-28s %8.3fs" % (label, time.time() - start))
+    return result
+
+def check(condition, message):
+    if not condition:
+        print("ERROR: %s!" % message)
+
+def benchmark(size = 1000, repetitions = 3):
+    numpy.random.seed(42)
+    # small random regions -> many nodes, edges and faces:
+    labels = numpy.random.randint(0, 6, (size, size)).astype(numpy.int32)
+
+    for i in range(repetitions):
+        m = timed("crackEdgeGraph(%dx%d)" % (size, size),
+                  geomap.crackEdgeGraph, labels)
+        print("  (%d nodes, %d edges, %d faces)" % (
+            m.nodeCount, m.edgeCount, m.faceCount))
+        m2 = timed("copy.copy(map)", copy.copy, m)
+
+        check(m2.checkConsistency(), "inconsistent copy")
+        check((m2.nodeCount, m2.edgeCount, m2.faceCount) ==
+              (m.nodeCount, m.edgeCount, m.faceCount),
+              "copy has different cell counts")
+        for node in m2.nodeIter():
+            break
+        for edge in m2.edgeIter():
+            break
+        position, points = node.position(), list(edge)
+        check(position == m.node(node.label()).position() and
+              points == list(m.edge(edge.label())),
+              "copy has different geometry")
+
+        start = time.time()
+        del m, m2
+        print("%-28s %8.3fs" % ("destruction (2 maps)", time.time() - start))
+
+        # the cells referenced from here outlived their map:
+        check(not node.initialized() and not edge.initialized(),
+              "cells of destroyed map still initialized")
+        check(node.position() == position and list(edge) == points,
+              "cells of destroyed map lost their data")
+        del node, edge
+
+if __name__ == "__main__":
+    args = [int(arg) for arg in sys.argv[1:]]
+    benchmark(*args)
@@ -0,0 +1,77 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Compares geomap.streamingCrackEdgeGraph() (serial and parallel)
+with geomap.crackEdgeGraph() on a large label image of square blocks
+with random labels (default: 10000x10000 pixels, 16x16 blocks),
+reporting run times, peak memory usage and the resulting cell counts.
+
+Since the peak memory (maximum resident set size) only ever grows,
+pass 'original', 'streaming' or 'parallel' as third argument in order
+to measure a single variant per process.
+
+usage: python benchmark_crack_edges.py [size [blockSize [variant]]]"""
+
+import sys, time, resource
+import geomap
+from labelimages import blockLabels
+
+def peakMemoryMB():
+    return resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024.0
+
+def benchmark(size = 10000, blockSize = 16, variant = None):
+    labels = blockLabels(size, blockSize)
+    print("%dx%d label image, %.1fMB peak memory before" % (
+        size, size, peakMemoryMB()))
+
+    variants = [("crackEdgeGraph", geomap.crackEdgeGraph),
+                ("streamingCrackEdgeGraph", geomap.streamingCrackEdgeGraph),
+                ("  (threadCount = 0)", lambda labels:
+                 geomap.streamingCrackEdgeGraph(labels, threadCount = 0))]
+    if variant == "original":
+        variants = variants[:1]
+    elif variant == "streaming":
+        variants = variants[1:2]
+    elif variant == "parallel":
+        variants = variants[2:]
+
+    counts = []
+    for label, f in variants:
+        start = time.time()
+        m = f(labels)
+        print("%-28s %8.3fs, %.1fMB peak memory" % (
+            label, time.time() - start, peakMemoryMB()))
+        counts.append((m.nodeCount, m.edgeCount))
+        print("  (%d nodes, %d edges)" % counts[-1])
+        del m
+
+    if len(set(counts)) > 1:
+        print("ERROR: different cell counts!")
+
+if __name__ == "__main__":
+    args = [int(arg) for arg in sys.argv[1:3]] + sys.argv[3:4]
+    benchmark(*args)
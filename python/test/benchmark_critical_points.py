@@ -0,0 +1,90 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Benchmarks SubPixelWatersheds.findCriticalPoints() with the fused,
+SIMD batched derivative evaluation (cpFusedDerivatives = True, the
+default) against separate dx()/dy()/dxx()/dxy()/dyy() calls, and
+compares the critical points found (which may differ in the last bits,
+since the fused derivatives are rounded differently).
+
+usage: python benchmark_critical_points.py [size [oversampling [threads]]]"""
+
+import sys, time
+import numpy
+import geomap
+
+def smoothNoise(size, scale = 4.0):
+    """Gaussian-smoothed (via FFT) white noise with many critical
+    points."""
+    numpy.random.seed(42)
+    noise = numpy.random.rand(size, size)
+    f = numpy.fft.fftfreq(size)
+    fx, fy = numpy.meshgrid(f, f)
+    kernel = numpy.exp(-2.0 * (numpy.pi * scale)**2 * (fx**2 + fy**2))
+    result = numpy.real(numpy.fft.ifft2(numpy.fft.fft2(noise) * kernel))
+    return numpy.asarray(255.0 * result / result.max(), numpy.float32)
+
+def points(spws):
+    return [numpy.array([tuple(p) for p in cps[1:]])
+            for cps in (spws.minima(), spws.saddles(), spws.maxima())]
+
+def maxDeviation(a, b):
+    if len(a) != len(b):
+        return None
+    if not len(a):
+        return 0.0
+    return abs(a - b).max()
+
+def benchmark(size = 256, oversampling = 2, threads = 1):
+    image = smoothNoise(size)
+    for order in (2, 3, 5):
+        SPWS = getattr(geomap, "SubPixelWatersheds%d" % order)
+        durations, results = [], []
+        for fused in (False, True):
+            spws = SPWS(image)
+            spws.cpOversampling = oversampling
+            spws.cpThreadCount = threads
+            spws.cpFusedDerivatives = fused
+            start = time.time()
+            spws.findCriticalPoints(progress = lambda percent: None)
+            durations.append(time.time() - start)
+            results.append(points(spws))
+
+        deviations = [maxDeviation(a, b) for a, b in zip(*results)]
+        print("order %d, %dx%d, oversampling %d: separate %.3fs, fused %.3fs "
+              "(speedup %.2f)" % (order, size, size, oversampling,
+                                  durations[0], durations[1],
+                                  durations[0] / durations[1]))
+        print("  %s minima, %s saddles, %s maxima; max. deviation %s" % (
+            tuple(len(cps) for cps in results[1]) + (deviations, )))
+        counters = spws.counters()
+        print("  dedup point set: %d queries, %d hits" % (
+            counters["cpDedupQueries"], counters["cpDedupHits"]))
+
+if __name__ == "__main__":
+    args = [int(arg) for arg in sys.argv[1:]]
+    benchmark(*args)
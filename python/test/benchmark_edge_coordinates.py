@@ -0,0 +1,69 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Compares getting the edge coordinates of a GeoMap via iteration
+(one Vector2 object per point) with the numpy views returned by
+Edge.coordinates() and the flat array copied by GeoMap.edgeCoordinates(),
+on the crack edge map of a label image of square blocks with random
+labels.
+
+usage: python benchmark_edge_coordinates.py [size [blockSize]]"""
+
+import sys, time
+import numpy
+import geomap
+from maputils.crackConvert import crackEdgeMap
+from labelimages import blockLabels
+
+def benchmark(size = 2000, blockSize = 16):
+    map = crackEdgeMap(blockLabels(size, blockSize), initLabelImage = False)
+    edges = list(map.edgeIter())
+    print("%d edges, %d points" % (
+        len(edges), sum(len(edge) for edge in edges)))
+
+    start = time.time()
+    copies = [numpy.array(list(edge)) for edge in edges]
+    print("numpy.array(list(edge))  %8.3fs" % (time.time() - start, ))
+
+    start = time.time()
+    arrays = [edge.coordinates() for edge in edges]
+    print("edge.coordinates()       %8.3fs" % (time.time() - start, ))
+
+    start = time.time()
+    points, offsets = map.edgeCoordinates()
+    print("map.edgeCoordinates()    %8.3fs" % (time.time() - start, ))
+
+    for edge, copy, array in zip(edges, copies, arrays):
+        label = edge.label()
+        if not (numpy.all(copy == array) and numpy.all(
+                array == points[offsets[label]:offsets[label+1]])):
+            print("ERROR: different coordinates for edge %d!" % label)
+            break
+
+if __name__ == "__main__":
+    args = [int(arg) for arg in sys.argv[1:]]
+    benchmark(*args)
@@ -0,0 +1,71 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Benchmarks SubPixelWatersheds.traceAllEdges() with the original
+second order flow line integrator against the Dormand-Prince 4(5)
+scheme, with and without polyline thinning (flowLineTolerance).
+
+usage: python benchmark_flowlines.py [size [threads]]"""
+
+import sys, time
+import geomap
+from benchmark_critical_points import smoothNoise
+
+def endpoints(edges):
+    return [edge and edge[:2] for edge in edges]
+
+def benchmark(size = 256, threads = 1):
+    image = smoothNoise(size)
+    for order in (2, 3, 5):
+        spws = getattr(geomap, "SubPixelWatersheds%d" % order)(image)
+        spws.findCriticalPoints(progress = lambda percent: None)
+
+        reference = None
+        for integrator, tolerance in (
+            (geomap.FlowLineIntegrator.SecondOrderDoubleStep, 0.0),
+            (geomap.FlowLineIntegrator.DormandPrince45, 0.0),
+            (geomap.FlowLineIntegrator.DormandPrince45, 0.01),
+            (geomap.FlowLineIntegrator.DormandPrince45, 0.1)):
+            spws.flowLineIntegrator = integrator
+            spws.flowLineTolerance = tolerance
+
+            start = time.time()
+            edges = spws.traceAllEdges(-1e10, threads)
+            duration = time.time() - start
+
+            pointCount = sum(len(edge[2]) for edge in edges if edge)
+            if reference is None:
+                reference = endpoints(edges)
+            sameEnds = sum(a == b for a, b in zip(reference, endpoints(edges)))
+            print("order %d, %-21s tolerance %.2f: %.3fs, %8d points, "
+                  "%d/%d edges with same end maxima" % (
+                order, integrator, tolerance, duration, pointCount,
+                sameEnds, len(edges)))
+
+if __name__ == "__main__":
+    args = [int(arg) for arg in sys.argv[1:]]
+    benchmark(*args)
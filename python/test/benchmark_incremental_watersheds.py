@@ -0,0 +1,82 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Benchmarks SubPixelWatersheds.updateCriticalPoints() / updateEdges()
+after editing a small part of the image against recomputing everything,
+and checks that both yield the same critical points.
+
+usage: python benchmark_incremental_watersheds.py [size [editSize [threads]]]"""
+
+import sys, time
+import numpy
+import geomap
+from geomap import Rect2D
+from benchmark_critical_points import smoothNoise
+
+def pointSet(points):
+    return set(tuple(round(c, 6) for c in p) for p in points[1:] if p)
+
+def benchmark(size = 1024, editSize = 32, threads = 0):
+    image = smoothNoise(size)
+
+    spws = geomap.SubPixelWatersheds3(image)
+    spws.cpThreadCount = threads
+    spws.findCriticalPoints(progress = lambda percent: None)
+    spws.traceAllEdges(-1e10, threads)
+
+    x0 = y0 = size // 2
+    edited = image.copy()
+    edited[x0:x0+editSize, y0:y0+editSize] += numpy.float32(20.0) * numpy.random.rand(
+        editSize, editSize).astype(numpy.float32)
+
+    start = time.time()
+    changes = spws.updateCriticalPoints(
+        edited, Rect2D(x0, y0, x0 + editSize, y0 + editSize))
+    changedEdges = spws.updateEdges(threads)
+    duration = time.time() - start
+    print("incremental: %.3fs, %d saddles / %d maxima changed, %d edges changed" % (
+        duration, len(changes["saddles"]), len(changes["maxima"]),
+        len(changedEdges)))
+
+    start = time.time()
+    full = geomap.SubPixelWatersheds3(edited)
+    full.cpThreadCount = threads
+    full.findCriticalPoints(progress = lambda percent: None)
+    full.traceAllEdges(-1e10, threads)
+    print("full:        %.3fs" % (time.time() - start, ))
+
+    # the coefficient halo makes the results equal up to rounding:
+    for kind in ("minima", "saddles", "maxima"):
+        incremental = pointSet(getattr(spws, kind)())
+        reference = pointSet(getattr(full, kind)())
+        print("%s: %d incremental, %d full, %d in common" % (
+            kind, len(incremental), len(reference),
+            len(incremental & reference)))
+
+if __name__ == "__main__":
+    args = [int(arg) for arg in sys.argv[1:]]
+    benchmark(*args)
@@ -0,0 +1,103 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Measures the cost of the label image updates performed by
+GeoMap's Euler operations (removeEdgeFromLabelImage() in mergeFaces()
+and rawAddEdgeToLabelImage() in mergeEdges()) over the real edge
+scanlines of a crack edge map of square blocks with random labels.
+
+The same random sequence of mergeFaces() and mergeDegree2Nodes()
+operations is applied to a map without label image and to one with
+label image; the difference of the run times is attributed to the
+label image updates.  The updated label image is checked against a
+freshly rasterized one.
+
+In order to compare with the former pixel-wise loops, run this script
+with a build of the revision before the row kernels (with the same
+arguments) and compare the reported time per merge.
+
+usage: python benchmark_label_updates.py [size [blockSize [mergeCount]]]"""
+
+import sys, time
+import numpy
+import geomap
+from maputils.crackConvert import crackEdgeMap
+from labelimages import blockLabels
+
+def mergeSequence(map, mergeCount):
+    """Random (but reproducible) sequence of edge labels separating
+    different faces, to be passed to mergeFaces()."""
+    numpy.random.seed(23)
+    labels = [edge.label() for edge in map.edgeIter()
+              if edge.leftFaceLabel() != edge.rightFaceLabel()
+              and not edge.flags()]
+    numpy.random.shuffle(labels)
+    return labels[:mergeCount]
+
+def run(map, edgeLabels):
+    start = time.time()
+    merged = 0
+    for edgeLabel in edgeLabels:
+        edge = map.edge(edgeLabel)
+        if edge is None or edge.leftFaceLabel() == edge.rightFaceLabel():
+            continue # removed by mergeEdges() or became a bridge
+        if map.mergeFaces(edge.dart()):
+            merged += 1
+    geomap.mergeDegree2Nodes(map)
+    return time.time() - start, merged
+
+def benchmark(size = 2000, blockSize = 8, mergeCount = 20000):
+    labels = blockLabels(size, blockSize)
+
+    results = []
+    for name, initLabelImage in (
+        ("without label image", False),
+        ("with label image", True)):
+        map = crackEdgeMap(labels, initLabelImage = initLabelImage)
+        edgeLabels = mergeSequence(map, mergeCount)
+        duration, merged = run(map, edgeLabels)
+        results.append((duration, merged, map.faceCount, map.edgeCount))
+        print("%-20s %8.3fs  (%d merges, %d faces, %d edges left)" % (
+            name, duration, merged, map.faceCount, map.edgeCount))
+
+    updated = numpy.asarray(map.labelImage()).copy()
+    map.setHasLabelImage(False)
+    map.setHasLabelImage(True)
+    if (updated != numpy.asarray(map.labelImage())).any():
+        print("ERROR: updated label image differs from rasterized one!")
+    del map
+
+    if results[0][1:] != results[1][1:]:
+        print("ERROR: different resulting maps!")
+
+    merged = max(1, results[1][1])
+    print("label image updates per merge: %.2f microseconds" % (
+        (results[1][0] - results[0][0]) * 1e6 / merged, ))
+
+if __name__ == "__main__":
+    args = [int(arg) for arg in sys.argv[1:]]
+    benchmark(*args)
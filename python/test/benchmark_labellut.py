@@ -0,0 +1,125 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Benchmarks LabelLUT.relabel() over long synthetic merge sequences,
+and the label lookups of a GeoMap's label image after many merges
+(labelImage() and faceAt() look up every pixel in the LUT).
+
+The script only uses the LUT / GeoMap API that was available before
+the union-by-size LUT, so in order to compare with the former LUT, run
+it with a build of the previous revision, too.  (Since the former
+relabel() is quadratic for the 'absorbing' sequence, it additionally
+reports the number of LUT entries the former implementation writes.)
+
+usage: python benchmark_labellut.py [mergeCount [size [faceMerges]]]"""
+
+import sys, time
+import numpy
+import geomap
+from maputils.crackConvert import crackEdgeMap
+from labelimages import blockLabels
+from benchmark_label_updates import mergeSequence, run
+
+def absorbingSequence(n):
+    """A growing region is repeatedly merged into a fresh small one
+    (relabel(big, small)), the worst case for the former LUT."""
+    return [(i, i + 1) for i in range(n)]
+
+def survivingSequence(n):
+    """A big region survives while absorbing all small ones
+    (relabel(small, big))."""
+    return [(i + 1, 0) for i in range(n)]
+
+def randomSequence(n):
+    """Random agglomeration of n + 1 labels."""
+    numpy.random.seed(42)
+    heads = range(n + 1)
+    result = []
+    for i in range(n):
+        a, b = numpy.random.randint(0, len(heads), 2)
+        if a == b:
+            b = (a + 1) % len(heads)
+        result.append((heads[a], heads[b]))
+        heads[a] = heads[-1]
+        heads.pop()
+    return result
+
+def formerWrites(sequence, size):
+    """Number of LUT entries written by the former relabel()."""
+    setSize = [1] * size
+    result = 0
+    for fromLabel, toLabel in sequence:
+        result += setSize[fromLabel]
+        setSize[toLabel] += setSize[fromLabel]
+    return result
+
+def benchmarkRelabel(mergeCount):
+    for name, generator in (("absorbing", absorbingSequence),
+                            ("surviving", survivingSequence),
+                            ("random", randomSequence)):
+        sequence = generator(mergeCount)
+        lut = geomap.LabelLUT(mergeCount + 1)
+        relabel = lut.relabel
+
+        start = time.time()
+        for fromLabel, toLabel in sequence:
+            relabel(fromLabel, toLabel)
+        duration = time.time() - start
+
+        # all labels must end up in the last surviving one:
+        final = lut[sequence[-1][1]]
+        assert lut[0] == final and lut[mergeCount] == final
+
+        print("%-10s %8d merges %8.3fs  (former LUT: %d entry writes)" % (
+            name, mergeCount, duration, formerWrites(sequence, mergeCount + 1)))
+
+def benchmarkLookups(size, faceMerges, repetitions = 10):
+    map = crackEdgeMap(blockLabels(size, 4))
+    duration, merged = run(map, mergeSequence(map, faceMerges))
+    print("%d mergeFaces() %8.3fs" % (merged, duration))
+
+    start = time.time()
+    for i in range(repetitions):
+        map.labelImage()
+    print("labelImage()    %8.3fs per %dx%d image" % (
+        (time.time() - start) / repetitions, size, size))
+
+    numpy.random.seed(42)
+    positions = numpy.random.rand(100000, 2) * (size - 1)
+    start = time.time()
+    for x, y in positions:
+        map.faceAt((x, y))
+    print("faceAt()        %8.3fs for %d positions" % (
+        time.time() - start, len(positions)))
+
+def benchmark(mergeCount = 200000, size = 2000, faceMerges = 100000):
+    benchmarkRelabel(mergeCount)
+    benchmarkLookups(size, faceMerges)
+
+if __name__ == "__main__":
+    args = [int(arg) for arg in sys.argv[1:]]
+    benchmark(*args)
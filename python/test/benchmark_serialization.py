@@ -0,0 +1,74 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Times pickling and GeoMap.save()/GeoMap.load() of the crack edge
+map of a label image of square blocks with random labels, and checks
+that the restored map has the same cells and label image.
+
+usage: python benchmark_serialization.py [size [blockSize]]"""
+
+import sys, os, time, pickle, tempfile
+import geomap
+from maputils.crackConvert import crackEdgeMap
+from labelimages import blockLabels
+from test_serialization import compareMaps
+
+def benchmark(size = 1000, blockSize = 16):
+    map = crackEdgeMap(blockLabels(size, blockSize))
+    print("%d nodes, %d edges, %d faces" % (
+        map.nodeCount, map.edgeCount, map.faceCount))
+
+    start = time.time()
+    data = pickle.dumps(map, pickle.HIGHEST_PROTOCOL)
+    print("pickle.dumps     %8.3fs (%d bytes)" % (
+        time.time() - start, len(data)))
+
+    start = time.time()
+    unpickled = pickle.loads(data)
+    print("pickle.loads     %8.3fs" % (time.time() - start, ))
+
+    fd, filename = tempfile.mkstemp(".geomap")
+    os.close(fd)
+    try:
+        start = time.time()
+        map.save(filename)
+        print("GeoMap.save      %8.3fs (%d bytes)" % (
+            time.time() - start, os.path.getsize(filename)))
+
+        start = time.time()
+        loaded = geomap.GeoMap.load(filename)
+        print("GeoMap.load      %8.3fs" % (time.time() - start, ))
+    finally:
+        os.remove(filename)
+
+    compareMaps(map, unpickled)
+    compareMaps(map, loaded)
+    print("restored maps OK")
+
+if __name__ == "__main__":
+    args = [int(arg) for arg in sys.argv[1:]]
+    benchmark(*args)
@@ -0,0 +1,84 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Benchmarks TiledSubPixelWatersheds against SubPixelWatersheds on the
+same image: run times, numbers of critical points, and how many edges
+connect the same maxima.
+
+usage: python benchmark_tiled_watersheds.py [size [tileSize [threads]]]"""
+
+import sys, time
+import geomap
+from benchmark_critical_points import smoothNoise
+
+def edgeEnds(edges, maxima):
+    """Set of (saddle index, start, end) position tuples of the edges
+    (positions instead of maximum indices, which are ordered
+    differently by the tiled version)."""
+    result = set()
+    def pos(index):
+        return index > 0 and tuple(round(c, 6) for c in maxima[index])
+    for edge in edges:
+        if edge:
+            saddle = edge[2][edge[3]]
+            result.add((tuple(round(c, 6) for c in saddle),
+                        pos(edge[0]), pos(edge[1])))
+    return result
+
+def benchmark(size = 1024, tileSize = 256, threads = 0):
+    image = smoothNoise(size)
+
+    start = time.time()
+    spws = geomap.SubPixelWatersheds3(image)
+    spws.cpThreadCount = threads
+    spws.findCriticalPoints(progress = lambda percent: None)
+    edges = spws.traceAllEdges(-1e10, threads)
+    duration = time.time() - start
+    print("untiled:        %.3fs, %d saddles, %d maxima" % (
+        duration, len(spws.saddles()) - 1, len(spws.maxima()) - 1))
+
+    start = time.time()
+    tiled = geomap.TiledSubPixelWatersheds3(image, tileSize)
+    tiled.findCriticalPoints(threads)
+    tiledEdges = tiled.edges(-1e10, threads)
+    duration = time.time() - start
+    print("tiles of %4d:  %.3fs, %d saddles, %d maxima (%d tiles)" % (
+        tileSize, duration, len(tiled.saddles()) - 1,
+        len(tiled.maxima()) - 1, tiled.tileCount()))
+
+    reference = edgeEnds(edges, spws.maxima())
+    same = len(reference & edgeEnds(tiledEdges, tiled.maxima()))
+    print("%d/%d edges connect the same maxima" % (same, len(reference)))
+
+    start = time.time()
+    tiledMap = tiled.map(-1e10, threads)
+    print("stitched GeoMap: %.3fs, %d nodes, %d edges" % (
+        time.time() - start, tiledMap.nodeCount, tiledMap.edgeCount))
+
+if __name__ == "__main__":
+    args = [int(arg) for arg in sys.argv[1:]]
+    benchmark(*args)
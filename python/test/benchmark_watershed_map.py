@@ -0,0 +1,63 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Benchmarks building the initialized subpixel watershed GeoMap in C++
+(SubPixelWatersheds.map()) against maputils.subpixelWatershedMapFromData()
+on the same traced edges.
+
+usage: python benchmark_watershed_map.py [size [threads]]"""
+
+import sys, time
+import geomap, maputils
+from benchmark_critical_points import smoothNoise
+
+def benchmark(size = 512, threads = 0):
+    image = smoothNoise(size)
+
+    spws = geomap.SubPixelWatersheds3(image)
+    spws.cpThreadCount = threads
+    spws.findCriticalPoints(progress = lambda percent: None)
+    maxima = spws.maxima()
+    edges = spws.traceAllEdges(-1e10, threads)
+
+    start = time.time()
+    pyMap = maputils.subpixelWatershedMapFromData(
+        maxima, [None] + edges, image.shape)
+    pyDuration = time.time() - start
+
+    start = time.time()
+    cppMap = spws.map(-1e10, threads)
+    cppDuration = time.time() - start
+
+    print("Python: %.3fs, %d nodes, %d edges, %d faces" % (
+        pyDuration, pyMap.nodeCount, pyMap.edgeCount, pyMap.faceCount))
+    print("C++:    %.3fs, %d nodes, %d edges, %d faces (incl. tracing)" % (
+        cppDuration, cppMap.nodeCount, cppMap.edgeCount, cppMap.faceCount))
+
+if __name__ == "__main__":
+    args = [int(arg) for arg in sys.argv[1:]]
+    benchmark(*args)
@@ -0,0 +1,75 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Reference for geomap.DynamicCostQueue: the binary heap with stale
+entries that it replaced.  setCost() pushes another entry, erase()
+only forgets the index, and top()/pop() skip the entries whose cost
+is no longer current."""
+
+import heapq
+
+class HeapQueue(object):
+    def __init__(self, maxIndex):
+        self._maxIndex = maxIndex
+        self._heap = []
+        self._costs = {}
+
+    def insert(self, index, cost):
+        assert index not in self._costs
+        self.setCost(index, cost)
+
+    def setCost(self, index, cost):
+        self._costs[index] = cost
+        heapq.heappush(self._heap, (cost, index))
+
+    def erase(self, index):
+        return self._costs.pop(index, None) is not None
+
+    def _skipStale(self):
+        heap = self._heap
+        while heap and self._costs.get(heap[0][1]) != heap[0][0]:
+            heapq.heappop(heap)
+
+    def top(self):
+        self._skipStale()
+        cost, index = self._heap[0]
+        return index, cost
+
+    def pop(self):
+        result = self.top()
+        heapq.heappop(self._heap)
+        del self._costs[result[0]]
+        return result
+
+    def cost(self, index):
+        return self._costs[index]
+
+    def __len__(self):
+        return len(self._costs)
+
+    def __contains__(self, index):
+        return index in self._costs
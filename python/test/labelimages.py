@@ -0,0 +1,60 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Label images used by the tests and benchmarks, from which maps are
+created e.g. via crackEdgeGraph()."""
+
+import numpy, vigra
+
+def blockLabels(size, blockSize):
+    """Square blocks of blockSize^2 pixels with random labels (fixed
+    seed) in a size x size image."""
+    numpy.random.seed(42)
+    blocks = (size + blockSize - 1) // blockSize
+    labels = numpy.random.randint(0, 6, (blocks, blocks)).astype(numpy.int32)
+    labels = labels.repeat(blockSize, 0).repeat(blockSize, 1)
+    return numpy.ascontiguousarray(labels[:size,:size])
+
+def boundaryLabels(filename):
+    image = numpy.asarray(vigra.readImage(filename)).squeeze()
+    return numpy.ascontiguousarray((image > 0).astype(numpy.int32))
+
+def nestedRings(size = 64):
+    """Concentric square rings (nested holes) next to a few islands."""
+    labels = numpy.zeros((size, size), numpy.int32)
+    for i in range(1, size // 4):
+        labels[2*i:size-2*i, 2*i:size//2+8-2*i] = i % 3 + 1
+    labels[size-12:size-4, 4:12] = 5
+    labels[size-10:size-6, 6:10] = 6
+    return labels
+
+def labelImages():
+    yield "blocks", blockLabels(96, 8)
+    yield "rings", nestedRings()
+    for filename in ("touching_boundary.png", "closed_contours.png",
+                     "bridges.png", "four_connected.png", "self_loop.png"):
+        yield filename, boundaryLabels(filename)
@@ -0,0 +1,56 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+import numpy
+import geomap
+
+def ragged(points, offsets, index):
+    return points[offsets[index]:offsets[index+1]]
+
+def circle(count):
+    angles = numpy.linspace(0, 2*numpy.pi, count)
+    return geomap.Polygon([(10*numpy.cos(a), 10*numpy.sin(a)) for a in angles])
+
+def test_repeatedPolygon():
+    # the same (fresh, i.e. without cached length) Polygon many times:
+    polygon = circle(50)
+    reference = geomap.tangentList(circle(50), 5, 1)
+    points, offsets, status = geomap.batchTangentLists(
+        [polygon] * 200, 5, 1, threadCount = 4)
+    assert status.all()
+    for i in range(200):
+        result = ragged(points, offsets, i)
+        assert len(result) == len(reference)
+        for p, q in zip(result, reference):
+            assert abs(p[0] - q[0]) < 1e-12 and abs(p[1] - q[1]) < 1e-12
+
+def test_shortPolygons():
+    polygons = [circle(50), [(0, 0)], circle(5), circle(20)]
+    points, offsets, status = geomap.batchCurvatureLists(
+        polygons, 5, 1, threadCount = 2)
+    assert list(status) == [1, 0, 1, 1]
+    assert len(ragged(points, offsets, 1)) == 0
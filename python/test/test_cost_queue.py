@@ -0,0 +1,146 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Checks DynamicCostQueue (a 4-ary indexed heap) against the binary
+heap with stale entries it replaced."""
+
+import numpy
+import geomap
+from heapqueue import HeapQueue
+
+MAX_INDEX = 500
+
+def drain(queue):
+    result = []
+    while len(queue):
+        result.append(queue.pop())
+    return result
+
+def randomCosts(count, seed):
+    """count distinct costs (multiples of 1/count), so that the order
+    does not depend on how ties are broken"""
+    numpy.random.seed(seed)
+    return numpy.random.permutation(count).astype(numpy.float64) / count
+
+def test_build():
+    indices = numpy.arange(0, MAX_INDEX, 2, dtype = numpy.uint32)
+    costs = randomCosts(len(indices), 1)
+    queue, reference = geomap.DynamicCostQueue(MAX_INDEX), HeapQueue(MAX_INDEX)
+    queue.build(indices, costs)
+    for index, cost in zip(indices, costs):
+        reference.insert(int(index), cost)
+    assert len(queue) == len(reference)
+    assert 2 in queue and 3 not in queue
+    assert queue.top() == reference.top()
+    assert drain(queue) == drain(reference)
+    assert queue.empty()
+
+def test_buildChangesCosts():
+    queue = geomap.DynamicCostQueue(10)
+    queue.insert(3, 5.0)
+    queue.insert(4, 1.0)
+    queue.build(numpy.array([3, 7], numpy.uint32), numpy.array([0.5, 2.0]))
+    assert len(queue) == 3
+    assert queue.cost(3) == 0.5
+    assert drain(queue) == [(3, 0.5), (4, 1.0), (7, 2.0)]
+
+def test_setCost():
+    # decreased and increased costs; the old entries must not come back:
+    queue, reference = geomap.DynamicCostQueue(MAX_INDEX), HeapQueue(MAX_INDEX)
+    costs = randomCosts(MAX_INDEX, 2)
+    for index in range(MAX_INDEX):
+        queue.insert(index, costs[index])
+        reference.insert(index, costs[index])
+    newCosts = randomCosts(MAX_INDEX, 3) * 2 - 0.4999
+    for index in range(0, MAX_INDEX, 3):
+        queue.setCost(index, newCosts[index])
+        reference.setCost(index, newCosts[index])
+    queue.setCost(1, 0.2501) # the same cost twice
+    reference.setCost(1, 0.2501)
+    queue.setCost(1, 0.2501)
+    reference.setCost(1, 0.2501)
+    assert len(queue) == len(reference) == MAX_INDEX
+    assert drain(queue) == drain(reference)
+
+def test_setCostInserts():
+    queue = geomap.DynamicCostQueue(10)
+    queue.setCost(5, 1.0)
+    assert 5 in queue and len(queue) == 1
+    assert queue.pop() == (5, 1.0)
+
+def test_eraseAndReinsert():
+    queue, reference = geomap.DynamicCostQueue(MAX_INDEX), HeapQueue(MAX_INDEX)
+    costs = randomCosts(MAX_INDEX, 4)
+    queue.build(numpy.arange(MAX_INDEX, dtype = numpy.uint32), costs)
+    for index in range(MAX_INDEX):
+        reference.insert(index, costs[index])
+
+    for index in range(0, MAX_INDEX, 5):
+        assert queue.erase(index)
+        reference.erase(index)
+        assert index not in queue
+    assert not queue.erase(0)
+    # the erased ones with other costs, some others popped in between:
+    for index in range(0, MAX_INDEX, 10):
+        queue.insert(index, costs[index] + 0.5001)
+        reference.insert(index, costs[index] + 0.5001)
+        assert queue.pop() == reference.pop()
+    assert len(queue) == len(reference)
+    assert drain(queue) == drain(reference)
+
+    # the top entry, and reinsertion after pop():
+    queue.insert(7, 0.0)
+    queue.insert(8, 1.0)
+    assert queue.erase(7)
+    assert queue.top() == (8, 1.0)
+    index, cost = queue.pop()
+    queue.insert(index, 3.0)
+    assert drain(queue) == [(8, 3.0)]
+
+def test_errors():
+    queue = geomap.DynamicCostQueue(10)
+    for operation in (queue.top, queue.pop):
+        try:
+            operation()
+        except IndexError:
+            pass
+        else:
+            assert False, "no IndexError for an empty queue"
+    queue.insert(1, 1.0)
+    try:
+        queue.insert(1, 2.0)
+    except ValueError:
+        pass
+    else:
+        assert False, "no ValueError for a duplicate index"
+    try:
+        queue.setCost(10, 1.0)
+    except IndexError:
+        pass
+    else:
+        assert False, "no IndexError for index >= maxIndex"
+    assert queue.cost(1) == 1.0
@@ -0,0 +1,101 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+
+"""Compares the maps of streamingCrackEdgeGraph() with those of
+crackEdgeGraph().  Node / edge labels and edge directions may differ,
+so the maps are compared geometrically."""
+
+import numpy
+import geomap
+from labelimages import labelImages
+
+def dartGeometry(dart):
+    return tuple([(p[0], p[1]) for p in dart])
+
+def canonicalCycle(items):
+    return min([items[i:] + items[:i] for i in range(len(items))] or [[]])
+
+def sigmaOrbits(map):
+    """Maps node positions to the (cyclic) sequence of the geometries
+    of the darts starting there."""
+    result = {}
+    for node in map.nodeIter():
+        darts = []
+        if not node.isIsolated():
+            darts = [dartGeometry(dart)
+                     for dart in node.anchor().sigmaOrbit()]
+        result[tuple(node.position())] = canonicalCycle(darts)
+    return result
+
+def faceProperties(map):
+    return sorted([(face.pixelArea(), face.holeCount())
+                   for face in map.faceIter()])
+
+def sameUpToLabels(image1, image2):
+    image1 = numpy.asarray(image1).ravel()
+    image2 = numpy.asarray(image2).ravel()
+    pairs = set(zip(image1, image2))
+    return len(pairs) == len(set(image1)) == len(set(image2))
+
+def initialized(map):
+    map.sortEdgesDirectly()
+    map.initializeMap()
+    return map
+
+def checkSameMaps(map1, map2, name):
+    assert map1.nodeCount == map2.nodeCount, name
+    assert map1.edgeCount == map2.edgeCount, name
+    assert sigmaOrbits(map1) == sigmaOrbits(map2), \
+           "%s: sigma orbits / edge geometry differ" % name
+    initialized(map1)
+    initialized(map2)
+    assert map1.faceCount == map2.faceCount, name
+    assert faceProperties(map1) == faceProperties(map2), name
+    assert sameUpToLabels(map1.labelImage(), map2.labelImage()), \
+           "%s: label images differ" % name
+
+def test_streaming():
+    for name, labels in labelImages():
+        for eightConnected in (True, False):
+            checkSameMaps(
+                geomap.crackEdgeGraph(
+                    labels, eightConnectedRegions = eightConnected),
+                geomap.streamingCrackEdgeGraph(
+                    labels, eightConnectedRegions = eightConnected),
+                "%s (eightConnectedRegions = %s)" % (name, eightConnected))
+
+def test_threadCount():
+    """Stitched strips must give the same map as the serial tracing,
+    also with more threads than (16 row high) strips."""
+    for name, labels in labelImages():
+        for threadCount in (2, 3, 8, max(labels.shape) + 1):
+            checkSameMaps(
+                geomap.streamingCrackEdgeGraph(labels),
+                geomap.streamingCrackEdgeGraph(
+                    labels, threadCount = threadCount),
+                "%s, %d threads" % (name, threadCount))
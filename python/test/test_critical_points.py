@@ -0,0 +1,59 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+
+import geomap
+from benchmark_critical_points import smoothNoise, points
+
+class ProgressError(Exception):
+    pass
+
+def watersheds(threads, progress = lambda percent: None):
+    spws = geomap.SubPixelWatersheds3(smoothNoise(64))
+    spws.cpThreadCount = threads
+    spws.findCriticalPoints(progress = progress)
+    return spws
+
+def test_threadCount():
+    serial = points(watersheds(1))
+    for threads in (2, 4):
+        parallel = points(watersheds(threads))
+        for a, b in zip(serial, parallel):
+            assert a.shape == b.shape and (a == b).all(), \
+                   "%d threads found different critical points" % threads
+
+def test_progressError():
+    def progress(percent):
+        if 0 < percent < 100:
+            raise ProgressError(percent)
+    for threads in (1, 4):
+        try:
+            watersheds(threads, progress)
+        except ProgressError:
+            pass
+        else:
+            assert False, "progress error lost with %d threads" % threads
@@ -0,0 +1,79 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Checks that the numpy views returned by Edge.coordinates() keep the
+points they were created with when the edges are modified by Euler
+operations or the map is destroyed, while new views show the changes."""
+
+import numpy
+import geomap
+from maputils.crackConvert import crackEdgeMap
+from labelimages import blockLabels
+
+def points(edge):
+    return [(p[0], p[1]) for p in edge]
+
+def longEdge(map):
+    for edge in map.edgeIter():
+        if len(edge) > 3 and not edge.isLoop():
+            return edge
+
+def test_polygon():
+    poly = geomap.Polygon([(0, 0), (1, 0), (1, 1)])
+    view = poly.coordinates()
+    assert view.shape == (3, 2)
+    assert not view.flags.writeable
+    poly.append((0, 1))
+    poly[0] = (2, 2)
+    assert view.tolist() == [[0, 0], [1, 0], [1, 1]]
+    assert poly.coordinates().tolist() == [[2, 2], [1, 0], [1, 1], [0, 1]]
+    del poly
+    assert view.tolist() == [[0, 0], [1, 0], [1, 1]]
+    assert geomap.Polygon().coordinates().shape == (0, 2)
+
+def test_eulerOperations():
+    map = crackEdgeMap(blockLabels(64, 16))
+    edge = longEdge(map)
+    before = points(edge)
+    view = edge.coordinates()
+    assert view.tolist() == [list(p) for p in before]
+
+    newEdge = map.splitEdge(edge, 1)
+    assert view.tolist() == [list(p) for p in before]
+    assert edge.coordinates().tolist() == [list(p) for p in points(edge)]
+    assert len(edge) + len(newEdge) == len(before) + 1
+
+    splitView = edge.coordinates()
+    merged = map.mergeEdges(edge.dart().nextAlpha())
+    assert splitView.tolist() == [list(p) for p in before[:2]]
+    assert sorted(merged.coordinates().tolist()) == \
+           sorted([list(p) for p in before])
+
+    mergedView = merged.coordinates()
+    del map, edge, newEdge, merged
+    assert sorted(mergedView.tolist()) == sorted([list(p) for p in before])
+    assert view.tolist() == [list(p) for p in before]
@@ -0,0 +1,96 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Checks faceAt() / facesAt() of maps without label image, which use
+a bounding box hierarchy (built on the first call), against the same
+maps with label image, also after Euler operations that update the
+hierarchy or the cached contour polygons."""
+
+import numpy
+import geomap
+from maputils.crackConvert import crackEdgeMap
+from labelimages import blockLabels, nestedRings
+
+def samplePoints(size):
+    y, x = numpy.indices((size, size)).reshape(2, -1).astype(float)
+    points = numpy.array([x, y]).T
+    return numpy.concatenate((points, points + (0.25, 0.3)))
+
+def checkSameFaces(indexed, labeled, points, name):
+    labels = indexed.facesAt(points)
+    assert (labels == labeled.facesAt(points)).all(), \
+           "%s: facesAt() differs from label image lookup" % name
+    for i in range(0, len(points), 97):
+        face = indexed.faceAt(tuple(points[i]))
+        assert (face.label() if face else 0) == labels[i], name
+
+def edgeLabels(map, predicate):
+    return [edge.label() for edge in map.edgeIter() if predicate(edge)]
+
+def innerEdge(edge):
+    return edge.leftFaceLabel() and edge.rightFaceLabel()
+
+def applyToBoth(maps, operation, edgeLabel, *args):
+    for map in maps:
+        edge = map.edge(edgeLabel)
+        operation(map, edge, *args)
+
+def mergeFaces(map, edge):
+    map.mergeFaces(edge.dart())
+
+def removeBridge(map, edge):
+    map.removeBridge(edge.dart())
+
+def splitEdge(map, edge, segmentIndex):
+    map.splitEdge(edge, segmentIndex)
+
+def test_eulerOperations():
+    for labels in (blockLabels(64, 8), nestedRings()):
+        size = labels.shape[0]
+        points = samplePoints(size)
+        indexed = crackEdgeMap(labels, initLabelImage = False)
+        labeled = crackEdgeMap(labels)
+        maps = (indexed, labeled)
+        checkSameFaces(indexed, labeled, points, "initial")
+
+        for label in edgeLabels(indexed, lambda edge: len(edge) > 2)[::5]:
+            applyToBoth(maps, splitEdge, label, 1)
+        checkSameFaces(indexed, labeled, points, "splitEdge")
+
+        for label in edgeLabels(indexed, innerEdge)[::3]:
+            edge = indexed.edge(label)
+            if edge and innerEdge(edge) and \
+                   edge.leftFaceLabel() != edge.rightFaceLabel():
+                applyToBoth(maps, mergeFaces, label)
+        checkSameFaces(indexed, labeled, points, "mergeFaces")
+
+        bridges = edgeLabels(indexed, lambda edge: edge.isBridge())
+        for label in bridges:
+            if indexed.edge(label) and indexed.edge(label).isBridge():
+                applyToBoth(maps, removeBridge, label)
+        checkSameFaces(indexed, labeled, points, "removeBridge")
+        assert indexed.checkConsistency()
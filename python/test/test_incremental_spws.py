@@ -0,0 +1,115 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+
+import numpy
+import geomap
+from geomap import Rect2D
+from benchmark_critical_points import smoothNoise
+
+size, x0, y0, editSize = 96, 30, 40, 24
+
+def editedImage(image):
+    """Replaces a block of image by a ramp without critical points, so
+    that the points found there before disappear."""
+    result = image.copy()
+    x, y = numpy.mgrid[0:editSize, 0:editSize]
+    result[x0:x0+editSize, y0:y0+editSize] = \
+        numpy.float32(100.0) + numpy.float32(2.0) * x + y
+    return result
+
+def watersheds(image):
+    spws = geomap.SubPixelWatersheds3(image)
+    spws.findCriticalPoints(progress = lambda percent: None)
+    return spws
+
+def incrementalAndFull():
+    image = smoothNoise(size)
+    spws = watersheds(image)
+    spws.traceAllEdges(-1e10)
+
+    edited = editedImage(image)
+    spws.updateCriticalPoints(
+        edited, Rect2D(x0, y0, x0 + editSize, y0 + editSize))
+    spws.updateEdges()
+    return spws, watersheds(edited)
+
+def matchingNode(node, map):
+    result = map.nearestNode(node.position(), 1e-8)
+    assert result, "no node at %s" % (node.position(), )
+    return result
+
+def sameEdgeGeometry(edge1, edge2):
+    if len(edge1) != len(edge2):
+        return False
+    p1 = numpy.array(list(edge1))
+    p2 = numpy.array(list(edge2))
+    return (numpy.abs(p1 - p2).max() < 1e-4 or
+            numpy.abs(p1 - p2[::-1]).max() < 1e-4)
+
+def checkSameMaps(map1, map2):
+    """Checks that map2 has the same nodes and edges as map1 (up to
+    rounding and labels) and the same number of faces."""
+    assert map1.nodeCount == map2.nodeCount
+    assert map1.edgeCount == map2.edgeCount
+    assert map1.faceCount == map2.faceCount
+    for edge in map1.edgeIter():
+        start = matchingNode(edge.startNode(), map2)
+        candidates = [dart.edge() for dart in start.anchor().sigmaOrbit()]
+        assert [other for other in candidates
+                if sameEdgeGeometry(edge, other)], \
+               "no edge like %s" % (edge, )
+
+def test_removedMaxima():
+    spws, full = incrementalAndFull()
+    assert None in spws.maxima(), "edit did not remove any maxima"
+
+def test_edge():
+    spws, full = incrementalAndFull()
+    removed = [i for i, saddle in enumerate(spws.saddles())
+               if i and saddle is None]
+    assert removed, "edit did not remove any saddles"
+    for index in removed:
+        try:
+            spws.edge(index)
+        except Exception:
+            pass
+        else:
+            assert False, "edge() traced removed saddle %d" % (index, )
+
+def test_map():
+    spws, full = incrementalAndFull()
+    width, height = spws.width(), spws.height()
+
+    incremental = spws.map(-1e10, cleanup = False)
+    for node in incremental.nodeIter():
+        x, y = node.position()
+        assert -1 <= x <= width and -1 <= y <= height, \
+               "node %d at %s" % (node.label(), node.position())
+    checkSameMaps(incremental, full.map(-1e10, cleanup = False))
+
+    checkSameMaps(spws.map(-1e10), full.map(-1e10))
@@ -0,0 +1,102 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Checks nearestNode(), nearestNodes() and nodesInRect() of GeoMap's
+node index against brute force, also after moving and removing nodes."""
+
+import numpy
+import geomap
+
+SIZE = 100
+
+def makeMap():
+    numpy.random.seed(42)
+    map = geomap.GeoMap(geomap.Size2D(SIZE, SIZE))
+    for x, y in numpy.random.rand(300, 2) * SIZE:
+        map.addNode(geomap.Vector2(x, y))
+    # many nodes in one column (the worst case of the former index):
+    for y in range(0, SIZE, 2):
+        map.addNode(geomap.Vector2(50.0, y + 0.5))
+    return map
+
+def positions(map):
+    return dict((node.label(), tuple(node.position()))
+                for node in map.nodeIter())
+
+def squaredDists(nodes, p):
+    return dict((label, (q[0] - p[0])**2 + (q[1] - p[1])**2)
+                for label, q in nodes.items())
+
+def checkIndex(map):
+    nodes = positions(map)
+    numpy.random.seed(23)
+    for p in numpy.random.rand(50, 2) * (SIZE + 20) - 10:
+        dists = squaredDists(nodes, p)
+        expected = sorted(dists.values())
+
+        nearest = map.nearestNode(geomap.Vector2(*p))
+        assert dists[nearest.label()] == expected[0]
+        assert map.nearestNode(geomap.Vector2(*p), expected[0] / 2) is None \
+               or expected[0] == 0
+
+        for k in (1, 5, 20):
+            found = map.nearestNodes(geomap.Vector2(*p), k)
+            assert [dists[node.label()] for node in found] == expected[:k]
+
+        found = map.nearestNodes(geomap.Vector2(*p), 20, 25.0)
+        assert [dists[node.label()] for node in found] == \
+               [d for d in expected[:20] if d < 25.0]
+
+    for x0, y0, x1, y1 in ((0, 0, SIZE, SIZE), (10, 20, 30, 25),
+                           (49, 0, 51, SIZE), (-5, -5, 3, 3), (60, 60, 60, 80)):
+        found = map.nodesInRect(geomap.Vector2(x0, y0), geomap.Vector2(x1, y1))
+        labels = [node.label() for node in found]
+        assert len(labels) == len(set(labels))
+        assert set(labels) == set(
+            label for label, (x, y) in nodes.items()
+            if x0 <= x < x1 and y0 <= y < y1)
+
+def test_queries():
+    checkIndex(makeMap())
+
+def test_moveNode():
+    map = makeMap()
+    numpy.random.seed(7)
+    for node in list(map.nodeIter())[::3]:
+        x, y = numpy.random.rand(2) * SIZE
+        node.setPosition(geomap.Vector2(x, y))
+    checkIndex(map)
+
+def test_removeNode():
+    map = makeMap()
+    for node in list(map.nodeIter())[::2]:
+        map.removeIsolatedNode(node)
+    checkIndex(map)
+    # all remaining nodes at the same position:
+    for node in map.nodeIter():
+        node.setPosition(geomap.Vector2(50.0, 0.5))
+    checkIndex(map)
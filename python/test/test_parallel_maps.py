@@ -0,0 +1,90 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+
+"""Compares maps initialized with threadCount > 1 (parallel label
+image rasterization and hole embedding) with serially initialized
+ones."""
+
+import numpy
+import geomap
+from labelimages import labelImages
+
+threadCounts = (2, 3, 8)
+
+def initializedMap(labels, threadCount):
+    result = geomap.crackEdgeGraph(labels)
+    result.sortEdgesDirectly()
+    result.initializeMap(True, threadCount)
+    return result
+
+def faceAssignments(map):
+    """Face labels with pixel areas and the (smallest dart labels of
+    the) contours, i.e. their outer boundaries and holes."""
+    result = []
+    for face in map.faceIter():
+        contours = [min([dart.label() for dart in anchor.phiOrbit()])
+                    for anchor in face.contours()]
+        result.append((face.label(), face.pixelArea(),
+                       contours[:1] + sorted(contours[1:])))
+    return result
+
+def edgeFaces(map):
+    return [(edge.label(), edge.leftFaceLabel(), edge.rightFaceLabel())
+            for edge in map.edgeIter()]
+
+def test_parallelInitialization():
+    for name, labels in labelImages():
+        serial = initializedMap(labels, 1)
+        assert serial.checkConsistency(), name
+        for threadCount in threadCounts:
+            parallel = initializedMap(labels, threadCount)
+            assert parallel.checkConsistency(), \
+                   "%s, %d threads" % (name, threadCount)
+            assert (numpy.asarray(parallel.labelImage()) ==
+                    numpy.asarray(serial.labelImage())).all(), \
+                   "%s: label images differ with %d threads" % (
+                name, threadCount)
+            assert faceAssignments(parallel) == faceAssignments(serial), \
+                   "%s: faces/holes differ with %d threads" % (
+                name, threadCount)
+            assert edgeFaces(parallel) == edgeFaces(serial), \
+                   "%s: edge faces differ with %d threads" % (
+                name, threadCount)
+
+def test_parallelLabelImage():
+    for name, labels in labelImages():
+        serial = initializedMap(labels, 1)
+        for threadCount in threadCounts:
+            m = geomap.crackEdgeGraph(labels)
+            m.sortEdgesDirectly()
+            m.initializeMap(False)
+            m.setHasLabelImage(True, threadCount)
+            assert (numpy.asarray(m.labelImage()) ==
+                    numpy.asarray(serial.labelImage())).all(), \
+                   "%s: setHasLabelImage() differs with %d threads" % (
+                name, threadCount)
@@ -0,0 +1,95 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+"""Compares the native AutomaticRegionMerger (the statistics'
+automaticRegionMerger()) with maputils.AutomaticRegionMerger using
+the heap based queue it replaced, on a small crack edge map."""
+
+import numpy
+import geomap
+from maputils.crackConvert import crackEdgeMap
+from maputils.flag_constants import ALL_PROTECTION
+from maputils.maputils import AutomaticRegionMerger
+from labelimages import blockLabels
+from heapqueue import HeapQueue
+
+SIZE = 48
+
+def makeStatistics():
+    map = crackEdgeMap(blockLabels(SIZE, 4))
+    w, h = map.imageSize()
+    numpy.random.seed(17)
+    image = numpy.asarray(255.0 * numpy.random.rand(w, h), numpy.float32)
+    return geomap.FaceGrayStatistics(map, image)
+
+def referenceMerger(stats, measure, **kwargs):
+    map = stats.map()
+    mergeCost = getattr(stats, measure)
+    q = HeapQueue(map.maxEdgeLabel() + 1)
+    for edge in map.edgeIter():
+        if not edge.flag(ALL_PROTECTION):
+            q.insert(edge.label(), mergeCost(edge.dart()))
+    return AutomaticRegionMerger(map, mergeCost, q, **kwargs)
+
+def mergeSequence(merger, map, hasNext):
+    """(surviving face label, face count) after each merge step."""
+    result = []
+    while hasNext():
+        survivor = merger.mergeStep()
+        if survivor:
+            result.append((survivor.label(), map.faceCount))
+    return result
+
+def checkSameSequence(measure, **kwargs):
+    stats = makeStatistics()
+    merger = referenceMerger(stats, measure, **kwargs)
+    reference = mergeSequence(merger, stats.map(), lambda: merger._queue)
+
+    stats = makeStatistics()
+    merger = stats.automaticRegionMerger(measure, **kwargs)
+    native = mergeSequence(merger, stats.map(), merger.hasNext)
+    assert len(reference) > 10
+    assert native == reference
+    assert stats.map().checkConsistency()
+
+def test_faceMeanDiff():
+    checkSameSequence("faceMeanDiff")
+
+def test_faceHomogeneity():
+    checkSameSequence("faceHomogeneity")
+
+def test_noNeighborhoodUpdate():
+    checkSameSequence("faceMeanDiff", updateNeighborHood = False)
+
+def test_mergeToCost():
+    stats = makeStatistics()
+    merger = stats.automaticRegionMerger("faceMeanDiff")
+    steps = merger.mergeToCost(20.0)
+    assert steps == merger.step() > 0
+    assert not merger.hasNext() or merger.nextCost() > 20.0
+    merger.merge()
+    assert not merger.hasNext()
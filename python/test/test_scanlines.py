@@ -0,0 +1,120 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+
+"""Compares the k-way merged FlatScanlines (Face.flatScanLines(),
+mergeScanlines()) with merging and normalizing Scanlines."""
+
+import geomap
+from geomap import Polygon, Vector2, scanPoly, mergeScanlines
+from maputils.crackConvert import crackEdgeMap
+from labelimages import blockLabels, nestedRings
+
+def segments(scanline):
+    return [(scanline[i].begin, scanline[i].direction, scanline[i].end)
+            for i in range(len(scanline))]
+
+def lines(scanlines, begin, end):
+    """Segment tuples of the lines [begin, end) (empty outside of the
+    scanlines' range)."""
+    return [scanlines.startIndex() <= y < scanlines.endIndex()
+            and segments(scanlines[y]) or []
+            for y in range(begin, end)]
+
+def lineRange(*scanlines):
+    scanlines = [s for s in scanlines if len(s)]
+    return (min([s.startIndex() for s in scanlines]),
+            max([s.endIndex() for s in scanlines]))
+
+def mergedAndNormalized(scanlines, directions):
+    """Reference implementation of Scanlines.merge() + normalize()."""
+    begin, end = lineRange(*scanlines)
+    result = []
+    for y in range(begin, end):
+        line = []
+        for s, direction in zip(scanlines, directions):
+            line.extend([(b, d * direction, e)
+                         for b, d, e in lines(s, y, y + 1)[0]])
+        line.sort(key = lambda segment: segment[0])
+        normalized = []
+        for b, d, e in line:
+            if normalized and b <= normalized[-1][2]:
+                pb, pd, pe = normalized[-1]
+                normalized[-1] = (pb, pd + d, max(pe, e))
+            else:
+                normalized.append((b, d, e))
+        result.append(normalized)
+    return result
+
+def checkSameLines(flat, expected, begin, end):
+    assert lines(flat, begin, end) == expected, \
+           "flat scanlines differ in lines %d..%d" % (begin, end)
+    assert flat.segmentCount() == sum([len(line) for line in expected])
+
+def polygon(*points):
+    return Polygon([Vector2(x, y) for x, y in points])
+
+def test_faces():
+    reversedDarts = 0
+    for labels in (blockLabels(64, 8), nestedRings()):
+        map = crackEdgeMap(labels)
+        for face in map.faceIter(skipInfinite = True):
+            flat, scanlines = face.flatScanLines(), face.scanLines()
+            begin, end = lineRange(flat, scanlines)
+            checkSameLines(flat, lines(scanlines, begin, end), begin, end)
+
+            darts = list(face.contour().phiOrbit())
+            reversedDarts += len([dart for dart in darts if dart.label() < 0])
+            sources = [dart.edge().scanLines() for dart in darts]
+            directions = [dart.label() > 0 and 1 or -1 for dart in darts]
+            checkSameLines(flat, mergedAndNormalized(sources, directions),
+                           begin, end)
+    assert reversedDarts, "no contours with reversed darts tested"
+
+def test_gaps():
+    # sources with gaps between their line ranges, overlapping and
+    # touching ones, and (partially) reversed ones:
+    sources = [
+        scanPoly(polygon((0, 0), (10, 3), (4, 6))),
+        scanPoly(polygon((2, 12), (8, 14), (3, 17))),
+        scanPoly(polygon((5, 1), (12, 2), (6, 5))),
+        scanPoly(polygon((4, 17.5), (9, 20), (1, 25))),
+        scanPoly(polygon((20, 40), (21, 41))),
+        ]
+    for directions in ([1] * len(sources), [1, -1, -1, 1, -1]):
+        flat = mergeScanlines(sources, directions)
+        begin, end = lineRange(*sources)
+        assert (flat.startIndex(), flat.endIndex()) == (begin, end)
+        checkSameLines(flat, mergedAndNormalized(sources, directions),
+                       begin, end)
+    flat = mergeScanlines(list(reversed(sources)))
+    checkSameLines(flat, mergedAndNormalized(sources, [1] * len(sources)),
+                   begin, end)
+
+def test_empty():
+    assert len(mergeScanlines([])) == 0
+    assert mergeScanlines([]).segmentCount() == 0
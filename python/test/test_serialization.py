@@ -0,0 +1,228 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+
+"""Checks that GeoMap.save()/GeoMap.load() and pickling (of maps in
+the binary format as well as of maps pickled in the former, list-based
+state format) restore the same maps."""
+
+import os, tempfile, pickle, struct
+import numpy
+import geomap
+from maputils.crackConvert import crackEdgeMap
+from labelimages import blockLabels
+
+# flags used internally, e.g. for caching properties:
+INTERNAL_FLAGS = 0xf0000000
+
+def points(edge):
+    return [(p[0], p[1]) for p in edge]
+
+def contours(face):
+    """Smallest dart labels of the face's contours (the outer one first,
+    then the holes, sorted); the anchors themselves may differ."""
+    result = [min([dart.label() for dart in anchor.phiOrbit()])
+              for anchor in face.contours()]
+    return result[:1] + sorted(result[1:])
+
+def compareMaps(map1, map2, withLabelImage = True):
+    assert tuple(map1.imageSize()) == tuple(map2.imageSize())
+    assert map1.edgesSorted() == map2.edgesSorted()
+    assert map1.mapInitialized() == map2.mapInitialized()
+    assert map1.sigmaMapping() == map2.sigmaMapping()
+    for name, iter1, iter2 in (
+        ("node", map1.nodeIter(), map2.nodeIter()),
+        ("edge", map1.edgeIter(), map2.edgeIter()),
+        ("face", map1.faceIter(), map2.faceIter())):
+        labels1 = [cell.label() for cell in iter1]
+        labels2 = [cell.label() for cell in iter2]
+        assert labels1 == labels2, "different %s labels" % name
+    for node1 in map1.nodeIter():
+        assert tuple(node1.position()) == \
+               tuple(map2.node(node1.label()).position())
+    for edge1 in map1.edgeIter():
+        edge2 = map2.edge(edge1.label())
+        assert edge1.flags() & ~INTERNAL_FLAGS == \
+               edge2.flags() & ~INTERNAL_FLAGS
+        assert points(edge1) == points(edge2), \
+               "different geometry of edge %d" % edge1.label()
+    for face1 in map1.faceIter():
+        face2 = map2.face(face1.label())
+        assert face1.flags() & ~INTERNAL_FLAGS == \
+               face2.flags() & ~INTERNAL_FLAGS
+        assert contours(face1) == contours(face2), \
+               "different contours of face %d" % face1.label()
+        if face1.label():
+            assert face1.area() == face2.area() and \
+                   face1.pixelArea() == face2.pixelArea(), \
+                   "different properties of face %d" % face1.label()
+    withLabelImage = withLabelImage and map1.hasLabelImage()
+    assert map2.hasLabelImage() == withLabelImage
+    if withLabelImage:
+        assert (numpy.asarray(map1.labelImage()) ==
+                numpy.asarray(map2.labelImage())).all(), \
+               "different label images"
+
+def testMaps():
+    labels = blockLabels(64, 8)
+    yield "initialized", crackEdgeMap(labels)
+    yield "without label image", crackEdgeMap(labels, initLabelImage = False)
+    graph = geomap.crackEdgeGraph(labels)
+    yield "without faces", graph
+    graph = geomap.crackEdgeGraph(labels)
+    graph.sortEdgesDirectly()
+    yield "sorted, without faces", graph
+    if hasattr(geomap, "setLabelImageStorage"): # tiled label image build
+        map = crackEdgeMap(labels, initLabelImage = False)
+        geomap.setLabelImageStorage(map, 16)
+        map.setHasLabelImage(True)
+        yield "small label image tiles", map
+
+def saveAndLoad(map, withLabelImage = True):
+    fd, filename = tempfile.mkstemp(".geomap")
+    os.close(fd)
+    try:
+        map.save(filename, withLabelImage)
+        return geomap.GeoMap.load(filename)
+    finally:
+        os.remove(filename)
+
+class LegacyPickle(object):
+    """Pickles a map in the list-based state format used before the
+    binary format, i.e. recreating it via GeoMap(nodePositions,
+    edgeTuples, imageSize) and __setstate__(state)."""
+
+    def __init__(self, map):
+        self.map = map
+
+    def __reduce__(self):
+        map = self.map
+        nodePositions = [None] * map.maxNodeLabel()
+        for node in map.nodeIter():
+            nodePositions[node.label()] = node.position()
+        edgeTuples = [None] * map.maxEdgeLabel()
+        for edge in map.edgeIter():
+            edgeTuples[edge.label()] = (
+                edge.startNodeLabel(), edge.endNodeLabel(),
+                geomap.Polygon(edge))
+        faces = list(map.faceIter())
+        state = (map.sigmaMapping(), map.edgesSorted(),
+                 map.mapInitialized(), map.hasLabelImage(),
+                 [edge.flags() for edge in map.edgeIter()],
+                 [face.flags() & ~INTERNAL_FLAGS for face in faces],
+                 [face.contour().label() for face in faces],
+                 ([face.label() for face in faces], map.maxFaceLabel()),
+                 map.__dict__)
+        return (geomap.GeoMap,
+                (nodePositions, edgeTuples, map.imageSize()), state)
+
+def test_saveLoad():
+    for name, map in testMaps():
+        compareMaps(map, saveAndLoad(map))
+        compareMaps(map, saveAndLoad(map, False), False)
+
+def test_pickle():
+    for name, map in testMaps():
+        map.someAttribute = name
+        for protocol in range(pickle.HIGHEST_PROTOCOL + 1):
+            unpickled = pickle.loads(pickle.dumps(map, protocol))
+            compareMaps(map, unpickled)
+            assert unpickled.someAttribute == name
+
+def test_legacyPickle():
+    for name, map in testMaps():
+        map.someAttribute = name
+        unpickled = pickle.loads(pickle.dumps(LegacyPickle(map)))
+        assert isinstance(unpickled, geomap.GeoMap)
+        compareMaps(map, unpickled)
+        assert unpickled.someAttribute == name
+        compareMaps(map, saveAndLoad(unpickled))
+
+def mapData(map):
+    return map.__getinitargs__()[0]
+
+def test_bytesLike():
+    for name, map in testMaps():
+        data = mapData(map)
+        assert isinstance(data, bytes)
+        compareMaps(map, geomap.GeoMap(bytearray(data)))
+        compareMaps(map, geomap.GeoMap(memoryview(data)))
+
+def arrayOffsets(data, offset, itemSizes):
+    """Offsets of the first elements of consecutive arrays starting at
+    offset (each stored as uint32 size followed by the elements)."""
+    result = []
+    for itemSize in itemSizes:
+        size, = struct.unpack_from("I", data, offset)
+        result.append(offset + 4)
+        offset += 4 + size * itemSize
+    return result, offset
+
+def corruptedData(map):
+    """Yields map data with one cross-reference each set to an
+    invalid label."""
+    data = mapData(map)
+    offset = 8 + 4*5 + 8 + 4 + 4 # header and maxNodeLabel (version 2)
+    (nodeLabels, positions, nodeAnchors), offset = arrayOffsets(
+        data, offset, (4, 16, 4))
+    offset += 4 # maxEdgeLabel
+    (edgeLabels, startNodes, endNodes, leftFaces, rightFaces,
+     flags, pointCounts, points, sigma, sigmaInverse), offset = arrayOffsets(
+        data, offset, (4, 4, 4, 4, 4, 4, 4, 16, 4, 4))
+    edgeLabel, = struct.unpack_from("I", data, edgeLabels)
+    edge = map.edge(edgeLabel)
+    nodeLabel = [node.label() for node in map.nodeIter()][0] # nodeAnchors[0]
+    sigmaCenter = sigma + 4 * ((len(map.sigmaMapping()) - 1) // 2)
+
+    corruptions = [
+        (nodeAnchors, 10**6),                 # no such edge
+        (startNodes, map.maxNodeLabel()),     # no such node
+        (endNodes, 10**6),
+        (sigmaCenter + 4*edgeLabel, 0),
+        (sigmaCenter + 4*edgeLabel, 10**6)]
+    if edge.endNodeLabel() != nodeLabel:
+        corruptions.append((nodeAnchors, -edgeLabel)) # dart of another node
+    if edge.startNodeLabel() != edge.endNodeLabel():
+        corruptions.append((sigmaCenter - 4*edgeLabel, edgeLabel))
+    for position, value in corruptions:
+        yield data[:position] + struct.pack("i", value) + data[position+4:]
+
+    if map.mapInitialized():
+        yield data[:leftFaces] + struct.pack("I", map.maxFaceLabel()) + \
+              data[leftFaces+4:]
+        yield data[:rightFaces] + struct.pack("I", 10**6) + \
+              data[rightFaces+4:]
+
+def test_corruptData():
+    for name, map in testMaps():
+        for data in corruptedData(map):
+            try:
+                geomap.GeoMap(data)
+            except RuntimeError:
+                pass
+            else:
+                assert False, "corrupt data of %s map loaded" % name
@@ -0,0 +1,98 @@
+##########################################################################
+#
+#                Copyright 2007-2019 by Hans Meine
+#
+#     Permission is hereby granted, free of charge, to any person
+#     obtaining a copy of this software and associated documentation
+#     files (the "Software"), to deal in the Software without
+#     restriction, including without limitation the rights to use,
+#     copy, modify, merge, publish, distribute, sublicense, and/or
+#     sell copies of the Software, and to permit persons to whom the
+#     Software is furnished to do so, subject to the following
+#     conditions:
+#
+#     The above copyright notice and this permission notice shall be
+#     included in all copies or substantial portions of the
+#     Software.
+#
+#     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND
+#     EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+#     OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+#     NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+#     HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+#     WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+#     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+#     OTHER DEALINGS IN THE SOFTWARE.
+#
+##########################################################################
+import numpy
+import geomap
+from benchmark_critical_points import smoothNoise
+
+SIZE, TILE_SIZE = 96, 32
+TOLERANCE = 1e-4
+
+def watersheds():
+    image = smoothNoise(SIZE)
+    spws = geomap.SubPixelWatersheds3(image)
+    spws.findCriticalPoints(progress = lambda percent: None)
+    tiled = geomap.TiledSubPixelWatersheds3(image, TILE_SIZE)
+    tiled.findCriticalPoints()
+    return spws, tiled
+
+def nearest(points, p):
+    """Index and distance of the point nearest to p (points[0] is
+    unused, as in SubPixelWatersheds)."""
+    points = numpy.array([tuple(q) for q in points[1:]])
+    dist = numpy.hypot(*(points - tuple(p)).T)
+    index = dist.argmin()
+    return index + 1, dist[index]
+
+def test_criticalPoints():
+    spws, tiled = watersheds()
+    assert tiled.tileCount() == (SIZE // TILE_SIZE)**2
+    for name in ("minima", "saddles", "maxima"):
+        reference = getattr(spws, name)()
+        points = getattr(tiled, name)()
+        assert len(points) == len(reference), \
+               "%s: %d instead of %d" % (name, len(points), len(reference))
+        for p in points[1:]:
+            assert nearest(reference, p)[1] < TOLERANCE, \
+                   "%s: %s not found untiled" % (name, p)
+        # no duplicates from neighboring tiles:
+        for i in range(1, len(points)):
+            others = points[:i] + points[i+1:]
+            assert nearest(others, points[i])[1] >= tiled.minCPDist
+
+def test_edges():
+    spws, tiled = watersheds()
+    reference = spws.edges(-1e10)
+    edges = tiled.edges(-1e10)
+    assert len([e for e in edges if e]) == len([e for e in reference if e])
+
+    refMaxima, maxima = spws.maxima(), tiled.maxima()
+    saddles = [edge[2][edge[3]] for edge in edges if edge]
+    tiledEdges = [edge for edge in edges if edge]
+    for edge in reference:
+        if not edge:
+            continue
+        index, dist = nearest([None] + saddles, edge[2][edge[3]])
+        assert dist < TOLERANCE
+        other = tiledEdges[index - 1]
+        for end, otherEnd in zip(edge[:2], other[:2]):
+            if end <= 0 or otherEnd <= 0:
+                continue # flow line failed (in either version)
+            assert numpy.hypot(*(numpy.array(tuple(refMaxima[end])) -
+                                 tuple(maxima[otherEnd]))) < TOLERANCE
+
+def test_tileCache():
+    _, tiled = watersheds()
+    cached = tiled.edges(-1e10, 2)
+    tiled.tileCacheSize = 0
+    uncached = tiled.edges(-1e10, 2)
+    assert len(cached) == len(uncached)
+    for a, b in zip(cached, uncached):
+        assert (a is None) == (b is None)
+        if a:
+            assert a[:2] == b[:2] and a[3] == b[3]
+            assert [tuple(p) for p in a[2]] == [tuple(p) for p in b[2]]
@@ -0,0 +1,231 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2007-2019 by Hans Meine                      */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef CELLARENA_HXX
+#define CELLARENA_HXX
+
+#include <boost/pool/pool.hpp>
+#include <boost/utility.hpp> // boost::noncopyable
+#include <vector>
+#include <new>
+#include <cstddef>
+
+namespace detail {
+
+/**
+ * Memory arena for the cells of one GeoMap and the control blocks of
+ * their CELL_PTRs (see CellAllocator).  Objects of equal size are
+ * carved from the same boost::pool, which allocates large blocks.
+ * Each cell is still destroyed individually (cells own e.g. point
+ * arrays), but once the map has given up its reference (close()),
+ * the memory is no longer returned chunk by chunk: all blocks are
+ * freed together when the arena is destroyed.
+ *
+ * Since cells may outlive their map (e.g. when referenced from
+ * Python), the arena is reference counted: the map holds one
+ * reference, and every allocated object holds another one (stored
+ * in a small header in front of the object), so that the memory is
+ * released when both the map and its last cell are gone.
+ *
+ * Neither the pools nor the reference count are synchronized: cells
+ * of one map must be allocated and released by one thread at a time
+ * (the parallel parts of GeoMap only access existing cells, and
+ * Python holds the GIL while dropping cell references).
+ */
+class CellArena : boost::noncopyable
+{
+  public:
+    CellArena()
+    : refCount_(1),
+      closed_(false)
+    {}
+
+    void *allocate(std::size_t size)
+    {
+        boost::pool<> &pool(poolFor(sizeof(Header) + size));
+        Header *header = static_cast<Header *>(pool.malloc());
+        if(!header)
+            throw std::bad_alloc();
+        header->owner.arena = this;
+        header->owner.pool = &pool;
+        ++refCount_;
+        return header + 1;
+    }
+
+    static void deallocate(void *p)
+    {
+        if(!p)
+            return;
+        Header *header = static_cast<Header *>(p) - 1;
+        CellArena *arena = header->owner.arena;
+        if(!arena->closed_)
+            header->owner.pool->free(header);
+        arena->release();
+    }
+
+        /// give up one reference (e.g. the map's one), may delete this
+    void release()
+    {
+        if(!--refCount_)
+            delete this;
+    }
+
+        /// give up the map's reference; since no more objects will be
+        /// allocated, deallocate() then leaves the chunks to the bulk
+        /// release of all blocks in the destructor
+    void close()
+    {
+        closed_ = true;
+        release();
+    }
+
+  protected:
+    union Header
+    {
+        struct
+        {
+            CellArena     *arena;
+            boost::pool<> *pool;
+        } owner;
+        double alignment_;
+    };
+
+    typedef std::vector<boost::pool<> *> Pools;
+
+    ~CellArena()
+    {
+        for(Pools::iterator it = pools_.begin(); it != pools_.end(); ++it)
+            delete *it;
+    }
+
+    boost::pool<> &poolFor(std::size_t chunkSize)
+    {
+        for(Pools::iterator it = pools_.begin(); it != pools_.end(); ++it)
+            if((*it)->get_requested_size() == chunkSize)
+                return **it;
+        pools_.push_back(new boost::pool<>(chunkSize, 256));
+        return *pools_.back();
+    }
+
+    Pools pools_;
+    std::size_t refCount_; // (not atomic, see above)
+    bool closed_;
+};
+
+/**
+ * Standard allocator carving objects from a CellArena, for
+ * allocating the control blocks of boost::shared_ptrs next to the
+ * cells (see MAKE_CELL_PTR in cppmap.hxx).
+ */
+template <class T>
+class CellAllocator
+{
+  public:
+    typedef T                 value_type;
+    typedef T                *pointer;
+    typedef const T          *const_pointer;
+    typedef T                &reference;
+    typedef const T          &const_reference;
+    typedef std::size_t       size_type;
+    typedef std::ptrdiff_t    difference_type;
+
+    template <class U>
+    struct rebind
+    {
+        typedef CellAllocator<U> other;
+    };
+
+    CellAllocator(CellArena *arena)
+    : arena_(arena)
+    {}
+
+    template <class U>
+    CellAllocator(const CellAllocator<U> &other)
+    : arena_(other.arena())
+    {}
+
+    pointer allocate(size_type n, const void * = 0)
+    {
+        return static_cast<pointer>(arena_->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(pointer p, size_type)
+    {
+        CellArena::deallocate(p);
+    }
+
+    void construct(pointer p, const T &v)
+    {
+        new(p) T(v);
+    }
+
+    void destroy(pointer p)
+    {
+        p->~T();
+    }
+
+    size_type max_size() const
+    {
+        return std::size_t(-1) / sizeof(T);
+    }
+
+    pointer address(reference r) const
+    {
+        return &r;
+    }
+
+    const_pointer address(const_reference r) const
+    {
+        return &r;
+    }
+
+    CellArena *arena() const
+    {
+        return arena_;
+    }
+
+    template <class U>
+    bool operator==(const CellAllocator<U> &other) const
+    {
+        return arena_ == other.arena();
+    }
+
+    template <class U>
+    bool operator!=(const CellAllocator<U> &other) const
+    {
+        return arena_ != other.arena();
+    }
+
+  private:
+    CellArena *arena_;
+};
+
+} // namespace detail
+
+#endif // CELLARENA_HXX
@@ -27,10 +27,14 @@
 /************************************************************************/
 
 #include "cppmap.hxx"
+#include "threading.hxx"
+#include "labelimagekernels.hxx"
 #include <vigra/tinyvector.hxx>
 #include <vigra/multi_pointoperators.hxx>
 #include <algorithm>
 #include <cmath>
+#include <istream>
+#include <ostream>
 
 template<class Container>
 void removeAll(Container &container,
@@ -146,6 +150,7 @@ inline InputIterator skipLast(InputIterator it)
  */
 void GeoMap::Edge::concatenate(Edge &other, bool atEnd, bool reverse)
 {
+    this->detachViews();
     if(reverse)
     {
         if(atEnd)
@@ -235,11 +240,16 @@ GeoMap::GeoMap(vigra::Size2D imageSize)
   nodeCount_(0),
   edgeCount_(0),
   faceCount_(0),
+  nodeMap_(8.0),
   imageSize_(imageSize),
   labelImage_(NULL),
-  edgesSorted_(false)
+  edgesSorted_(false),
+  cellArena_(new detail::CellArena)
 {
     edges_.push_back(NULL_PTR(Edge));
+#ifdef USE_TILED_LABEL_IMAGE
+    labelImageTileSize_ = vigra::TiledLabelImage::DefaultTileSize;
+#endif
 }
 
 GeoMap::GeoMap(const GeoMap &other)
@@ -251,22 +261,31 @@ GeoMap::GeoMap(const GeoMap &other)
   nodeCount_(other.nodeCount_),
   edgeCount_(other.edgeCount_),
   faceCount_(other.faceCount_),
+  nodeMap_(other.nodeMap_.cellSize()),
   imageSize_(other.imageSize()),
   labelImage_(NULL),
-  edgesSorted_(false)
+  edgesSorted_(false),
+  cellArena_(new detail::CellArena)
 {
+#ifdef USE_TILED_LABEL_IMAGE
+    labelImageTileSize_ = other.labelImageTileSize_;
+#endif
+
     nodes_.resize(other.nodes_.size(), NULL_PTR(GeoMap::Node));
+    nodeMap_.reserve(other.nodeMap_.size());
     for(ConstNodeIterator it = other.nodesBegin(); it.inRange(); ++it)
     {
         nodes_[(*it)->label()] =
-            GeoMap::NodePtr(new GeoMap::Node(this, **it));
+            MAKE_CELL_PTR(GeoMap::Node,
+                          new(cellArena_) GeoMap::Node(this, **it), cellArena_);
     }
 
     edges_.resize(other.edges_.size(), NULL_PTR(GeoMap::Edge));
     for(ConstEdgeIterator it = other.edgesBegin(); it.inRange(); ++it)
     {
         edges_[(*it)->label()] =
-            GeoMap::EdgePtr(new GeoMap::Edge(this, **it));
+            MAKE_CELL_PTR(GeoMap::Edge,
+                          new(cellArena_) GeoMap::Edge(this, **it), cellArena_);
     }
 
     // slightly more efficient than calling setSigmaMapping():
@@ -284,7 +303,9 @@ GeoMap::GeoMap(const GeoMap &other)
         for(ConstFaceIterator it = other.facesBegin(); it.inRange(); ++it)
         {
             faces_[(*it)->label()] =
-                GeoMap::FacePtr(new GeoMap::Face(this, **it));
+                MAKE_CELL_PTR(GeoMap::Face,
+                              new(cellArena_) GeoMap::Face(this, **it),
+                              cellArena_);
         }
 
         if(other.hasLabelImage())
@@ -297,6 +318,10 @@ GeoMap::GeoMap(const GeoMap &other)
 
 GeoMap::~GeoMap()
 {
+    // no more cells will be allocated, so their memory is freed in
+    // bulk when the last one is gone (see CellArena::close()):
+    cellArena_->close();
+
     // make sure the cells don't access this map anymore!
     for(NodeIterator it = nodesBegin(); it.inRange(); ++it)
         (*it)->uninitialize();
@@ -306,56 +331,510 @@ GeoMap::~GeoMap()
         (*it)->uninitialize();
 }
 
-GeoMap::FacePtr GeoMap::faceAt(const Vector2 &position)
+/********************************************************************/
+
+namespace {
+
+// Binary GeoMap format (see GeoMap::save()); all integers are 32 bit
+// and all values are written in native byte order, which is checked
+// when loading.  Per-cell properties are stored as separate arrays
+// (and all edge points in one contiguous block), so that loading
+// mostly consists of a few large reads.  Version 2 added the node
+// map's cell size and the label image tile size (version 1 data is
+// loaded with the defaults).  The backing file of a tiled label image
+// is not stored (see setLabelImageStorage()).
+const char GEOMAP_MAGIC[8] = { 'G', 'e', 'o', 'M', 'a', 'p', '\r', '\n' };
+const unsigned int GEOMAP_FORMAT_VERSION = 2;
+const unsigned int GEOMAP_BYTE_ORDER_MARK = 0x01020304U;
+
+enum GeoMapFormatFlags {
+    MAP_INITIALIZED = 1,
+    EDGES_SORTED    = 2,
+    HAS_LABEL_IMAGE = 4,
+};
+
+template<class T>
+void writeValue(std::ostream &os, const T &value)
 {
-    vigra_precondition(mapInitialized(),
-        "faceAt() called on graph (mapInitialized() == false)!");
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
 
-    if(labelImage_)
+template<class T>
+void writeArray(std::ostream &os, const std::vector<T> &array)
+{
+    writeValue(os, (unsigned int)array.size());
+    if(array.size())
+        os.write(reinterpret_cast<const char *>(&array[0]),
+                 array.size() * sizeof(T));
+}
+
+template<class T>
+T readValue(std::istream &is)
+{
+    T result;
+    is.read(reinterpret_cast<char *>(&result), sizeof(T));
+    vigra_precondition(is.good(), "GeoMap::load(): unexpected end of data");
+    return result;
+}
+
+template<class T>
+void readArray(std::istream &is, std::vector<T> &array)
+{
+    array.resize(readValue<unsigned int>(is));
+    if(array.size())
+        is.read(reinterpret_cast<char *>(&array[0]),
+                array.size() * sizeof(T));
+    vigra_precondition(is.good(), "GeoMap::load(): unexpected end of data");
+}
+
+} // anonymous namespace
+
+void GeoMap::save(std::ostream &os, bool withLabelImage) const
+{
+    withLabelImage = withLabelImage && hasLabelImage();
+
+    os.write(GEOMAP_MAGIC, sizeof(GEOMAP_MAGIC));
+    writeValue(os, GEOMAP_FORMAT_VERSION);
+    writeValue(os, GEOMAP_BYTE_ORDER_MARK);
+    writeValue(os, (unsigned int)(
+                   (mapInitialized() ? MAP_INITIALIZED : 0) |
+                   (edgesSorted_ ? EDGES_SORTED : 0) |
+                   (withLabelImage ? HAS_LABEL_IMAGE : 0)));
+    writeValue(os, imageSize_.x);
+    writeValue(os, imageSize_.y);
+    writeValue(os, nodeMap_.cellSize());
+#ifdef USE_TILED_LABEL_IMAGE
+    writeValue(os, labelImageTileSize_);
+#else
+    writeValue(os, 0);
+#endif
+
+    std::vector<CellLabel> labels;
+    std::vector<Vector2> positions;
+    std::vector<int> anchors;
+    for(ConstNodeIterator it = nodesBegin(); it.inRange(); ++it)
+    {
+        labels.push_back((*it)->label());
+        positions.push_back((*it)->position());
+        anchors.push_back((*it)->anchor_);
+    }
+    writeValue(os, maxNodeLabel());
+    writeArray(os, labels);
+    writeArray(os, positions);
+    writeArray(os, anchors);
+
+    std::vector<CellLabel> startNodeLabels, endNodeLabels,
+        leftFaceLabels, rightFaceLabels, pointCounts;
+    std::vector<CellFlags> flags;
+    labels.clear();
+    positions.clear();
+    for(ConstEdgeIterator it = edgesBegin(); it.inRange(); ++it)
+    {
+        const Edge &edge(**it);
+        labels.push_back(edge.label());
+        startNodeLabels.push_back(edge.startNodeLabel());
+        endNodeLabels.push_back(edge.endNodeLabel());
+        leftFaceLabels.push_back(edge.leftFaceLabel());
+        rightFaceLabels.push_back(edge.rightFaceLabel());
+        flags.push_back(edge.flags());
+        pointCounts.push_back(edge.size());
+        positions.insert(positions.end(), edge.begin(), edge.end());
+    }
+    writeValue(os, maxEdgeLabel());
+    writeArray(os, labels);
+    writeArray(os, startNodeLabels);
+    writeArray(os, endNodeLabels);
+    writeArray(os, leftFaceLabels);
+    writeArray(os, rightFaceLabels);
+    writeArray(os, flags);
+    writeArray(os, pointCounts);
+    writeArray(os, positions);
+
+    writeArray(os, sigmaMappingArray_);
+    writeArray(os, sigmaInverseMappingArray_);
+
+    if(!mapInitialized())
+        return;
+
+    std::vector<double> boxesAndAreas;
+    std::vector<unsigned int> pixelAreas, anchorCounts;
+    labels.clear();
+    flags.clear();
+    anchors.clear();
+    for(ConstFaceIterator it = facesBegin(); it.inRange(); ++it)
+    {
+        const Face &face(**it);
+        labels.push_back(face.label());
+        flags.push_back(face.flags_ & ~Face::CONTOUR_POLYS_VALID);
+        Face::BoundingBox bbox;
+        if(face.flag(Face::BOUNDING_BOX_VALID))
+            bbox = face.boundingBox_;
+        boxesAndAreas.push_back(bbox.begin()[0]);
+        boxesAndAreas.push_back(bbox.begin()[1]);
+        boxesAndAreas.push_back(bbox.end()[0]);
+        boxesAndAreas.push_back(bbox.end()[1]);
+        boxesAndAreas.push_back(face.flag(Face::AREA_VALID) ? face.area_ : 0.0);
+        pixelAreas.push_back(face.pixelArea_);
+        anchorCounts.push_back(face.anchors_.size());
+        for(Face::ContourIterator ai = face.contoursBegin();
+            ai != face.contoursEnd(); ++ai)
+            anchors.push_back(ai->label());
+    }
+    writeValue(os, maxFaceLabel());
+    writeArray(os, labels);
+    writeArray(os, flags);
+    writeArray(os, boxesAndAreas);
+    writeArray(os, pixelAreas);
+    writeArray(os, anchorCounts);
+    writeArray(os, anchors);
+
+    if(withLabelImage)
+    {
+        // store final face labels, s.t. the loaded map can start
+        // with an identity faceLabelLUT_:
+        const LabelLUT &faceLabelLUT(faceLabelLUT_);
+
+        const LabelImage &labelImage(*labelImage_);
+        std::vector<int> row(imageSize_.x);
+        for(int y = 0; y < imageSize_.y; ++y)
+        {
+            for(int x = 0; x < imageSize_.x; ++x)
+            {
+                int label = labelImage(x, y);
+                row[x] = (label >= 0 ? (int)faceLabelLUT[label] : label);
+            }
+            os.write(reinterpret_cast<const char *>(&row[0]),
+                     row.size() * sizeof(int));
+        }
+    }
+
+    vigra_precondition(os.good(), "GeoMap::save(): error writing data");
+}
+
+std::auto_ptr<GeoMap> GeoMap::load(std::istream &is)
+{
+    char magic[sizeof(GEOMAP_MAGIC)];
+    is.read(magic, sizeof(magic));
+    vigra_precondition(
+        is.good() && std::equal(magic, magic + sizeof(magic), GEOMAP_MAGIC),
+        "GeoMap::load(): not a binary GeoMap");
+    unsigned int version = readValue<unsigned int>(is);
+    vigra_precondition(
+        version >= 1 && version <= GEOMAP_FORMAT_VERSION,
+        "GeoMap::load(): unsupported format version");
+    vigra_precondition(
+        readValue<unsigned int>(is) == GEOMAP_BYTE_ORDER_MARK,
+        "GeoMap::load(): data was saved with a different byte order");
+    unsigned int formatFlags = readValue<unsigned int>(is);
+    int width = readValue<int>(is);
+    int height = readValue<int>(is);
+
+    std::auto_ptr<GeoMap> result(new GeoMap(vigra::Size2D(width, height)));
+    GeoMap &map(*result);
+
+    if(version >= 2)
+    {
+        double cellSize = readValue<double>(is);
+        int tileSize = readValue<int>(is);
+        vigra_precondition(cellSize > 0.0 && tileSize >= 0 &&
+                           !(tileSize & (tileSize - 1)),
+                           "GeoMap::load(): invalid map parameters");
+        if(cellSize != map.nodeMap_.cellSize())
+            map.nodeMap_ = NodeMap(cellSize);
+#ifdef USE_TILED_LABEL_IMAGE
+        if(tileSize)
+            map.labelImageTileSize_ = tileSize;
+#endif
+    }
+
+    std::vector<CellLabel> labels;
+    std::vector<Vector2> positions;
+    std::vector<int> anchors;
+    map.nodes_.resize(readValue<CellLabel>(is), NULL_PTR(Node));
+    readArray(is, labels);
+    readArray(is, positions);
+    readArray(is, anchors);
+    vigra_precondition(positions.size() == labels.size() &&
+                       anchors.size() == labels.size(),
+                       "GeoMap::load(): inconsistent node data");
+    for(unsigned int i = 0; i < labels.size(); ++i)
+    {
+        vigra_precondition(labels[i] < map.nodes_.size(),
+                           "GeoMap::load(): invalid node label");
+        map.nodes_[labels[i]] = MAKE_CELL_PTR(Node, new(map.cellArena_) Node(
+            &map, labels[i], positions[i], anchors[i]), map.cellArena_);
+    }
+    map.nodeCount_ = labels.size();
+
+    std::vector<CellLabel> startNodeLabels, endNodeLabels,
+        leftFaceLabels, rightFaceLabels, pointCounts;
+    std::vector<CellFlags> flags;
+    CellLabel maxEdgeLabel = readValue<CellLabel>(is);
+    vigra_precondition(maxEdgeLabel > 0, "GeoMap::load(): invalid edge count");
+    map.edges_.resize(maxEdgeLabel, NULL_PTR(Edge));
+    readArray(is, labels);
+    readArray(is, startNodeLabels);
+    readArray(is, endNodeLabels);
+    readArray(is, leftFaceLabels);
+    readArray(is, rightFaceLabels);
+    readArray(is, flags);
+    readArray(is, pointCounts);
+    readArray(is, positions);
+    vigra_precondition(startNodeLabels.size() == labels.size() &&
+                       endNodeLabels.size() == labels.size() &&
+                       leftFaceLabels.size() == labels.size() &&
+                       rightFaceLabels.size() == labels.size() &&
+                       flags.size() == labels.size() &&
+                       pointCounts.size() == labels.size(),
+                       "GeoMap::load(): inconsistent edge data");
+    std::vector<Vector2>::const_iterator points = positions.begin();
+    for(unsigned int i = 0; i < labels.size(); ++i)
+    {
+        vigra_precondition(labels[i] > 0 && labels[i] < map.edges_.size(),
+                           "GeoMap::load(): invalid edge label");
+        vigra_precondition(
+            pointCounts[i] <= (unsigned int)(positions.end() - points),
+            "GeoMap::load(): inconsistent edge data");
+        map.edges_[labels[i]] = MAKE_CELL_PTR(Edge, new(map.cellArena_) Edge(
+            &map, labels[i], startNodeLabels[i], endNodeLabels[i],
+            leftFaceLabels[i], rightFaceLabels[i], flags[i],
+            points, points + pointCounts[i]), map.cellArena_);
+        points += pointCounts[i];
+    }
+    map.edgeCount_ = labels.size();
+
+    readArray(is, map.sigmaMappingArray_);
+    readArray(is, map.sigmaInverseMappingArray_);
+    vigra_precondition(
+        map.sigmaMappingArray_.size() >= 2*map.edges_.size() - 1 &&
+        map.sigmaInverseMappingArray_.size() ==
+        map.sigmaMappingArray_.size(),
+        "GeoMap::load(): inconsistent sigma mapping");
+    map.sigmaMapping_ =
+        map.sigmaMappingArray_.begin() + map.sigmaMappingArray_.size()/2;
+    map.sigmaInverseMapping_ =
+        map.sigmaInverseMappingArray_.begin()
+        + map.sigmaInverseMappingArray_.size()/2;
+    map.edgesSorted_ = (formatFlags & EDGES_SORTED) != 0;
+
+    // validate the cross-references, so that corrupt data cannot lead
+    // to dangling labels (the geometry is not checked, see
+    // checkConsistency()):
+    vigra_precondition(map.sigmaMappingArray_.size() & 1,
+                       "GeoMap::load(): inconsistent sigma mapping");
+    for(EdgeIterator it = map.edgesBegin(); it.inRange(); ++it)
+    {
+        const Edge &edge(**it);
+        vigra_precondition(
+            edge.startNodeLabel() < map.nodes_.size() &&
+            map.nodes_[edge.startNodeLabel()].get() &&
+            edge.endNodeLabel() < map.nodes_.size() &&
+            map.nodes_[edge.endNodeLabel()].get(),
+            "GeoMap::load(): edge refers to invalid node");
+        for(int label = edge.label(), k = 0; k < 2; label = -label, ++k)
+        {
+            int next = map.sigmaMapping_[label];
+            vigra_precondition(
+                next && (CellLabel)abs(next) < map.edges_.size() &&
+                map.edges_[abs(next)].get() &&
+                map.sigmaInverseMapping_[next] == label &&
+                Dart(&map, next).startNodeLabel() ==
+                Dart(&map, label).startNodeLabel(),
+                "GeoMap::load(): inconsistent sigma mapping");
+        }
+    }
+    for(NodeIterator it = map.nodesBegin(); it.inRange(); ++it)
     {
-        GeoMap::LabelImage::difference_type p(detail::intVPos(position));
-        if(labelImage_->isInside(p))
+        int anchor = (*it)->anchor_;
+        vigra_precondition(
+            !anchor || ((CellLabel)abs(anchor) < map.edges_.size() &&
+                        map.edges_[abs(anchor)].get() &&
+                        Dart(&map, anchor).startNodeLabel() ==
+                        (*it)->label()),
+            "GeoMap::load(): invalid node anchor");
+    }
+
+    if(!(formatFlags & MAP_INITIALIZED))
+        return result;
+
+    std::vector<double> boxesAndAreas;
+    std::vector<unsigned int> pixelAreas, anchorCounts;
+    map.faces_.resize(readValue<CellLabel>(is), NULL_PTR(Face));
+    readArray(is, labels);
+    readArray(is, flags);
+    readArray(is, boxesAndAreas);
+    readArray(is, pixelAreas);
+    readArray(is, anchorCounts);
+    readArray(is, anchors);
+    vigra_precondition(flags.size() == labels.size() &&
+                       boxesAndAreas.size() == 5*labels.size() &&
+                       pixelAreas.size() == labels.size() &&
+                       anchorCounts.size() == labels.size(),
+                       "GeoMap::load(): inconsistent face data");
+    std::vector<int>::const_iterator anchor = anchors.begin();
+    for(unsigned int i = 0; i < labels.size(); ++i)
+    {
+        vigra_precondition(labels[i] < map.faces_.size(),
+                           "GeoMap::load(): invalid face label");
+        vigra_precondition(
+            anchorCounts[i] <= (unsigned int)(anchors.end() - anchor),
+            "GeoMap::load(): inconsistent face data");
+        const double *boxAndArea = &boxesAndAreas[5*i];
+        Face *face = new(map.cellArena_) Face(
+            &map, labels[i], flags[i],
+            Face::BoundingBox(Vector2(boxAndArea[0], boxAndArea[1]),
+                              Vector2(boxAndArea[2], boxAndArea[3])),
+            boxAndArea[4], pixelAreas[i]);
+        map.faces_[labels[i]] = MAKE_CELL_PTR(Face, face, map.cellArena_);
+        for(unsigned int j = 0; j < anchorCounts[i]; ++j, ++anchor)
         {
-            int faceLabel = (*labelImage_)[p];
-            if(faceLabel > 0)
-                return face(faceLabelLUT_[faceLabel]);
+            vigra_precondition(
+                *anchor && (CellLabel)abs(*anchor) < map.edges_.size() &&
+                map.edges_[abs(*anchor)].get(),
+                "GeoMap::load(): invalid face anchor");
+            face->anchors_.push_back(Dart(&map, *anchor));
         }
     }
+    map.faceCount_ = labels.size();
 
-    for(FaceIterator it = finiteFacesBegin(); it.inRange(); ++it)
-        if((*it)->contains(position))
-            return *it;
+    for(EdgeIterator it = map.edgesBegin(); it.inRange(); ++it)
+    {
+        const Edge &edge(**it);
+        vigra_precondition(
+            edge.leftFaceLabel() < map.faces_.size() &&
+            map.faces_[edge.leftFaceLabel()].get() &&
+            edge.rightFaceLabel() < map.faces_.size() &&
+            map.faces_[edge.rightFaceLabel()].get(),
+            "GeoMap::load(): edge refers to invalid face");
+    }
+    for(FaceIterator it = map.facesBegin(); it.inRange(); ++it)
+    {
+        for(Face::ContourIterator ci = (*it)->contoursBegin();
+            ci != (*it)->contoursEnd(); ++ci)
+            vigra_precondition(ci->leftFaceLabel() == (*it)->label(),
+                               "GeoMap::load(): invalid face anchor");
+    }
 
-    return face(0);
+    if(formatFlags & HAS_LABEL_IMAGE)
+    {
+        map.labelImage_ = map.createLabelImage();
+        map.faceLabelLUT_.initIdentity(map.faces_.size());
+
+        LabelImage &labelImage(*map.labelImage_);
+        std::vector<int> row(width);
+        for(int y = 0; y < height; ++y)
+        {
+            is.read(reinterpret_cast<char *>(&row[0]),
+                    row.size() * sizeof(int));
+            vigra_precondition(is.good(),
+                               "GeoMap::load(): unexpected end of data");
+#ifdef USE_RLE_LABEL_IMAGE
+            for(int x = 0, end; x < width; x = end)
+            {
+                for(end = x + 1; end < width && row[end] == row[x]; ++end)
+                    ;
+                labelImage.setRange(y, x, end, row[x]);
+            }
+#else
+            // the new label image is filled with zeros (this also
+            // avoids allocating tiles of a tiled label image):
+            for(int x = 0; x < width; ++x)
+                if(row[x])
+                    labelImage(x, y) = row[x];
+#endif
+        }
+    }
+
+    return result;
+}
+
+    // The index is built on demand, since changes of the geometry
+    // reset it.  faceLabelAt() is const and may thus be called by
+    // concurrent threads, so the index is built (and the faces'
+    // bounding boxes and contour polygons are cached) in a critical
+    // section, only once.  While the index exists, the Euler
+    // operations keep these caches valid, so that faceLabelAt() only
+    // reads them.
+const GeoMap::FaceIndex &GeoMap::faceIndex() const
+{
+    const FaceIndex *index;
+    std::string error;
+#ifdef _OPENMP
+#pragma omp critical(geomap_face_index)
+#endif
+    {
+        try
+        {
+            if(!faceIndex_.get())
+            {
+                // build BVH over bounding boxes of all finite faces:
+                std::vector<std::pair<Vector2Polygon::BoundingBox, CellLabel> > leaves;
+                leaves.reserve(faceCount_);
+                for(ConstFaceIterator it = finiteFacesBegin(); it.inRange(); ++it)
+                {
+                    leaves.push_back(std::make_pair((*it)->boundingBox(), (*it)->label()));
+                    (*it)->contourPolys();
+                }
+                std::auto_ptr<FaceIndex> newIndex(new FaceIndex());
+                newIndex->build(leaves, faces_.size());
+                faceIndex_ = newIndex;
+            }
+        }
+        catch(std::exception &e)
+        {
+            // (exceptions must not leave the critical section)
+            error = e.what();
+        }
+        index = faceIndex_.get();
+    }
+    if(!index)
+        vigra_fail(error.c_str());
+    return *index;
+}
+
+GeoMap::FacePtr GeoMap::faceAt(const Vector2 &position)
+{
+    return face(faceLabelAt(position));
 }
 
 GeoMap::ConstFacePtr GeoMap::faceAt(const Vector2 &position) const
+{
+    return face(faceLabelAt(position));
+}
+
+CellLabel GeoMap::faceLabelAt(const Vector2 &position) const
 {
     vigra_precondition(mapInitialized(),
         "faceAt() called on graph (mapInitialized() == false)!");
 
     if(labelImage_)
     {
+        const LabelImage &labels(*labelImage_);
         GeoMap::LabelImage::difference_type p(detail::intVPos(position));
-        if(labelImage_->isInside(p))
+        if(labels.isInside(p))
         {
-            int faceLabel = (*labelImage_)[p];
+            int faceLabel = labels[p];
             if(faceLabel > 0)
-                return face(faceLabelLUT_[faceLabel]);
+                return faceLabelLUT_[faceLabel];
         }
     }
 
-    for(ConstFaceIterator it = finiteFacesBegin(); it.inRange(); ++it)
-        if((*it)->contains(position))
-            return *it;
+    std::vector<CellLabel> candidates;
+    faceIndex().candidates(position, candidates);
+    for(unsigned int i = 0; i < candidates.size(); ++i)
+    {
+        const FacePtr &candidate(faces_[candidates[i]]);
+        if(candidates[i] && candidate && candidate->contains(position))
+            return candidates[i];
+    }
 
-    return face(0);
+    return 0;
 }
 
 GeoMap::NodePtr GeoMap::addNode(
     const Vector2 &position)
 {
-    GeoMap::Node *result = new GeoMap::Node(this, position);
+    GeoMap::Node *result = new(cellArena_) GeoMap::Node(this, position);
     return node(result->label());
 }
 
@@ -364,7 +843,7 @@ GeoMap::NodePtr GeoMap::addNode(
 {
     if(label > nodes_.size())
         nodes_.resize(label, NULL_PTR(GeoMap::Node));
-    GeoMap::Node *result = new GeoMap::Node(this, position);
+    GeoMap::Node *result = new(cellArena_) GeoMap::Node(this, position);
     return node(result->label());
 }
 
@@ -378,7 +857,7 @@ GeoMap::EdgePtr GeoMap::addEdge(
 
     if(label > edges_.size())
         edges_.resize(label, NULL_PTR(GeoMap::Edge));
-    GeoMap::Edge *result = new GeoMap::Edge(
+    GeoMap::Edge *result = new(cellArena_) GeoMap::Edge(
         this, startNeighbor.nodeLabel(),  endNeighbor.nodeLabel(), points);
 
     if(startNeighbor.isSingular())
@@ -962,7 +1441,7 @@ void GeoMap::setSigmaMapping(SigmaMapping const &sigmaMapping, bool sorted)
     edgesSorted_ = sorted;
 }
 
-void GeoMap::initializeMap(bool initLabelImage)
+void GeoMap::initializeMap(bool initLabelImage, unsigned int threadCount)
 {
     vigra_precondition(!mapInitialized(),
                        "initializeMap() called more than once");
@@ -971,52 +1450,72 @@ void GeoMap::initializeMap(bool initLabelImage)
 
     initContours();
     //std::cerr << faceCount_ << " contours found, embedding...\n";
-    embedFaces(initLabelImage);
+    embedFaces(initLabelImage, threadCount);
 }
 
-typedef vigra::MultiArray<2, int> LabelImage;
+typedef GeoMap::LabelImage LabelImage;
 
+template<class SCANLINES>
+void markEdgeInLabelImage(
+    const SCANLINES &scanlines, LabelImage &labelImage);
+template<class SCANLINES>
 void markEdgeInLabelImage(
-    const vigra::Scanlines &scanlines, LabelImage &labelImage);
+    const SCANLINES &scanlines, LabelImage &labelImage,
+    int beginRow, int endRow);
+
+#ifdef USE_TILED_LABEL_IMAGE
+void GeoMap::setLabelImageStorage(int tileSize, const std::string &backingFile)
+{
+    vigra_precondition(tileSize > 0 && !(tileSize & (tileSize - 1)),
+        "setLabelImageStorage(): tileSize must be a power of two!");
+    labelImageTileSize_ = tileSize;
+    labelImageFile_ = backingFile;
+}
+#endif
+
+GeoMap::LabelImage *GeoMap::createLabelImage() const
+{
+    vigra_precondition(imageSize_.area() > 0,
+                       "initLabelImage: imageSize must be non-zero!");
+    LabelImage::size_type shape(imageSize().width(), imageSize().height());
+#ifdef USE_TILED_LABEL_IMAGE
+    return new LabelImage(shape, 0, labelImageTileSize_, labelImageFile_);
+#else
+    return new LabelImage(shape, 0);
+#endif
+}
 
-void GeoMap::setHasLabelImage(bool onoff)
+void GeoMap::setHasLabelImage(bool onoff, unsigned int threadCount)
 {
     if(onoff == hasLabelImage())
         return;
 
     if(onoff)
     {
-        vigra_precondition(imageSize_.area() > 0,
-                           "initLabelImage: imageSize must be non-zero!");
-        labelImage_ = new LabelImage(
-            LabelImage::size_type(imageSize().width(), imageSize().height()), 0);
+        labelImage_ = createLabelImage();
         faceLabelLUT_.initIdentity(faces_.size());
 
-        for(FaceIterator it = finiteFacesBegin(); it.inRange(); ++it)
+        threadCount = detail::resolveThreadCount(threadCount);
+        if(threadCount > 1)
         {
-            std::auto_ptr<vigra::Scanlines> scanlines =
-                (*it)->scanLines();
-            fillScannedPoly(*scanlines, (int)(*it)->label(),
-                            destMultiArrayRange(*labelImage_));
-            (*it)->pixelArea_ = 0;
+            Faces regions;
+            for(FaceIterator it = finiteFacesBegin(); it.inRange(); ++it)
+                regions.push_back(*it);
+            rasterizeFaces(regions, false, threadCount);
         }
-
-        for(EdgeIterator it = edgesBegin(); it.inRange(); ++it)
-            markEdgeInLabelImage((*it)->scanLines(),
-                                 *labelImage_);
-
-        // determine pixelArea_:
-        for(GeoMap::LabelImage::traverser lrow = labelImage_->traverser_begin();
-            lrow != labelImage_->traverser_end(); ++lrow)
+        else
         {
-            for(GeoMap::LabelImage::traverser::next_type lit = lrow.begin();
-                lit != lrow.end(); ++lit)
+            for(FaceIterator it = finiteFacesBegin(); it.inRange(); ++it)
             {
-                int label = *lit;
-                if(label >= 0)
-                    ++face(label)->pixelArea_;
+                std::auto_ptr<vigra::FlatScanlines> scanlines =
+                    (*it)->flatScanLines();
+                fillScannedPoly(*scanlines, (int)(*it)->label(),
+                                destMultiArrayRange(*labelImage_));
             }
         }
+
+        // mark edges and determine pixelArea_:
+        finishLabelImage(threadCount);
     }
     else
     {
@@ -1027,7 +1526,7 @@ void GeoMap::setHasLabelImage(bool onoff)
 
 void GeoMap::initContours()
 {
-    new Face(this, Dart(this, 0)); // create infinite face, dart will be ignored
+    new(cellArena_) Face(this, Dart(this, 0)); // create infinite face, dart will be ignored
 
     // fill list of faces with contours, i.e. no face will have a
     // contour after this, but all faces will carry the properties
@@ -1035,9 +1534,9 @@ void GeoMap::initContours()
     for(EdgeIterator it = edgesBegin(); it.inRange(); ++it)
     {
         if((*it)->leftFaceLabel_ == UNINITIALIZED_CELL_LABEL)
-            new Face(this, dart( (int)(*it)->label()));
+            new(cellArena_) Face(this, dart( (int)(*it)->label()));
         if((*it)->rightFaceLabel_ == UNINITIALIZED_CELL_LABEL)
-            new Face(this, dart(-(int)(*it)->label()));
+            new(cellArena_) Face(this, dart(-(int)(*it)->label()));
     }
 }
 
@@ -1054,7 +1553,61 @@ struct AbsAreaCompare
     }
 };
 
-void GeoMap::embedFaces(bool initLabelImage)
+namespace detail {
+
+    // labels at the (rounded) point positions of a contour, as found
+    // in the label image right before the face with index 'before' is
+    // drawn by GeoMap::rasterizeFaces() (-1 outside the image)
+struct ContourSamples
+{
+    struct Sample
+    {
+        GeoMap::LabelImage::difference_type pos;
+        unsigned int index;
+
+        bool operator<(const Sample &other) const
+        {
+            return pos[1] < other.pos[1];
+        }
+    };
+
+    ContourSamples(const GeoMap::Dart &anchor, unsigned int before,
+                   const GeoMap::LabelImage &labelImage)
+    : before(before)
+    {
+        for(ContourPointIter cpi(anchor); cpi.inRange(); ++cpi)
+        {
+            Sample sample;
+            sample.pos = intVPos(*cpi);
+            sample.index = labels.size();
+            labels.push_back(-1);
+            if(labelImage.isInside(sample.pos))
+                samples.push_back(sample);
+        }
+        std::sort(samples.begin(), samples.end());
+    }
+
+        // read the samples within the given rows
+    void read(const GeoMap::LabelImage &labelImage, int beginRow, int endRow)
+    {
+        Sample first;
+        first.pos[1] = beginRow;
+        for(std::vector<Sample>::const_iterator it =
+                std::lower_bound(samples.begin(), samples.end(), first);
+            it != samples.end() && it->pos[1] < endRow; ++it)
+        {
+            labels[it->index] = labelImage[it->pos];
+        }
+    }
+
+    unsigned int before;
+    std::vector<Sample> samples; // sorted by row
+    std::vector<int> labels;     // in contour order
+};
+
+} // namespace detail
+
+void GeoMap::embedFaces(bool initLabelImage, unsigned int threadCount)
 {
     // the result of this function is to transform the result of
     // initContours (i.e. preliminary faces, which are just phi
@@ -1069,10 +1622,7 @@ void GeoMap::embedFaces(bool initLabelImage)
 
     if(initLabelImage)
     {
-        vigra_precondition(imageSize_.area() > 0,
-                           "initLabelImage: imageSize must be non-zero!");
-        labelImage_ = new LabelImage(
-            LabelImage::size_type(imageSize().width(), imageSize().height()), 0);
+        labelImage_ = createLabelImage();
         faceLabelLUT_.initIdentity(faces_.size());
     }
 
@@ -1081,6 +1631,28 @@ void GeoMap::embedFaces(bool initLabelImage)
     std::sort(contours.begin(), contours.end(), AbsAreaCompare());
     std::fill(faces_.begin() + 1, faces_.end(), NULL_PTR(Face));
 
+    // in parallel mode, all regions are rasterized up-front (in the
+    // same order as below); the labels at the hole contours are read
+    // in between, right when a hole comes up in that order, so that
+    // they are the same as in serial mode:
+    threadCount = detail::resolveThreadCount(threadCount);
+    bool parallelLabels = initLabelImage && threadCount > 1;
+    std::vector<detail::ContourSamples> holeSamples;
+    if(parallelLabels)
+    {
+        GeoMap::Faces regions;
+        for(unsigned int i = 0; i < contours.size(); ++i)
+        {
+            if(contours[i]->area() > 0)
+                regions.push_back(contours[i]);
+            else
+                holeSamples.push_back(detail::ContourSamples(
+                    contours[i]->contour(), regions.size(), *labelImage_));
+        }
+        rasterizeFaces(regions, true, threadCount, &holeSamples);
+    }
+    unsigned int holeIndex = 0;
+
     for(unsigned int i = 0; i < contours.size(); ++i)
     {
         GeoMap::Face &contour(*contours[i]); // FIXME: const
@@ -1093,10 +1665,10 @@ void GeoMap::embedFaces(bool initLabelImage)
         {
             faces_[contour.label()] = contours[i];
 
-            if(initLabelImage)
+            if(initLabelImage && !parallelLabels)
             {
-                std::auto_ptr<vigra::Scanlines> scanlines =
-                    contour.scanLines();
+                std::auto_ptr<vigra::FlatScanlines> scanlines =
+                    contour.flatScanLines();
                 contour.pixelArea_ =
                     fillScannedPoly(*scanlines, (int)contour.label(),
                                     destMultiArrayRange(*labelImage_));
@@ -1113,15 +1685,28 @@ void GeoMap::embedFaces(bool initLabelImage)
             // contour is a hole, determine parent face
             GeoMap::FacePtr parent = NULL_PTR(GeoMap::Face);
 
-            if(initLabelImage)
+            if(parallelLabels)
+            {
+                const std::vector<int> &labels(holeSamples[holeIndex++].labels);
+                for(unsigned int j = 0; j < labels.size(); ++j)
+                {
+                    if(labels[j] >= 0)
+                    {
+                        parent = face(labels[j]);
+                        break;
+                    }
+                }
+            }
+            else if(initLabelImage)
             {
                 ContourPointIter cpi(anchor);
                 while(cpi.inRange())
                 {
+                    const LabelImage &labels(*labelImage_);
                     GeoMap::LabelImage::difference_type p(detail::intVPos(*cpi++));
-                    if(labelImage_->isInside(p))
+                    if(labels.isInside(p))
                     {
-                        int parentLabel = (*labelImage_)[p];
+                        int parentLabel = labels[p];
                         if(parentLabel >= 0)
                         {
                             parent = face(parentLabel);
@@ -1164,51 +1749,303 @@ void GeoMap::embedFaces(bool initLabelImage)
 
     if(initLabelImage)
     {
-        // in the case of holes, the face's pixelArea()s will be wrong:
-        for(FaceIterator it = facesBegin(); it.inRange(); ++it)
-            (*it)->pixelArea_ = 0;
+        // remove temporary contour markings, redo all edge markings
+        // correctly (also for interior bridges, which may not have
+        // been set to negative labels yet), and fix pixelAreas (which
+        // are wrong in the case of holes):
+        finishLabelImage(threadCount);
+    }
+}
 
-        // interior bridges may not have been set to negative labels yet:
-        for(EdgeIterator it = edgesBegin(); it.inRange(); ++it)
-            if((*it)->isBridge())
-                drawScannedPoly((*it)->scanLines(), -1,
-                                destMultiArrayRange(*labelImage_));
+namespace detail {
+
+    // owns FlatScanlines computed in parallel (std::auto_ptr cannot
+    // be stored in a std::vector)
+struct ScanlinesArray : public std::vector<vigra::FlatScanlines *>
+{
+    ScanlinesArray(size_type size)
+    : std::vector<vigra::FlatScanlines *>(size, (vigra::FlatScanlines *)NULL)
+    {}
+
+    ~ScanlinesArray()
+    {
+        for(size_type i = 0; i < size(); ++i)
+            delete (*this)[i];
+    }
+};
+
+    // row bands for (parallel) label image operations; more bands
+    // than threads for better load balancing.  Tiled label images
+    // are split at tile rows, so that no tile is shared by threads.
+struct LabelImageBands
+{
+    LabelImageBands(const GeoMap::LabelImage &labelImage,
+                    unsigned int threadCount)
+    : height((int)labelImage.size(1)),
+#ifdef USE_TILED_LABEL_IMAGE
+      rowAlignment(labelImage.tileSize()),
+#else
+      rowAlignment(1),
+#endif
+      units((height + rowAlignment - 1) / rowAlignment),
+      count(std::max(1, std::min(units, 4*(int)threadCount)))
+    {}
 
-        // remove temporary edge markings and fix pixelAreas:
-        for(GeoMap::LabelImage::traverser lrow = labelImage_->traverser_begin();
-            lrow != labelImage_->traverser_end(); ++lrow)
+    int beginRow(int band) const
+    {
+        return std::min(height, bandBegin(units, count, band) * rowAlignment);
+    }
+
+    int endRow(int band) const
+    {
+        return beginRow(band + 1);
+    }
+
+    int height, rowAlignment, units, count;
+};
+
+    // call f(begin, end) for contiguous pixel ranges covering the
+    // rows [beginRow, endRow), and f.uniform(label, pixelCount) for
+    // unallocated parts of a tiled label image (resp. every run of a
+    // run-length encoded one, which has no raw pixel memory)
+template<class Functor>
+void forEachLabelSpan(GeoMap::LabelImage &labelImage,
+                      int beginRow, int endRow, Functor &f)
+{
+#ifdef USE_SPARSE_LABEL_IMAGE
+    labelImage.forEachSpan(beginRow, endRow, f);
+#else
+    int width = (int)labelImage.size(0);
+    for(int y = beginRow; y < endRow; ++y)
+    {
+        int *row = &labelImage(0, y);
+        f(row, row + width);
+    }
+#endif
+}
+
+struct ResetNegativeLabels
+{
+    void operator()(int *begin, int *end) const
+    {
+        for(; begin != end; ++begin)
+            if(*begin < 0)
+                *begin = 0;
+    }
+
+    int operator()(int label) const
+    {
+        return label < 0 ? 0 : label;
+    }
+
+    void uniform(int, unsigned int) const
+    {
+        // unallocated tiles are never negative
+    }
+};
+
+inline void resetNegativeLabels(GeoMap::LabelImage &labelImage,
+                                int beginRow, int endRow)
+{
+    ResetNegativeLabels reset;
+#ifdef USE_RLE_LABEL_IMAGE
+    labelImage.transformValues(beginRow, endRow, reset);
+#else
+    forEachLabelSpan(labelImage, beginRow, endRow, reset);
+#endif
+}
+
+struct CountLabels
+{
+    CountLabels(std::vector<unsigned int> &counts)
+    : counts_(counts)
+    {}
+
+    void operator()(const int *begin, const int *end) const
+    {
+        for(; begin != end; ++begin)
+            if(*begin >= 0)
+                ++counts_[*begin];
+    }
+
+    void uniform(int label, unsigned int pixelCount) const
+    {
+        if(label >= 0)
+            counts_[label] += pixelCount;
+    }
+
+    std::vector<unsigned int> &counts_;
+};
+
+} // namespace detail
+
+void GeoMap::rasterizeFaces(const Faces &faces, bool drawContours,
+                            unsigned int threadCount,
+                            std::vector<detail::ContourSamples> *holeSamples)
+{
+    unsigned int sampleCount = holeSamples ? holeSamples->size() : 0;
+    int edgeCount = (int)edges_.size(), faceCount = (int)faces.size();
+    detail::ParallelErrors errors;
+
+    // edges' bounding boxes and scanlines are lazily cached and
+    // shared by adjacent faces, so compute them first:
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 64) num_threads(threadCount)
+#endif
+    for(int i = 0; i < edgeCount; ++i)
+    {
+        if(!edges_[i])
+            continue;
+        try
+        {
+            edges_[i]->boundingBox();
+            edges_[i]->scanLines();
+        }
+        catch(std::exception &e)
         {
-            for(GeoMap::LabelImage::traverser::next_type lit = lrow.begin();
-                lit != lrow.end(); ++lit)
+            errors.capture(e);
+        }
+    }
+    errors.rethrow();
+
+    detail::ScanlinesArray scanlines(faceCount);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16) num_threads(threadCount)
+#endif
+    for(int i = 0; i < faceCount; ++i)
+    {
+        try
+        {
+            scanlines[i] = faces[i]->flatScanLines().release();
+        }
+        catch(std::exception &e)
+        {
+            errors.capture(e);
+        }
+    }
+    errors.rethrow();
+
+    // each band of rows is written by exactly one thread, which
+    // processes the faces in the given order (later faces overwrite
+    // earlier ones, as in the serial code):
+    detail::LabelImageBands bands(*labelImage_, threadCount);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(threadCount)
+#endif
+    for(int band = 0; band < bands.count; ++band)
+    {
+        int beginRow = bands.beginRow(band),
+              endRow = bands.endRow(band);
+        try
+        {
+            unsigned int nextSamples = 0;
+            for(int i = 0; i < faceCount; ++i)
             {
-                int label = *lit;
-                if(label < 0)
-                    *lit = 0;
-                else
-                    ++face(label)->pixelArea_;
+                for(; nextSamples < sampleCount &&
+                        (*holeSamples)[nextSamples].before <= (unsigned int)i;
+                    ++nextSamples)
+                    (*holeSamples)[nextSamples].read(
+                        *labelImage_, beginRow, endRow);
+
+                const vigra::FlatScanlines &faceScanlines(*scanlines[i]);
+                if(faceScanlines.endIndex() <= beginRow ||
+                   faceScanlines.startIndex() >= endRow)
+                    continue;
+
+                fillScannedPoly(faceScanlines, (int)faces[i]->label(),
+                                destMultiArrayRange(*labelImage_),
+                                beginRow, endRow);
+                if(drawContours)
+                    drawScannedPoly(faceScanlines, -1,
+                                    destMultiArrayRange(*labelImage_),
+                                    beginRow, endRow);
             }
+            for(; nextSamples < sampleCount; ++nextSamples)
+                (*holeSamples)[nextSamples].read(
+                    *labelImage_, beginRow, endRow);
+        }
+        catch(std::exception &e)
+        {
+            errors.capture(e);
         }
+    }
+    errors.rethrow();
+}
+
+void GeoMap::finishLabelImage(unsigned int threadCount)
+{
+    // with threadCount > 1, this expects the edges' scanlines to be
+    // cached already (cf. rasterizeFaces())
+
+    detail::LabelImageBands bands(*labelImage_, threadCount);
+    int edgeCount = (int)edges_.size();
 
-        // redo all edge markings correctly:
-        for(EdgeIterator it = edgesBegin(); it.inRange(); ++it)
-            markEdgeInLabelImage((*it)->scanLines(),
-                                 *labelImage_);
+    // per-thread pixel counts, reduced below:
+    std::vector<std::vector<unsigned int> > pixelAreas(
+        threadCount, std::vector<unsigned int>(faces_.size(), 0));
+    detail::ParallelErrors errors;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(threadCount)
+#endif
+    for(int band = 0; band < bands.count; ++band)
+    {
+        int beginRow = bands.beginRow(band),
+              endRow = bands.endRow(band);
+        detail::CountLabels countLabels(pixelAreas[detail::currentThread()]);
+        try
+        {
+            // remove temporary contour markings:
+            detail::resetNegativeLabels(*labelImage_, beginRow, endRow);
+
+            // redo all edge markings correctly (this also covers
+            // interior bridges, which are not part of any contour):
+            for(int i = 0; i < edgeCount; ++i)
+                if(edges_[i])
+                    markEdgeInLabelImage(edges_[i]->scanLines(),
+                                         *labelImage_, beginRow, endRow);
+
+            // determine pixelArea_:
+            detail::forEachLabelSpan(*labelImage_, beginRow, endRow,
+                                     countLabels);
+        }
+        catch(std::exception &e)
+        {
+            errors.capture(e);
+        }
+    }
+    errors.rethrow();
+
+    for(FaceIterator it = facesBegin(); it.inRange(); ++it)
+    {
+        unsigned int pixelArea = 0;
+        for(unsigned int t = 0; t < threadCount; ++t)
+            pixelArea += pixelAreas[t][(*it)->label()];
+        (*it)->pixelArea_ = pixelArea;
     }
 }
 
 class LookupNewLabel
 {
     const std::vector<CellLabel> &newLabels_;
+    const LabelLUT *faceLabelLUT_;
 
   public:
-    LookupNewLabel(const std::vector<CellLabel> &newLabels)
-    : newLabels_(newLabels)
+        // if given, faceLabelLUT is applied first
+    LookupNewLabel(const std::vector<CellLabel> &newLabels,
+                   const LabelLUT *faceLabelLUT = NULL)
+    : newLabels_(newLabels),
+      faceLabelLUT_(faceLabelLUT)
     {}
 
     int operator()(int label) const
     {
         if(label >= 0)
+        {
+            if(faceLabelLUT_)
+                label = (*faceLabelLUT_)[label];
             return (int)newLabels_[label];
+        }
         return label;
     }
 };
@@ -1222,6 +2059,8 @@ void GeoMap::changeFaceLabels(
     vigra_precondition(newFaceLabels.size() == faces_.size(),
         "changeFaceLabels(): 1-to-1 mapping expected (wrong newFaceLabels size)");
 
+    faceIndex_.reset();
+
     GeoMap::Faces newFaces(maxFaceLabel, NULL_PTR(Face));
     for(CellLabel l = 0; l < newFaceLabels.size(); ++l)
     {
@@ -1245,9 +2084,14 @@ void GeoMap::changeFaceLabels(
 
     if(hasLabelImage())
     {
+#ifdef USE_SPARSE_LABEL_IMAGE
+        labelImage_->transformValues(
+            LookupNewLabel(newFaceLabels, &faceLabelLUT_));
+#else
         transformMultiArray(srcMultiArrayRange(*labelImage_, labelAccessor()),
                             destMultiArray(*labelImage_),
                             LookupNewLabel(newFaceLabels));
+#endif
         faceLabelLUT_.initIdentity(faces_.size());
     }
 }
@@ -1312,13 +2156,33 @@ GeoMap::NodePtr GeoMap::nearestNode(
     const Vector2 &position,
     double maxSquaredDist)
 {
-    NodeMap::iterator n(
-        nodeMap_.nearest(PositionedNodeLabel(position, 0), maxSquaredDist));
-    if(n != nodeMap_.end())
-        return node(n->second.payload);
+    const NodeMap::value_type *n(
+        nodeMap_.nearest(position, maxSquaredDist));
+    if(n)
+        return node(n->payload);
     return NULL_PTR(GeoMap::Node);
 }
 
+void GeoMap::nearestNodes(
+    const Vector2 &position, unsigned int k, std::vector<NodePtr> &result,
+    double maxSquaredDist)
+{
+    std::vector<NodeMap::value_type> found;
+    nodeMap_.kNearest(position, k, found, maxSquaredDist);
+    for(unsigned int i = 0; i < found.size(); ++i)
+        result.push_back(node(found[i].payload));
+}
+
+void GeoMap::nodesInRect(
+    const Vector2 &upperLeft, const Vector2 &lowerRight,
+    std::vector<NodePtr> &result)
+{
+    std::vector<NodeMap::value_type> found;
+    nodeMap_.inRect(upperLeft, lowerRight, found);
+    for(unsigned int i = 0; i < found.size(); ++i)
+        result.push_back(node(found[i].payload));
+}
+
 bool GeoMap::checkConsistency()
 {
     //std::cerr << "GeoMap[" << this << "].checkConsistency()\n";
@@ -1670,8 +2534,9 @@ bool GeoMap::removeIsolatedNode(GeoMap::Node &node)
     return true;
 }
 
+template<class SCANLINES>
 void rawAddEdgeToLabelImage(
-    const vigra::Scanlines &scanlines, LabelImage &labelImage, int diff)
+    const SCANLINES &scanlines, LabelImage &labelImage, int diff)
 {
     // clip to image range vertically:
     int y = std::max(0, scanlines.startIndex()),
@@ -1679,7 +2544,7 @@ void rawAddEdgeToLabelImage(
 
     for(; y < endY; ++y)
     {
-        const vigra::Scanlines::Scanline &scanline(scanlines[y]);
+        typename SCANLINES::const_reference scanline(scanlines[y]);
         for(unsigned int j = 0; j < scanline.size(); ++j)
         {
             // X range checking
@@ -1690,22 +2555,38 @@ void rawAddEdgeToLabelImage(
             if(end > labelImage.size(0))
                 end = labelImage.size(0);
 
+#ifndef USE_SPARSE_LABEL_IMAGE
+            if(begin < end)
+                detail::addToLabels(&labelImage(begin, y),
+                                    &labelImage(0, y) + end, diff);
+#else
             for(int x = begin; x < end; ++x)
                 labelImage[LabelImage::difference_type(x, y)] += diff;
+#endif
         }
     }
 }
 
+template<class SCANLINES>
 void markEdgeInLabelImage(
-    const vigra::Scanlines &scanlines, LabelImage &labelImage)
+    const SCANLINES &scanlines, LabelImage &labelImage)
 {
-    // clip to image range vertically:
-    int y = std::max(0, scanlines.startIndex()),
-     endY = std::min((int)labelImage.size(1), scanlines.endIndex());
+    markEdgeInLabelImage(scanlines, labelImage, 0, (int)labelImage.size(1));
+}
+
+template<class SCANLINES>
+void markEdgeInLabelImage(
+    const SCANLINES &scanlines, LabelImage &labelImage,
+    int beginRow, int endRow)
+{
+    // clip to image range (and requested rows) vertically:
+    int y = std::max(std::max(0, beginRow), scanlines.startIndex()),
+     endY = std::min(std::min((int)labelImage.size(1), endRow),
+                     scanlines.endIndex());
 
     for(; y < endY; ++y)
     {
-        const vigra::Scanlines::Scanline &scanline(scanlines[y]);
+        typename SCANLINES::const_reference scanline(scanlines[y]);
         for(unsigned int j = 0; j < scanline.size(); ++j)
         {
             // X range checking
@@ -1716,18 +2597,25 @@ void markEdgeInLabelImage(
             if(end > labelImage.size(0))
                 end = labelImage.size(0);
 
+#ifndef USE_SPARSE_LABEL_IMAGE
+            if(begin < end)
+                detail::markEdgeLabels(&labelImage(begin, y),
+                                       &labelImage(0, y) + end);
+#else
             for(int x = begin; x < end; ++x)
             {
                 LabelImage::difference_type pos(x, y);
                 int label = labelImage[pos];
                 labelImage[pos] = (label >= 0 ? -1 : label-1);
             }
+#endif
         }
     }
 }
 
+template<class SCANLINES>
 void removeEdgeFromLabelImage(
-    const vigra::Scanlines &scanlines,
+    const SCANLINES &scanlines,
     LabelImage &labelImage,
     LabelImage::value_type substituteLabel,
     PixelList &outputPixels)
@@ -1736,9 +2624,17 @@ void removeEdgeFromLabelImage(
     int y = std::max(0, scanlines.startIndex()),
      endY = std::min((int)labelImage.size(1), scanlines.endIndex());
 
+#ifndef USE_SPARSE_LABEL_IMAGE
+    // offsets of the reassociated pixels within one chunk of a
+    // scanline segment (longer segments are processed chunk-wise, so
+    // that no scratch memory needs to be allocated):
+    enum { ChunkSize = 256 };
+    int positions[ChunkSize];
+#endif
+
     for(; y < endY; ++y)
     {
-        const vigra::Scanlines::Scanline &scanline(scanlines[y]);
+        typename SCANLINES::const_reference scanline(scanlines[y]);
         for(unsigned int j = 0; j < scanline.size(); ++j)
         {
             // X range checking
@@ -1749,6 +2645,18 @@ void removeEdgeFromLabelImage(
             if(end > labelImage.size(0))
                 end = labelImage.size(0);
 
+#ifndef USE_SPARSE_LABEL_IMAGE
+            for(int chunk = begin; chunk < end; chunk += ChunkSize)
+            {
+                int chunkEnd = std::min(end, chunk + (int)ChunkSize);
+                unsigned int count = detail::removeEdgeLabels(
+                    &labelImage(chunk, y), &labelImage(0, y) + chunkEnd,
+                    substituteLabel, positions);
+                for(unsigned int k = 0; k < count; ++k)
+                    outputPixels.push_back(
+                        vigra::Point2D(chunk + positions[k], y));
+            }
+#else
             for(int x = begin; x < end; ++x)
             {
                 LabelImage::reference old(labelImage(x, y));
@@ -1762,6 +2670,7 @@ void removeEdgeFromLabelImage(
                     outputPixels.push_back(vigra::Point2D(x, y));
                 }
             }
+#endif
         }
     }
 }
@@ -1885,6 +2794,14 @@ GeoMap::EdgePtr GeoMap::splitEdge(
 
     preSplitEdgeHook(edge, segmentIndex, newPoint, insertPoint);
 
+    if(insertPoint && mapInitialized())
+    {
+        // the new point changes the geometry of the adjacent faces:
+        edge.leftFace()->invalidateContourPolys();
+        edge.rightFace()->invalidateContourPolys();
+        faceIndex_.reset();
+    }
+
     GeoMap::Node
         &newNode(*addNode(insertPoint ? newPoint : edge[segmentIndex])),
         &changedNode(*edge.endNode());
@@ -1898,7 +2815,7 @@ GeoMap::EdgePtr GeoMap::splitEdge(
         edge.insert(edge.begin() + segmentIndex, newPoint);
     }
 
-    GeoMap::Edge *result = new GeoMap::Edge(
+    GeoMap::Edge *result = new(cellArena_) GeoMap::Edge(
         this, newNode.label(), changedNode.label(), edge.split(segmentIndex));
     result->leftFaceLabel_ = edge.leftFaceLabel_;
     result->rightFaceLabel_ = edge.rightFaceLabel_;
@@ -2022,6 +2939,9 @@ GeoMap::FacePtr GeoMap::removeBridge(const GeoMap::Dart &dart)
             edge.scanLines(), *labelImage_, face.label(), associatedPixels);
 
     edge.uninitialize();
+    face.invalidateContourPolys();
+    if(faceIndex_.get())
+        face.contourPolys(); // read by faceLabelAt(), see faceIndex()
 
     // COMPLEXITY: depends on callbacks (postRemoveBridgeHook)
     postRemoveBridgeHook(face);
@@ -2147,10 +3067,20 @@ GeoMap::FacePtr GeoMap::mergeFaces(const GeoMap::Dart &dart)
 
     if(survivor.flag(GeoMap::Face::BOUNDING_BOX_VALID))
         survivor.boundingBox_ |= mergedBBox;
+    survivor.invalidateContourPolys();
+    if(faceIndex_.get())
+        faceIndex_->merged(mergedFace.label(), survivor.label());
 
     mergedEdge.uninitialize();
     mergedFace.uninitialize();
 
+    if(faceIndex_.get())
+    {
+        // keep the caches read by faceLabelAt() valid (see faceIndex()):
+        survivor.boundingBox();
+        survivor.contourPolys();
+    }
+
     // COMPLEXITY: depends on callbacks (postMergeFacesHook)
     postMergeFacesHook(survivor);
 
@@ -2166,9 +3096,7 @@ GeoMap::FacePtr GeoMap::mergeFaces(const GeoMap::Dart &dart)
 void GeoMap::Node::setPosition(const Vector2 &p)
 {
     vigra_precondition(initialized(), "setPosition() of uninitialized node!");
-    map_->nodeMap_.erase(
-        map_->nodeMap_.nearest(PositionedNodeLabel(position_, label_),
-                               vigra::NumericTraits<double>::epsilon()));
+    map_->nodeMap_.erase(position(), label_);
     position_ = p;
 
     if(!isIsolated())
@@ -2185,11 +3113,14 @@ void GeoMap::Node::setPosition(const Vector2 &p)
                 GeoMap::Edge &edge(*map_->edge(-d.label()));
                 edge[edge.size()-1] = p;
             }
+            if(map_->mapInitialized())
+                d.leftFace()->invalidateContourPolys();
         }
         while(d.nextSigma().label() != anchor_);
     }
+    map_->faceIndex_.reset();
 
-    map_->nodeMap_.insert(PositionedNodeLabel(p, label_));
+    map_->nodeMap_.insert(p, label_);
 }
 
 std::string description(GeoMap::Edge const &edge)
@@ -2242,6 +3173,7 @@ GeoMap::Face::findComponentAnchor(const GeoMap::Dart &dart)
 void GeoMap::Face::embedContour(const Dart &anchor)
 {
     anchors_.push_back(anchor);
+    invalidateContourPolys();
 
     Dart dart(anchor);
     for(; dart.leftFaceLabel() != label_; dart.nextPhi())
@@ -31,11 +31,20 @@
 
 #include "filteriterator.hxx"
 #include "labellut.hxx"
-#include "vigra/map2d.hxx"
+#include "vigra/gridhash2d.hxx"
 #include "polygon.hxx"
+#include "cellarena.hxx"
+#include "faceindex.hxx"
 #include <vector>
 #include <list>
+#include <iosfwd>
 #include <vigra/multi_array.hxx>
+#ifdef USE_TILED_LABEL_IMAGE
+#  include "vigra/tiledlabelimage.hxx"
+#endif
+#ifdef USE_RLE_LABEL_IMAGE
+#  include "runlengthlabelimage.hxx"
+#endif
 
 #include <boost/signals2/signal.hpp>
 #include <boost/utility.hpp> // boost::noncopyable
@@ -46,15 +55,43 @@
 // The define USE_INSECURE_CELL_PTRS can be used to switch between
 // "safe" cell handling e.g. for Python and a possibly faster C++ way.
 
+// MAKE_CELL_PTR(Type, cell, arena) wraps a cell allocated from the
+// given CellArena, which then also holds the shared_ptr's control block.
+
 #ifdef USE_INSECURE_CELL_PTRS
 #  define CELL_PTR(Type) Type *
 #  define NULL_PTR(Type) (Type *)NULL
 #  define RESET_PTR(ptr) delete ptr; ptr = NULL
+#  define MAKE_CELL_PTR(Type, cell, arena) ((Type *)(cell))
 #else
 #  include <boost/shared_ptr.hpp>
+#  include <boost/checked_delete.hpp>
 #  define CELL_PTR(Type) boost::shared_ptr<Type>
 #  define NULL_PTR(Type) boost::shared_ptr<Type>()
 #  define RESET_PTR(ptr) ptr.reset()
+#  define MAKE_CELL_PTR(Type, cell, arena) \
+    boost::shared_ptr<Type>((cell), boost::checked_deleter<Type>(), \
+                            detail::CellAllocator<Type>(arena))
+#endif
+
+// The define USE_TILED_LABEL_IMAGE replaces the dense label image by
+// a vigra::TiledLabelImage, whose tiles are only allocated where
+// faces (or edges) are rasterized, optionally in a memory-mapped
+// scratch file (see GeoMap::setLabelImageStorage()).  This is meant
+// for maps over huge images.
+//
+// Similarly, USE_RLE_LABEL_IMAGE stores the label image as runs of
+// equal labels per row (vigra::RunLengthLabelImage), which typically
+// needs an order of magnitude less memory for segmentations.
+//
+// Both are "sparse" label images without raw pixel memory, for which
+// USE_SPARSE_LABEL_IMAGE gets defined.
+
+#if defined(USE_TILED_LABEL_IMAGE) && defined(USE_RLE_LABEL_IMAGE)
+#  error "USE_TILED_LABEL_IMAGE and USE_RLE_LABEL_IMAGE are mutually exclusive"
+#endif
+#if defined(USE_TILED_LABEL_IMAGE) || defined(USE_RLE_LABEL_IMAGE)
+#  define USE_SPARSE_LABEL_IMAGE
 #endif
 
 typedef unsigned int CellLabel;
@@ -102,6 +139,7 @@ inline IVector2 intVPos(const Vector2 &p)
 }
 
 class PlannedSplits;
+struct ContourSamples;
 
 } // namespace detail
 
@@ -147,37 +185,66 @@ class GeoMap
     typedef std::vector<int> SigmaMapping;
     typedef std::vector<double> EdgePreferences;
 
+#if defined(USE_TILED_LABEL_IMAGE)
+    typedef vigra::TiledLabelImage LabelImage;
+#elif defined(USE_RLE_LABEL_IMAGE)
+    typedef vigra::RunLengthLabelImage LabelImage;
+#endif
+#ifdef USE_SPARSE_LABEL_IMAGE
+        // iterates over pixel coordinates, LabelImageAccessor
+        // reads the labels from the label image:
+    typedef vigra::CoordinateIterator LabelImageIterator;
+#else
+    typedef vigra::MultiArray<2, int> LabelImage;
     typedef vigra::ConstImageIterator<int> LabelImageIterator;
+#endif
+
     struct LabelImageAccessor {
         typedef int value_type;
 
         template<class Iterator>
         value_type operator()(Iterator it) const
         {
-            int label = *it;
-            if(label >= 0)
-                label = faceLabelLUT_[label];
-            return label;
+            return lookup(rawLabel(*it));
         }
 
         template<class Iterator>
         value_type operator()(Iterator it,
                               typename Iterator::difference_type diff) const
         {
-            int label = it[diff];
-            if(label >= 0)
-                label = faceLabelLUT_[label];
-            return label;
+            return lookup(rawLabel(it[diff]));
         }
 
       protected:
         friend class GeoMap;
 
-        LabelImageAccessor(LabelLUT const &faceLabelLUT)
-        : faceLabelLUT_(faceLabelLUT)
+        LabelImageAccessor(LabelLUT const &faceLabelLUT,
+                           const LabelImage *labelImage)
+        : faceLabelLUT_(faceLabelLUT),
+          labelImage_(labelImage)
         {}
 
+#ifdef USE_SPARSE_LABEL_IMAGE
+        int rawLabel(const vigra::Diff2D &pos) const
+        {
+            return labelImage_->get(pos.x, pos.y);
+        }
+#else
+        int rawLabel(int label) const
+        {
+            return label;
+        }
+#endif
+
+        int lookup(int label) const
+        {
+            if(label >= 0)
+                label = faceLabelLUT_[label];
+            return label;
+        }
+
         LabelLUT const &faceLabelLUT_;
+        const LabelImage *labelImage_;
     };
 
   protected:
@@ -196,25 +263,44 @@ class GeoMap
     unsigned int edgeCount_;
     unsigned int faceCount_;
 
-    typedef vigra::PositionedObject<Vector2, CellLabel> PositionedNodeLabel;
-    typedef vigra::Map2D<PositionedNodeLabel> NodeMap;
+        // node labels by position, on a hashed grid of 8x8 pixel cells
+        // (memory only depends on the number of nodes)
+    typedef vigra::GridHash2D<Vector2, CellLabel> NodeMap;
     NodeMap nodeMap_;
 
-    typedef vigra::MultiArray<2, int> LabelImage;
-
     vigra::Size2D imageSize_;
     LabelImage   *labelImage_;
     LabelLUT      faceLabelLUT_;
+#ifdef USE_TILED_LABEL_IMAGE
+    int           labelImageTileSize_;
+    std::string   labelImageFile_;
+#endif
 
     bool edgesSorted_;
     std::auto_ptr<detail::PlannedSplits> splitInfo_;
     std::auto_ptr<EdgePreferences> edgePreferences_;
 
+    detail::CellArena *cellArena_;
+
+        // lazily built for faceAt() (see faceIndex()):
+    typedef detail::FaceIndex<Vector2Polygon::BoundingBox> FaceIndex;
+    mutable std::auto_ptr<FaceIndex> faceIndex_;
+    const FaceIndex &faceIndex() const;
+
   public:
     GeoMap(vigra::Size2D imageSize);
     GeoMap(const GeoMap &other);
     ~GeoMap();
 
+        /// writes the map in a compact, versioned binary format,
+        /// including the label image if present and withLabelImage
+    void save(std::ostream &os, bool withLabelImage = true) const;
+        /// restores a map written by save(), including its faces and
+        /// label image (without re-running sortEdges / embedFaces);
+        /// a tiled label image keeps its tile size, but not its
+        /// backing file (see setLabelImageStorage())
+    static std::auto_ptr<GeoMap> load(std::istream &is);
+
     NodeIterator nodesBegin()
         { return NodeIterator(nodes_.begin(), nodes_.end()); }
     NodeIterator nodesEnd()
@@ -279,6 +365,7 @@ class GeoMap
     inline Dart dart(int label);
     FacePtr faceAt(const Vector2 &position);
     ConstFacePtr faceAt(const Vector2 &position) const;
+    CellLabel faceLabelAt(const Vector2 &position) const;
 
     CellLabel nodeCount() const { return nodeCount_; }
     CellLabel maxNodeLabel() const { return nodes_.size(); }
@@ -324,15 +411,35 @@ class GeoMap
 
     bool edgesSorted() const { return edgesSorted_; }
 
-    void initializeMap(bool initLabelImage = true);
+        // threadCount > 1 rasterizes the label image in parallel row
+        // bands (0 = use all available threads; needs OpenMP)
+    void initializeMap(bool initLabelImage = true,
+                       unsigned int threadCount = 1);
     bool mapInitialized() const  { return faces_.size() > 0; }
     bool hasLabelImage() const { return labelImage_ != NULL; }
-    void setHasLabelImage(bool onoff);
+    void setHasLabelImage(bool onoff, unsigned int threadCount = 1);
+#ifdef USE_TILED_LABEL_IMAGE
+        // configure tiles of label images created subsequently; with
+        // a non-empty backingFile, they are kept in a memory-mapped
+        // scratch file (copied and loaded maps keep their tiles in
+        // memory)
+    void setLabelImageStorage(
+        int tileSize = vigra::TiledLabelImage::DefaultTileSize,
+        const std::string &backingFile = std::string());
+#endif
+#ifdef USE_SPARSE_LABEL_IMAGE
+        // e.g. for memory statistics
+    const LabelImage *labelImage() const { return labelImage_; }
+#endif
     const LabelLUT &faceLabelLUT() const { return faceLabelLUT_; }
 
     LabelImageIterator labelsUpperLeft() const
     {
+#ifdef USE_SPARSE_LABEL_IMAGE
+        return LabelImageIterator(0, 0);
+#else
         return LabelImageIterator(labelImage_->data(), labelImage_->shape(0));
+#endif
     }
     LabelImageIterator labelsLowerRight() const
     {
@@ -340,7 +447,7 @@ class GeoMap
     }
     LabelImageAccessor labelAccessor() const
     {
-        return LabelImageAccessor(faceLabelLUT_);
+        return LabelImageAccessor(faceLabelLUT_, labelImage_);
     }
 
     vigra::triple<LabelImageIterator, LabelImageIterator, LabelImageAccessor>
@@ -359,7 +466,14 @@ class GeoMap
 
   protected:
     void initContours();
-    void embedFaces(bool initLabelImage);
+    LabelImage *createLabelImage() const;
+    void embedFaces(bool initLabelImage, unsigned int threadCount = 1);
+        // holeSamples (sorted by 'before') are read in between the
+        // faces, see detail::ContourSamples
+    void rasterizeFaces(const Faces &faces, bool drawContours,
+                        unsigned int threadCount,
+                        std::vector<detail::ContourSamples> *holeSamples = NULL);
+    void finishLabelImage(unsigned int threadCount);
     void resizeSigmaMapping(SigmaMapping::size_type newSize);
     void insertSigmaPredecessor(int successor, int newPredecessor);
     void detachDart(int dartLabel);
@@ -368,6 +482,14 @@ class GeoMap
     NodePtr nearestNode(
         const Vector2 &position,
         double maxSquaredDist = vigra::NumericTraits<double>::max());
+        /// the (at most) k nodes nearest to position, sorted by distance
+    void nearestNodes(
+        const Vector2 &position, unsigned int k, std::vector<NodePtr> &result,
+        double maxSquaredDist = vigra::NumericTraits<double>::max());
+        /// all nodes within the rectangle [upperLeft, lowerRight)
+    void nodesInRect(
+        const Vector2 &upperLeft, const Vector2 &lowerRight,
+        std::vector<NodePtr> &result);
 
     bool checkConsistency();
 
@@ -442,7 +564,7 @@ class GeoMap::Node : boost::noncopyable
   protected:
     GeoMap        *map_;
     CellLabel      label_;
-    Vector2 position_;
+    Vector2        position_;
     int            anchor_;
 
     friend class GeoMap; // give access to anchor_ (add edge, sort edges, Euler..)
@@ -456,9 +578,10 @@ class GeoMap::Node : boost::noncopyable
       position_(position),
       anchor_(0)
     {
-        map_->nodes_.push_back(GeoMap::NodePtr(this));
+        map_->nodes_.push_back(
+            MAKE_CELL_PTR(GeoMap::Node, this, map_->cellArena_));
         ++map_->nodeCount_;
-        map_->nodeMap_.insert(PositionedNodeLabel(position_, label_));
+        map_->nodeMap_.insert(position_, label_);
     }
 
         // copy constructor for copying GeoMaps
@@ -468,10 +591,34 @@ class GeoMap::Node : boost::noncopyable
       position_(other.position_),
       anchor_(other.anchor_)
     {
-        map_->nodeMap_.insert(PositionedNodeLabel(position_, label_));
+        map_->nodeMap_.insert(position_, label_);
+    }
+
+        // constructor for loading GeoMaps (see GeoMap::load())
+    Node(GeoMap *map, CellLabel label, const Vector2 &position, int anchor)
+    : map_(map),
+      label_(label),
+      position_(position),
+      anchor_(anchor)
+    {
+        map_->nodeMap_.insert(position_, label_);
     }
 
   public:
+        // cells are allocated from the map's arena (see CellArena)
+    static void *operator new(std::size_t size, detail::CellArena *arena)
+    {
+        return arena->allocate(size);
+    }
+    static void operator delete(void *p, detail::CellArena *)
+    {
+        detail::CellArena::deallocate(p);
+    }
+    static void operator delete(void *p)
+    {
+        detail::CellArena::deallocate(p);
+    }
+
     bool initialized() const
     {
         return map_ != NULL;
@@ -567,7 +714,8 @@ class GeoMap::Edge
       rightFaceLabel_(UNINITIALIZED_CELL_LABEL),
       flags_(0)
     {
-        map_->edges_.push_back(GeoMap::EdgePtr(this));
+        map_->edges_.push_back(
+            MAKE_CELL_PTR(GeoMap::Edge, this, map_->cellArena_));
         ++map_->edgeCount_;
     }
 
@@ -582,9 +730,40 @@ class GeoMap::Edge
       rightFaceLabel_(other.rightFaceLabel_),
       flags_(other.flags_)
     {
+    }
+
+        // constructor for loading GeoMaps (see GeoMap::load())
+    template<class ITERATOR>
+    Edge(GeoMap *map, CellLabel label,
+         CellLabel startNodeLabel, CellLabel endNodeLabel,
+         CellLabel leftFaceLabel, CellLabel rightFaceLabel, CellFlags flags,
+         ITERATOR pointsBegin, ITERATOR pointsEnd)
+    : Base(pointsBegin, pointsEnd),
+      map_(map),
+      label_(label),
+      startNodeLabel_(startNodeLabel),
+      endNodeLabel_(endNodeLabel),
+      leftFaceLabel_(leftFaceLabel),
+      rightFaceLabel_(rightFaceLabel),
+      flags_(flags)
+    {
     }
 
   public:
+        // cells are allocated from the map's arena (see CellArena)
+    static void *operator new(std::size_t size, detail::CellArena *arena)
+    {
+        return arena->allocate(size);
+    }
+    static void operator delete(void *p, detail::CellArena *)
+    {
+        detail::CellArena::deallocate(p);
+    }
+    static void operator delete(void *p)
+    {
+        detail::CellArena::deallocate(p);
+    }
+
     bool initialized() const
     {
         return map_ != NULL;
@@ -605,7 +784,7 @@ class GeoMap::Edge
     GeoMap::NodePtr startNode() const
     {
         vigra_precondition(initialized(), "startNode() of uninitialized edge!");
-        return map_->node(startNodeLabel_);
+        return map_->node(startNodeLabel());
     }
 
     CellLabel endNodeLabel() const
@@ -616,7 +795,7 @@ class GeoMap::Edge
     GeoMap::NodePtr endNode() const
     {
         vigra_precondition(initialized(), "endNode() of uninitialized edge!");
-        return map_->node(endNodeLabel_);
+        return map_->node(endNodeLabel());
     }
 
     CellLabel leftFaceLabel() const
@@ -648,7 +827,7 @@ class GeoMap::Edge
 
     bool isLoop() const
     {
-        return startNodeLabel_ == endNodeLabel_;
+        return startNodeLabel() == endNodeLabel();
     }
 
     bool operator==(const GeoMap::Edge &other)
@@ -668,7 +847,7 @@ class GeoMap::Edge
 
     CellFlags flag(CellFlags which) const
     {
-        return flags_ & which;
+        return flags() & which;
     }
 
     void setFlag(CellFlags flag, bool onoff = true)
@@ -1086,24 +1265,42 @@ class GeoMap::Face : boost::noncopyable
     unsigned int         pixelArea_;
 
     enum {
-        BOUNDING_BOX_VALID = 0x80000000U,
-        AREA_VALID         = 0x40000000U,
-        INTERNAL_FLAGS     = 0xf0000000U,
+        BOUNDING_BOX_VALID  = 0x80000000U,
+        AREA_VALID          = 0x40000000U,
+        CONTOUR_POLYS_VALID = 0x20000000U,
+        INTERNAL_FLAGS      = 0xf0000000U,
     };
 
+        // cache for contains(), see contourPolys():
+    mutable std::vector<Vector2Polygon> contourPolys_;
+
     friend class GeoMap; // give access to pixelArea_ and anchors_ (Euler ops...)
 
     inline void uninitialize();
     typedef Contours::iterator AnchorIterator; // non-const ContourIterator
     AnchorIterator findComponentAnchor(const GeoMap::Dart &dart);
 
+        // returns contourPoly() of all contours (cached)
+    const std::vector<Vector2Polygon> &contourPolys() const
+    {
+        if(!flag(CONTOUR_POLYS_VALID))
+        {
+            contourPolys_.clear();
+            for(ContourIterator it = contoursBegin(); it != contoursEnd(); ++it)
+                contourPolys_.push_back(contourPoly(*it));
+            flags_ |= CONTOUR_POLYS_VALID;
+        }
+        return contourPolys_;
+    }
+
     Face(GeoMap *map, Dart anchor)
     : map_(map),
       label_(map->faces_.size()),
       flags_(0),
       pixelArea_(0)
     {
-        map_->faces_.push_back(GeoMap::FacePtr(this));
+        map_->faces_.push_back(
+            MAKE_CELL_PTR(GeoMap::Face, this, map_->cellArena_));
         ++map_->faceCount_;
 
         if(label_)
@@ -1125,7 +1322,7 @@ class GeoMap::Face : boost::noncopyable
     Face(GeoMap *map, const Face &other)
     : map_(map),
       label_(other.label_),
-      flags_(other.flags_),
+      flags_(other.flags_ & ~CONTOUR_POLYS_VALID),
       boundingBox_(other.boundingBox_),
       area_(other.area_),
       pixelArea_(other.pixelArea_)
@@ -1134,7 +1331,33 @@ class GeoMap::Face : boost::noncopyable
             anchors_.push_back(Dart(map, other.anchors_[i].label()));
     }
 
+        // constructor for loading GeoMaps (see GeoMap::load()),
+        // anchors_ are filled in by the map
+    Face(GeoMap *map, CellLabel label, CellFlags flags,
+         const BoundingBox &boundingBox, double area, unsigned int pixelArea)
+    : map_(map),
+      label_(label),
+      flags_(flags & ~CONTOUR_POLYS_VALID),
+      boundingBox_(boundingBox),
+      area_(area),
+      pixelArea_(pixelArea)
+    {}
+
   public:
+        // cells are allocated from the map's arena (see CellArena)
+    static void *operator new(std::size_t size, detail::CellArena *arena)
+    {
+        return arena->allocate(size);
+    }
+    static void operator delete(void *p, detail::CellArena *)
+    {
+        detail::CellArena::deallocate(p);
+    }
+    static void operator delete(void *p)
+    {
+        detail::CellArena::deallocate(p);
+    }
+
     bool initialized() const
     {
         return map_ != NULL;
@@ -1163,30 +1386,39 @@ class GeoMap::Face : boost::noncopyable
         return boundingBox_;
     }
 
+        // to be called whenever the contours' geometry changes
+        // (used by Euler operations and Node::setPosition())
+    void invalidateContourPolys()
+    {
+        flags_ &= ~CONTOUR_POLYS_VALID;
+        contourPolys_.clear();
+    }
+
     bool contains(const Vector2 &point) const
     {
         vigra_precondition(initialized(), "contains() of uninitialized face!");
         if(map_->labelImage_)
         {
             detail::IVector2 iPos(detail::intVPos(point));
-            if(map_->labelImage_->isInside(iPos))
+            const LabelImage &labels(*map_->labelImage_);
+            if(labels.isInside(iPos))
             {
-                int l = (*map_->labelImage_)[iPos];
+                int l = labels[iPos];
                 if(l > 0)
                     return map_->faceLabelLUT_[l] == label_;
             }
         }
-        ContourIterator it = contoursBegin();
+        unsigned int i = 0;
         if(label_)
         {
             if(!boundingBox().contains(point))
                 return false;
-            if(!contourPoly(*it).contains(point))
+            if(!contourPolys()[0].contains(point))
                 return false;
-            ++it;
+            ++i;
         }
-        for(; it != contoursEnd(); ++it)
-            if(contourPoly(*it).contains(point))
+        for(; i < contourPolys().size(); ++i)
+            if(contourPolys()[i].contains(point))
                 return false;
         return true;
     }
@@ -1235,6 +1467,24 @@ class GeoMap::Face : boost::noncopyable
         return result;
     }
 
+        /// same as scanLines(), but built by a k-way merge of the
+        /// contour edges' scanlines into the flat representation
+    std::auto_ptr<vigra::FlatScanlines> flatScanLines() const
+    {
+        std::vector<vigra::ScanlinesSource> sources;
+
+        Dart anchor(*anchors_.begin()), dart(anchor);
+        do
+        {
+            sources.push_back(vigra::ScanlinesSource(
+                dart.edge()->scanLines(), dart.label() > 0 ? 1 : -1));
+        }
+        while(dart.nextPhi() != anchor);
+
+        return std::auto_ptr<vigra::FlatScanlines>(
+            new vigra::FlatScanlines(sources));
+    }
+
     unsigned int pixelArea() const
     {
         return pixelArea_;
@@ -1316,9 +1566,7 @@ inline void GeoMap::Node::uninitialize()
     GeoMap *map = map_;
     map_ = NULL; // DON'T MESS WITH THIS!
     --map->nodeCount_;
-    map->nodeMap_.erase(
-        map->nodeMap_.nearest(PositionedNodeLabel(position_, label_),
-                              vigra::NumericTraits<double>::epsilon()));
+    map->nodeMap_.erase(position_, label_);
     RESET_PTR(map->nodes_[label_]); // may have effect like "delete this;"!
 }
 
@@ -27,6 +27,9 @@
 /************************************************************************/
 
 #include "cppmap_utils.hxx"
+#include <algorithm>
+#include <iostream>
+#include <utility>
 
 GeoMap::FacePtr mergeFacesCompletely(
     GeoMap::Dart &dart, bool mergeDegree2Nodes)
@@ -194,3 +197,137 @@ unsigned int removeBridges(GeoMap &map)
 
     return removeBridges(map, bridgeLabels);
 }
+
+/********************************************************************/
+
+namespace {
+
+struct NodePositionCompare
+{
+    int dim_;
+    bool reverse_;
+
+    NodePositionCompare(int dim, bool reverse)
+    : dim_(dim),
+      reverse_(reverse)
+    {}
+
+    bool operator()(GeoMap::NodePtr const &a, GeoMap::NodePtr const &b) const
+    {
+        return reverse_
+            ? b->position()[dim_] < a->position()[dim_]
+            : a->position()[dim_] < b->position()[dim_];
+    }
+};
+
+typedef std::vector<std::pair<Vector2Array, GeoMap::NodePtr> > BorderEdges;
+
+    // Appends the border polylines up to each of the (sorted) nodes
+    // on one side of the border, which runs at position `border` in
+    // dimension `dim`; `inward` is the sign of the direction into the
+    // image.
+void collectBorderEdges(std::vector<GeoMap::NodePtr> const &nodes,
+                        int dim, double border, double inward,
+                        double samePosEpsilon,
+                        Vector2Array &lastPoints, BorderEdges &borderEdges)
+{
+    for(unsigned int i = 0; i < nodes.size(); ++i)
+    {
+        Vector2 pos(nodes[i]->position());
+        Vector2Array thisPoints;
+        if(inward * (pos[dim] - border) > samePosEpsilon)
+        {
+            Vector2 borderPos(pos);
+            borderPos[dim] = border;
+            thisPoints.push_back(borderPos);
+        }
+        thisPoints.push_back(pos);
+        lastPoints.insert(lastPoints.end(),
+                          thisPoints.begin(), thisPoints.end());
+        borderEdges.push_back(std::make_pair(lastPoints, nodes[i]));
+        thisPoints.reverse();
+        lastPoints.swap(thisPoints);
+    }
+}
+
+GeoMap::SigmaAnchor borderEdgeAnchor(GeoMap::Node const &node)
+{
+    if(node.map()->edgesSorted() && !node.isIsolated())
+        return GeoMap::SigmaAnchor(node.anchor());
+    return GeoMap::SigmaAnchor(node);
+}
+
+} // anonymous namespace
+
+unsigned int connectBorderNodes(GeoMap &map, double epsilon,
+                                double samePosEpsilon, bool aroundPixels)
+{
+    double dist = aroundPixels ? 0.5 : 0.0;
+    double x1 = -dist, y1 = -dist,
+           x2 = map.imageSize().width() - 1 + dist,
+           y2 = map.imageSize().height() - 1 + dist;
+
+    std::vector<GeoMap::NodePtr> left, right, top, bottom;
+    for(GeoMap::NodeIterator it = map.nodesBegin(); it.inRange(); ++it)
+    {
+        Vector2 p((*it)->position());
+        if(p[0] > x2 - epsilon)
+            right.push_back(*it);
+        else if(p[0] < x1 + epsilon)
+            left.push_back(*it);
+        else if(p[1] > y2 - epsilon)
+            bottom.push_back(*it);
+        else if(p[1] < y1 + epsilon)
+            top.push_back(*it);
+    }
+
+    // clockwise order, starting at the upper left corner:
+    std::stable_sort(top.begin(), top.end(), NodePositionCompare(0, false));
+    std::stable_sort(right.begin(), right.end(), NodePositionCompare(1, false));
+    std::stable_sort(bottom.begin(), bottom.end(), NodePositionCompare(0, true));
+    std::stable_sort(left.begin(), left.end(), NodePositionCompare(1, true));
+
+    BorderEdges borderEdges;
+    Vector2Array lastPoints;
+    lastPoints.push_back(Vector2(x1, y1));
+    collectBorderEdges(top, 1, y1, 1.0, samePosEpsilon,
+                       lastPoints, borderEdges);
+    lastPoints.push_back(Vector2(x2, y1));
+    collectBorderEdges(right, 0, x2, -1.0, samePosEpsilon,
+                       lastPoints, borderEdges);
+    lastPoints.push_back(Vector2(x2, y2));
+    collectBorderEdges(bottom, 1, y2, -1.0, samePosEpsilon,
+                       lastPoints, borderEdges);
+    lastPoints.push_back(Vector2(x1, y2));
+    collectBorderEdges(left, 0, x1, 1.0, samePosEpsilon,
+                       lastPoints, borderEdges);
+
+    if(borderEdges.empty())
+    {
+        GeoMap::NodePtr cornerNode(map.addNode(lastPoints[0]));
+        lastPoints.push_back(lastPoints[0]); // close loop
+        map.addEdge(*cornerNode, *cornerNode, lastPoints)
+            ->setFlag(GeoMap::Edge::BORDER_PROTECTION);
+        return 1;
+    }
+
+    // the polyline after the last node continues into the first edge:
+    lastPoints.insert(lastPoints.end(),
+                      borderEdges[0].first.begin(), borderEdges[0].first.end());
+    borderEdges[0].first.swap(lastPoints);
+
+    if(map.edgesSorted())
+        std::cerr << "*** BIG FAT WARNING! ***\n  connectBorderNodes() "
+            "called on already sorted map - resorting necessary!\n";
+
+    GeoMap::NodePtr endNode(borderEdges.back().second);
+    for(unsigned int i = 0; i < borderEdges.size(); ++i)
+    {
+        GeoMap::NodePtr startNode(endNode);
+        endNode = borderEdges[i].second;
+        map.addEdge(borderEdgeAnchor(*startNode), borderEdgeAnchor(*endNode),
+                    borderEdges[i].first)
+            ->setFlag(GeoMap::Edge::BORDER_PROTECTION);
+    }
+    return borderEdges.size();
+}
@@ -108,6 +108,15 @@ unsigned int removeBridges(GeoMap &map, std::list<CellLabel> &bridges);
 
 unsigned int removeBridges(GeoMap &map);
 
+/// Inserts BORDER_PROTECTION edges along the image border (through the
+/// pixel centers, or around the pixel facets if `aroundPixels`) and
+/// connects all nodes closer than `epsilon` to the border to it
+/// (like connectBorderNodes() in maputils.py).  Returns the number of
+/// edges added.
+unsigned int connectBorderNodes(GeoMap &map, double epsilon,
+                                double samePosEpsilon = 1e-6,
+                                bool aroundPixels = false);
+
 /// Removes all edges whose labels are in `edgeLabels`.
 /// Uses an optimized sequence of basic Euler operations.
 template<class ITERATOR>
@@ -149,12 +158,12 @@ void drawLabelImage(const GeoMap &geomap,
     for(GeoMap::ConstFaceIterator
             it = geomap.finiteFacesBegin(); it.inRange(); ++it)
     {
-        std::auto_ptr<vigra::Scanlines> scanlines =
-            (*it)->scanLines();
+        std::auto_ptr<vigra::FlatScanlines> scanlines =
+            (*it)->flatScanLines();
         fillScannedPoly(*scanlines, (int)(*it)->label(),
                         dul, ds, a);
         if(negativeEdgeLabels)
-            vigra::drawScannedPoly(*(*it)->scanLines(), -1,
+            vigra::drawScannedPoly(*scanlines, -1,
                                    dul, ds, a);
     }
 
@@ -28,6 +28,7 @@
 
 #include "crackedgemap.hxx"
 #include "cppmap_utils.hxx"
+#include <algorithm>
 
 void CrackEdgeMapGenerator::makeCCSymmetric()
 {
@@ -228,19 +229,21 @@ void CrackEdgeMapGenerator::followAllEdgesStartingWith(int connMask)
     }
 }
 
-void CrackEdgeMapGenerator::initializeMap(bool initLabelImage)
+namespace {
+
+void initializeCrackEdgeMap(GeoMap &map, bool initLabelImage)
 {
     // no longer necessary, since generation process should not create
     // degree 2 nodes anymore:
-    //mergeDegree2Nodes(*result);
-    result->sortEdgesDirectly();
-    result->initializeMap(initLabelImage);
+    //mergeDegree2Nodes(map);
+    map.sortEdgesDirectly();
+    map.initializeMap(initLabelImage);
 
     // mark the border edges
-    vigra_assert(result->face(0)->holeCount() == 1,
+    vigra_assert(map.face(0)->holeCount() == 1,
                  "infinite face should have exactly one contour");
 
-    GeoMap::Dart dart(*result->face(0)->holesBegin()), start(dart);
+    GeoMap::Dart dart(*map.face(0)->holesBegin()), start(dart);
     do
     {
         vigra_assert(!dart.leftFaceLabel(), "infinite face's contour lost");
@@ -249,6 +252,410 @@ void CrackEdgeMapGenerator::initializeMap(bool initLabelImage)
     while(dart.nextPhi() != start);
 }
 
+} // anonymous namespace
+
+void CrackEdgeMapGenerator::initializeMap(bool initLabelImage)
+{
+    initializeCrackEdgeMap(*result, initLabelImage);
+}
+
+/********************************************************************/
+
+void CrackEdgeTracer::beginStrip(
+    int y, const std::vector<int> &connections)
+{
+    for(int x = 0; x < (int)connections.size(); ++x)
+    {
+        if(!(connections[x] & CrackEdgeMapGenerator::CONN_UP))
+            continue;
+
+        // contours starting here have already been entered above:
+        int chain = newChain(vigra::Point2D(x, y - 1), topBorder(x));
+        chains_[chain].loopStart = vigra::Point2D(0x7fffffff, 0x7fffffff);
+        attachToSlot(2*chain + 1, x);
+    }
+}
+
+void CrackEdgeTracer::processCornerRow(
+    int y, const std::vector<int> &connections)
+{
+    typedef CrackEdgeMapGenerator CEMG;
+
+    static const unsigned char conn2degree[] =
+        {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+
+    for(int x = 0; x < (int)connections.size(); ++x)
+    {
+        int conn(connections[x]);
+        if(!conn)
+            continue;
+
+        const vigra::Point2D corner(x, y);
+        const Vector2 pos(x - 0.5, y - 0.5);
+
+        // open chain ends arriving from above / from the left:
+        int up = (conn & CEMG::CONN_UP) ? down_[x] : -1;
+        int left = (conn & CEMG::CONN_LEFT) ? right_ : -1;
+        down_[x] = -1;
+        right_ = -1;
+
+        if(conn & CEMG::CONN_DIAG_UPLEFT)
+        {
+            // two contours pass by, around the upper right and the
+            // lower left pixel:
+            extendChain(up, pos);
+            attachToSlot(up, RIGHT_SLOT);
+            extendChain(left, pos);
+            attachToSlot(left, x);
+        }
+        else if(conn & CEMG::CONN_DIAG_UPRIGHT)
+        {
+            // around the upper left and the lower right pixel:
+            joinChains(up, left, corner);
+            int chain = newChain(corner, OPEN_END);
+            attachToSlot(2*chain, x);
+            attachToSlot(2*chain + 1, RIGHT_SLOT);
+        }
+        else if(conn2degree[conn] > 2)
+        {
+            int node = addNode(pos);
+            if(up >= 0)
+            {
+                extendChain(up, pos);
+                attachToNode(up, node);
+            }
+            if(left >= 0)
+            {
+                extendChain(left, pos);
+                attachToNode(left, node);
+            }
+            if(conn & CEMG::CONN_RIGHT)
+                attachToSlot(2*newChain(corner, node) + 1, RIGHT_SLOT);
+            if(conn & CEMG::CONN_DOWN)
+                attachToSlot(2*newChain(corner, node) + 1, x);
+        }
+        else if(up >= 0 && left >= 0)
+        {
+            joinChains(up, left, corner);
+        }
+        else if(up >= 0 || left >= 0)
+        {
+            int end = (up >= 0) ? up : left;
+            extendChain(end, pos);
+            attachToSlot(end, (conn & CEMG::CONN_RIGHT) ? (int)RIGHT_SLOT : x);
+        }
+        else
+        {
+            // upper left corner of a contour (RIGHT | DOWN), cf. CONN_MAYBE_NODE
+            int chain = newChain(corner, OPEN_END);
+            attachToSlot(2*chain, x);
+            attachToSlot(2*chain + 1, RIGHT_SLOT);
+        }
+    }
+}
+
+void CrackEdgeTracer::endStrip()
+{
+    for(int x = 0; x < (int)down_.size(); ++x)
+    {
+        int chainEnd = down_[x];
+        down_[x] = -1;
+        if(chainEnd >= 0)
+            attachToNode(chainEnd, bottomBorder(x));
+    }
+}
+
+int CrackEdgeTracer::newChain(
+    const vigra::Point2D &corner, int node)
+{
+    int chain;
+    if(freeChains_.empty())
+    {
+        chain = chains_.size();
+        chains_.push_back(Chain());
+    }
+    else
+    {
+        chain = freeChains_.back();
+        freeChains_.pop_back();
+    }
+
+    Chain &c(chains_[chain]);
+    c.points.push_back(Vector2(corner.x - 0.5, corner.y - 0.5));
+    c.node[0] = node;
+    c.node[1] = OPEN_END;
+    c.slot[0] = c.slot[1] = RIGHT_SLOT;
+    c.loopStart = corner;
+    return chain;
+}
+
+void CrackEdgeTracer::freeChain(int chain)
+{
+    chains_[chain].points.clear();
+    freeChains_.push_back(chain);
+}
+
+void CrackEdgeTracer::extendChain(
+    int chainEnd, const Vector2 &pos)
+{
+    std::deque<Vector2> &points(chains_[chainEnd >> 1].points);
+    if(chainEnd & 1)
+        points.push_back(pos);
+    else
+        points.push_front(pos);
+}
+
+void CrackEdgeTracer::attachToSlot(int chainEnd, int slot)
+{
+    chains_[chainEnd >> 1].slot[chainEnd & 1] = slot;
+    if(slot == RIGHT_SLOT)
+        right_ = chainEnd;
+    else
+        down_[slot] = chainEnd;
+}
+
+void CrackEdgeTracer::attachToNode(int chainEnd, int node)
+{
+    Chain &c(chains_[chainEnd >> 1]);
+    c.node[chainEnd & 1] = node;
+    if(c.node[0] != OPEN_END && c.node[1] != OPEN_END)
+        emitEdge(chainEnd >> 1);
+}
+
+void CrackEdgeTracer::joinChains(
+    int chainEnd1, int chainEnd2, const vigra::Point2D &corner)
+{
+    const Vector2 pos(corner.x - 0.5, corner.y - 0.5);
+
+    if((chainEnd1 >> 1) == (chainEnd2 >> 1))
+    {
+        closeLoop(chainEnd1 >> 1, pos);
+        return;
+    }
+
+    // append the shorter chain to the longer one:
+    if(chains_[chainEnd1 >> 1].points.size() <
+       chains_[chainEnd2 >> 1].points.size())
+        std::swap(chainEnd1, chainEnd2);
+
+    Chain &c1(chains_[chainEnd1 >> 1]), &c2(chains_[chainEnd2 >> 1]);
+    int end1 = chainEnd1 & 1, end2 = chainEnd2 & 1;
+
+    extendChain(chainEnd1, pos);
+    if(end2)
+    {
+        for(std::deque<Vector2>::reverse_iterator it = c2.points.rbegin();
+            it != c2.points.rend(); ++it)
+            extendChain(chainEnd1, *it);
+    }
+    else
+    {
+        for(std::deque<Vector2>::iterator it = c2.points.begin();
+            it != c2.points.end(); ++it)
+            extendChain(chainEnd1, *it);
+    }
+
+    // the other end of c2 becomes end1 of c1:
+    c1.node[end1] = c2.node[1 - end2];
+    if(c1.node[end1] == OPEN_END)
+        attachToSlot(chainEnd1, c2.slot[1 - end2]);
+    if(c2.loopStart.y < c1.loopStart.y ||
+       (c2.loopStart.y == c1.loopStart.y && c2.loopStart.x < c1.loopStart.x))
+        c1.loopStart = c2.loopStart;
+    freeChain(chainEnd2 >> 1);
+
+    if(c1.node[0] != OPEN_END && c1.node[1] != OPEN_END)
+        emitEdge(chainEnd1 >> 1);
+}
+
+void CrackEdgeTracer::closeLoop(int chain, const Vector2 &pos)
+{
+    Chain &c(chains_[chain]);
+    c.points.push_back(pos);
+
+    // start the loop at its upper left corner (first one in scan
+    // order), like CrackEdgeMapGenerator does with CONN_MAYBE_NODE:
+    Vector2 startPos(c.loopStart.x - 0.5, c.loopStart.y - 0.5);
+    std::deque<Vector2>::iterator start =
+        std::find(c.points.begin(), c.points.end(), startPos);
+    vigra_assert(start != c.points.end(), "closeLoop: loop start lost");
+
+    std::rotate(c.points.begin(), start, c.points.end());
+    c.points.push_back(startPos);
+
+    int node = addNode(startPos);
+    addEdge(node, node, c.points, c.loopStart);
+    freeChain(chain);
+}
+
+void CrackEdgeTracer::emitEdge(int chain)
+{
+    Chain &c(chains_[chain]);
+    addEdge(c.node[0], c.node[1], c.points, c.loopStart);
+    freeChain(chain);
+}
+
+/********************************************************************/
+
+void StreamingCrackEdgeMapGenerator::initializeMap(bool initLabelImage)
+{
+    initializeCrackEdgeMap(*result, initLabelImage);
+}
+
+int StreamingCrackEdgeMapGenerator::addNode(const Vector2 &pos)
+{
+    return result->addNode(pos)->label();
+}
+
+void StreamingCrackEdgeMapGenerator::addEdge(
+    int startNode, int endNode, std::deque<Vector2> &points,
+    const vigra::Point2D &)
+{
+    result->addEdge(*result->node(startNode), *result->node(endNode),
+                    Vector2Array(points.begin(), points.end()));
+}
+
+/********************************************************************/
+
+void ParallelCrackEdgeMapGenerator::initializeMap(bool initLabelImage)
+{
+    initializeCrackEdgeMap(*result, initLabelImage);
+}
+
+int ParallelCrackEdgeMapGenerator::StripTracer::addNode(const Vector2 &pos)
+{
+    nodes.push_back(pos);
+    return nodes.size() - 1;
+}
+
+void ParallelCrackEdgeMapGenerator::StripTracer::addEdge(
+    int startNode, int endNode, std::deque<Vector2> &points,
+    const vigra::Point2D &loopStart)
+{
+    int piece = pieces.size();
+    pieces.push_back(Piece());
+
+    Piece &p(pieces.back());
+    p.points.swap(points);
+    p.node[0] = startNode;
+    p.node[1] = endNode;
+    p.loopStart = loopStart;
+    p.stitched = false;
+
+    for(int end = 0; end < 2; ++end)
+    {
+        if(p.node[end] >= 0)
+            continue;
+        int border = -2 - p.node[end];
+        if(border & 1)
+            bottomEnds[border >> 1] = 2*piece + end;
+        else
+            topEnds[border >> 1] = 2*piece + end;
+    }
+}
+
+void ParallelCrackEdgeMapGenerator::stitchStrips()
+{
+    for(unsigned int strip = 0; strip < strips_.size(); ++strip)
+    {
+        StripTracer &tracer(*strips_[strip]);
+        tracer.nodeLabels.resize(tracer.nodes.size());
+        for(unsigned int i = 0; i < tracer.nodes.size(); ++i)
+            tracer.nodeLabels[i] = result->addNode(tracer.nodes[i])->label();
+    }
+
+    // first, all edges between nodes:
+    for(unsigned int strip = 0; strip < strips_.size(); ++strip)
+    {
+        StripTracer &tracer(*strips_[strip]);
+        for(unsigned int i = 0; i < tracer.pieces.size(); ++i)
+        {
+            Piece &p(tracer.pieces[i]);
+            if(p.stitched)
+                continue;
+            if(p.node[0] >= 0)
+                stitchEdge(strip, 2*i);
+            else if(p.node[1] >= 0)
+                stitchEdge(strip, 2*i + 1);
+        }
+    }
+
+    // the remaining pieces belong to contours without nodes:
+    for(unsigned int strip = 0; strip < strips_.size(); ++strip)
+    {
+        StripTracer &tracer(*strips_[strip]);
+        for(unsigned int i = 0; i < tracer.pieces.size(); ++i)
+            if(!tracer.pieces[i].stitched)
+                stitchEdge(strip, 2*i);
+    }
+
+    strips_.clear();
+}
+
+void ParallelCrackEdgeMapGenerator::stitchEdge(int startStrip, int startPieceEnd)
+{
+    Vector2Array points;
+    vigra::Point2D loopStart(0x7fffffff, 0x7fffffff);
+
+    int strip = startStrip, pieceEnd = startPieceEnd, startNode, endNode;
+    {
+        const Piece &p(strips_[strip]->pieces[pieceEnd >> 1]);
+        startNode = (p.node[pieceEnd & 1] >= 0
+                     ? (int)strips_[strip]->nodeLabels[p.node[pieceEnd & 1]]
+                     : -1);
+    }
+
+    while(true)
+    {
+        Piece &p(strips_[strip]->pieces[pieceEnd >> 1]);
+        p.stitched = true;
+
+        // the first point equals the last one of the previous piece:
+        int skip = points.size() ? 1 : 0;
+        if(pieceEnd & 1)
+            points.insert(points.end(),
+                          p.points.rbegin() + skip, p.points.rend());
+        else
+            points.insert(points.end(),
+                          p.points.begin() + skip, p.points.end());
+        std::deque<Vector2>().swap(p.points);
+
+        if(p.loopStart.y < loopStart.y ||
+           (p.loopStart.y == loopStart.y && p.loopStart.x < loopStart.x))
+            loopStart = p.loopStart;
+
+        int end = p.node[1 - (pieceEnd & 1)];
+        if(end >= 0)
+        {
+            endNode = strips_[strip]->nodeLabels[end];
+            break;
+        }
+
+        // continue with the piece on the other side of the strip border:
+        int border = -2 - end;
+        if(border & 1)
+            pieceEnd = strips_[++strip]->topEnds[border >> 1];
+        else
+            pieceEnd = strips_[--strip]->bottomEnds[border >> 1];
+
+        if(strip == startStrip && pieceEnd == startPieceEnd)
+        {
+            // closed contour without nodes; start it at its upper
+            // left corner like CrackEdgeTracer::closeLoop():
+            Vector2 startPos(loopStart.x - 0.5, loopStart.y - 0.5);
+            points.erase(points.end() - 1);
+            std::rotate(points.begin(),
+                        std::find(points.begin(), points.end(), startPos),
+                        points.end());
+            points.push_back(startPos);
+            startNode = endNode = result->addNode(startPos)->label();
+            break;
+        }
+    }
+
+    result->addEdge(*result->node(startNode), *result->node(endNode), points);
+}
+
 void crackEdgesToMidcracks(GeoMap &geomap)
 {
     for(GeoMap::EdgeIterator it = geomap.edgesBegin(); it.inRange(); ++it)
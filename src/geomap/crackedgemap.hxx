@@ -30,10 +30,15 @@
 #define CRACKEDGEMAP_HXX
 
 #include "cppmap.hxx"
+#include "threading.hxx"
 #include "vigra/crackconnections.hxx"
 #include <vigra/stdimage.hxx>
 #include <vigra/pixelneighborhood.hxx>
+#include <boost/shared_ptr.hpp>
+#include <algorithm>
+#include <deque>
 #include <memory>
+#include <vector>
 
 class CrackEdgeMapGenerator
 {
@@ -194,6 +199,311 @@ void CrackEdgeMapGenerator::getSourceLabels(vigra::pair<SrcImageIterator, SrcAcc
     }
 }
 
+/**
+ * Traces crack edges through consecutive rows of pixel corners,
+ * given their crack connections (as computed by cornerConnections()).
+ * Nodes and finished edges are passed to addNode() / addEdge().  Only
+ * O(width) working memory is needed, apart from the geometry of the
+ * edges that still cross the current row.
+ *
+ * When the rows are processed in horizontal strips (see beginStrip()
+ * / endStrip()), edges may also end at the strip's upper or lower
+ * border.  These ends are passed to addEdge() as negative node ids,
+ * cf. topBorder() / bottomBorder().
+ */
+class CrackEdgeTracer
+{
+  public:
+    CrackEdgeTracer(int width)
+    : down_(width + 1, -1),
+      right_(-1)
+    {}
+
+    virtual ~CrackEdgeTracer()
+    {}
+
+        /// compute the crack connections (same bits as
+        /// CrackEdgeMapGenerator::crackConnections after
+        /// makeCCSymmetric() and markEightConnectedRegions()) of
+        /// the pixel corners of row y, i.e. between pixel rows y-1
+        /// and y (size.x + 1 corners)
+    template <class SrcImageIterator, class SrcAccessor>
+    static void cornerConnections(
+        SrcImageIterator sul, SrcAccessor sa, vigra::Size2D size, int y,
+        bool eightConnectedRegions, std::vector<int> &connections);
+
+        /// start a strip at row y > 0; the cracks from row y-1 to row
+        /// y start edges with a topBorder() end
+    void beginStrip(int y, const std::vector<int> &connections);
+
+    void processCornerRow(int y, const std::vector<int> &connections);
+
+        /// end a strip after the last processed row; cracks leading
+        /// further down end their edges with a bottomBorder() end
+    void endStrip();
+
+    static int topBorder(int x)
+    {
+        return -2 - 2*x;
+    }
+
+    static int bottomBorder(int x)
+    {
+        return -3 - 2*x;
+    }
+
+  protected:
+    enum { OPEN_END = -1, RIGHT_SLOT = -1 };
+
+        /// partial edge crossing the current row of pixel corners;
+        /// each end is either attached to a node (or strip border),
+        /// or open (i.e. stored in down_ / right_, whose index is
+        /// kept in slot[end])
+    struct Chain
+    {
+        std::deque<Vector2> points;
+        int node[2], slot[2];
+        vigra::Point2D loopStart;
+    };
+
+    std::deque<Chain> chains_;
+    std::vector<int> freeChains_;
+        /// open chain ends (chain index * 2 + end) of the vertical
+        /// cracks below the current row / the crack to the right of
+        /// the current corner, or -1
+    std::vector<int> down_;
+    int right_;
+
+        /// returns the id of the new node
+    virtual int addNode(const Vector2 &pos) = 0;
+
+        /// `points` may be swapped out; `loopStart` is the upper left
+        /// corner of the edge's RIGHT | DOWN corners, used for closing
+        /// contours without nodes that cross strip borders
+    virtual void addEdge(int startNode, int endNode,
+                         std::deque<Vector2> &points,
+                         const vigra::Point2D &loopStart) = 0;
+
+    int newChain(const vigra::Point2D &corner, int node);
+    void freeChain(int chain);
+    void extendChain(int chainEnd, const Vector2 &pos);
+    void attachToSlot(int chainEnd, int slot);
+    void attachToNode(int chainEnd, int node);
+    void joinChains(int chainEnd1, int chainEnd2,
+                    const vigra::Point2D &corner);
+    void closeLoop(int chain, const Vector2 &pos);
+    void emitEdge(int chain);
+};
+
+template <class SrcImageIterator, class SrcAccessor>
+void CrackEdgeTracer::cornerConnections(
+    SrcImageIterator sul, SrcAccessor sa, vigra::Size2D size, int y,
+    bool eightConnectedRegions, std::vector<int> &connections)
+{
+    typedef CrackEdgeMapGenerator CEMG;
+
+    // same connections as crackConnectionImage() followed by
+    // makeCCSymmetric() and markEightConnectedRegions(), but only
+    // for the corners of row y (between pixel rows y-1 and y):
+    for(int x = 0; x <= size.x; ++x)
+    {
+        int conn = 0;
+
+        if(x < size.x &&
+           (y == 0 || y == size.y ||
+            sa(sul, vigra::Diff2D(x, y - 1)) != sa(sul, vigra::Diff2D(x, y))))
+            conn |= CEMG::CONN_RIGHT;
+        if(y < size.y &&
+           (x == 0 || x == size.x ||
+            sa(sul, vigra::Diff2D(x - 1, y)) != sa(sul, vigra::Diff2D(x, y))))
+            conn |= CEMG::CONN_DOWN;
+        if(x > 0 && (connections[x - 1] & CEMG::CONN_RIGHT))
+            conn |= CEMG::CONN_LEFT;
+        if(y > 0 &&
+           (x == 0 || x == size.x ||
+            sa(sul, vigra::Diff2D(x - 1, y - 1)) != sa(sul, vigra::Diff2D(x, y - 1))))
+            conn |= CEMG::CONN_UP;
+
+        if(eightConnectedRegions && conn == CEMG::CONN_ALL4)
+        {
+            if(sa(sul, vigra::Diff2D(x, y)) ==
+               sa(sul, vigra::Diff2D(x - 1, y - 1)))
+                conn |= CEMG::CONN_DIAG_UPLEFT;
+            if(sa(sul, vigra::Diff2D(x - 1, y)) ==
+               sa(sul, vigra::Diff2D(x, y - 1)))
+                conn |= CEMG::CONN_DIAG_UPRIGHT;
+
+            // crossing regions?
+            if((conn & CEMG::CONN_DIAG) == CEMG::CONN_DIAG)
+            {
+                // preserve connectedness of higher label:
+                if(sa(sul, vigra::Diff2D(x, y - 1)) >
+                   sa(sul, vigra::Diff2D(x - 1, y - 1)))
+                    conn -= CEMG::CONN_DIAG_UPLEFT;
+                else
+                    conn -= CEMG::CONN_DIAG_UPRIGHT;
+            }
+        }
+
+        connections[x] = conn;
+    }
+}
+
+/**
+ * Single-pass alternative to CrackEdgeMapGenerator: scans the label
+ * image two rows at a time, derives the crack connections of each
+ * row of pixel corners on the fly and emits every crack edge as soon
+ * as both of its ends have reached a node.  Apart from the resulting
+ * GeoMap and the geometry of edges still crossing the current row,
+ * only O(width) working memory is needed (no crackConnections /
+ * nodeImage of the full image size).
+ *
+ * The resulting graph is the same as that of CrackEdgeMapGenerator
+ * (up to node / edge labels and edge directions); closed contours
+ * without any node get a node at their upper left corner.
+ */
+class StreamingCrackEdgeMapGenerator : protected CrackEdgeTracer
+{
+  public:
+    template <class SrcImageIterator, class SrcAccessor>
+    StreamingCrackEdgeMapGenerator(
+        vigra::triple<SrcImageIterator, SrcImageIterator, SrcAccessor> src,
+        bool eightConnectedRegions = false)
+    : CrackEdgeTracer((src.second - src.first).x),
+      result(new GeoMap(vigra::Size2D(src.second - src.first)))
+    {
+        vigra::Size2D size(src.second - src.first);
+        std::vector<int> connections(size.x + 1);
+
+        for(int y = 0; y <= size.y; ++y)
+        {
+            cornerConnections(src.first, src.third, size, y,
+                              eightConnectedRegions, connections);
+            processCornerRow(y, connections);
+        }
+    }
+
+    std::auto_ptr<GeoMap> result;
+
+    void initializeMap(bool initLabelImage);
+
+  protected:
+    virtual int addNode(const Vector2 &pos);
+    virtual void addEdge(int startNode, int endNode,
+                         std::deque<Vector2> &points,
+                         const vigra::Point2D &loopStart);
+};
+
+/**
+ * Parallel variant of StreamingCrackEdgeMapGenerator: splits the
+ * corner rows into horizontal strips, traces the crack edges within
+ * each strip concurrently and finally stitches the pieces of edges
+ * crossing strip borders into single edges.  The resulting graph is
+ * the same as that of StreamingCrackEdgeMapGenerator (up to node /
+ * edge labels and edge directions).
+ */
+class ParallelCrackEdgeMapGenerator
+{
+  public:
+    template <class SrcImageIterator, class SrcAccessor>
+    ParallelCrackEdgeMapGenerator(
+        vigra::triple<SrcImageIterator, SrcImageIterator, SrcAccessor> src,
+        bool eightConnectedRegions = false,
+        unsigned int threadCount = 0);
+
+    std::auto_ptr<GeoMap> result;
+
+    void initializeMap(bool initLabelImage);
+
+  protected:
+        /// edge (piece) traced within a single strip
+    struct Piece
+    {
+        std::deque<Vector2> points;
+        int node[2];
+        vigra::Point2D loopStart;
+        bool stitched;
+    };
+
+    class StripTracer : public CrackEdgeTracer
+    {
+      public:
+        StripTracer(int width)
+        : CrackEdgeTracer(width),
+          topEnds(width + 1, -1),
+          bottomEnds(width + 1, -1)
+        {}
+
+        std::vector<Vector2> nodes;
+        std::vector<CellLabel> nodeLabels;
+        std::deque<Piece> pieces;
+            /// piece ends (piece index * 2 + end) at the strip
+            /// borders, indexed by x
+        std::vector<int> topEnds, bottomEnds;
+
+      protected:
+        virtual int addNode(const Vector2 &pos);
+        virtual void addEdge(int startNode, int endNode,
+                             std::deque<Vector2> &points,
+                             const vigra::Point2D &loopStart);
+    };
+
+    std::vector<boost::shared_ptr<StripTracer> > strips_;
+
+    void stitchStrips();
+    void stitchEdge(int strip, int pieceEnd);
+};
+
+template <class SrcImageIterator, class SrcAccessor>
+ParallelCrackEdgeMapGenerator::ParallelCrackEdgeMapGenerator(
+    vigra::triple<SrcImageIterator, SrcImageIterator, SrcAccessor> src,
+    bool eightConnectedRegions, unsigned int threadCount)
+: result(new GeoMap(vigra::Size2D(src.second - src.first)))
+{
+    vigra::Size2D size(src.second - src.first);
+    threadCount = ::detail::resolveThreadCount(threadCount);
+
+    // strips of at least 16 corner rows:
+    int rows = size.y + 1,
+        stripCount = std::max(1, std::min((int)threadCount, rows / 16));
+    for(int strip = 0; strip < stripCount; ++strip)
+        strips_.push_back(
+            boost::shared_ptr<StripTracer>(new StripTracer(size.x)));
+
+    ::detail::ParallelErrors errors;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(threadCount)
+#endif
+    for(int strip = 0; strip < stripCount; ++strip)
+    {
+        try
+        {
+            StripTracer &tracer(*strips_[strip]);
+            int beginRow = ::detail::bandBegin(rows, stripCount, strip),
+                  endRow = ::detail::bandBegin(rows, stripCount, strip + 1);
+
+            std::vector<int> connections(size.x + 1);
+            for(int y = beginRow; y < endRow; ++y)
+            {
+                CrackEdgeTracer::cornerConnections(
+                    src.first, src.third, size, y,
+                    eightConnectedRegions, connections);
+                if(y == beginRow && y > 0)
+                    tracer.beginStrip(y, connections);
+                tracer.processCornerRow(y, connections);
+            }
+            tracer.endStrip();
+        }
+        catch(std::exception &e)
+        {
+            errors.capture(e);
+        }
+    }
+    errors.rethrow();
+
+    stitchStrips();
+}
+
 void crackEdgesToMidcracks(GeoMap &geomap);
 
 /**
@@ -0,0 +1,254 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2007-2019 by Hans Meine                      */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef DYNAMICCOSTQUEUE_HXX
+#define DYNAMICCOSTQUEUE_HXX
+
+#include <vigra/error.hxx>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+/**
+ * Priority queue over a fixed range of integer indices (e.g. edge
+ * labels), which supports changing the cost of an already inserted
+ * index.  top() / pop() always return the (index, cost) pair with the
+ * lowest cost (ties are broken by index).
+ *
+ * The queue is implemented as an implicit d-ary heap (ARITY
+ * children per node, default 4) stored in a contiguous array of
+ * indices, plus two arrays indexed by the index itself that store
+ * the costs and the current heap positions.  Thus, setCost() and
+ * erase() work in O(log n) without any per-entry allocations, and
+ * build() initializes the queue with n entries in O(n).
+ */
+template<class COST, unsigned int ARITY = 4>
+class DynamicCostQueue
+{
+  public:
+    typedef unsigned int                   IndexType;
+    typedef COST                           CostType;
+    typedef std::pair<IndexType, CostType> value_type;
+    typedef std::vector<IndexType>::size_type size_type;
+
+    DynamicCostQueue(size_type maxIndex)
+    : costs_(maxIndex),
+      heapPos_(maxIndex, NOT_IN_HEAP)
+    {}
+
+    bool empty() const
+    {
+        return heap_.empty();
+    }
+
+    size_type size() const
+    {
+        return heap_.size();
+    }
+
+        /// the size of the index range (i.e. the max. index + 1)
+    size_type maxIndex() const
+    {
+        return costs_.size();
+    }
+
+    bool contains(IndexType index) const
+    {
+        return index < heapPos_.size() && heapPos_[index] != NOT_IN_HEAP;
+    }
+
+    CostType cost(IndexType index) const
+    {
+        vigra_precondition(contains(index),
+                           "DynamicCostQueue::cost(): index not in queue");
+        return costs_[index];
+    }
+
+    value_type top() const
+    {
+        vigra_precondition(!empty(), "DynamicCostQueue::top(): queue is empty");
+        return value_type(heap_[0], costs_[heap_[0]]);
+    }
+
+    void insert(IndexType index, CostType cost)
+    {
+        vigra_precondition(index < heapPos_.size(),
+                           "DynamicCostQueue::insert(): index out of range");
+        vigra_precondition(heapPos_[index] == NOT_IN_HEAP,
+                           "DynamicCostQueue::insert(): index already in queue");
+        costs_[index] = cost;
+        heapPos_[index] = heap_.size();
+        heap_.push_back(index);
+        moveUp(heap_.size() - 1);
+    }
+
+        /// change the cost of the given index, inserting it if necessary
+    void setCost(IndexType index, CostType cost)
+    {
+        if(!contains(index))
+        {
+            insert(index, cost);
+            return;
+        }
+
+        CostType oldCost = costs_[index];
+        costs_[index] = cost;
+        if(cost < oldCost)
+            moveUp(heapPos_[index]);
+        else
+            moveDown(heapPos_[index]);
+    }
+
+        /// remove the given index from the queue (if present)
+    bool erase(IndexType index)
+    {
+        if(!contains(index))
+            return false;
+        removeAt(heapPos_[index]);
+        return true;
+    }
+
+    value_type pop()
+    {
+        value_type result(top());
+        removeAt(0);
+        return result;
+    }
+
+    void clear()
+    {
+        for(size_type i = 0; i < heap_.size(); ++i)
+            heapPos_[heap_[i]] = NOT_IN_HEAP;
+        heap_.clear();
+    }
+
+        /**
+         * Bulk insertion of the indices in [indices, indicesEnd) with
+         * the costs given by the corresponding elements of the range
+         * starting at costs.  Indices that are already contained get
+         * their costs changed (the last given cost wins).  The heap
+         * property is restored once at the end (Floyd's heapify), so
+         * this is O(size()) instead of O(n log n) for single inserts.
+         */
+    template<class INDEX_ITERATOR, class COST_ITERATOR>
+    void build(INDEX_ITERATOR indices, INDEX_ITERATOR indicesEnd,
+               COST_ITERATOR costs)
+    {
+        for(; indices != indicesEnd; ++indices, ++costs)
+        {
+            IndexType index = *indices;
+            vigra_precondition(index < heapPos_.size(),
+                               "DynamicCostQueue::build(): index out of range");
+            costs_[index] = *costs;
+            if(heapPos_[index] == NOT_IN_HEAP)
+            {
+                heapPos_[index] = heap_.size();
+                heap_.push_back(index);
+            }
+        }
+
+        if(heap_.size() < 2)
+            return;
+        for(size_type pos = (heap_.size() - 2) / ARITY + 1; pos-- > 0; )
+            moveDown(pos);
+    }
+
+  protected:
+    enum { NOT_IN_HEAP = ~0U };
+
+    bool less(IndexType i1, IndexType i2) const
+    {
+        return costs_[i1] < costs_[i2] ||
+            (!(costs_[i2] < costs_[i1]) && i1 < i2);
+    }
+
+    void place(size_type pos, IndexType index)
+    {
+        heap_[pos] = index;
+        heapPos_[index] = pos;
+    }
+
+    void moveUp(size_type pos)
+    {
+        IndexType index = heap_[pos];
+        while(pos > 0)
+        {
+            size_type parent = (pos - 1) / ARITY;
+            if(!less(index, heap_[parent]))
+                break;
+            place(pos, heap_[parent]);
+            pos = parent;
+        }
+        place(pos, index);
+    }
+
+    void moveDown(size_type pos)
+    {
+        IndexType index = heap_[pos];
+        size_type count = heap_.size();
+        while(true)
+        {
+            size_type firstChild = ARITY*pos + 1;
+            if(firstChild >= count)
+                break;
+            size_type childEnd = std::min(firstChild + ARITY, count),
+                      best = firstChild;
+            for(size_type child = firstChild + 1; child < childEnd; ++child)
+                if(less(heap_[child], heap_[best]))
+                    best = child;
+            if(!less(heap_[best], index))
+                break;
+            place(pos, heap_[best]);
+            pos = best;
+        }
+        place(pos, index);
+    }
+
+    void removeAt(size_type pos)
+    {
+        IndexType removed = heap_[pos];
+        IndexType last = heap_.back();
+        heap_.pop_back();
+        heapPos_[removed] = NOT_IN_HEAP;
+        if(pos == heap_.size())
+            return;
+
+        place(pos, last);
+        if(pos > 0 && less(last, heap_[(pos - 1) / ARITY]))
+            moveUp(pos);
+        else
+            moveDown(pos);
+    }
+
+    std::vector<CostType>  costs_;
+    std::vector<IndexType> heapPos_;
+    std::vector<IndexType> heap_;
+};
+
+#endif // DYNAMICCOSTQUEUE_HXX
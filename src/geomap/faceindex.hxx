@@ -0,0 +1,186 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2007-2019 by Hans Meine                      */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef FACEINDEX_HXX
+#define FACEINDEX_HXX
+
+#include "labellut.hxx"
+#include <vector>
+#include <algorithm>
+
+namespace detail {
+
+/**
+ * Bounding volume hierarchy over labelled axis-aligned boxes (face
+ * bounding boxes), used by GeoMap::faceAt() for point location
+ * without a label image.
+ *
+ * The hierarchy is built once (top-down, median split along the
+ * longest axis) and then kept valid under face merges: instead of
+ * updating the boxes, merged() records the merge in a LabelLUT, so
+ * that the leaves of merged faces report their survivor (whose real
+ * bounding box is the union of the merged ones).
+ */
+template<class BOX>
+class FaceIndex
+{
+  public:
+    typedef BOX                          BoxType;
+    typedef typename BOX::Vector         Vector;
+    typedef LabelLUT::LabelType          LabelType;
+
+    FaceIndex()
+    {}
+
+        /**
+         * Build the hierarchy over the given (box, label) pairs;
+         * maxLabel must be larger than all labels.
+         */
+    void build(std::vector<std::pair<BoxType, LabelType> > &leaves,
+               LabelType maxLabel)
+    {
+        leaves_.swap(leaves);
+        nodes_.clear();
+        mergeLUT_.initIdentity(maxLabel);
+        if(leaves_.size())
+        {
+            nodes_.resize(1);
+            buildNode(0, 0, leaves_.size());
+        }
+    }
+
+        /// record that face merged has been merged into survivor
+    void merged(LabelType merged, LabelType survivor)
+    {
+        mergeLUT_.relabel(merged, survivor);
+    }
+
+        /**
+         * Append the (current) labels of all faces whose bounding box
+         * (closed) contains point to result, without duplicates.
+         */
+    template<class POINT>
+    void candidates(const POINT &point, std::vector<LabelType> &result) const
+    {
+        if(nodes_.empty())
+            return;
+
+        unsigned int stack[64], stackSize = 0;
+        stack[stackSize++] = 0;
+        while(stackSize)
+        {
+            const Node &node(nodes_[stack[--stackSize]]);
+            if(!contains(node.box, point))
+                continue;
+            if(node.firstChild)
+            {
+                stack[stackSize++] = node.firstChild;
+                stack[stackSize++] = node.firstChild + 1;
+                continue;
+            }
+            for(unsigned int i = node.begin; i < node.end; ++i)
+            {
+                if(!contains(leaves_[i].first, point))
+                    continue;
+                LabelType label = mergeLUT_[leaves_[i].second];
+                if(std::find(result.begin(), result.end(), label) == result.end())
+                    result.push_back(label);
+            }
+        }
+    }
+
+  protected:
+    enum { LEAF_SIZE = 4 };
+
+    struct Node
+    {
+        BoxType box;
+        unsigned int begin, end;
+        unsigned int firstChild; // 0 for leaves, else index of left child
+    };
+
+    struct CenterLess
+    {
+        unsigned int axis;
+
+        CenterLess(unsigned int a) : axis(a) {}
+
+        bool operator()(const std::pair<BoxType, LabelType> &a,
+                        const std::pair<BoxType, LabelType> &b) const
+        {
+            return a.first.begin()[axis] + a.first.end()[axis] <
+                b.first.begin()[axis] + b.first.end()[axis];
+        }
+    };
+
+    template<class POINT>
+    static bool contains(const BoxType &box, const POINT &point)
+    {
+        return !(point[0] < box.begin()[0] || point[0] > box.end()[0] ||
+                 point[1] < box.begin()[1] || point[1] > box.end()[1]);
+    }
+
+        // fills nodes_[index] with the subtree for leaves_[begin, end)
+    void buildNode(unsigned int index, unsigned int begin, unsigned int end)
+    {
+        BoxType box;
+        for(unsigned int i = begin; i < end; ++i)
+            box |= leaves_[i].first;
+
+        nodes_[index].box = box;
+        nodes_[index].begin = begin;
+        nodes_[index].end = end;
+        nodes_[index].firstChild = 0;
+        if(end - begin <= LEAF_SIZE)
+            return;
+
+        // median split -> logarithmic depth, so that the fixed-size
+        // stack in candidates() suffices:
+        Vector extent(box.end() - box.begin());
+        unsigned int mid = (begin + end) / 2;
+        std::nth_element(leaves_.begin() + begin, leaves_.begin() + mid,
+                         leaves_.begin() + end,
+                         CenterLess(extent[1] > extent[0] ? 1 : 0));
+
+        // children must be adjacent (firstChild, firstChild + 1):
+        unsigned int left = nodes_.size();
+        nodes_.resize(left + 2);
+        nodes_[index].firstChild = left;
+        buildNode(left, begin, mid);
+        buildNode(left + 1, mid, end);
+    }
+
+    std::vector<std::pair<BoxType, LabelType> > leaves_;
+    std::vector<Node> nodes_;
+    LabelLUT mergeLUT_;
+};
+
+} // namespace detail
+
+#endif // FACEINDEX_HXX
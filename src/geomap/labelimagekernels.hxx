@@ -0,0 +1,126 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2007-2019 by Hans Meine                      */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef LABELIMAGEKERNELS_HXX
+#define LABELIMAGEKERNELS_HXX
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Row kernels for the label image updates of GeoMap's Euler
+// operations (rawAddEdgeToLabelImage(), markEdgeInLabelImage() and
+// removeEdgeFromLabelImage() in cppmap.cxx), operating on contiguous
+// ranges of a dense label image row.  With SSE2 (always available on
+// x86-64), four labels are processed at once; the scalar loops are
+// the fallback and handle the remaining pixels.
+
+namespace detail {
+
+inline void addToLabels(int *begin, int *end, int diff)
+{
+#ifdef __SSE2__
+    const __m128i vdiff = _mm_set1_epi32(diff);
+    for(; end - begin >= 4; begin += 4)
+    {
+        __m128i labels = _mm_loadu_si128((const __m128i *)begin);
+        _mm_storeu_si128((__m128i *)begin, _mm_add_epi32(labels, vdiff));
+    }
+#endif
+    for(; begin != end; ++begin)
+        *begin += diff;
+}
+
+    // label >= 0 ? -1 : label - 1 (i.e. count the edges crossing
+    // each pixel as negative labels)
+inline void markEdgeLabels(int *begin, int *end)
+{
+#ifdef __SSE2__
+    const __m128i minusOne = _mm_set1_epi32(-1);
+    for(; end - begin >= 4; begin += 4)
+    {
+        __m128i labels = _mm_loadu_si128((const __m128i *)begin);
+        // all bits set for labels >= 0, which then become -1:
+        __m128i faceMask = _mm_cmpgt_epi32(labels, minusOne);
+        _mm_storeu_si128(
+            (__m128i *)begin,
+            _mm_or_si128(faceMask, _mm_add_epi32(labels, minusOne)));
+    }
+#endif
+    for(; begin != end; ++begin)
+        *begin = (*begin >= 0 ? -1 : *begin - 1);
+}
+
+    // Labels == -1 (crossed by no other edge) are replaced by
+    // substituteLabel, and their offsets from begin are stored in
+    // positions (which must have room for end - begin entries); all
+    // other labels are incremented.  Returns the number of positions.
+inline unsigned int removeEdgeLabels(int *begin, int *end,
+                                     int substituteLabel, int *positions)
+{
+    unsigned int count = 0;
+    int offset = 0;
+#ifdef __SSE2__
+    const __m128i
+        minusOne = _mm_set1_epi32(-1),
+        substitute = _mm_set1_epi32(substituteLabel);
+    for(; end - begin >= 4; begin += 4, offset += 4)
+    {
+        __m128i labels = _mm_loadu_si128((const __m128i *)begin);
+        __m128i freeMask = _mm_cmpeq_epi32(labels, minusOne);
+        // blend substituteLabel / label + 1:
+        _mm_storeu_si128(
+            (__m128i *)begin,
+            _mm_or_si128(_mm_and_si128(freeMask, substitute),
+                         _mm_andnot_si128(freeMask,
+                                          _mm_sub_epi32(labels, minusOne))));
+
+        // compress-store the offsets of the freed pixels:
+        int bits = _mm_movemask_ps(_mm_castsi128_ps(freeMask));
+        if(!bits)
+            continue;
+        for(int i = 0; i < 4; ++i)
+        {
+            positions[count] = offset + i;
+            count += (bits >> i) & 1;
+        }
+    }
+#endif
+    for(; begin != end; ++begin, ++offset)
+    {
+        int isFree = (*begin == -1);
+        *begin = isFree ? substituteLabel : *begin + 1;
+        positions[count] = offset;
+        count += isFree;
+    }
+    return count;
+}
+
+} // namespace detail
+
+#endif // LABELIMAGEKERNELS_HXX
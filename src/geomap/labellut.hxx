@@ -30,7 +30,20 @@
 #define LABELLUT_HXX
 
 #include <vector>
-
+#include <iterator>  // std::forward_iterator_tag
+
+/**
+ * Maps (original) labels to the labels they have been merged into.
+ * Every label points directly to the representative of its set, so
+ * that lookups are a flat O(1) table access (they are performed for
+ * every pixel read from a GeoMap's label image).  relabel() re-links
+ * only the members of the smaller of both sets (union by size), so
+ * every label is re-linked at most log2(size()) times, instead of
+ * all labels merged into the 'from' label each time.
+ *
+ * In addition, all original labels merged into a label are kept in a
+ * list that can be traversed with mergedBegin().
+ */
 class LabelLUT
 {
   public:
@@ -94,55 +107,73 @@ class LabelLUT
     {}
 
     LabelLUT(unsigned int size)
-    : labelLUT_(size),
-      prevMerged_(size)
     {
         initIdentity(size);
     }
 
     void initIdentity(unsigned int size)
     {
-        labelLUT_.resize(size);
+        parent_.resize(size);
+        rootLabel_.resize(size);
+        setSize_.resize(size);
         prevMerged_.resize(size);
+        lastMerged_.resize(size);
         for(unsigned int i = 0; i < size; ++i)
         {
-            labelLUT_[i] = i;
+            parent_[i] = i;
+            rootLabel_[i] = i;
+            setSize_[i] = 1;
             prevMerged_[i] = i;
+            lastMerged_[i] = i;
         }
     }
 
     void appendOne()
     {
-        labelLUT_.push_back(labelLUT_.size());
-        prevMerged_.push_back(prevMerged_.size());
+        LabelType label = parent_.size();
+        parent_.push_back(label);
+        rootLabel_.push_back(label);
+        setSize_.push_back(1);
+        prevMerged_.push_back(label);
+        lastMerged_.push_back(label);
     }
 
     LabelType operator[](size_type index) const
     {
-        return labelLUT_[index];
+        return rootLabel_[parent_[index]];
     }
 
     size_type size() const
     {
-        return labelLUT_.size();
+        return parent_.size();
     }
 
+        /**
+         * Let all labels currently mapped to from be mapped to to.
+         * Both from and to must be current (i.e. unmerged) labels.
+         */
     void relabel(LabelType from, LabelType to)
     {
-        // relabel elements in "from" list:
-        LabelType prev;
-        for(LabelType fromIt = from; true; fromIt = prev)
+        // union by size; the resulting set is labeled "to" in any case:
+        LabelType fromRoot = parent_[from], toRoot = parent_[to];
+        LabelType smaller = from, largerRoot = toRoot, smallerRoot = fromRoot;
+        if(setSize_[fromRoot] > setSize_[toRoot])
         {
-            labelLUT_[fromIt] = to;
-
-            prev = prevMerged_[fromIt];
-            if(prev == fromIt)
-                break;
+            smaller = to;
+            largerRoot = fromRoot;
+            smallerRoot = toRoot;
         }
+        for(MergedIterator it = mergedBegin(smaller); it.inRange(); ++it)
+            parent_[*it] = largerRoot;
+        setSize_[largerRoot] += setSize_[smallerRoot];
+        rootLabel_[largerRoot] = to;
 
-        // insert from-list at beginning of to-list:
+        // insert from-list at beginning of to-list (after to itself):
+        LabelType fromLast = lastMerged_[from];
         if(prevMerged_[to] != to)
-            prevMerged_[prev] = prevMerged_[to];
+            prevMerged_[fromLast] = prevMerged_[to];
+        else
+            lastMerged_[to] = fromLast;
         prevMerged_[to] = from;
     }
 
@@ -152,8 +183,12 @@ class LabelLUT
     }
 
   protected:
-    LUTType labelLUT_;
-    LUTType prevMerged_;
+    LUTType parent_;     // representative of each label's set
+    LUTType rootLabel_;  // current label of each set (indexed by root)
+    LUTType setSize_;    // number of original labels (indexed by root)
+
+    LUTType prevMerged_; // singly-linked lists of merged labels
+    LUTType lastMerged_; // tail of each list (valid for list heads)
 };
 
 #endif // LABELLUT_HXX
@@ -35,6 +35,7 @@
 #include <vigra/splines.hxx>
 #include <vigra/linear_solve.hxx>
 #include <vigra/polynomial.hxx>
+#include <boost/shared_ptr.hpp>
 #include <vector>
 #include <cmath>
 #include <algorithm>
@@ -74,6 +75,41 @@ class PointArray
     : points_(b, e)
     {}
 
+    PointArray(const PointArray &other)
+    : points_(other.points_)
+    {}
+
+    ~PointArray()
+    {
+        detachViews(false);
+    }
+
+    PointArray &operator=(const PointArray &other)
+    {
+        if(this != &other)
+        {
+            detachViews(false);
+            points_ = other.points_;
+        }
+        return *this;
+    }
+
+        /**
+         * Owner of the points' memory for views onto it (e.g. numpy
+         * arrays, which keep a reference to the returned pointer).
+         * Before the points are (potentially) modified, i.e. on any
+         * non-const access, the viewed memory is handed over to this
+         * owner, and this array continues with a copy.  Thus, views
+         * never dangle, but show the points as they were when the
+         * views were created.
+         */
+    boost::shared_ptr<InternalVector> viewOwner() const
+    {
+        if(!views_.get())
+            views_.reset(new InternalVector());
+        return views_;
+    }
+
     const_reference operator[](size_type index) const
     {
         return points_[index];
@@ -81,6 +117,7 @@ class PointArray
 
     reference operator[](size_type index)
     {
+        detachViews();
         return points_[index];
     }
 
@@ -96,6 +133,7 @@ class PointArray
 
     iterator begin()
     {
+        detachViews();
         return points_.begin();
     }
 
@@ -106,6 +144,7 @@ class PointArray
 
     iterator end()
     {
+        detachViews();
         return points_.end();
     }
 
@@ -116,6 +155,7 @@ class PointArray
 
     reverse_iterator rbegin()
     {
+        detachViews();
         return points_.rbegin();
     }
 
@@ -126,6 +166,7 @@ class PointArray
 
     reverse_iterator rend()
     {
+        detachViews();
         return points_.rend();
     }
 
@@ -136,6 +177,7 @@ class PointArray
 
     reference front()
     {
+        detachViews();
         return points_.front();
     }
 
@@ -146,19 +188,24 @@ class PointArray
 
     reference back()
     {
+        detachViews();
         return points_.back();
     }
 
     void clear()
     {
+        detachViews(false);
         points_.clear();
     }
 
     void push_back(const_reference v)
     {
+        detachViews();
         points_.push_back(v);
     }
 
+        // (pos must have been obtained after the last call of
+        // viewOwner(), as with any other non-const access)
     void erase(iterator pos)
     {
         points_.erase(pos);
@@ -184,11 +231,14 @@ class PointArray
 
     void swap(PointArray &rhs)
     {
+        detachViews();
+        rhs.detachViews();
         std::swap(points_, rhs.points_);
     }
 
     void reverse()
     {
+        detachViews();
         std::reverse(points_.begin(), points_.end());
     }
 
@@ -220,7 +270,23 @@ class PointArray
     }
 
   protected:
+        // called before any (potential) modification of points_, see
+        // viewOwner(); keepPoints == false discards the points
+    void detachViews(bool keepPoints = true)
+    {
+        if(!views_.get())
+            return;
+        if(!views_.unique())
+        {
+            views_->swap(points_);
+            if(keepPoints)
+                points_ = *views_;
+        }
+        views_.reset();
+    }
+
     InternalVector points_;
+    mutable boost::shared_ptr<InternalVector> views_;
 };
 
 /********************************************************************/
@@ -363,6 +429,7 @@ class Polygon : public PointArray<POINT>
     {
         if(!other.size())
             return;
+        this->detachViews();
 
         const_iterator otherBegin(other.begin());
         if(this->size())
@@ -406,6 +473,7 @@ class Polygon : public PointArray<POINT>
             }
         }
         partialAreaValid_ = false;
+        this->detachViews();
         this->points_[pos] = x;
     }
 
@@ -1702,6 +1770,123 @@ void polygonSplineControlPoints(
 
 /********************************************************************/
 
+/**
+ * Makes a sequence of angles continuous by shifting each one by the
+ * multiple of 2*PI that brings it closest to its predecessor.
+ */
+struct ContinuousDirection
+{
+    double prevAngle, offset;
+
+    ContinuousDirection(double startAngle = 0.0)
+    : prevAngle(startAngle),
+      offset(0.0)
+    {}
+
+    double operator()(double angle)
+    {
+        angle += offset;
+        double diff = angle - prevAngle;
+        if(fabs(diff) > M_PI)
+        {
+            double delta = -floor((diff + M_PI)/(M_PI*2.0))*M_PI*2.0;
+            offset += delta;
+            angle  += delta;
+        }
+        prevAngle = angle;
+        return angle;
+    }
+};
+
+    // Appends (arcLength, angle) pairs to result, with the tangent
+    // angles calculated from each chord between the points with
+    // indices (i-dx, i+dx), ignoring skip points from both ends.
+template<class PointArray, class ResultArray>
+void polygonTangentList(
+    const PointArray &p, int dx, unsigned int skip, ResultArray &result)
+{
+    typedef typename PointArray::value_type Point;
+    typedef typename ResultArray::value_type Pair;
+
+    vigra_precondition(p.size() >= 2*dx + 2*skip,
+        "tangentList: polygon too small (less than 2*dx + 2*skip points)");
+    vigra_precondition(dx >= 1,
+        "tangentList: dx too small (must be >= 1)");
+
+    double pos = 0.0;
+    for(unsigned int i = 0; i < dx + skip - 1; ++i)
+        pos += (p[i+1]-p[i]).magnitude();
+
+    ContinuousDirection makeContinuous;
+
+    for(unsigned int i = skip; i < p.size() - 2*dx - skip; ++i)
+    {
+        Point s(p[i+2*dx] - p[i]);
+
+        pos += (p[i+dx] - p[i+dx-1]).magnitude();
+
+        static const double eps = 1e-14;
+        if(s.squaredMagnitude() < eps)
+            continue;
+
+        result.push_back(
+            Pair(pos, makeContinuous(VIGRA_CSTD::atan2(s[1], s[0]))));
+    }
+}
+
+    // Appends (arcLength, curvature) pairs to result, calculated for
+    // each triangle between the point triples with indices
+    // (i-dx, i, i+dx), ignoring skip points from both ends.
+template<class PointArray, class ResultArray>
+void polygonCurvatureList(
+    const PointArray &p, int dx, unsigned int skip, ResultArray &result)
+{
+    typedef typename PointArray::value_type Point;
+    typedef typename ResultArray::value_type Pair;
+
+    vigra_precondition(p.size() >= 2*dx + 2*skip,
+        "curvatureList: polygon too small (less than 2*dx + 2*skip points).");
+
+    double pos = 0.0;
+    for(unsigned int i = 0; i < dx + skip - 1; ++i)
+        pos += (p[i+1]-p[i]).magnitude();
+
+    for(unsigned int i = skip; i < p.size() - 2*dx - skip; ++i)
+    {
+        Point
+            s1(p[i+  dx] - p[i]),
+            s2(p[i+2*dx] - p[i+dx]),
+            s3(p[i+2*dx] - p[i]);
+
+        double
+            a2 = s1.squaredMagnitude(),
+            b2 = s2.squaredMagnitude(),
+            c2 = s3.squaredMagnitude(),
+            a = sqrt(a2),
+            b = sqrt(b2);
+
+        pos += (p[i+dx] - p[i+dx-1]).magnitude();
+
+        static const double eps = 1e-8;
+        if(a < eps || b < eps)
+            continue;
+
+        double gamma = (a2+b2-c2) / (2*a*b), delta;
+        if(gamma > -1.0)
+        {
+            delta = M_PI - acos(gamma);
+            if((s1[0]*s3[1] - s3[0]*s1[1]) < 0)
+                result.push_back(Pair(pos, -2*delta / (a+b)));
+            else
+                result.push_back(Pair(pos,  2*delta / (a+b)));
+        }
+        else
+            result.push_back(Pair(pos, 0.0));
+    }
+}
+
+/********************************************************************/
+
 struct ScanlineSegment
 {
     int begin, direction, end;
@@ -1747,6 +1932,7 @@ struct Scanlines
 {
     typedef std::vector<ScanlineSegment> Scanline;
     typedef Scanline value_type;
+    typedef const Scanline &const_reference;
 
     int startIndex_;
     std::vector<Scanline> scanLines_;
@@ -1867,6 +2053,233 @@ struct Scanlines
     }
 };
 
+    /** Normalized Scanlines to be merged into FlatScanlines, with a
+     * factor for their directions (-1 for reversed contour parts).
+     */
+struct ScanlinesSource
+{
+    const Scanlines *scanlines;
+    int direction;
+
+    ScanlinesSource(const Scanlines &s, int d = 1)
+    : scanlines(&s), direction(d)
+    {}
+};
+
+/**
+ * Flat (CSR-like) alternative to Scanlines: the segments of all lines
+ * are stored in one array, and lineBegin_[i] is the index of the
+ * first segment of line startIndex() + i.  The lines are always
+ * normalized (sorted, overlapping segments joined); merging several
+ * Scanlines (e.g. those of a face's contour edges) is done by a k-way
+ * merge of their already normalized lines, without any per-line
+ * sorting or erasing.
+ */
+class FlatScanlines
+{
+  public:
+        /// read-only view of the segments of one line
+    class Scanline
+    {
+      public:
+        typedef const ScanlineSegment *const_iterator;
+
+        Scanline(const_iterator begin, const_iterator end)
+        : begin_(begin), end_(end)
+        {}
+
+        unsigned int size() const
+        {
+            return end_ - begin_;
+        }
+
+        const ScanlineSegment &operator[](unsigned int index) const
+        {
+            return begin_[index];
+        }
+
+        const_iterator begin() const
+        {
+            return begin_;
+        }
+
+        const_iterator end() const
+        {
+            return end_;
+        }
+
+      protected:
+        const_iterator begin_, end_;
+    };
+
+    typedef Scanline value_type;
+    typedef Scanline const_reference;
+
+    FlatScanlines()
+    : startIndex_(0),
+      lineBegin_(1, 0)
+    {}
+
+        /// copy of normalized Scanlines
+    explicit FlatScanlines(const Scanlines &scanlines)
+    : startIndex_(0),
+      lineBegin_(1, 0)
+    {
+        merge(std::vector<ScanlinesSource>(1, ScanlinesSource(scanlines)));
+    }
+
+    explicit FlatScanlines(const std::vector<ScanlinesSource> &sources)
+    : startIndex_(0),
+      lineBegin_(1, 0)
+    {
+        merge(sources);
+    }
+
+    int startIndex() const
+    {
+        return startIndex_;
+    }
+
+    int endIndex() const
+    {
+        return startIndex_ + size();
+    }
+
+    unsigned int size() const
+    {
+        return lineBegin_.size() - 1;
+    }
+
+    Scanline operator[](int index) const
+    {
+        index -= startIndex_;
+        const ScanlineSegment *segments =
+            segments_.empty() ? NULL : &segments_[0];
+        return Scanline(segments + lineBegin_[index],
+                        segments + lineBegin_[index + 1]);
+    }
+
+    unsigned int segmentCount() const
+    {
+        return segments_.size();
+    }
+
+        /** Replace the contents by the k-way merge of the given
+         * normalized Scanlines (covering the union of their lines).
+         */
+    void merge(const std::vector<ScanlinesSource> &sources)
+    {
+        segments_.clear();
+        lineBegin_.assign(1, 0);
+
+        std::vector<unsigned int> order;
+        for(unsigned int i = 0; i < sources.size(); ++i)
+            if(sources[i].scanlines->size())
+                order.push_back(i);
+        if(order.empty())
+            return;
+        std::sort(order.begin(), order.end(), StartIndexCompare(sources));
+
+        startIndex_ = sources[order[0]].scanlines->startIndex();
+        int endIndex = startIndex_;
+        for(unsigned int i = 0; i < order.size(); ++i)
+            endIndex = std::max(endIndex, sources[order[i]].scanlines->endIndex());
+        lineBegin_.reserve(endIndex - startIndex_ + 1);
+
+        std::vector<unsigned int> active;
+        std::vector<Cursor> heap;
+        unsigned int next = 0;
+        for(int y = startIndex_; y < endIndex; ++y)
+        {
+            while(next < order.size() &&
+                  sources[order[next]].scanlines->startIndex() == y)
+                active.push_back(order[next++]);
+
+            heap.clear();
+            for(unsigned int i = 0; i < active.size(); )
+            {
+                const ScanlinesSource &source(sources[active[i]]);
+                if(source.scanlines->endIndex() <= y)
+                {
+                    active[i] = active.back();
+                    active.pop_back();
+                    continue;
+                }
+                const Scanlines::Scanline &line((*source.scanlines)[y]);
+                if(line.size())
+                    heap.push_back(Cursor(line, source.direction));
+                ++i;
+            }
+
+            unsigned int lineBegin = segments_.size();
+            std::make_heap(heap.begin(), heap.end());
+            while(heap.size())
+            {
+                std::pop_heap(heap.begin(), heap.end());
+                Cursor &cursor(heap.back());
+
+                ScanlineSegment segment(*cursor.pos);
+                segment.direction *= cursor.direction;
+                if(segments_.size() > lineBegin &&
+                   segment.begin <= segments_.back().end)
+                    segments_.back().joinSuccessor(segment);
+                else
+                    segments_.push_back(segment);
+
+                if(++cursor.pos == cursor.end)
+                    heap.pop_back();
+                else
+                    std::push_heap(heap.begin(), heap.end());
+            }
+            lineBegin_.push_back(segments_.size());
+        }
+    }
+
+    void swap(FlatScanlines &other)
+    {
+        std::swap(startIndex_, other.startIndex_);
+        lineBegin_.swap(other.lineBegin_);
+        segments_.swap(other.segments_);
+    }
+
+  protected:
+        /// position within one source line; ordered s.t. the heap's
+        /// top is the cursor with the smallest segment begin
+    struct Cursor
+    {
+        const ScanlineSegment *pos, *end;
+        int direction;
+
+        Cursor(const Scanlines::Scanline &line, int d)
+        : pos(&line[0]), end(&line[0] + line.size()), direction(d)
+        {}
+
+        bool operator<(const Cursor &other) const
+        {
+            return pos->begin > other.pos->begin;
+        }
+    };
+
+    struct StartIndexCompare
+    {
+        const std::vector<ScanlinesSource> &sources;
+
+        StartIndexCompare(const std::vector<ScanlinesSource> &s)
+        : sources(s)
+        {}
+
+        bool operator()(unsigned int a, unsigned int b) const
+        {
+            return sources[a].scanlines->startIndex() <
+                sources[b].scanlines->startIndex();
+        }
+    };
+
+    int startIndex_;
+    std::vector<unsigned int> lineBegin_;
+    std::vector<ScanlineSegment> segments_;
+};
+
 /// iterator over the crossed pixels:
 class ScanlinesIter
 {
@@ -2054,25 +2467,28 @@ std::auto_ptr<Scanlines> scanPoly(
     return result;
 }
 
-template<class DestIterator, class SizeType, class DestAccessor>
+    // variant restricted to the image rows [beginRow, endRow), which
+    // allows several threads to rasterize disjoint row bands:
+template<class SCANLINES, class DestIterator, class SizeType, class DestAccessor>
 unsigned int fillScannedPoly(
-    const Scanlines &scanlines,
+    const SCANLINES &scanlines,
     typename DestAccessor::value_type value,
-    DestIterator dul, SizeType ds, DestAccessor a)
+    DestIterator dul, SizeType ds, DestAccessor a,
+    int beginRow, int endRow)
 {
     bool clean = true;
     unsigned int pixelCount = 0;
 
-    // clip to image range vertically:
-    int y = std::max(0, scanlines.startIndex()),
-     endY = std::min((int)ds[1], scanlines.endIndex());
+    // clip to image range (and requested rows) vertically:
+    int y = std::max(std::max(0, beginRow), scanlines.startIndex()),
+     endY = std::min(std::min((int)ds[1], endRow), scanlines.endIndex());
 
     for(DestIterator row(dul + y); y < endY; ++y, ++row)
     {
         int inside = 0;
         int x = 0;
         typename DestIterator::next_type it(row.begin());
-        const Scanlines::Scanline &scanline(scanlines[y]);
+        typename SCANLINES::const_reference scanline(scanlines[y]);
         for(unsigned int j = 0; j < scanline.size(); ++j)
         {
             // X range checking
@@ -2112,9 +2528,18 @@ unsigned int fillScannedPoly(
     return pixelCount;
 }
 
-template<class DestIterator, class SizeType, class DestAccessor>
+template<class SCANLINES, class DestIterator, class SizeType, class DestAccessor>
 unsigned int fillScannedPoly(
-    const Scanlines &scanlines,
+    const SCANLINES &scanlines,
+    typename DestAccessor::value_type value,
+    DestIterator dul, SizeType ds, DestAccessor a)
+{
+    return fillScannedPoly(scanlines, value, dul, ds, a, 0, (int)ds[1]);
+}
+
+template<class SCANLINES, class DestIterator, class SizeType, class DestAccessor>
+unsigned int fillScannedPoly(
+    const SCANLINES &scanlines,
     typename DestAccessor::value_type value,
     triple<DestIterator, SizeType, DestAccessor> dest)
 {
@@ -2122,23 +2547,36 @@ unsigned int fillScannedPoly(
                            dest.first, dest.second, dest.third);
 }
 
-template<class DestIterator, class SizeType, class DestAccessor>
+template<class SCANLINES, class DestIterator, class SizeType, class DestAccessor>
+unsigned int fillScannedPoly(
+    const SCANLINES &scanlines,
+    typename DestAccessor::value_type value,
+    triple<DestIterator, SizeType, DestAccessor> dest,
+    int beginRow, int endRow)
+{
+    return fillScannedPoly(scanlines, value,
+                           dest.first, dest.second, dest.third,
+                           beginRow, endRow);
+}
+
+template<class SCANLINES, class DestIterator, class SizeType, class DestAccessor>
 unsigned int drawScannedPoly(
-    const Scanlines &scanlines,
+    const SCANLINES &scanlines,
     typename DestAccessor::value_type value,
-    DestIterator dul, SizeType ds, DestAccessor a)
+    DestIterator dul, SizeType ds, DestAccessor a,
+    int beginRow, int endRow)
 {
     unsigned int pixelCount = 0;
 
-    // clip to image range vertically:
-    int y = std::max(0, scanlines.startIndex()),
-     endY = std::min((int)ds[1], scanlines.endIndex());
+    // clip to image range (and requested rows) vertically:
+    int y = std::max(std::max(0, beginRow), scanlines.startIndex()),
+     endY = std::min(std::min((int)ds[1], endRow), scanlines.endIndex());
 
     for(DestIterator row(dul + y); y < endY; ++y, ++row)
     {
         int x = 0;
         typename DestIterator::next_type it(row.begin());
-        const Scanlines::Scanline &scanline(scanlines[y]);
+        typename SCANLINES::const_reference scanline(scanlines[y]);
         for(unsigned int j = 0; j < scanline.size(); ++j)
         {
             // X range checking
@@ -2163,9 +2601,18 @@ unsigned int drawScannedPoly(
     return pixelCount;
 }
 
-template<class DestIterator, class SizeType, class DestAccessor>
+template<class SCANLINES, class DestIterator, class SizeType, class DestAccessor>
+unsigned int drawScannedPoly(
+    const SCANLINES &scanlines,
+    typename DestAccessor::value_type value,
+    DestIterator dul, SizeType ds, DestAccessor a)
+{
+    return drawScannedPoly(scanlines, value, dul, ds, a, 0, (int)ds[1]);
+}
+
+template<class SCANLINES, class DestIterator, class SizeType, class DestAccessor>
 unsigned int drawScannedPoly(
-    const Scanlines &scanlines,
+    const SCANLINES &scanlines,
     typename DestAccessor::value_type value,
     triple<DestIterator, SizeType, DestAccessor> dest)
 {
@@ -2173,6 +2620,18 @@ unsigned int drawScannedPoly(
                            dest.first, dest.second, dest.third);
 }
 
+template<class SCANLINES, class DestIterator, class SizeType, class DestAccessor>
+unsigned int drawScannedPoly(
+    const SCANLINES &scanlines,
+    typename DestAccessor::value_type value,
+    triple<DestIterator, SizeType, DestAccessor> dest,
+    int beginRow, int endRow)
+{
+    return drawScannedPoly(scanlines, value,
+                           dest.first, dest.second, dest.third,
+                           beginRow, endRow);
+}
+
 } // namespace vigra
 
 /********************************************************************/
@@ -0,0 +1,255 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2007-2019 by Hans Meine                      */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef REGIONMERGER_HXX
+#define REGIONMERGER_HXX
+
+#include "cppmap.hxx"
+#include "cppmap_utils.hxx"
+#include "dynamiccostqueue.hxx"
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+/**
+ * Cost measure for AutomaticRegionMerger that delegates to one of
+ * the dart-based measures of a face statistics object, e.g.
+ * FaceColorStatistics::faceMeanDiff or
+ * FaceColorStatistics::faceHomogeneity.
+ *
+ * The statistics object is only referenced, i.e. it must outlive the
+ * cost measure (and must stay attached to the merged map).
+ */
+template<class STATISTICS>
+class FaceStatisticsCostMeasure
+{
+  public:
+    typedef double (STATISTICS::*Measure)(const GeoMap::Dart &) const;
+
+    FaceStatisticsCostMeasure(const STATISTICS &statistics, Measure measure)
+    : statistics_(&statistics),
+      measure_(measure)
+    {}
+
+    double operator()(const GeoMap::Dart &dart) const
+    {
+        return (statistics_->*measure_)(dart);
+    }
+
+  protected:
+    const STATISTICS *statistics_;
+    Measure measure_;
+};
+
+/**
+ * Merges faces of a GeoMap in order of increasing costs (C++
+ * counterpart of maputils.AutomaticRegionMerger).  The COST_MEASURE
+ * is called on a dart for each edge to determine the cost of
+ * removing that edge / merging the adjacent regions.
+ *
+ * Internally, a DynamicCostQueue over the edge labels is used in
+ * order to always remove the edge with the lowest assigned cost.
+ * After each operation, the costs of all edges around the surviving
+ * face are recalculated (if updateNeighborHood is true).  Edges with
+ * any of the Edge::ALL_PROTECTION flags set are never removed.
+ */
+template<class COST_MEASURE>
+class AutomaticRegionMerger
+{
+  public:
+    typedef COST_MEASURE             CostMeasure;
+    typedef DynamicCostQueue<double> CostQueue;
+
+    AutomaticRegionMerger(boost::shared_ptr<GeoMap> map,
+                          const CostMeasure &costMeasure,
+                          bool completeMerge = true,
+                          bool updateNeighborHood = true)
+    : map_(map),
+      costMeasure_(costMeasure),
+      queue_(map->maxEdgeLabel()),
+      completeMerge_(completeMerge),
+      updateNeighborHood_(updateNeighborHood),
+      step_(0)
+    {
+        vigra_precondition(map->mapInitialized(),
+            "AutomaticRegionMerger: map must be initialized");
+
+        std::vector<CellLabel> labels;
+        std::vector<double> costs;
+        for(GeoMap::EdgeIterator it = map->edgesBegin(); it.inRange(); ++it)
+        {
+            if((*it)->flag(GeoMap::Edge::ALL_PROTECTION))
+                continue;
+            labels.push_back((*it)->label());
+            costs.push_back(costMeasure_((*it)->dart()));
+        }
+        queue_.build(labels.begin(), labels.end(), costs.begin());
+    }
+
+        /// Returns the number of steps performed so far.
+    unsigned int step() const
+    {
+        return step_;
+    }
+
+        /// Returns true if there are (possibly invalid) entries left.
+    bool hasNext() const
+    {
+        return !queue_.empty();
+    }
+
+        /**
+         * Skip queue entries that do not correspond to removable
+         * edges anymore, so that nextCost() / nextLabel() refer to
+         * the operation really performed by the next mergeStep().
+         * Returns false iff the queue ran empty.
+         */
+    bool ensureValidNext()
+    {
+        while(!queue_.empty() && !isRemovable(queue_.top().first))
+            queue_.pop();
+        return !queue_.empty();
+    }
+
+    double nextCost() const
+    {
+        return queue_.top().second;
+    }
+
+    CellLabel nextLabel()
+    {
+        ensureValidNext();
+        return queue_.top().first;
+    }
+
+        /**
+         * Fetch next edge from cost queue and remove it from the map.
+         *
+         * If the edge is protected or nonexistent, do nothing and
+         * return NULL (i.e. not every call results in a merge step!).
+         * Else, return the surviving Face and increment step().
+         */
+    GeoMap::FacePtr mergeStep()
+    {
+        CostQueue::value_type next(queue_.pop());
+        if(!isRemovable(next.first))
+            return NULL_PTR(GeoMap::Face);
+
+        GeoMap::Dart dart(map_->edge(next.first)->dart());
+
+        GeoMap::FacePtr survivor;
+        if(dart.edge()->isBridge())
+        {
+            survivor = map_->removeBridge(dart);
+        }
+        else
+        {
+            if(completeMerge_)
+                survivor = mergeFacesCompletely(dart, true);
+            else
+                survivor = map_->mergeFaces(dart);
+            if(survivor && updateNeighborHood_)
+                updateContourCosts(*survivor);
+        }
+
+        if(survivor)
+            ++step_;
+        return survivor;
+    }
+
+        /// merge until the queue is empty, return number of steps
+    unsigned int merge()
+    {
+        unsigned int oldStep = step_;
+        while(!queue_.empty())
+            mergeStep();
+        return step_ - oldStep;
+    }
+
+    unsigned int mergeSteps(unsigned int count)
+    {
+        return mergeToStep(step_ + count);
+    }
+
+    unsigned int mergeToStep(unsigned int targetStep)
+    {
+        unsigned int oldStep = step_;
+        while(!queue_.empty() && step_ < targetStep)
+            mergeStep();
+        return step_ - oldStep;
+    }
+
+        /// merge while the next cost is <= maxCost
+    unsigned int mergeToCost(double maxCost)
+    {
+        unsigned int oldStep = step_;
+        while(ensureValidNext() && nextCost() <= maxCost)
+            mergeStep();
+        return step_ - oldStep;
+    }
+
+    const boost::shared_ptr<GeoMap> map() const
+    {
+        return map_;
+    }
+
+    const CostQueue &queue() const
+    {
+        return queue_;
+    }
+
+  protected:
+    bool isRemovable(CellLabel edgeLabel) const
+    {
+        GeoMap::EdgePtr edge(map_->edge(edgeLabel));
+        return edge && !edge->flag(GeoMap::Edge::ALL_PROTECTION);
+    }
+
+    void updateContourCosts(const GeoMap::Face &face)
+    {
+        for(GeoMap::Face::ContourIterator it = face.contoursBegin();
+            it != face.contoursEnd(); ++it)
+        {
+            GeoMap::Dart dart(*it);
+            do
+            {
+                if(!dart.edge()->flag(GeoMap::Edge::ALL_PROTECTION))
+                    queue_.setCost(dart.edgeLabel(), costMeasure_(dart));
+            }
+            while(dart.nextPhi() != *it);
+        }
+    }
+
+    boost::shared_ptr<GeoMap> map_;
+    CostMeasure costMeasure_;
+    CostQueue queue_;
+    bool completeMerge_, updateNeighborHood_;
+    unsigned int step_;
+};
+
+#endif // REGIONMERGER_HXX
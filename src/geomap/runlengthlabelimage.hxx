@@ -0,0 +1,481 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2007-2019 by Hans Meine                      */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef VIGRA_RUNLENGTHLABELIMAGE_HXX
+#define VIGRA_RUNLENGTHLABELIMAGE_HXX
+
+#include "polygon.hxx" // Scanlines
+#include <vigra/error.hxx>
+#include <vigra/multi_array.hxx> // MultiArrayShape
+#include <vigra/accessor.hxx>    // StandardValueAccessor
+#include <vigra/utilities.hxx>   // triple
+#include <vector>
+#include <algorithm>
+
+namespace vigra {
+
+/**
+ * 2D int image stored as runs of equal labels per row.  Each run
+ * extends from its begin to the next run's begin (or the image
+ * width); adjacent runs always have different labels.  For typical
+ * segmentations (long runs of the same face label), this needs a
+ * fraction of the memory of a dense image.
+ *
+ * The interface mimics the parts of MultiArray<2, int> used for
+ * GeoMap's label image, with element references being proxies.
+ * Faces are rasterized run-wise by the fillScannedPoly() and
+ * drawScannedPoly() overloads below, i.e. directly from the
+ * polygons' Scanlines.
+ */
+class RunLengthLabelImage
+{
+  public:
+    typedef int                       value_type;
+    typedef value_type                const_reference;
+    typedef MultiArrayShape<2>::type  difference_type;
+    typedef difference_type           size_type;
+
+    struct Run
+    {
+        int        begin;
+        value_type label;
+
+        Run(int b, value_type l)
+        : begin(b), label(l)
+        {}
+    };
+
+    typedef std::vector<Run> Row;
+
+        /// proxy for a single pixel, as returned by non-const access
+    class reference
+    {
+      public:
+        reference(RunLengthLabelImage *image, int x, int y)
+        : image_(image), x_(x), y_(y)
+        {}
+
+        operator value_type() const
+        {
+            return image_->get(x_, y_);
+        }
+
+        reference &operator=(value_type v)
+        {
+            image_->set(x_, y_, v);
+            return *this;
+        }
+
+        reference &operator=(const reference &other)
+        {
+            return operator=((value_type)other);
+        }
+
+        reference &operator+=(value_type diff)
+        {
+            return operator=(image_->get(x_, y_) + diff);
+        }
+
+      protected:
+        RunLengthLabelImage *image_;
+        int x_, y_;
+    };
+
+        /// row iterator, only used to dispatch to the run-wise
+        /// fillScannedPoly() / drawScannedPoly() overloads
+    class traverser
+    {
+      public:
+        traverser(RunLengthLabelImage *image, int y)
+        : image_(image), y_(y)
+        {}
+
+        traverser operator+(int diff) const
+        {
+            return traverser(image_, y_ + diff);
+        }
+
+        traverser &operator++()
+        {
+            ++y_;
+            return *this;
+        }
+
+        RunLengthLabelImage &image() const
+        {
+            return *image_;
+        }
+
+        int y() const
+        {
+            return y_;
+        }
+
+      protected:
+        RunLengthLabelImage *image_;
+        int y_;
+    };
+
+    RunLengthLabelImage(const difference_type &shape, value_type fill = 0)
+    : shape_(shape),
+      rows_(shape[1], Row(1, Run(0, fill)))
+    {
+        vigra_precondition(shape_[0] > 0 && shape_[1] >= 0,
+            "RunLengthLabelImage: invalid shape!");
+    }
+
+    const difference_type &shape() const
+    {
+        return shape_;
+    }
+
+    MultiArrayIndex size(int dim) const
+    {
+        return shape_[dim];
+    }
+
+    int width() const
+    {
+        return (int)shape_[0];
+    }
+
+    int height() const
+    {
+        return (int)shape_[1];
+    }
+
+    bool isInside(const difference_type &p) const
+    {
+        return p[0] >= 0 && p[1] >= 0 && p[0] < shape_[0] && p[1] < shape_[1];
+    }
+
+    const Row &row(int y) const
+    {
+        return rows_[y];
+    }
+
+        /// total number of runs (the memory used is proportional)
+    unsigned long runCount() const
+    {
+        unsigned long result = 0;
+        for(unsigned int y = 0; y < rows_.size(); ++y)
+            result += rows_[y].size();
+        return result;
+    }
+
+    value_type get(int x, int y) const
+    {
+        const Row &r(rows_[y]);
+        return (findRun(r, x) - 1)->label;
+    }
+
+    void set(int x, int y, value_type v)
+    {
+        setRange(y, x, x + 1, v);
+    }
+
+        /// set pixels [begin, end) of row y to label
+    void setRange(int y, int begin, int end, value_type label)
+    {
+        begin = std::max(0, begin);
+        end = std::min(width(), end);
+        if(begin >= end)
+            return;
+
+        Row &r(rows_[y]);
+
+        // runs containing begin and end:
+        int i = (int)(findRun(r, begin) - r.begin()) - 1,
+            k = (int)(findRun(r, end) - r.begin()) - 1;
+        value_type labelAfter = r[k].label;
+        bool tail = end < width() && r[k].begin < end;
+
+        // replace runs [from, to) with the new run(s):
+        int from = r[i].begin < begin ? i + 1 : i,
+              to = r[k].begin == end ? k : k + 1;
+
+        Run newRuns[2] = { Run(begin, label), Run(end, labelAfter) };
+        int newCount = tail ? 2 : 1, oldCount = to - from;
+        if(oldCount >= newCount)
+        {
+            std::copy(newRuns, newRuns + newCount, r.begin() + from);
+            r.erase(r.begin() + from + newCount, r.begin() + to);
+        }
+        else
+        {
+            std::copy(newRuns, newRuns + oldCount, r.begin() + from);
+            r.insert(r.begin() + from + oldCount,
+                     newRuns + oldCount, newRuns + newCount);
+        }
+
+        // merge with equally labeled neighbors:
+        for(int j = std::min(from + newCount, (int)r.size() - 1);
+            j >= std::max(from, 1); --j)
+        {
+            if(r[j].label == r[j-1].label)
+                r.erase(r.begin() + j);
+        }
+    }
+
+    value_type operator()(int x, int y) const
+    {
+        return get(x, y);
+    }
+
+    value_type operator[](const difference_type &p) const
+    {
+        return get((int)p[0], (int)p[1]);
+    }
+
+    reference operator()(int x, int y)
+    {
+        return reference(this, x, y);
+    }
+
+    reference operator[](const difference_type &p)
+    {
+        return reference(this, (int)p[0], (int)p[1]);
+    }
+
+    traverser traverser_begin()
+    {
+        return traverser(this, 0);
+    }
+
+    traverser traverser_end()
+    {
+        return traverser(this, height());
+    }
+
+        /**
+         * Visit the rows [beginRow, endRow) run by run, calling
+         * f.uniform(label, pixelCount) for each run (cf. the span
+         * visitor of TiledLabelImage, which additionally calls
+         * f(begin, end) for stored pixels).
+         */
+    template<class Functor>
+    void forEachSpan(int beginRow, int endRow, Functor &f) const
+    {
+        beginRow = std::max(0, beginRow);
+        endRow = std::min(height(), endRow);
+
+        for(int y = beginRow; y < endRow; ++y)
+        {
+            const Row &r(rows_[y]);
+            for(unsigned int j = 0; j < r.size(); ++j)
+            {
+                int end = (j + 1 < r.size() ? r[j+1].begin : width());
+                f.uniform(r[j].label, (unsigned int)(end - r[j].begin));
+            }
+        }
+    }
+
+        /// replace every value v in rows [beginRow, endRow) with f(v)
+    template<class Functor>
+    void transformValues(int beginRow, int endRow, const Functor &f)
+    {
+        beginRow = std::max(0, beginRow);
+        endRow = std::min(height(), endRow);
+
+        for(int y = beginRow; y < endRow; ++y)
+        {
+            Row &r(rows_[y]);
+            unsigned int size = 0;
+            for(unsigned int j = 0; j < r.size(); ++j)
+            {
+                value_type label = f(r[j].label);
+                if(size && r[size-1].label == label)
+                    continue;
+                r[size] = Run(r[j].begin, label);
+                ++size;
+            }
+            r.erase(r.begin() + size, r.end());
+        }
+    }
+
+    template<class Functor>
+    void transformValues(const Functor &f)
+    {
+        transformValues(0, height(), f);
+    }
+
+  protected:
+    struct BeginCompare
+    {
+        bool operator()(int x, const Run &run) const
+        {
+            return x < run.begin;
+        }
+    };
+
+        // first run beginning after x (i.e. x lies in the previous one)
+    static Row::const_iterator findRun(const Row &r, int x)
+    {
+        return std::upper_bound(r.begin(), r.end(), x, BeginCompare());
+    }
+
+    static Row::iterator findRun(Row &r, int x)
+    {
+        return std::upper_bound(r.begin(), r.end(), x, BeginCompare());
+    }
+
+    difference_type shape_;
+    std::vector<Row> rows_;
+};
+
+inline triple<RunLengthLabelImage::traverser,
+              RunLengthLabelImage::difference_type,
+              StandardValueAccessor<int> >
+destMultiArrayRange(RunLengthLabelImage &image)
+{
+    return triple<RunLengthLabelImage::traverser,
+                  RunLengthLabelImage::difference_type,
+                  StandardValueAccessor<int> >(
+                      image.traverser_begin(), image.shape(),
+                      StandardValueAccessor<int>());
+}
+
+    // run-wise versions of the generic fillScannedPoly() /
+    // drawScannedPoly() from polygon.hxx (same clipping and results):
+
+template<class SCANLINES>
+unsigned int fillScannedPoly(
+    const SCANLINES &scanlines, int value,
+    RunLengthLabelImage::traverser dul,
+    RunLengthLabelImage::difference_type ds,
+    StandardValueAccessor<int>,
+    int beginRow, int endRow)
+{
+    RunLengthLabelImage &image(dul.image());
+    bool clean = true;
+    unsigned int pixelCount = 0;
+
+    int y = std::max(std::max(0, beginRow), scanlines.startIndex()),
+     endY = std::min(std::min((int)ds[1], endRow), scanlines.endIndex());
+
+    for(; y < endY; ++y)
+    {
+        int inside = 0;
+        int x = 0;
+        typename SCANLINES::const_reference scanline(scanlines[y]);
+        for(unsigned int j = 0; j < scanline.size(); ++j)
+        {
+            // X range checking
+            int begin = scanline[j].begin,
+                  end = scanline[j].end;
+            if(begin < 0)
+            {
+                begin = 0;
+                if(end < 0)
+                    end = 0;
+            }
+            if(end > ds[0])
+            {
+                end = ds[0];
+                if(begin > ds[0])
+                    begin = ds[0];
+            }
+
+            if(inside > 0 && x < begin)
+            {
+                image.setRange(dul.y() + y, x, begin, value);
+                pixelCount += begin - x;
+            }
+            x = end;
+            inside += scanline[j].direction;
+        }
+        if(inside)
+            clean = false;
+    }
+
+    vigra_postcondition(clean, "error in polygon scanlines (not closed?)");
+    return pixelCount;
+}
+
+template<class SCANLINES>
+unsigned int fillScannedPoly(
+    const SCANLINES &scanlines, int value,
+    RunLengthLabelImage::traverser dul,
+    RunLengthLabelImage::difference_type ds,
+    StandardValueAccessor<int> a)
+{
+    return fillScannedPoly(scanlines, value, dul, ds, a, 0, (int)ds[1]);
+}
+
+template<class SCANLINES>
+unsigned int drawScannedPoly(
+    const SCANLINES &scanlines, int value,
+    RunLengthLabelImage::traverser dul,
+    RunLengthLabelImage::difference_type ds,
+    StandardValueAccessor<int>,
+    int beginRow, int endRow)
+{
+    RunLengthLabelImage &image(dul.image());
+    unsigned int pixelCount = 0;
+
+    int y = std::max(std::max(0, beginRow), scanlines.startIndex()),
+     endY = std::min(std::min((int)ds[1], endRow), scanlines.endIndex());
+
+    for(; y < endY; ++y)
+    {
+        typename SCANLINES::const_reference scanline(scanlines[y]);
+        for(unsigned int j = 0; j < scanline.size(); ++j)
+        {
+            // X range checking
+            int begin = scanline[j].begin,
+                  end = scanline[j].end;
+            if(begin < 0)
+                begin = 0;
+            if(end > ds[0])
+                end = ds[0];
+
+            if(begin < end)
+            {
+                image.setRange(dul.y() + y, begin, end, value);
+                pixelCount += end - begin;
+            }
+        }
+    }
+
+    return pixelCount;
+}
+
+template<class SCANLINES>
+unsigned int drawScannedPoly(
+    const SCANLINES &scanlines, int value,
+    RunLengthLabelImage::traverser dul,
+    RunLengthLabelImage::difference_type ds,
+    StandardValueAccessor<int> a)
+{
+    return drawScannedPoly(scanlines, value, dul, ds, a, 0, (int)ds[1]);
+}
+
+} // namespace vigra
+
+#endif // VIGRA_RUNLENGTHLABELIMAGE_HXX
@@ -0,0 +1,398 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2007-2019 by Hans Meine                      */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef SUBPIXELWATERSHEDMAP_HXX
+#define SUBPIXELWATERSHEDMAP_HXX
+
+#include "cppmap.hxx"
+#include "cppmap_utils.hxx"
+#include "vigra/subpixel_watershed.hxx" // removedCriticalPoint()
+#include <boost/shared_ptr.hpp>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+namespace detail {
+
+    // Find or create the node for the end of a flow line that did not
+    // reach a maximum (like addFlowLinesToMap() in maputils.py): an
+    // existing node within sqrt(maxSquaredDist) pixels is used if it
+    // is not behind the flow line end, possibly extending the flow
+    // line to its position.  If atStart, the end at points[0] is
+    // meant, else points.back().
+inline GeoMap::NodePtr
+flowLineEndNode(GeoMap &map, Vector2Array &points, bool atStart,
+                double maxSquaredDist = 0.25)
+{
+    Vector2 pos(atStart ? points[0] : points[points.size() - 1]);
+    Vector2 prev(atStart ? points[1] : points[points.size() - 2]);
+
+    GeoMap::NodePtr result(map.nearestNode(pos, maxSquaredDist));
+    if(!result)
+        return map.addNode(pos);
+
+    Vector2 diff(result->position() - pos);
+    if(dot(diff, pos - prev) >= 0) // don't jump back
+    {
+        if(diff.squaredMagnitude())
+        {
+            // include node position if not present
+            if(atStart)
+                points.insert(points.begin(), result->position());
+            else
+                points.push_back(result->position());
+        }
+    }
+    else
+    {
+        (atStart ? points[0] : points[points.size() - 1]) = result->position();
+    }
+    return result;
+}
+
+inline bool
+insideBox(Vector2 const &p, Vector2 const &ul, Vector2 const &lr)
+{
+    return p[0] >= ul[0] && p[0] <= lr[0] && p[1] >= ul[1] && p[1] <= lr[1];
+}
+
+    // Point where the segment from inside to outside leaves the box.
+inline Vector2
+boxExitPoint(Vector2 const &inside, Vector2 const &outside,
+             Vector2 const &ul, Vector2 const &lr)
+{
+    Vector2 diff(outside - inside);
+    double l = 1.0;
+    for(int d = 0; d < 2; ++d)
+    {
+        if(outside[d] < ul[d])
+            l = std::min(l, (ul[d] - inside[d]) / diff[d]);
+        else if(outside[d] > lr[d])
+            l = std::min(l, (lr[d] - inside[d]) / diff[d]);
+    }
+    return inside + l * diff;
+}
+
+    // Clips the flow line at the border of the box ul..lr and keeps
+    // only the part containing the saddle (which must be within the
+    // box), like clipPoly() in polytools.py.  Returns whether the
+    // start / end of the flow line have been cut off.
+template <class POINTS>
+void
+clipFlowLine(POINTS &points, unsigned int &saddlePosition,
+             Vector2 const &ul, Vector2 const &lr,
+             bool &startClipped, bool &endClipped)
+{
+    unsigned int begin = saddlePosition, end = saddlePosition + 1;
+    while(begin > 0 && insideBox(points[begin - 1], ul, lr))
+        --begin;
+    while(end < points.size() && insideBox(points[end], ul, lr))
+        ++end;
+
+    startClipped = begin > 0;
+    endClipped = end < points.size();
+    if(!startClipped && !endClipped)
+        return;
+
+    POINTS clipped;
+    if(startClipped)
+    {
+        Vector2 p(boxExitPoint(points[begin], points[begin - 1], ul, lr));
+        if(p != Vector2(points[begin]))
+            clipped.push_back(p);
+    }
+    saddlePosition = saddlePosition - begin + clipped.size();
+    for(unsigned int i = begin; i < end; ++i)
+        clipped.push_back(points[i]);
+    if(endClipped)
+    {
+        Vector2 p(boxExitPoint(points[end - 1], points[end], ul, lr));
+        if(p != Vector2(points[end - 1]))
+            clipped.push_back(p);
+    }
+    points.swap(clipped);
+}
+
+    // Adds a node for each maximum, labelled with its index (maxima[0]
+    // is unused), skipping the placeholders of maxima removed by
+    // SubPixelWatersheds::updateCriticalPoints().
+template <class POINTS>
+void
+addMaximumNodes(POINTS const &maxima, GeoMap &map)
+{
+    vigra::TinyVector<double, 2> removed(vigra::detail::removedCriticalPoint());
+    for(unsigned int i = 1; i < maxima.size(); ++i)
+    {
+        if(maxima[i][0] == removed[0] && maxima[i][1] == removed[1])
+            continue;
+        map.addNode(Vector2(maxima[i][0], maxima[i][1]), i);
+    }
+}
+
+struct NoDelete
+{
+    void operator()(void const *) const {}
+};
+
+} // namespace detail
+
+    // Adds the flow lines traced by SubPixelWatersheds::traceAllEdges()
+    // or TiledSubPixelWatersheds::traceAllEdges() to map, whose nodes
+    // are expected to be labelled with the indices of the maxima.
+    // The edge for edges[i] gets the label i.  Flow lines that did not
+    // reach a maximum get a new end node, or the existing one within
+    // maxNodeDist, and self-loops that would have area zero are
+    // skipped.
+    //
+    // If clipAtBorder is set, flow lines whose saddles lie within
+    // minSaddleBorderDist of the image border or that run entirely
+    // within minMaxBorderDist of it are skipped, and flow lines that
+    // leave the image are clipped minSaddleBorderDist inside it (see
+    // addFlowLinesToMap() in maputils.py).  Clipped edges are written
+    // back into edges (with end indices -1) for later statistics.
+    //
+    // Returns the number of skipped flow lines.
+template <class TRACED_EDGES>
+unsigned int addTracedEdgesToMap(TRACED_EDGES &edges, GeoMap &map,
+                                 bool clipAtBorder = false,
+                                 double minSaddleBorderDist = 1e-4,
+                                 double minMaxBorderDist = 1e-2,
+                                 double maxNodeDist = 0.5)
+{
+    Vector2 imageEnd(map.imageSize().width() - 1, map.imageSize().height() - 1);
+    Vector2 clipBegin(minSaddleBorderDist, minSaddleBorderDist),
+            clipEnd(imageEnd - clipBegin),
+            innerBegin(minMaxBorderDist, minMaxBorderDist),
+            innerEnd(imageEnd - innerBegin);
+
+    unsigned int skipped = 0;
+    for(unsigned int i = 1; i < edges.size(); ++i)
+    {
+        if(!edges[i].traced)
+            continue;
+
+        if(clipAtBorder)
+        {
+            Vector2 bboxBegin(edges[i].points[0]), bboxEnd(bboxBegin);
+            for(unsigned int j = 1; j < edges[i].points.size(); ++j)
+                for(int d = 0; d < 2; ++d)
+                {
+                    bboxBegin[d] = std::min(bboxBegin[d], edges[i].points[j][d]);
+                    bboxEnd[d] = std::max(bboxEnd[d], edges[i].points[j][d]);
+                }
+
+            if(!detail::insideBox(bboxBegin, innerBegin, innerEnd) ||
+               !detail::insideBox(bboxEnd, innerBegin, innerEnd))
+            {
+                // don't add edges that run along the border at all,
+                // or whose saddles are (nearly) on the border:
+                if(!detail::insideBox(edges[i].points[edges[i].saddlePosition],
+                                      clipBegin, clipEnd) ||
+                   bboxEnd[0] < innerBegin[0] || bboxBegin[0] > innerEnd[0] ||
+                   bboxEnd[1] < innerBegin[1] || bboxBegin[1] > innerEnd[1])
+                {
+                    ++skipped;
+                    continue;
+                }
+
+                bool startClipped, endClipped;
+                detail::clipFlowLine(edges[i].points, edges[i].saddlePosition,
+                                     clipBegin, clipEnd,
+                                     startClipped, endClipped);
+                if(startClipped)
+                    edges[i].forwardIndex = -1;
+                if(endClipped)
+                    edges[i].backwardIndex = -1;
+                if(edges[i].points.size() < 2)
+                {
+                    ++skipped;
+                    continue;
+                }
+            }
+        }
+
+        int startNodeLabel = edges[i].forwardIndex;
+        int endNodeLabel = edges[i].backwardIndex;
+        Vector2Array points(edges[i].points.begin(), edges[i].points.end());
+        vigra_precondition(points.size() >= 2,
+            "addTracedEdgesToMap(): edges need to have at least two (end-)points");
+
+        double maxSquaredDist = maxNodeDist * maxNodeDist;
+        GeoMap::NodePtr startNode(
+            startNodeLabel > 0
+            ? map.node(startNodeLabel)
+            : detail::flowLineEndNode(map, points, true, maxSquaredDist));
+        GeoMap::NodePtr endNode(
+            endNodeLabel > 0
+            ? map.node(endNodeLabel)
+            : detail::flowLineEndNode(map, points, false, maxSquaredDist));
+        vigra_precondition(startNode && endNode,
+            "addTracedEdgesToMap(): no node for maximum index");
+
+        if(startNode == endNode &&
+           (startNodeLabel <= 0 || endNodeLabel <= 0 || points.size() == 2))
+        {
+            ++skipped;
+            continue;
+        }
+
+        map.addEdge(*startNode, *endNode, points, i);
+    }
+    return skipped;
+}
+
+    // Creates a GeoMap with a node for each maximum (labelled with its
+    // index, maxima[0] and removed maxima are unused) and an edge for
+    // each traced edge, see addTracedEdgesToMap().  The map is not
+    // sorted yet.
+template <class POINTS, class TRACED_EDGES>
+std::auto_ptr<GeoMap>
+subpixelWatershedMap(POINTS const &maxima, TRACED_EDGES &edges,
+                     vigra::Size2D imageSize)
+{
+    std::auto_ptr<GeoMap> result(new GeoMap(imageSize));
+    detail::addMaximumNodes(maxima, *result);
+    addTracedEdgesToMap(edges, *result);
+    return result;
+}
+
+    // Removes pairs of darts of unsortable self-loops from the groups
+    // returned by GeoMap::sortEdgesEventually() (most likely short
+    // flow lines that were connected back to their start node) and
+    // fails if other unsortable edges remain (like _handleUnsortable()
+    // in maputils.py).  Returns the number of such self-loops.
+inline unsigned int
+handleUnsortableGroups(GeoMap &map, GeoMap::UnsortableGroups &unsortable)
+{
+    typedef GeoMap::UnsortableGroups::iterator GroupIterator;
+    typedef GeoMap::UnsortableGroups::value_type::iterator DartIterator;
+
+    unsigned int loopCount = 0;
+    for(GroupIterator group = unsortable.begin(); group != unsortable.end(); )
+    {
+        for(DartIterator it = group->begin(); it != group->end(); )
+        {
+            DartIterator opposite(
+                std::find(group->begin(), group->end(), -*it));
+            if(opposite != group->end() && map.dart(*it).edge()->isLoop())
+            {
+                group->erase(opposite);
+                it = group->erase(it);
+                ++loopCount;
+            }
+            else
+                ++it;
+        }
+
+        if(group->empty())
+            group = unsortable.erase(group);
+        else
+            ++group;
+    }
+
+    if(loopCount)
+        std::cerr << "*** BIG FAT WARNING: " << loopCount
+                  << " unsortable self-loops found. ***\n";
+
+    if(!unsortable.empty())
+    {
+        std::stringstream msg;
+        msg << "unhandled unsortable edges occured (darts";
+        for(GroupIterator group = unsortable.begin(); group != unsortable.end(); ++group)
+        {
+            msg << " [";
+            for(DartIterator it = group->begin(); it != group->end(); ++it)
+                msg << (it == group->begin() ? "" : ", ") << *it;
+            msg << "]";
+        }
+        msg << ")";
+        vigra_fail(msg.str());
+    }
+    return loopCount;
+}
+
+    // Builds an initialized GeoMap from the critical points and traced
+    // edges of the subpixel watersheds in one go, following
+    // subpixelWatershedMapFromData() in maputils.py: flow lines are
+    // clipped at the image border, border edges are added if
+    // performBorderClosing (nodes within borderConnectionDist are
+    // connected to them), the edges are sorted with the given
+    // sortEdgesEventually() parameters (ssMinDist also serves as
+    // minimal distance of flow lines from the border), parallel edges
+    // are split if performEdgeSplits, and with cleanup, isolated
+    // nodes, bridges, and degree 2 nodes are removed.  The border
+    // edges are protected during the cleanup only; attach an
+    // EdgeProtection to the result for further protection.
+    //
+    // edges is modified like by addTracedEdgesToMap().
+template <class POINTS, class TRACED_EDGES>
+std::auto_ptr<GeoMap>
+subpixelWatershedMapFromData(POINTS const &maxima, TRACED_EDGES &edges,
+                             vigra::Size2D imageSize,
+                             double borderConnectionDist = 0.1,
+                             double ssStepDist = 0.2, double ssMinDist = 0.12,
+                             bool performBorderClosing = true,
+                             bool performEdgeSplits = true,
+                             bool cleanup = true)
+{
+    std::auto_ptr<GeoMap> result(new GeoMap(imageSize));
+    detail::addMaximumNodes(maxima, *result);
+    addTracedEdgesToMap(edges, *result, true, 1e-4, ssMinDist);
+
+    if(performBorderClosing)
+        connectBorderNodes(*result, borderConnectionDist);
+
+    if(cleanup)
+        removeIsolatedNodes(*result);
+
+    GeoMap::UnsortableGroups unsortable;
+    result->sortEdgesEventually(ssStepDist, ssMinDist,
+                                unsortable, performEdgeSplits);
+    handleUnsortableGroups(*result, unsortable);
+
+    if(performEdgeSplits)
+        result->splitParallelEdges();
+
+    result->initializeMap();
+
+    if(cleanup)
+    {
+        EdgeProtection protection;
+        if(performBorderClosing)
+            protection.attachHooks(
+                boost::shared_ptr<GeoMap>(result.get(), detail::NoDelete()));
+        removeBridges(*result);
+        mergeDegree2Nodes(*result);
+        protection.detachHooks();
+    }
+
+    return result;
+}
+
+#endif // SUBPIXELWATERSHEDMAP_HXX
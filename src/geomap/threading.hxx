@@ -0,0 +1,128 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2007-2019 by Hans Meine                      */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef THREADING_HXX
+#define THREADING_HXX
+
+#include <vigra/error.hxx>
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Small helpers shared by the OpenMP-parallelized code paths.  When
+// compiled without OpenMP, everything degrades to a single thread and
+// the serial code paths are used.
+
+namespace detail {
+
+    // Map a user-supplied thread count onto the number of threads
+    // that will actually be used; 0 means "as many as OpenMP offers".
+inline unsigned int resolveThreadCount(unsigned int threadCount)
+{
+#ifdef _OPENMP
+    if(!threadCount)
+        threadCount = (unsigned int)omp_get_max_threads();
+    return threadCount ? threadCount : 1;
+#else
+    (void)threadCount;
+    return 1;
+#endif
+}
+
+    // index of the calling thread within the current parallel region
+inline unsigned int currentThread()
+{
+#ifdef _OPENMP
+    return (unsigned int)omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+    // Split [0, size) into count contiguous ranges and return the
+    // begin of range index (index == count gives size).
+inline int bandBegin(int size, int count, int index)
+{
+    return (int)((long long)size * index / count);
+}
+
+/**
+ * Exceptions must not escape an OpenMP parallel region.  Worker
+ * code catches them via capture(), and the master re-raises the
+ * first one (as a runtime error) after the region has been left.
+ */
+class ParallelErrors
+{
+  public:
+    ParallelErrors()
+    : failed_(false)
+    {}
+
+    void capture(const std::exception &e)
+    {
+#ifdef _OPENMP
+#pragma omp critical(geomap_parallel_errors)
+#endif
+        {
+            if(!failed_)
+            {
+                failed_ = true;
+                message_ = e.what();
+            }
+        }
+    }
+
+    void captureUnknown()
+    {
+        capture(std::runtime_error("unknown exception in parallel region"));
+    }
+
+    bool failed() const
+    {
+        return failed_;
+    }
+
+    void rethrow() const
+    {
+        if(failed_)
+            vigra_fail(message_.c_str());
+    }
+
+  protected:
+    bool failed_;
+    std::string message_;
+};
+
+} // namespace detail
+
+#endif // THREADING_HXX
@@ -0,0 +1,576 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2007-2019 by Hans Meine                      */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef VIGRA_GRIDHASH2D_HXX
+#define VIGRA_GRIDHASH2D_HXX
+
+#include "map2d.hxx" // PositionedObject
+#include <vigra/error.hxx>
+#include <vigra/numerictraits.hxx>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+namespace vigra {
+
+    /// numbers of nearest() calls and of calls that found an element
+struct GridHash2DCounters
+{
+    GridHash2DCounters()
+    : queries(0),
+      hits(0)
+    {}
+
+    GridHash2DCounters &operator+=(const GridHash2DCounters &other)
+    {
+        queries += other.queries;
+        hits += other.hits;
+        return *this;
+    }
+
+    unsigned long queries, hits;
+};
+
+/**
+ * Spatial index for positioned payloads on an unbounded grid of
+ * square cells, of which only the occupied ones are stored (in an
+ * open addressing hash table).  Memory is thus proportional to the
+ * number of elements, not to their extent, and the cell size may be
+ * tiny compared to the latter (e.g. the minimal distance of critical
+ * points).  Insertion and erasure are O(1) expected.
+ *
+ * nearest() and kNearest() first search the cells within the given
+ * radius if that is small, else within a window around the query
+ * position that is doubled until the result is known to be
+ * complete.  nearest() counts its calls and hits (see counters());
+ * the counters are updated atomically, so that concurrent queries
+ * are fine (as long as there is no concurrent insert() or erase()).
+ */
+template<class Position, class Payload>
+class GridHash2D
+{
+  public:
+    typedef PositionedObject<Position, Payload> value_type;
+    typedef typename Position::value_type       CoordType;
+    typedef typename std::vector<value_type>::size_type size_type;
+
+    GridHash2D(double cellSize = 1.0)
+    : cellSize_(cellSize),
+      cellCount_(0),
+      minX_(0), maxX_(0), minY_(0), maxY_(0),
+      cells_(16)
+    {
+        vigra_precondition(cellSize > 0.0,
+                           "GridHash2D: cellSize must be positive");
+    }
+
+    size_type size() const
+    {
+        return elements_.size();
+    }
+
+    bool empty() const
+    {
+        return elements_.empty();
+    }
+
+    double cellSize() const
+    {
+        return cellSize_;
+    }
+
+    const value_type &operator[](size_type index) const
+    {
+        return elements_[index];
+    }
+
+    void clear()
+    {
+        elements_.clear();
+        next_.clear();
+        cells_.assign(16, Cell());
+        cellCount_ = 0;
+    }
+
+    void reserve(size_type count)
+    {
+        elements_.reserve(count);
+        next_.reserve(count);
+    }
+
+    void insert(const Position &position, const Payload &payload)
+    {
+        if(2 * (cellCount_ + 1) > cells_.size())
+            rehash();
+
+        Cell &c(cell(key(position[0]), key(position[1])));
+        if(c.first == FREE)
+        {
+            ++cellCount_;
+            includeInBounds(c.x, c.y);
+        }
+        next_.push_back(c.first >= 0 ? c.first : -1);
+        c.first = elements_.size();
+        elements_.push_back(value_type(position, payload));
+    }
+
+    void insert(const value_type &element)
+    {
+        insert(element.position, element.payload);
+    }
+
+        /**
+         * Remove the element with the given payload, which must have
+         * been inserted at the given position.  Returns false iff no
+         * such element was found.  The last element is moved into
+         * the erased one's index (see operator[]).
+         */
+    bool erase(const Position &position, const Payload &payload)
+    {
+        Cell &c(const_cast<Cell &>(find(key(position[0]), key(position[1]))));
+        int prev = -1, i = c.first;
+        while(i >= 0 && !(elements_[i].payload == payload))
+        {
+            prev = i;
+            i = next_[i];
+        }
+        if(i < 0)
+            return false;
+
+        if(prev < 0)
+            c.first = next_[i] >= 0 ? next_[i] : EMPTIED;
+        else
+            next_[prev] = next_[i];
+
+        int last = elements_.size() - 1;
+        if(i != last)
+        {
+            const Position &p(elements_[last].position);
+            int *link = &const_cast<Cell &>(find(key(p[0]), key(p[1]))).first;
+            while(*link != last)
+                link = &next_[*link];
+            *link = i;
+            elements_[i] = elements_[last];
+            next_[i] = next_[last];
+        }
+        elements_.pop_back();
+        next_.pop_back();
+        return true;
+    }
+
+        /**
+         * Return the element nearest to position whose squared
+         * distance is < maxSquaredDist, or NULL if there is none.
+         */
+    const value_type *nearest(
+        const Position &position,
+        double maxSquaredDist = NumericTraits<double>::max()) const
+    {
+        return nearest(position, maxSquaredDist, AcceptAll());
+    }
+
+        /**
+         * Like above, but only considering the elements for which
+         * accept(element) is true.
+         */
+    template<class PREDICATE>
+    const value_type *nearest(const Position &position,
+                              double maxSquaredDist,
+                              const PREDICATE &accept) const
+    {
+        NearestVisitor<PREDICATE> visitor(*this, position,
+                                          maxSquaredDist, accept);
+        for(double radius = initialRadius(maxSquaredDist);
+            !empty(); radius *= 2)
+        {
+            visitWindow(position, radius, visitor);
+            if(visitor.result)
+            {
+                // anything nearer must be within the found distance:
+                if(visitor.maxSquaredDist > radius*radius)
+                    visitWindow(position, std::sqrt(visitor.maxSquaredDist),
+                                visitor);
+                break;
+            }
+            if(radius*radius >= maxSquaredDist ||
+               windowCoversAll(position, radius))
+                break;
+        }
+
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+        ++counters_.queries;
+        if(visitor.result)
+        {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+            ++counters_.hits;
+        }
+        return visitor.result;
+    }
+
+        /**
+         * Append (at most) the k elements nearest to position whose
+         * squared distances are < maxSquaredDist to result, sorted by
+         * increasing distance.
+         */
+    void kNearest(const Position &position, unsigned int k,
+                  std::vector<value_type> &result,
+                  double maxSquaredDist = NumericTraits<double>::max()) const
+    {
+        if(!k)
+            return;
+
+        KNearestVisitor visitor(*this, position, k, maxSquaredDist);
+        for(double radius = initialRadius(maxSquaredDist);
+            !empty(); radius *= 2)
+        {
+            visitor.reset(maxSquaredDist);
+            visitWindow(position, radius, visitor);
+            if(visitor.candidates.size() == k)
+            {
+                if(visitor.maxSquaredDist > radius*radius)
+                {
+                    double dist2 = visitor.maxSquaredDist;
+                    visitor.reset(maxSquaredDist);
+                    visitWindow(position, std::sqrt(dist2), visitor);
+                }
+                break;
+            }
+            if(radius*radius >= maxSquaredDist ||
+               windowCoversAll(position, radius))
+                break;
+        }
+
+        for(unsigned int i = 0; i < visitor.candidates.size(); ++i)
+            result.push_back(elements_[visitor.candidates[i].second]);
+    }
+
+        /**
+         * Append all elements within the rectangle [upperLeft,
+         * lowerRight) to result (in no particular order).
+         */
+    void inRect(const Position &upperLeft, const Position &lowerRight,
+                std::vector<value_type> &result) const
+    {
+        RectVisitor visitor(*this, upperLeft, lowerRight, result);
+        visitCells(key(upperLeft[0]), key(lowerRight[0]),
+                   key(upperLeft[1]), key(lowerRight[1]), visitor);
+    }
+
+    const GridHash2DCounters &counters() const
+    {
+        return counters_;
+    }
+
+    void resetCounters()
+    {
+        counters_ = GridHash2DCounters();
+    }
+
+  protected:
+    typedef long long Key;
+
+    enum { FREE = -1, EMPTIED = -2 };
+
+    struct Cell
+    {
+        Cell()
+        : x(0),
+          y(0),
+          first(FREE)
+        {}
+
+        Key x, y;
+        int first; // index of the first element, or FREE / EMPTIED
+    };
+
+    struct AcceptAll
+    {
+        bool operator()(const value_type &) const
+        {
+            return true;
+        }
+    };
+
+    template<class PREDICATE>
+    struct NearestVisitor
+    {
+        NearestVisitor(const GridHash2D &index, const Position &position,
+                       double maxSquaredDist, const PREDICATE &accept)
+        : index(index),
+          position(position),
+          maxSquaredDist(maxSquaredDist),
+          accept(accept),
+          result(NULL)
+        {}
+
+        void operator()(int i)
+        {
+            const value_type &element(index.elements_[i]);
+            double dist2 = squaredNorm(element.position - position);
+            if(dist2 < maxSquaredDist && accept(element))
+            {
+                result = &element;
+                maxSquaredDist = dist2;
+            }
+        }
+
+        const GridHash2D &index;
+        const Position &position;
+        double maxSquaredDist;
+        const PREDICATE &accept;
+        const value_type *result;
+    };
+
+    struct KNearestVisitor
+    {
+            // candidates are kept sorted by distance (k is expected
+            // to be small)
+        typedef std::pair<double, int> Candidate;
+
+        KNearestVisitor(const GridHash2D &index, const Position &position,
+                        unsigned int k, double maxSquaredDist)
+        : index(index),
+          position(position),
+          k(k),
+          maxSquaredDist(maxSquaredDist)
+        {}
+
+        void reset(double dist2)
+        {
+            candidates.clear();
+            maxSquaredDist = dist2;
+        }
+
+        void operator()(int i)
+        {
+            double dist2 = squaredNorm(index.elements_[i].position - position);
+            if(dist2 >= maxSquaredDist)
+                return;
+            Candidate candidate(dist2, i);
+            candidates.insert(
+                std::upper_bound(candidates.begin(), candidates.end(),
+                                 candidate, CandidateLess()),
+                candidate);
+            if(candidates.size() > k)
+                candidates.pop_back();
+            if(candidates.size() == k)
+                maxSquaredDist = candidates.back().first;
+        }
+
+        const GridHash2D &index;
+        const Position &position;
+        unsigned int k;
+        double maxSquaredDist;
+        std::vector<Candidate> candidates;
+    };
+
+    struct CandidateLess
+    {
+        template<class Candidate>
+        bool operator()(const Candidate &a, const Candidate &b) const
+        {
+            return a.first < b.first;
+        }
+    };
+
+    struct RectVisitor
+    {
+        RectVisitor(const GridHash2D &index,
+                    const Position &upperLeft, const Position &lowerRight,
+                    std::vector<value_type> &result)
+        : index(index),
+          upperLeft(upperLeft),
+          lowerRight(lowerRight),
+          result(result)
+        {}
+
+        void operator()(int i)
+        {
+            const Position &p(index.elements_[i].position);
+            if(p[0] >= upperLeft[0] && p[0] < lowerRight[0] &&
+               p[1] >= upperLeft[1] && p[1] < lowerRight[1])
+                result.push_back(index.elements_[i]);
+        }
+
+        const GridHash2D &index;
+        const Position &upperLeft, &lowerRight;
+        std::vector<value_type> &result;
+    };
+
+        // small search radii are used as-is, larger ones are
+        // approached from a window of a few cells
+    double initialRadius(double maxSquaredDist) const
+    {
+        return std::min(std::sqrt(maxSquaredDist), 2 * cellSize_);
+    }
+
+    bool windowCoversAll(const Position &position, double radius) const
+    {
+        return key(position[0] - radius) <= minX_ &&
+               key(position[0] + radius) >= maxX_ &&
+               key(position[1] - radius) <= minY_ &&
+               key(position[1] + radius) >= maxY_;
+    }
+
+    template<class VISITOR>
+    void visitWindow(const Position &position, double radius,
+                     VISITOR &visitor) const
+    {
+        visitCells(key(position[0] - radius), key(position[0] + radius),
+                   key(position[1] - radius), key(position[1] + radius),
+                   visitor);
+    }
+
+        // calls visitor(i) for the indices i of all elements in the
+        // cells [x0, x1] x [y0, y1], by looking up every cell or (if
+        // there are more cells than slots) by scanning the table
+    template<class VISITOR>
+    void visitCells(Key x0, Key x1, Key y0, Key y1, VISITOR &visitor) const
+    {
+        if(!cellCount_)
+            return;
+        x0 = std::max(x0, minX_);
+        x1 = std::min(x1, maxX_);
+        y0 = std::max(y0, minY_);
+        y1 = std::min(y1, maxY_);
+        if(x0 > x1 || y0 > y1)
+            return;
+
+        if((double)(x1 - x0 + 1) * (double)(y1 - y0 + 1) > cells_.size())
+        {
+            for(size_type s = 0; s < cells_.size(); ++s)
+            {
+                const Cell &c(cells_[s]);
+                if(c.x >= x0 && c.x <= x1 && c.y >= y0 && c.y <= y1)
+                    for(int i = c.first; i >= 0; i = next_[i])
+                        visitor(i);
+            }
+            return;
+        }
+
+        for(Key y = y0; y <= y1; ++y)
+            for(Key x = x0; x <= x1; ++x)
+                for(int i = find(x, y).first; i >= 0; i = next_[i])
+                    visitor(i);
+    }
+
+    Key key(CoordType coord) const
+    {
+        // keep keys (and window extents) finite for huge or
+        // non-finite coordinates:
+        const double limit = 1e15;
+        double k = std::floor(coord / cellSize_);
+        if(!(k > -limit))
+            return (Key)-limit;
+        if(k > limit)
+            return (Key)limit;
+        return (Key)k;
+    }
+
+    size_type slot(Key x, Key y) const
+    {
+        unsigned long long h =
+            (unsigned long long)x * 0x9E3779B97F4A7C15ULL ^
+            (unsigned long long)y * 0xC2B2AE3D27D4EB4FULL;
+        return (size_type)((h ^ (h >> 29)) & (cells_.size() - 1));
+    }
+
+        // the cell for (x, y), or the free slot it would go into
+    const Cell &find(Key x, Key y) const
+    {
+        size_type s = slot(x, y);
+        while(cells_[s].first != FREE && (cells_[s].x != x || cells_[s].y != y))
+            s = (s + 1) & (cells_.size() - 1);
+        return cells_[s];
+    }
+
+    Cell &cell(Key x, Key y)
+    {
+        Cell &result(const_cast<Cell &>(find(x, y)));
+        result.x = x;
+        result.y = y;
+        return result;
+    }
+
+    void includeInBounds(Key x, Key y)
+    {
+        if(cellCount_ == 1)
+        {
+            minX_ = maxX_ = x;
+            minY_ = maxY_ = y;
+            return;
+        }
+        minX_ = std::min(minX_, x);
+        maxX_ = std::max(maxX_, x);
+        minY_ = std::min(minY_, y);
+        maxY_ = std::max(maxY_, y);
+    }
+
+        // drops the cells emptied by erase() and resizes the table
+        // to at most 1/4 load
+    void rehash()
+    {
+        size_type occupied = 0;
+        for(size_type i = 0; i < cells_.size(); ++i)
+            if(cells_[i].first >= 0)
+                ++occupied;
+
+        size_type newSize = 16;
+        while(newSize < 4 * (occupied + 1))
+            newSize *= 2;
+
+        std::vector<Cell> old(newSize);
+        old.swap(cells_);
+        cellCount_ = 0;
+        for(size_type i = 0; i < old.size(); ++i)
+        {
+            if(old[i].first >= 0)
+            {
+                cell(old[i].x, old[i].y).first = old[i].first;
+                ++cellCount_;
+                includeInBounds(old[i].x, old[i].y);
+            }
+        }
+    }
+
+    double cellSize_;
+    size_type cellCount_; // number of non-FREE slots
+    Key minX_, maxX_, minY_, maxY_; // bounds of the keys of these
+    std::vector<Cell> cells_;
+    std::vector<value_type> elements_;
+    std::vector<int> next_;
+    mutable GridHash2DCounters counters_;
+};
+
+} // namespace vigra
+
+#endif // VIGRA_GRIDHASH2D_HXX
@@ -0,0 +1,521 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2007-2019 by Hans Meine                      */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef VIGRA_SPLINEDERIVATIVES_HXX
+#define VIGRA_SPLINEDERIVATIVES_HXX
+
+#include <vigra/splineimageview.hxx>
+#include <vigra/numerictraits.hxx>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace vigra {
+
+/** First and second order partial derivatives of a spline image
+    view at one position.
+*/
+struct SplineDerivatives
+{
+    double dx, dy, dxx, dxy, dyy;
+};
+
+/**
+ * Evaluates SplineDerivatives by calling dx(), dy(), dxx(), dxy()
+ * and dyy() of an arbitrary image view separately.  The evaluator
+ * keeps its own copy of the view (views like SplineImageView cache
+ * per-facet data, so one copy per thread is needed).
+ */
+template <class IMAGEVIEW>
+class SeparateSplineDerivatives
+{
+  public:
+    typedef IMAGEVIEW ImageView;
+    typedef typename ImageView::value_type value_type;
+
+    explicit SeparateSplineDerivatives(ImageView const & image)
+    : image_(image)
+    {}
+
+    int width() const { return image_.width(); }
+    int height() const { return image_.height(); }
+
+    bool isValid(double x, double y) const
+    {
+        return image_.isValid(x, y);
+    }
+
+    void operator()(double x, double y, SplineDerivatives & result) const
+    {
+        result.dx  = image_.dx(x, y);
+        result.dy  = image_.dy(x, y);
+        result.dxx = image_.dxx(x, y);
+        result.dxy = image_.dxy(x, y);
+        result.dyy = image_.dyy(x, y);
+    }
+
+        /// evaluate at count positions (x[i], y[i])
+    void operator()(int count, const double *x, const double *y,
+                    SplineDerivatives *result) const
+    {
+        for(int i = 0; i < count; ++i)
+            (*this)(x[i], y[i], result[i]);
+    }
+
+  protected:
+    ImageView image_;
+};
+
+namespace detail {
+
+    // Arithmetic on the lanes of a SIMD register of doubles (four
+    // with AVX, two with SSE2, i.e. always on x86-64), so that the
+    // same code evaluates the splines at several positions at once.
+    // ScalarLanes is the fallback (and used for single positions).
+struct ScalarLanes
+{
+    enum { size = 1 };
+    typedef double Vector;
+
+    static Vector load(const double *p) { return *p; }
+    static void store(double *p, Vector v) { *p = v; }
+    static Vector set1(double v) { return v; }
+    static Vector add(Vector a, Vector b) { return a + b; }
+    static Vector sub(Vector a, Vector b) { return a - b; }
+    static Vector mul(Vector a, Vector b) { return a * b; }
+
+        // rows[l][columns[l]] for each lane l
+    template <class T>
+    static Vector gather(T const * const * rows, const int * columns)
+    {
+        return rows[0][columns[0]];
+    }
+};
+
+#if defined(__AVX__)
+struct SIMDLanes
+{
+    enum { size = 4 };
+    typedef __m256d Vector;
+
+    static Vector load(const double *p) { return _mm256_loadu_pd(p); }
+    static void store(double *p, Vector v) { _mm256_storeu_pd(p, v); }
+    static Vector set1(double v) { return _mm256_set1_pd(v); }
+    static Vector add(Vector a, Vector b) { return _mm256_add_pd(a, b); }
+    static Vector sub(Vector a, Vector b) { return _mm256_sub_pd(a, b); }
+    static Vector mul(Vector a, Vector b) { return _mm256_mul_pd(a, b); }
+
+    template <class T>
+    static Vector gather(T const * const * rows, const int * columns)
+    {
+        return _mm256_set_pd(rows[3][columns[3]], rows[2][columns[2]],
+                             rows[1][columns[1]], rows[0][columns[0]]);
+    }
+};
+#elif defined(__SSE2__)
+struct SIMDLanes
+{
+    enum { size = 2 };
+    typedef __m128d Vector;
+
+    static Vector load(const double *p) { return _mm_loadu_pd(p); }
+    static void store(double *p, Vector v) { _mm_storeu_pd(p, v); }
+    static Vector set1(double v) { return _mm_set1_pd(v); }
+    static Vector add(Vector a, Vector b) { return _mm_add_pd(a, b); }
+    static Vector sub(Vector a, Vector b) { return _mm_sub_pd(a, b); }
+    static Vector mul(Vector a, Vector b) { return _mm_mul_pd(a, b); }
+
+    template <class T>
+    static Vector gather(T const * const * rows, const int * columns)
+    {
+        return _mm_set_pd(rows[1][columns[1]], rows[0][columns[0]]);
+    }
+};
+#else
+typedef ScalarLanes SIMDLanes;
+#endif
+
+    // Kernel weights w[d][i] (derivative order d = 0..2) of the
+    // B-spline of the given ORDER >= 2 at the offset u in [0, 1) from
+    // the first of its ORDER+1 support points, computed branch-free by
+    // the Cox-de Boor recursion of the uniform B-splines b (the
+    // derivatives are differences of the weights of lower orders).
+template <int ORDER, class LANES>
+void bsplineWeights(typename LANES::Vector u,
+                    typename LANES::Vector (*w)[ORDER + 1])
+{
+    typedef typename LANES::Vector Vector;
+    enum { ksize = ORDER + 1 };
+
+    Vector zero = LANES::set1(0.0), oneMinusU = LANES::sub(LANES::set1(1.0), u),
+           b[ksize], diff[ksize + 1];
+    b[0] = LANES::set1(1.0);
+    for(int k = 0; k <= ORDER; ++k)
+    {
+        if(k > 0)
+        {
+            // b[i] = ((u + k - i) b[i-1] + (1 - u + i) b[i]) / k
+            Vector scale = LANES::set1(1.0 / k);
+            b[k] = LANES::mul(LANES::mul(u, b[k - 1]), scale);
+            for(int i = k - 1; i > 0; --i)
+                b[i] = LANES::mul(
+                    LANES::add(
+                        LANES::mul(LANES::add(u, LANES::set1(k - i)), b[i - 1]),
+                        LANES::mul(LANES::add(oneMinusU, LANES::set1(i)), b[i])),
+                    scale);
+            b[0] = LANES::mul(LANES::mul(oneMinusU, b[0]), scale);
+        }
+
+        if(k == ORDER - 2 || k == ORDER - 1)
+        {
+            // diff[i] = b[i-1] - b[i] (for i = 0..k+1) is the
+            // derivative of the weights of order k+1:
+            diff[0] = LANES::sub(zero, b[0]);
+            for(int i = 1; i <= k; ++i)
+                diff[i] = LANES::sub(b[i - 1], b[i]);
+            diff[k + 1] = b[k];
+
+            if(k == ORDER - 2)
+            {
+                for(int i = 0; i < ksize; ++i)
+                    w[2][i] = LANES::sub(i > 0 ? diff[i - 1] : zero,
+                                         i <= k + 1 ? diff[i] : zero);
+            }
+            else
+            {
+                for(int i = 0; i < ksize; ++i)
+                    w[1][i] = diff[i];
+            }
+        }
+    }
+    for(int i = 0; i < ksize; ++i)
+        w[0][i] = b[i];
+}
+
+    // coefficient indices of the ORDER+1 support points of x
+    // (reflected at the borders like SplineImageView does) for the
+    // given lane; returns the offset of x from the first one (see
+    // bsplineWeights())
+template <int ORDER, int LANES>
+double splineIndices(double x, int size1, int (*index)[LANES], int lane)
+{
+    enum { ksize = ORDER + 1, kcenter = ORDER / 2 };
+
+    int center = (ORDER % 2)
+                 ? (int)VIGRA_CSTD::floor(x)
+                 : (int)VIGRA_CSTD::floor(x + 0.5);
+    for(int i = 0; i < ksize; ++i)
+    {
+        int k = center - kcenter + i;
+        index[i][lane] = k < 0
+                         ? -k
+                         : (k > size1 ? 2*size1 - k : k);
+    }
+    return (ORDER % 2) ? x - center : x - center + 0.5;
+}
+
+} // namespace detail
+
+/**
+ * Fast evaluation of SplineDerivatives.  The generic version falls
+ * back to SeparateSplineDerivatives; for SplineImageView, all five
+ * derivatives are computed from one set of kernel weights and a
+ * single pass over the (ORDER+1)x(ORDER+1) spline coefficients,
+ * instead of five full evaluations that each recompute indices and
+ * weights.  Batches of positions are evaluated in the lanes of SIMD
+ * registers (see detail::SIMDLanes), i.e. several positions at once.
+ * This version only reads the view's coefficient image and may thus
+ * be shared (or cheaply copied) between threads.
+ */
+template <class IMAGEVIEW>
+class SplineDerivativeEvaluator
+: public SeparateSplineDerivatives<IMAGEVIEW>
+{
+  public:
+    explicit SplineDerivativeEvaluator(IMAGEVIEW const & image)
+    : SeparateSplineDerivatives<IMAGEVIEW>(image)
+    {}
+};
+
+template <int ORDER, class VALUETYPE>
+class SplineDerivativeEvaluator<SplineImageView<ORDER, VALUETYPE> >
+{
+  public:
+    typedef SplineImageView<ORDER, VALUETYPE> ImageView;
+    typedef typename ImageView::InternalImage InternalImage;
+    typedef VALUETYPE value_type;
+
+    enum { ksize = ORDER + 1 };
+
+    explicit SplineDerivativeEvaluator(ImageView const & image)
+    : image_(image),
+      w1_(image.width() - 1),
+      h1_(image.height() - 1)
+    {}
+
+    int width() const { return image_.width(); }
+    int height() const { return image_.height(); }
+
+    bool isValid(double x, double y) const
+    {
+        return image_.isValid(x, y);
+    }
+
+    void operator()(double x, double y, SplineDerivatives & result) const
+    {
+        evaluate<detail::ScalarLanes>(&x, &y, &result);
+    }
+
+        /// evaluate at count positions (x[i], y[i])
+    void operator()(int count, const double *x, const double *y,
+                    SplineDerivatives *result) const
+    {
+        typedef detail::SIMDLanes Lanes;
+        int i = 0;
+        for(; i + Lanes::size <= count; i += Lanes::size)
+            evaluate<Lanes>(x + i, y + i, result + i);
+        if(i == count)
+            return;
+
+        // pad the remaining positions to a full set of lanes:
+        double px[Lanes::size], py[Lanes::size];
+        SplineDerivatives presult[Lanes::size];
+        for(int l = 0; l < Lanes::size; ++l)
+        {
+            px[l] = x[std::min(i + l, count - 1)];
+            py[l] = y[std::min(i + l, count - 1)];
+        }
+        evaluate<Lanes>(px, py, presult);
+        for(int l = 0; l < count - i; ++l)
+            result[i + l] = presult[l];
+    }
+
+  protected:
+        // the derivatives at LANES::size positions
+    template <class LANES>
+    void evaluate(const double *x, const double *y,
+                  SplineDerivatives *result) const
+    {
+        typedef typename LANES::Vector Vector;
+        enum { lanes = LANES::size };
+
+        int ix[ksize][lanes], iy[ksize][lanes];
+        double ux[lanes], uy[lanes];
+        for(int l = 0; l < lanes; ++l)
+        {
+            ux[l] = detail::splineIndices<ORDER>(x[l], w1_, ix, l);
+            uy[l] = detail::splineIndices<ORDER>(y[l], h1_, iy, l);
+        }
+
+        Vector wx[3][ksize], wy[3][ksize];
+        detail::bsplineWeights<ORDER, LANES>(LANES::load(ux), wx);
+        detail::bsplineWeights<ORDER, LANES>(LANES::load(uy), wy);
+
+        InternalImage const & coefficients = image_.image();
+
+        Vector zero = LANES::set1(0.0),
+               dx = zero, dy = zero, dxx = zero, dxy = zero, dyy = zero;
+        for(int j = 0; j < ksize; ++j)
+        {
+            typename InternalImage::const_pointer rows[lanes];
+            for(int l = 0; l < lanes; ++l)
+                rows[l] = coefficients[iy[j][l]];
+
+            Vector s0 = zero, s1 = zero, s2 = zero;
+            for(int i = 0; i < ksize; ++i)
+            {
+                Vector cv = LANES::gather(rows, ix[i]);
+                s0 = LANES::add(s0, LANES::mul(wx[0][i], cv));
+                s1 = LANES::add(s1, LANES::mul(wx[1][i], cv));
+                s2 = LANES::add(s2, LANES::mul(wx[2][i], cv));
+            }
+            dx  = LANES::add(dx,  LANES::mul(wy[0][j], s1));
+            dxx = LANES::add(dxx, LANES::mul(wy[0][j], s2));
+            dy  = LANES::add(dy,  LANES::mul(wy[1][j], s0));
+            dxy = LANES::add(dxy, LANES::mul(wy[1][j], s1));
+            dyy = LANES::add(dyy, LANES::mul(wy[2][j], s0));
+        }
+
+        double out[5][lanes];
+        LANES::store(out[0], dx);
+        LANES::store(out[1], dy);
+        LANES::store(out[2], dxx);
+        LANES::store(out[3], dxy);
+        LANES::store(out[4], dyy);
+        for(int l = 0; l < lanes; ++l)
+        {
+            result[l].dx  = out[0][l];
+            result[l].dy  = out[1][l];
+            result[l].dxx = out[2][l];
+            result[l].dxy = out[3][l];
+            result[l].dyy = out[4][l];
+        }
+    }
+
+    ImageView const & image_;
+    int w1_, h1_;
+};
+
+    // linear (and constant) splines have no (useful) second
+    // derivatives; keep using the view itself
+template <class VALUETYPE>
+class SplineDerivativeEvaluator<SplineImageView<1, VALUETYPE> >
+: public SeparateSplineDerivatives<SplineImageView<1, VALUETYPE> >
+{
+  public:
+    explicit SplineDerivativeEvaluator(SplineImageView<1, VALUETYPE> const & image)
+    : SeparateSplineDerivatives<SplineImageView<1, VALUETYPE> >(image)
+    {}
+};
+
+template <class VALUETYPE>
+class SplineDerivativeEvaluator<SplineImageView<0, VALUETYPE> >
+: public SeparateSplineDerivatives<SplineImageView<0, VALUETYPE> >
+{
+  public:
+    explicit SplineDerivativeEvaluator(SplineImageView<0, VALUETYPE> const & image)
+    : SeparateSplineDerivatives<SplineImageView<0, VALUETYPE> >(image)
+    {}
+};
+
+/**
+ * Spline image view that evaluates the spline of a SplineImageView
+ * from the latter's coefficient image, without copying it.  Like
+ * SplineImageView, it caches the indices and kernel weights of the
+ * last position (so that e.g. dx() and dy() at the same position
+ * share them), but in its own members: concurrent threads need
+ * their own SharedSplineImageView, yet these are cheap to create.
+ * The generic version keeps a copy of the view; SplineImageView
+ * must have ORDER >= 2 (i.e. second derivatives).
+ */
+template <class IMAGEVIEW>
+class SharedSplineImageView
+{
+  public:
+    typedef IMAGEVIEW ImageView;
+    typedef typename ImageView::value_type value_type;
+
+    explicit SharedSplineImageView(ImageView const & image)
+    : image_(image)
+    {}
+
+    int width() const { return image_.width(); }
+    int height() const { return image_.height(); }
+
+    bool isInside(double x, double y) const { return image_.isInside(x, y); }
+    bool isValid(double x, double y) const { return image_.isValid(x, y); }
+
+    value_type operator()(double x, double y) const { return image_(x, y); }
+    value_type dx(double x, double y) const { return image_.dx(x, y); }
+    value_type dy(double x, double y) const { return image_.dy(x, y); }
+    value_type dxx(double x, double y) const { return image_.dxx(x, y); }
+    value_type dxy(double x, double y) const { return image_.dxy(x, y); }
+    value_type dyy(double x, double y) const { return image_.dyy(x, y); }
+
+  protected:
+    ImageView image_;
+};
+
+template <int ORDER, class VALUETYPE>
+class SharedSplineImageView<SplineImageView<ORDER, VALUETYPE> >
+{
+  public:
+    typedef SplineImageView<ORDER, VALUETYPE> ImageView;
+    typedef typename ImageView::InternalImage InternalImage;
+    typedef VALUETYPE value_type;
+
+    enum { ksize = ORDER + 1 };
+
+    explicit SharedSplineImageView(ImageView const & image)
+    : image_(image),
+      w1_(image.width() - 1),
+      h1_(image.height() - 1),
+      x_(NumericTraits<double>::max()),
+      y_(NumericTraits<double>::max())
+    {}
+
+    int width() const { return image_.width(); }
+    int height() const { return image_.height(); }
+
+    bool isInside(double x, double y) const { return image_.isInside(x, y); }
+    bool isValid(double x, double y) const { return image_.isValid(x, y); }
+
+    value_type operator()(double x, double y) const { return convolve(x, y, 0, 0); }
+    value_type dx(double x, double y) const { return convolve(x, y, 1, 0); }
+    value_type dy(double x, double y) const { return convolve(x, y, 0, 1); }
+    value_type dxx(double x, double y) const { return convolve(x, y, 2, 0); }
+    value_type dxy(double x, double y) const { return convolve(x, y, 1, 1); }
+    value_type dyy(double x, double y) const { return convolve(x, y, 0, 2); }
+
+  protected:
+    value_type convolve(double x, double y, int xorder, int yorder) const
+    {
+        if(x != x_)
+        {
+            x_ = x;
+            detail::bsplineWeights<ORDER, detail::ScalarLanes>(
+                detail::splineIndices<ORDER>(x, w1_, ix_, 0), wx_);
+        }
+        if(y != y_)
+        {
+            y_ = y;
+            detail::bsplineWeights<ORDER, detail::ScalarLanes>(
+                detail::splineIndices<ORDER>(y, h1_, iy_, 0), wy_);
+        }
+
+        InternalImage const & coefficients = image_.image();
+        double const * wx = wx_[xorder], * wy = wy_[yorder];
+        double sum = 0.0;
+        for(int j = 0; j < ksize; ++j)
+        {
+            typename InternalImage::const_pointer row = coefficients[iy_[j][0]];
+            double s = 0.0;
+            for(int i = 0; i < ksize; ++i)
+                s += wx[i]*row[ix_[i][0]];
+            sum += wy[j]*s;
+        }
+        return NumericTraits<VALUETYPE>::fromRealPromote(sum);
+    }
+
+    ImageView const & image_;
+    int w1_, h1_;
+    mutable double x_, y_;
+    mutable int ix_[ksize][1], iy_[ksize][1];
+    mutable double wx_[3][ksize], wy_[3][ksize];
+};
+
+
+} // namespace vigra
+
+#endif // VIGRA_SPLINEDERIVATIVES_HXX
@@ -25,7 +25,9 @@
 #include <cmath>
 #include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <vector>
 #include "vigra/mathutil.hxx"
 #include "vigra/edgedetection.hxx"
 #include "vigra/polynomial.hxx"
@@ -33,6 +35,9 @@
 #include "vigra/splineimageview.hxx"
 #include "vigra/pixelneighborhood.hxx"
 #include "map2d.hxx"
+#include "gridhash2d.hxx"
+#include "splinederivatives.hxx"
+#include "../threading.hxx"
 
 namespace vigra {
 
@@ -433,6 +438,107 @@ findDirectedMaximum(IMAGEVIEW const & image,
     return Failed;
 }
 
+    // maximal number of seeds findCriticalPointsNewtonMethodBatch()
+    // iterates at once
+enum { criticalPointBatchSize = 16 };
+
+/** Newton iteration like findCriticalPointNewtonMethod() with a
+    search radius, but for count <= criticalPointBatchSize seeds
+    (x[i], y[i]) at once.  The derivatives are taken from an evaluator
+    like SplineDerivativeEvaluator, which is called once per
+    iteration for all seeds that have not yet converged or failed.
+    Like findCriticalPointNewtonMethod(), the Newton steps are
+    computed in the evaluator's value_type.
+*/
+template <class EVALUATOR>
+void
+findCriticalPointsNewtonMethodBatch(
+    EVALUATOR const & image, int count,
+    const double *x, const double *y,
+    double *xx, double *yy, CriticalPoint *types,
+    const double stepEpsilon, const double squaredSearchRadius)
+{
+    typedef typename EVALUATOR::value_type Value;
+    Value zero = NumericTraits<Value>::zero();
+
+    vigra_precondition(count <= (int)criticalPointBatchSize,
+        "findCriticalPointsNewtonMethodBatch(): too many seeds");
+
+    int active[criticalPointBatchSize];
+    double ax[criticalPointBatchSize], ay[criticalPointBatchSize];
+    SplineDerivatives d[criticalPointBatchSize];
+
+    for(int i = 0; i < count; ++i)
+    {
+        xx[i] = x[i];
+        yy[i] = y[i];
+        types[i] = Failed;
+        active[i] = i;
+    }
+
+    double stepEpsilon2 = stepEpsilon * stepEpsilon;
+    int activeCount = count;
+    for(int iteration = 0; activeCount && iteration < 100; ++iteration)
+    {
+        for(int k = 0; k < activeCount; ++k)
+        {
+            ax[k] = xx[active[k]];
+            ay[k] = yy[active[k]];
+        }
+        image(activeCount, ax, ay, d);
+
+        int stillActive = 0;
+        for(int k = 0; k < activeCount; ++k)
+        {
+            int i = active[k];
+            Value dx = (Value)d[k].dx;
+            Value dy = (Value)d[k].dy;
+            Value dxx = (Value)d[k].dxx;
+            Value dxy = (Value)d[k].dxy;
+            Value dyy = (Value)d[k].dyy;
+            Value det = dxx*dyy - dxy*dxy;
+            double sxx = 0.0, syy = 0.0;
+
+            if(det != zero)
+            {
+                sxx = (dxy*dy - dyy*dx) / det;
+                syy = (dxy*dx - dxx*dy) / det;
+                xx[i] += sxx;
+                yy[i] += syy;
+                if(!image.isValid(xx[i], yy[i]))
+                    continue; // coordinates out of range
+            }
+
+            if(sxx*sxx + syy*syy < stepEpsilon2) // convergence
+            {
+                if(xx[i] < -stepEpsilon || xx[i] > (double)(image.width())-1.0+stepEpsilon ||
+                   yy[i] < -stepEpsilon || yy[i] > (double)(image.height())-1.0+stepEpsilon)
+                    continue; // coordinates out of range
+
+                if(det == zero)
+                {
+                    if(dx == zero && dy == zero)
+                        types[i] = Saddle;
+                    // else: Hessian singular
+                }
+                else if(det < zero)
+                    types[i] = Saddle;
+                else if(dxx + dyy > zero)
+                    types[i] = Minimum;
+                else
+                    types[i] = Maximum;
+                continue;
+            }
+
+            if(sq(xx[i]-x[i]) + sq(yy[i]-y[i]) > squaredSearchRadius)
+                continue;
+
+            active[stillActive++] = i;
+        }
+        activeCount = stillActive;
+    }
+}
+
 struct CriticalPointHolder
 {
     double x,y;
@@ -468,126 +574,585 @@ struct CriticalPointsCompare
     }
 };
 
-template <class IMAGEVIEW, class VECTOR>
-void findCriticalPointsNewtonMethod(
-    IMAGEVIEW const & image,
-    VECTOR *minima, VECTOR *saddles, VECTOR *maxima,
-    double minCPDist, double stepEpsilon, unsigned int oversampling)
+    // Newton iterations started from a seed are abandoned once they
+    // wander farther than this (in pixels) from it.
+static const double criticalPointSearchRadius = 2.0;
+
+/** Progress callback for findCriticalPointsNewtonMethod() which
+    reproduces the former console output on std::cerr.  Callbacks
+    are called with the percentage of processed rows, and with 100
+    once the search has finished.
+*/
+class CriticalPointsProgressStream
 {
-    int w = image.width();
-    int h = image.height();
+  public:
+    CriticalPointsProgressStream(const char *name)
+    : name_(name)
+    {}
 
-    typedef typename IMAGEVIEW::value_type Value;
-    typedef typename VECTOR::value_type Coordinate;
+    void operator()(int percent) const
+    {
+        if(percent < 100)
+            std::cerr << name_ << ": " << percent << "%\r";
+        else
+            std::cerr << name_ << ": done.\n";
+    }
 
-    double d = 1.0 / oversampling;
-    double squareMinCPDist = sq(minCPDist);
+  protected:
+    const char *name_;
+};
+
+/** Progress callback for findCriticalPointsNewtonMethod() that
+    does not report anything.
+*/
+struct CriticalPointsNoProgress
+{
+    void operator()(int) const
+    {}
+};
+
+namespace detail {
+
+struct AllCriticalPointSeeds
+{
+    bool operator()(int, int) const
+    {
+        return true;
+    }
+};
+
+template <class MaskIterator, class MaskAccessor>
+class MaskedCriticalPointSeeds
+{
+  public:
+    MaskedCriticalPointSeeds(pair<MaskIterator, MaskAccessor> mask)
+    : mask_(mask)
+    {}
+
+    bool operator()(int x, int y) const
+    {
+        return mask_.second(mask_.first, Diff2D(x, y)) != 0;
+    }
+
+  protected:
+    pair<MaskIterator, MaskAccessor> mask_;
+};
+
+class RectCriticalPointSeeds
+{
+  public:
+    RectCriticalPointSeeds(Rect2D const & rect)
+    : rect_(rect)
+    {}
+
+    bool operator()(int x, int y) const
+    {
+        return rect_.contains(Point2D(x, y));
+    }
+
+  protected:
+    Rect2D rect_;
+};
+
+    // placeholder for critical points removed by
+    // SubPixelWatersheds::updateCriticalPoints()
+inline TinyVector<double, 2> removedCriticalPoint()
+{
+    return TinyVector<double, 2>(-NumericTraits<double>::max(),
+                                 -NumericTraits<double>::max());
+}
+
+    // the facet (pixel) containing p, clamped to imageRect
+inline Point2D
+criticalPointFacet(TinyVector<double, 2> const & p, Rect2D const & imageRect)
+{
+    int x = (int)VIGRA_CSTD::floor(p[0] + 0.5);
+    int y = (int)VIGRA_CSTD::floor(p[1] + 0.5);
+    return Point2D(std::max(imageRect.left(), std::min(x, imageRect.right() - 1)),
+                   std::max(imageRect.top(), std::min(y, imageRect.bottom() - 1)));
+}
+
+struct UntakenCriticalPoint
+{
+    UntakenCriticalPoint(std::vector<char> const & taken)
+    : taken_(taken)
+    {}
 
-    Map2D<Coordinate> points;
+    template <class Element>
+    bool operator()(Element const & point) const
+    {
+        return !taken_[point.payload];
+    }
+
+    std::vector<char> const & taken_;
+};
+
+    // Replaces the points whose facets lie within rect by the ones
+    // found there (see SubPixelWatersheds::updateCriticalPoints())
+    // and appends the indices of the changed points to changed.
+template <class POINTS>
+void replaceCriticalPoints(POINTS & points, POINTS const & found,
+                           Rect2D const & rect, Rect2D const & imageRect,
+                           std::vector<int> & changed)
+{
+    typedef TinyVector<double, 2> Point;
+    Point removed(removedCriticalPoint());
 
-    // search for critical points
-    int percent = -1, lastPercent = -1;
-    //std::cerr << "\n";
-    for(int y=0; y <= h-1; ++y)
+    GridHash2D<Point, int> oldPoints(1.0);
+    std::vector<int> oldIndices;
+    for(unsigned int i = 1; i < points.size(); ++i)
     {
-        percent = 100 * y / h;
-        if(percent != lastPercent)
+        if(points[i] != removed &&
+           rect.contains(criticalPointFacet(points[i], imageRect)))
         {
-            std::cerr << "findCriticalPointsNewtonMethod(): " << percent << "%\r";
-            lastPercent = percent;
+            oldPoints.insert(points[i], i);
+            oldIndices.push_back(i);
         }
+    }
+
+    // points that (nearly) stayed keep their indices:
+    std::vector<char> taken(points.size(), 0);
+    std::vector<unsigned int> added;
+    for(unsigned int j = 1; j < found.size(); ++j)
+    {
+        if(!rect.contains(criticalPointFacet(found[j], imageRect)))
+            continue;
+        typename GridHash2D<Point, int>::value_type const * old =
+            oldPoints.nearest(found[j], 0.25, UntakenCriticalPoint(taken));
+        if(!old)
+        {
+            added.push_back(j);
+            continue;
+        }
+        taken[old->payload] = 1;
+        if(old->position != found[j])
+        {
+            points[old->payload] = found[j];
+            changed.push_back(old->payload);
+        }
+    }
+
+    // new points take over the indices of disappeared ones first:
+    std::vector<int>::const_iterator oldIndex = oldIndices.begin();
+    for(unsigned int k = 0; k < added.size(); ++k)
+    {
+        while(oldIndex != oldIndices.end() && taken[*oldIndex])
+            ++oldIndex;
+        if(oldIndex != oldIndices.end())
+        {
+            points[*oldIndex] = found[added[k]];
+            taken[*oldIndex] = 1;
+            changed.push_back(*oldIndex);
+        }
+        else
+        {
+            changed.push_back(points.size());
+            points.push_back(found[added[k]]);
+        }
+    }
+
+    for(; oldIndex != oldIndices.end(); ++oldIndex)
+    {
+        if(!taken[*oldIndex])
+        {
+            points[*oldIndex] = removed;
+            changed.push_back(*oldIndex);
+        }
+    }
+    std::sort(changed.begin(), changed.end());
+}
+
+    // whether one of the segments of the polyline may pass through
+    // the box ul..lr (checking the bounding boxes of the segments)
+template <class POINTS, class Point>
+bool polylineMayCrossBox(POINTS const & points,
+                         Point const & ul, Point const & lr)
+{
+    for(unsigned int i = 0; i < points.size(); ++i)
+    {
+        Point const & p = points[i];
+        Point const & q = points[i + 1 < points.size() ? i + 1 : i];
+        if(std::max(p[0], q[0]) >= ul[0] && std::min(p[0], q[0]) <= lr[0] &&
+           std::max(p[1], q[1]) >= ul[1] && std::min(p[1], q[1]) <= lr[1])
+            return true;
+    }
+    return false;
+}
+
+    // cells of about minCPDist make the dedup queries visit at most
+    // 3x3 cells (minCPDist may be 0, i.e. no dedup)
+inline double criticalPointHashCellSize(double minCPDist)
+{
+    return minCPDist > 0.0 ? minCPDist : 1.0;
+}
+
+template <class Coordinate>
+struct CriticalPointCandidate
+{
+    Coordinate point;
+    CriticalPoint type;
+    bool halo; // acceptance has to be decided when merging the bands
+
+    CriticalPointCandidate(Coordinate const & p, CriticalPoint t, bool h)
+    : point(p),
+      type(t),
+      halo(h)
+    {}
+};
+
+    // Counts finished seed rows (from all threads) and reports the
+    // percentage; only the thread that started the search calls the
+    // callback, which may thus be e.g. a Python callable.
+template <class PROGRESS>
+class CriticalPointsProgressCounter
+{
+  public:
+    CriticalPointsProgressCounter(PROGRESS & progress, int rowCount)
+    : progress_(progress),
+      rowCount_(rowCount ? rowCount : 1),
+      rowsDone_(0),
+      lastPercent_(-1)
+    {}
+
+    void start()
+    {
+        report(0);
+    }
+
+    void rowDone()
+    {
+        int rowsDone;
+#ifdef _OPENMP
+#pragma omp critical(geomap_critical_points_progress)
+#endif
+        rowsDone = ++rowsDone_;
+        if(::detail::currentThread() == 0)
+            report(std::min(99, 100 * rowsDone / rowCount_));
+    }
+
+    void finish()
+    {
+        report(100);
+    }
+
+  protected:
+    void report(int percent)
+    {
+        if(percent != lastPercent_)
+        {
+            lastPercent_ = percent;
+            progress_(percent);
+        }
+    }
+
+    PROGRESS & progress_;
+    int rowCount_, rowsDone_, lastPercent_;
+};
+
+    // Deduplicates the converged points of one band in seed order.
+    // Points below haloEnd may coincide with points found from the
+    // previous band, so their fate (and the fate of any later point
+    // close to one of them) is left to mergeCriticalPointCandidates();
+    // all other points are accepted or rejected here exactly as the
+    // serial search would.
+template <class CANDIDATES>
+class CriticalPointCandidateCollector
+{
+  public:
+    typedef typename CANDIDATES::value_type Candidate;
+
+    CriticalPointCandidateCollector(CANDIDATES & candidates,
+                                    double haloEnd, double minCPDist)
+    : candidates_(candidates),
+      haloEnd_(haloEnd),
+      squareMinCPDist_(sq(minCPDist)),
+      accepted_(criticalPointHashCellSize(minCPDist)),
+      halo_(criticalPointHashCellSize(minCPDist))
+    {}
+
+    void add(CriticalPoint type, double x, double y)
+    {
+        if(type == Failed)
+            return;
+
+        TinyVector<double, 2> c(x, y);
+        if(y < haloEnd_ || halo_.nearest(c, squareMinCPDist_))
+        {
+            candidates_.push_back(Candidate(c, type, true));
+            halo_.insert(c, 0);
+            return;
+        }
+
+        if(accepted_.nearest(c, squareMinCPDist_))
+            return;
+
+        candidates_.push_back(Candidate(c, type, false));
+        accepted_.insert(c, 0);
+    }
+
+    GridHash2DCounters counters() const
+    {
+        GridHash2DCounters result(accepted_.counters());
+        return result += halo_.counters();
+    }
+
+  protected:
+    CANDIDATES & candidates_;
+    double haloEnd_, squareMinCPDist_;
+    GridHash2D<TinyVector<double, 2>, int> accepted_, halo_;
+};
+
+    // Runs the Newton iterations for all seeds in rows
+    // [beginRow, endRow); the oversampling^2 seeds of each pixel are
+    // iterated in batches.
+template <class EVALUATOR, class SEEDS, class CANDIDATES, class COUNTER>
+void collectCriticalPointCandidates(
+    EVALUATOR const & image, SEEDS const & seeds,
+    int beginRow, int endRow, double haloEnd,
+    double minCPDist, double stepEpsilon, unsigned int oversampling,
+    CANDIDATES & candidates, COUNTER & counter,
+    GridHash2DCounters & dedupCounters)
+{
+    int w = image.width();
+    double d = 1.0 / oversampling;
+
+    CriticalPointCandidateCollector<CANDIDATES> collector(
+        candidates, haloEnd, minCPDist);
+
+    double sx[criticalPointBatchSize], sy[criticalPointBatchSize],
+           xx[criticalPointBatchSize], yy[criticalPointBatchSize];
+    CriticalPoint types[criticalPointBatchSize];
+
+    for(int y = beginRow; y < endRow; ++y)
+    {
         for(int x=0; x <= w-1; ++x)
         {
+            if(!seeds(x, y))
+                continue;
+            int count = 0;
             for(double dy = 0.0; dy < 1.0; dy += d)
             {
                 for(double dx = 0.0; dx < 1.0; dx += d)
                 {
-                    double xx, yy;
-                    CriticalPoint type = findCriticalPointNewtonMethod(
-                        image, x + dx, y + dy, &xx, &yy, stepEpsilon, 4.0);
-                    if(type == Failed)
+                    sx[count] = x + dx;
+                    sy[count] = y + dy;
+                    if(++count < (int)criticalPointBatchSize)
                         continue;
 
-                    Coordinate c(xx, yy);
-                    if(points.nearest(c, squareMinCPDist) != points.end())
-                        continue;
-
-                    if(type == Saddle)
-                        saddles->push_back(c);
-                    else if(type == Minimum)
-                        minima->push_back(c);
-                    else
-                        maxima->push_back(c);
-
-                    points.insert(c);
+                    findCriticalPointsNewtonMethodBatch(
+                        image, count, sx, sy, xx, yy, types, stepEpsilon,
+                        sq(criticalPointSearchRadius));
+                    for(int k = 0; k < count; ++k)
+                        collector.add(types[k], xx[k], yy[k]);
+                    count = 0;
                 }
             }
+            findCriticalPointsNewtonMethodBatch(
+                image, count, sx, sy, xx, yy, types, stepEpsilon,
+                sq(criticalPointSearchRadius));
+            for(int k = 0; k < count; ++k)
+                collector.add(types[k], xx[k], yy[k]);
         }
+        counter.rowDone();
     }
-    std::cerr << "findCriticalPointsNewtonMethod(): done.\n";
+    dedupCounters += collector.counters();
 }
 
-template <class IMAGEVIEW, class VECTOR, class MaskIterator, class MaskAccessor>
-void findCriticalPointsNewtonMethodIf(IMAGEVIEW const & image,
-    pair<MaskIterator, MaskAccessor> mask,
+    // Replays the candidates of all bands in seed order against the
+    // global set of accepted points.
+template <class BANDS, class VECTOR>
+void mergeCriticalPointCandidates(
+    BANDS const & bands,
     VECTOR *minima, VECTOR *saddles, VECTOR *maxima,
-    double minCPDist, double stepEpsilon, unsigned int oversampling)
+    double minCPDist, GridHash2DCounters & dedupCounters)
 {
-    int w = image.width();
-    int h = image.height();
-
-    typedef typename IMAGEVIEW::value_type Value;
     typedef typename VECTOR::value_type Coordinate;
+    typedef typename BANDS::value_type Candidates;
 
-    double d = 1.0 / oversampling;
     double squareMinCPDist = sq(minCPDist);
+    GridHash2D<TinyVector<double, 2>, int> points(
+        criticalPointHashCellSize(minCPDist));
 
-    Map2D<Coordinate> points;
-
-    // search for critical points
-    int percent = -1, lastPercent = -1;
-    //std::cerr << "\n";
-    MaskIterator maskRow(mask.first);
-    for(int y=0; y <= h-1; ++y, ++maskRow.y)
+    for(unsigned int band = 0; band < bands.size(); ++band)
     {
-        percent = 100 * y / h;
-        if(percent != lastPercent)
-        {
-            std::cerr << "findCriticalPointsNewtonMethodIf(): " << percent << "%\r";
-            lastPercent = percent;
-        }
-        MaskIterator mit(maskRow);
-        for(int x=0; x <= w-1; ++x, ++mit.x)
+        for(typename Candidates::const_iterator it = bands[band].begin();
+            it != bands[band].end(); ++it)
         {
-            if(!mask.second(mit))
+            if(it->halo && points.nearest(it->point, squareMinCPDist))
                 continue;
-            for(double dy = 0.0; dy < 1.0; dy += d)
-            {
-                for(double dx = 0.0; dx < 1.0; dx += d)
-                {
-                    double xx, yy;
-                    CriticalPoint type = findCriticalPointNewtonMethod(
-                        image, x + dx, y + dy, &xx, &yy, stepEpsilon, 4.0);
-                    if(type == Failed)
-                        continue;
 
-                    Coordinate c(xx, yy);
-                    if(points.nearest(c, squareMinCPDist) != points.end())
-                        continue;
+            Coordinate c(it->point[0], it->point[1]);
+            if(it->type == Saddle)
+                saddles->push_back(c);
+            else if(it->type == Minimum)
+                minima->push_back(c);
+            else
+                maxima->push_back(c);
 
-                    if(type == Saddle)
-                        saddles->push_back(c);
-                    else if(type == Minimum)
-                        minima->push_back(c);
-                    else
-                        maxima->push_back(c);
+            points.insert(it->point, 0);
+        }
+    }
+    dedupCounters += points.counters();
+}
 
-                    points.insert(c);
-                }
+template <class EVALUATOR, class SEEDS, class VECTOR, class PROGRESS>
+void findCriticalPointsNewtonMethodImpl(
+    EVALUATOR const & image, SEEDS const & seeds,
+    VECTOR *minima, VECTOR *saddles, VECTOR *maxima,
+    double minCPDist, double stepEpsilon, unsigned int oversampling,
+    unsigned int threadCount, PROGRESS & progress,
+    GridHash2DCounters * dedupCounters = 0)
+{
+    typedef CriticalPointCandidate<TinyVector<double, 2> > Candidate;
+    typedef std::vector<Candidate> Candidates;
+
+    int h = image.height();
+    threadCount = ::detail::resolveThreadCount(threadCount);
+
+    CriticalPointsProgressCounter<PROGRESS> counter(progress, h);
+    counter.start();
+
+    GridHash2DCounters localCounters;
+    if(!dedupCounters)
+        dedupCounters = &localCounters;
+
+    if(threadCount == 1 || h < 2)
+    {
+        std::vector<Candidates> bands(1);
+        collectCriticalPointCandidates(
+            image, seeds, 0, h, -NumericTraits<double>::max(),
+            minCPDist, stepEpsilon, oversampling, bands[0], counter,
+            *dedupCounters);
+        mergeCriticalPointCandidates(bands, minima, saddles, maxima, minCPDist,
+                                     *dedupCounters);
+        counter.finish();
+        return;
+    }
+
+    // Converged points lie within the search radius (plus the final
+    // Newton step) from their seed, so a point of a band can only be
+    // within minCPDist of a point found from an earlier band if it is
+    // that close to the top of its band (some slack is added against
+    // rounding):
+    double halo = criticalPointSearchRadius + 2.0*(stepEpsilon + minCPDist);
+
+    int bandCount = std::min(h, 4 * (int)threadCount);
+    std::vector<Candidates> bands(bandCount);
+    std::vector<GridHash2DCounters> bandCounters(bandCount);
+
+    ::detail::ParallelErrors errors;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threadCount)
+#endif
+    {
+        // cheap for SplineDerivativeEvaluator, but a view that caches
+        // per-facet data (like SplineImageView itself) gets copied
+        EVALUATOR threadImage(image);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for(int band = 0; band < bandCount; ++band)
+        {
+            if(errors.failed())
+                continue;
+            try
+            {
+                int beginRow = ::detail::bandBegin(h, bandCount, band),
+                      endRow = ::detail::bandBegin(h, bandCount, band + 1);
+                collectCriticalPointCandidates(
+                    threadImage, seeds, beginRow, endRow,
+                    band ? beginRow + halo : -NumericTraits<double>::max(),
+                    minCPDist, stepEpsilon, oversampling,
+                    bands[band], counter, bandCounters[band]);
+            }
+            catch(std::exception &e)
+            {
+                errors.capture(e);
+            }
+            catch(...) // e.g. raised by the progress callback (the
+                       // Python bindings restore the original error)
+            {
+                errors.captureUnknown();
             }
         }
     }
-    std::cerr << "findCriticalPointsNewtonMethodIf(): done.\n";
+    errors.rethrow();
+
+    for(int band = 0; band < bandCount; ++band)
+        *dedupCounters += bandCounters[band];
+    mergeCriticalPointCandidates(bands, minima, saddles, maxima, minCPDist,
+                                 *dedupCounters);
+    counter.finish();
+}
+
+} // namespace detail
+
+/** Find the critical points of a spline image view by starting
+    Newton iterations from oversampling^2 seeds per pixel.  Points
+    closer than minCPDist to an earlier point are skipped.
+
+    With threadCount != 1 (0 meaning as many threads as OpenMP
+    offers), the image is split into row bands that are searched in
+    parallel; the result is identical to the serial search, including
+    the order of the points.  progress is called with the percentage
+    of processed rows (see CriticalPointsProgressStream).
+
+    The derivatives are computed by a SplineDerivativeEvaluator,
+    which evaluates all of them at once for SplineImageView.
+*/
+template <class IMAGEVIEW, class VECTOR, class PROGRESS>
+void findCriticalPointsNewtonMethod(
+    IMAGEVIEW const & image,
+    VECTOR *minima, VECTOR *saddles, VECTOR *maxima,
+    double minCPDist, double stepEpsilon, unsigned int oversampling,
+    unsigned int threadCount, PROGRESS progress)
+{
+    detail::findCriticalPointsNewtonMethodImpl(
+        SplineDerivativeEvaluator<IMAGEVIEW>(image), detail::AllCriticalPointSeeds(),
+        minima, saddles, maxima,
+        minCPDist, stepEpsilon, oversampling, threadCount, progress);
+}
+
+template <class IMAGEVIEW, class VECTOR>
+void findCriticalPointsNewtonMethod(
+    IMAGEVIEW const & image,
+    VECTOR *minima, VECTOR *saddles, VECTOR *maxima,
+    double minCPDist, double stepEpsilon, unsigned int oversampling)
+{
+    findCriticalPointsNewtonMethod(
+        image, minima, saddles, maxima,
+        minCPDist, stepEpsilon, oversampling, 1,
+        CriticalPointsProgressStream("findCriticalPointsNewtonMethod()"));
+}
+
+/** Like findCriticalPointsNewtonMethod(), but only seeds within
+    pixels where the mask is non-zero are used.
+*/
+template <class IMAGEVIEW, class VECTOR, class MaskIterator, class MaskAccessor,
+          class PROGRESS>
+void findCriticalPointsNewtonMethodIf(IMAGEVIEW const & image,
+    pair<MaskIterator, MaskAccessor> mask,
+    VECTOR *minima, VECTOR *saddles, VECTOR *maxima,
+    double minCPDist, double stepEpsilon, unsigned int oversampling,
+    unsigned int threadCount, PROGRESS progress)
+{
+    detail::findCriticalPointsNewtonMethodImpl(
+        SplineDerivativeEvaluator<IMAGEVIEW>(image), detail::MaskedCriticalPointSeeds<MaskIterator, MaskAccessor>(mask),
+        minima, saddles, maxima,
+        minCPDist, stepEpsilon, oversampling, threadCount, progress);
+}
+
+template <class IMAGEVIEW, class VECTOR, class MaskIterator, class MaskAccessor>
+void findCriticalPointsNewtonMethodIf(IMAGEVIEW const & image,
+    pair<MaskIterator, MaskAccessor> mask,
+    VECTOR *minima, VECTOR *saddles, VECTOR *maxima,
+    double minCPDist, double stepEpsilon, unsigned int oversampling)
+{
+    findCriticalPointsNewtonMethodIf(
+        image, mask, minima, saddles, maxima,
+        minCPDist, stepEpsilon, oversampling, 1,
+        CriticalPointsProgressStream("findCriticalPointsNewtonMethodIf()"));
 }
 
 template <class T, class VECTOR>
@@ -1271,21 +1836,124 @@ void polynomialRemainder(Poly const & l, Poly const & r, Poly & res)
         Coeff c = res[res.order()] / r[r.order()];
         for(unsigned int k = 0; k < r.order(); ++k)
         {
-            res[k+diffOrder] -= c*r[k];
+            res[k+diffOrder] -= c*r[k];
+        }
+        res.setOrder(res.order()-1);
+        res.minimizeOrder(0.0);
+        diffOrder = res.order() - r.order();
+    }
+}
+
+/*******************************************************************/
+/*                                                                 */
+/*                         SubPixelWatersheds                      */
+/*                                                                 */
+/*******************************************************************/
+
+#define DEBUG 0
+
+    /// integration schemes for SubPixelWatersheds::flowLine()
+enum FlowLineIntegrator
+{
+    SecondOrderDoubleStep, ///< RK2 with step doubling (the original scheme)
+    DormandPrince45        ///< embedded RK 4(5) with dense output
+};
+
+namespace detail {
+
+    // direction of a flow line at p (the normalized gradient, i.e. the
+    // flow has unit speed); false if p is outside the image
+template <class IMAGEVIEW, class PointType>
+bool flowLineDirection(IMAGEVIEW const & image, PointType const & p,
+                       PointType & direction)
+{
+    if(!image.isInside(p[0], p[1]))
+        return false;
+    direction = PointType(image.dx(p[0], p[1]), image.dy(p[0], p[1]));
+    double norm = direction.magnitude();
+    if(norm)
+        direction /= norm;
+    return true;
+}
+
+    // Collects the points of a flow line, leaving out intermediate
+    // points as long as the polyline stays within tolerance of all
+    // points (integration steps and dense output samples) seen since
+    // the last emitted point.  tolerance 0 emits every step.
+template <class PointArray>
+class FlowLinePolyline
+{
+  public:
+    typedef typename PointArray::value_type PointType;
+
+    FlowLinePolyline(PointArray & curve, double tolerance)
+    : curve_(curve),
+      tolerance2_(sq(tolerance))
+    {}
+
+        // add one step ending in end, with mid on the curve in between
+    void addStep(PointType const & mid, PointType const & end)
+    {
+        if(!tolerance2_)
+        {
+            curve_.push_back(end);
+            return;
+        }
+
+        pending_.push_back(mid);
+        if(fits(end))
+        {
+            pending_.push_back(end);
+            return;
+        }
+
+        // the chord to end is too far from the curve; start a new
+        // segment at the end of the previous step (or at mid):
+        pending_.pop_back();
+        if(pending_.size())
+            emit(pending_.size() - 1);
+        pending_.push_back(mid);
+        if(!fits(end))
+            emit(0);
+        pending_.push_back(end);
+    }
+
+        // emit the end of the last step (if left out so far)
+    void flush()
+    {
+        if(pending_.size())
+            emit(pending_.size() - 1);
+    }
+
+  protected:
+    bool fits(PointType const & end) const
+    {
+        PointType const & begin = curve_.back();
+        PointType diff = end - begin;
+        double length2 = squaredNorm(diff);
+        for(unsigned int i = 0; i < pending_.size(); ++i)
+        {
+            PointType rel = pending_[i] - begin;
+            double t = length2 ? dot(rel, diff) / length2 : 0.0;
+            t = std::min(1.0, std::max(0.0, t));
+            if(squaredNorm(rel - diff * t) > tolerance2_)
+                return false;
         }
-        res.setOrder(res.order()-1);
-        res.minimizeOrder(0.0);
-        diffOrder = res.order() - r.order();
+        return true;
     }
-}
 
-/*******************************************************************/
-/*                                                                 */
-/*                         SubPixelWatersheds                      */
-/*                                                                 */
-/*******************************************************************/
+    void emit(unsigned int index)
+    {
+        curve_.push_back(pending_[index]);
+        pending_.erase(pending_.begin(), pending_.begin() + index + 1);
+    }
 
-#define DEBUG 0
+    PointArray & curve_;
+    double tolerance2_;
+    std::vector<PointType> pending_;
+};
+
+} // namespace detail
 
 template <class SPLINEIMAGEVIEW>
 class SubPixelWatersheds
@@ -1297,13 +1965,53 @@ class SubPixelWatersheds
     typedef ArrayVector<PointType> PointArray;
     enum RungeKuttaResult { Success, Outside, StepTooLarge };
 
+        /// result of tracing the flow lines starting at one saddle
+    struct TracedEdge
+    {
+        TracedEdge()
+        : forwardIndex(0),
+          backwardIndex(0),
+          saddlePosition(0),
+          traced(false)
+        {}
+
+            /// flowLine() results of the forward / backward flow line
+        int forwardIndex, backwardIndex;
+            /// polyline from the forward over the saddle to the backward end
+        PointArray points;
+            /// position of the saddle within points
+        unsigned int saddlePosition;
+            /// false if the saddle was below the threshold
+        bool traced;
+    };
+    typedef std::vector<TracedEdge> TracedEdges;
+
+        /// critical points changed by updateCriticalPoints()
+    struct CriticalPointUpdate
+    {
+            /// the spline (and thus possibly the flow lines) changed
+            /// within the facets of these pixels; the critical points
+            /// whose facets lie within have been searched again
+        Rect2D changedRect;
+            /// indices of the moved, added, or removed points
+        std::vector<int> minima, saddles, maxima;
+
+            /// accumulate another update (before updateEdges())
+        CriticalPointUpdate & operator|=(CriticalPointUpdate const & other);
+    };
+
     template <class SrcIterator, class SrcAccessor>
     SubPixelWatersheds(SrcIterator ul, SrcIterator lr, SrcAccessor src)
     : image_(ul, lr, src),
       initialStep_(0.1),
       minCPDist_(1e-3),
       stepEpsilon_(1e-4),
-      cpOversampling_(2)
+      cpOversampling_(2),
+      cpThreadCount_(1),
+      cpFusedDerivatives_(true),
+      flowLineIntegrator_(SecondOrderDoubleStep),
+      flowLineTolerance_(0.0),
+      coefficientHalo_(32)
     {}
 
     template <class SrcIterator, class SrcAccessor>
@@ -1312,7 +2020,12 @@ class SubPixelWatersheds
       initialStep_(0.1),
       minCPDist_(1e-3),
       stepEpsilon_(1e-4),
-      cpOversampling_(2)
+      cpOversampling_(2),
+      cpThreadCount_(1),
+      cpFusedDerivatives_(true),
+      flowLineIntegrator_(SecondOrderDoubleStep),
+      flowLineTolerance_(0.0),
+      coefficientHalo_(32)
     {}
 
     int width() const { return image_.width(); }
@@ -1323,10 +2036,57 @@ class SubPixelWatersheds
     template <class MaskIterator, class MaskAccessor>
     void findCriticalPoints(pair<MaskIterator, MaskAccessor> mask);
     void findCriticalPoints();
+        /// like above, but reporting to the given progress callback
+        /// (see findCriticalPointsNewtonMethod())
+    template <class MaskIterator, class MaskAccessor, class PROGRESS>
+    void findCriticalPoints(pair<MaskIterator, MaskAccessor> mask,
+                            PROGRESS progress);
+    template <class PROGRESS>
+    void findCriticalPoints(PROGRESS progress);
+        /// like above, but only search from pixels within seedRect
+    template <class PROGRESS>
+    void findCriticalPoints(Rect2D const & seedRect, PROGRESS progress);
+        /// Take over the edited src image within dirtyRect: the spline
+        /// coefficients are recomputed within dirtyRect plus
+        /// coefficientHalo_ (from a window with another halo around
+        /// that), and the critical points within the part of the
+        /// spline that changed are searched again.  Points that did
+        /// not move keep their indices, moved points keep the index of
+        /// the old point within 0.5 pixels, new points reuse the
+        /// indices of disappeared ones or are appended, and the indices
+        /// left over are marked as removed (see isRemoved()).  Unlike
+        /// findCriticalPoints(), maxima_ is not resorted.
+    template <class SrcIterator, class SrcAccessor>
+    void updateCriticalPoints(triple<SrcIterator, SrcIterator, SrcAccessor> src,
+                              Rect2D const & dirtyRect,
+                              CriticalPointUpdate & update);
+        /// true for the placeholders of points removed by
+        /// updateCriticalPoints()
+    static bool isRemoved(PointType const & p)
+    {
+        return p == detail::removedCriticalPoint();
+    }
     void updateMaxImage();
+        /// distance of the nearest maximum in direction (dx, dy) if it
+        /// is closer than initialStep_ (max. double otherwise)
     double nearestMaximum(double x, double y, double dx, double dy, int & resindex) const;
     int flowLine(double x, double y, bool forward, double epsilon, PointArray & curve);
     pair<int, int> findEdge(double x, double y, double epsilon, PointArray & edge);
+        /// trace the flow lines of saddles_[index] into edge (which
+        /// must not have been removed, see isRemoved())
+    void traceEdge(unsigned int index, double epsilon, TracedEdge & edge);
+        /// Trace the edges of all saddles whose value is >= threshold,
+        /// using threadCount threads (0 = all available).  edges[i]
+        /// belongs to saddles_[i] (i.e. edges[0] is unused).
+    void traceAllEdges(double threshold, unsigned int threadCount,
+                       TracedEdges & edges, double epsilon = 1e-4) const;
+        /// Retrace the edges (from traceAllEdges() with the same
+        /// threshold) of the saddles changed by update and those whose
+        /// flow lines pass through its changedRect.  Returns the
+        /// number of retraced saddles.
+    unsigned int updateEdges(CriticalPointUpdate const & update,
+                             double threshold, unsigned int threadCount,
+                             TracedEdges & edges, double epsilon = 1e-4) const;
     RungeKuttaResult rungeKuttaStepSecondOrder(
         double x0, double y0, double dx, double dy, double h,
         double *x, double *y);
@@ -1334,11 +2094,75 @@ class SubPixelWatersheds
         double x0, double y0, double dx, double dy,
         double *h, double *xx, double *yx, double epsilon);
 
+        // The following variants evaluate the given view of image_
+        // instead (e.g. a SharedSplineImageView): views cache the
+        // data of the last position, so concurrent threads need their
+        // own views.
+    template <class IMAGEVIEW>
+    int flowLine(IMAGEVIEW const & image,
+                 double x, double y, bool forward, double epsilon,
+                 PointArray & curve) const;
+    template <class IMAGEVIEW>
+    void traceEdge(IMAGEVIEW const & image,
+                   unsigned int index, double epsilon, TracedEdge & edge) const;
+        /// Follow the flow line through (x, y) uphill (e.g. the end
+        /// of a flow line that left another view of the same image);
+        /// (x, y) becomes the first point of curve, the result is
+        /// that of flowLine().
+    template <class IMAGEVIEW>
+    int continueFlowLine(IMAGEVIEW const & image,
+                         double x, double y, double epsilon,
+                         PointArray & curve) const;
+    template <class IMAGEVIEW>
+    RungeKuttaResult rungeKuttaStepSecondOrder(
+        IMAGEVIEW const & image,
+        double x0, double y0, double dx, double dy, double h,
+        double *x, double *y) const;
+    template <class IMAGEVIEW>
+    RungeKuttaResult rungeKuttaDoubleStepSecondOrder(
+        IMAGEVIEW const & image,
+        double x0, double y0, double dx, double dy,
+        double *h, double *xx, double *yx, double epsilon) const;
+
     SplineImageView image_;
     PointArray minima_, saddles_, maxima_;
-    IImage maxImage_;
+        // maxima_ indices by position (for nearestMaximum()), see
+        // updateMaxImage()
+    GridHash2D<PointType, int> maximaIndex_;
+        // dedup queries / hits of the last findCriticalPoints()
+    GridHash2DCounters cpDedupCounters_;
     double initialStep_, minCPDist_, stepEpsilon_;
     unsigned int cpOversampling_;
+        // threads used by findCriticalPoints() (0 = all available)
+    unsigned int cpThreadCount_;
+        // evaluate the derivatives for findCriticalPoints() via
+        // SplineDerivativeEvaluator (instead of separate dx() etc. calls)
+    bool cpFusedDerivatives_;
+        // integration scheme used by flowLine()
+    FlowLineIntegrator flowLineIntegrator_;
+        // max. distance of the curve from the polyline output by
+        // flowLine() with DormandPrince45 (0 = output every step)
+    double flowLineTolerance_;
+        // border around the dirty rectangle of updateCriticalPoints()
+        // within which the spline coefficients are recomputed (the
+        // influence of a change decays by the spline's prefilter pole
+        // per pixel, e.g. 0.27 for cubic and 0.43 for quintic splines)
+    int coefficientHalo_;
+
+  protected:
+    void rebuildMaximaIndex();
+        // trace the edges of the given saddles (see traceAllEdges())
+    void traceEdges(std::vector<int> const & indices,
+                    double threshold, unsigned int threadCount,
+                    TracedEdges & edges, double epsilon) const;
+
+    template <class IMAGEVIEW>
+    int flowLineDormandPrince(IMAGEVIEW const & image,
+                              double x, double y, double epsilon,
+                              PointArray & curve) const;
+
+    template <class SEEDS, class PROGRESS>
+    void findCriticalPointsImpl(SEEDS const & seeds, PROGRESS & progress);
 };
 
 // static int sturmcount, zeroOrder;
@@ -1493,31 +2317,33 @@ template<class MaskIterator, class MaskAccessor>
 void SubPixelWatersheds<SplineImageView>::findCriticalPoints(
     pair<MaskIterator, MaskAccessor> mask)
 {
-    minima_.clear();
-    saddles_.clear();
-    maxima_.clear();
-    // use 1-based arrays
-    minima_.push_back(PointType());
-    saddles_.push_back(PointType());
-    maxima_.push_back(PointType());
+    findCriticalPoints(
+        mask, CriticalPointsProgressStream("findCriticalPointsNewtonMethodIf()"));
+}
 
-    findCriticalPointsNewtonMethodIf(
-        image_, mask, &minima_, &saddles_, &maxima_, minCPDist_, stepEpsilon_, cpOversampling_);
-    updateMaxImage();
+template <class SplineImageView>
+template<class MaskIterator, class MaskAccessor, class PROGRESS>
+void SubPixelWatersheds<SplineImageView>::findCriticalPoints(
+    pair<MaskIterator, MaskAccessor> mask, PROGRESS progress)
+{
+    findCriticalPointsImpl(
+        detail::MaskedCriticalPointSeeds<MaskIterator, MaskAccessor>(mask),
+        progress);
 }
 
 template <class SplineImageView>
 void
 SubPixelWatersheds<SplineImageView>::findCriticalPoints()
 {
-    minima_.clear();
-    saddles_.clear();
-    maxima_.clear();
-    // use 1-based arrays
-    minima_.push_back(PointType());
-    saddles_.push_back(PointType());
-    maxima_.push_back(PointType());
+    findCriticalPoints(
+        CriticalPointsProgressStream("findCriticalPointsNewtonMethod()"));
+}
 
+template <class SplineImageView>
+template <class PROGRESS>
+void
+SubPixelWatersheds<SplineImageView>::findCriticalPoints(PROGRESS progress)
+{
 //     sturmcount = 0;
 //     zeroOrder = 0;
 //     for(unsigned int y=1; y<image_.height()-1; ++y)
@@ -1528,13 +2354,48 @@ SubPixelWatersheds<SplineImageView>::findCriticalPoints()
 //             findCriticalPointsInFacet(x, y, minima_, saddles_, maxima_);
 //         }
 //     }
-    findCriticalPointsNewtonMethod(
-        image_, &minima_, &saddles_, &maxima_, minCPDist_, stepEpsilon_, cpOversampling_);
-    updateMaxImage();
+    findCriticalPointsImpl(detail::AllCriticalPointSeeds(), progress);
 //     std::cerr << "Sturm fired: " << sturmcount << " times\n";
 //     std::cerr << "Zero order fired: " << zeroOrder << " times\n";
 }
 
+template <class SplineImageView>
+template <class PROGRESS>
+void
+SubPixelWatersheds<SplineImageView>::findCriticalPoints(
+    Rect2D const & seedRect, PROGRESS progress)
+{
+    findCriticalPointsImpl(detail::RectCriticalPointSeeds(seedRect), progress);
+}
+
+template <class SplineImageView>
+template <class SEEDS, class PROGRESS>
+void
+SubPixelWatersheds<SplineImageView>::findCriticalPointsImpl(
+    SEEDS const & seeds, PROGRESS & progress)
+{
+    minima_.clear();
+    saddles_.clear();
+    maxima_.clear();
+    // use 1-based arrays
+    minima_.push_back(PointType());
+    saddles_.push_back(PointType());
+    maxima_.push_back(PointType());
+
+    cpDedupCounters_ = GridHash2DCounters();
+    if(cpFusedDerivatives_)
+        detail::findCriticalPointsNewtonMethodImpl(
+            SplineDerivativeEvaluator<SplineImageView>(image_), seeds,
+            &minima_, &saddles_, &maxima_, minCPDist_, stepEpsilon_, cpOversampling_,
+            cpThreadCount_, progress, &cpDedupCounters_);
+    else
+        detail::findCriticalPointsNewtonMethodImpl(
+            SeparateSplineDerivatives<SplineImageView>(image_), seeds,
+            &minima_, &saddles_, &maxima_, minCPDist_, stepEpsilon_, cpOversampling_,
+            cpThreadCount_, progress, &cpDedupCounters_);
+    updateMaxImage();
+}
+
 struct PointSort
 {
     template <class Point>
@@ -1546,88 +2407,175 @@ struct PointSort
     }
 };
 
+    // (re-)builds maximaIndex_ after maxima_ has been changed; the
+    // name stems from the facet image that used to serve this purpose
 template <class SplineImageView>
 void
 SubPixelWatersheds<SplineImageView>::updateMaxImage()
 {
-    maxImage_.resize(image_.size());
-    maxImage_.init(0);  // means no maximum
-    std::sort(maxima_.begin()+1, maxima_.end(), PointSort()); // necessary so that points in the same facet are consecutive
+    // sorted for compatibility (the order of maxima_ was exported)
+    std::sort(maxima_.begin()+1, maxima_.end(), PointSort());
+    rebuildMaximaIndex();
+}
+
+template <class SplineImageView>
+void
+SubPixelWatersheds<SplineImageView>::rebuildMaximaIndex()
+{
+    maximaIndex_ = GridHash2D<PointType, int>(1.0);
+    maximaIndex_.reserve(maxima_.size());
     for(unsigned int i = 1; i<maxima_.size(); ++i)
-    {
-        int x = (int)VIGRA_CSTD::floor(maxima_[i][0] + 0.5);
-        int y = (int)VIGRA_CSTD::floor(maxima_[i][1] + 0.5);
+        if(!isRemoved(maxima_[i]))
+            maximaIndex_.insert(maxima_[i], i);
+}
 
-        if(maxImage_(x,y) == 0)
-        {
-            maxImage_(x,y) = i;  // store index of the subpixel coordinate object
-        }
-        else
-        {
-            // negative index denotes several maxima in the same facet
-            maxImage_(x,y) = -std::abs(maxImage_(x,y));
-        }
-    }
+template <class SplineImageView>
+template <class SrcIterator, class SrcAccessor>
+void
+SubPixelWatersheds<SplineImageView>::updateCriticalPoints(
+    triple<SrcIterator, SrcIterator, SrcAccessor> src,
+    Rect2D const & dirtyRect, CriticalPointUpdate & update)
+{
+    Rect2D imageRect(Size2D(width(), height()));
+    vigra_precondition(src.second - src.first == imageRect.size(),
+        "updateCriticalPoints(): image size mismatch");
+    vigra_precondition(saddles_.size() > 0,
+        "updateCriticalPoints(): findCriticalPoints() must be called first");
+
+    update = CriticalPointUpdate();
+    Rect2D dirty(dirtyRect & imageRect);
+    if(dirty.isEmpty())
+        return;
+
+    // The prefilter spreads the change over the whole image, but with
+    // exponential decay; recompute the coefficients near the dirty
+    // rectangle from a window large enough for the deviation due to
+    // the window's border treatment to have decayed, too:
+    Rect2D coefficientRect(dirty), window(dirty);
+    coefficientRect.addBorder(coefficientHalo_);
+    coefficientRect &= imageRect;
+    window.addBorder(2 * coefficientHalo_);
+    window &= imageRect;
+
+    SplineImageView windowView(src.first + window.upperLeft(),
+                               src.first + window.lowerRight(), src.third);
+    typedef typename SplineImageView::InternalImage InternalImage;
+    InternalImage const & windowCoefficients = windowView.image();
+    // SplineImageView only offers read access (the data it caches
+    // does not depend on the coefficients):
+    InternalImage & coefficients = const_cast<InternalImage &>(image_.image());
+    for(int y = coefficientRect.top(); y < coefficientRect.bottom(); ++y)
+        for(int x = coefficientRect.left(); x < coefficientRect.right(); ++x)
+            coefficients(x, y) = windowCoefficients(x - window.left(),
+                                                    y - window.top());
+
+    // the spline changed within the support of the coefficients
+    // (plus one pixel for facets vs. support):
+    Rect2D changedRect(coefficientRect);
+    changedRect.addBorder(SplineImageView::order / 2 + 2);
+    changedRect &= imageRect;
+    update.changedRect = changedRect;
+
+    Rect2D seedRect(changedRect);
+    seedRect.addBorder((int)VIGRA_CSTD::ceil(criticalPointSearchRadius) + 1);
+    seedRect &= imageRect;
+
+    PointArray minima, saddles, maxima;
+    minima.push_back(PointType());
+    saddles.push_back(PointType());
+    maxima.push_back(PointType());
+
+    CriticalPointsNoProgress progress;
+    if(cpFusedDerivatives_)
+        detail::findCriticalPointsNewtonMethodImpl(
+            SplineDerivativeEvaluator<SplineImageView>(image_),
+            detail::RectCriticalPointSeeds(seedRect),
+            &minima, &saddles, &maxima, minCPDist_, stepEpsilon_, cpOversampling_,
+            cpThreadCount_, progress);
+    else
+        detail::findCriticalPointsNewtonMethodImpl(
+            SeparateSplineDerivatives<SplineImageView>(image_),
+            detail::RectCriticalPointSeeds(seedRect),
+            &minima, &saddles, &maxima, minCPDist_, stepEpsilon_, cpOversampling_,
+            cpThreadCount_, progress);
+
+    detail::replaceCriticalPoints(minima_, minima, changedRect, imageRect,
+                                  update.minima);
+    detail::replaceCriticalPoints(saddles_, saddles, changedRect, imageRect,
+                                  update.saddles);
+    detail::replaceCriticalPoints(maxima_, maxima, changedRect, imageRect,
+                                  update.maxima);
+    rebuildMaximaIndex();
+}
+
+namespace detail {
+
+inline void mergeSortedIndices(std::vector<int> & indices,
+                               std::vector<int> const & other)
+{
+    std::vector<int> result;
+    std::set_union(indices.begin(), indices.end(), other.begin(), other.end(),
+                   std::back_inserter(result));
+    indices.swap(result);
 }
 
+} // namespace detail
+
 template <class SplineImageView>
-double
-SubPixelWatersheds<SplineImageView>::nearestMaximum(double x, double y, double dx, double dy,
-                                      int & resindex) const
+typename SubPixelWatersheds<SplineImageView>::CriticalPointUpdate &
+SubPixelWatersheds<SplineImageView>::CriticalPointUpdate::operator|=(
+    CriticalPointUpdate const & other)
 {
-    PointType diff, p(x,y);
-    double dist = NumericTraits<double>::max();
+    if(changedRect.isEmpty())
+        changedRect = other.changedRect;
+    else if(!other.changedRect.isEmpty())
+        changedRect |= other.changedRect;
+    detail::mergeSortedIndices(minima, other.minima);
+    detail::mergeSortedIndices(saddles, other.saddles);
+    detail::mergeSortedIndices(maxima, other.maxima);
+    return *this;
+}
 
-    int xi = (int)VIGRA_CSTD::floor(x + 0.5);
-    int yi = (int)VIGRA_CSTD::floor(y + 0.5);
+namespace detail {
 
-    int dxi = (x - xi >= 0.0)
-                 ?  1
-                 : -1;
-    int dyi = (y - yi >= 0.0)
-                 ?  1
-                 : -1;
+    // accepts maxima in direction (dx, dy) from p
+template <class Point>
+struct MaximumInDirection
+{
+    MaximumInDirection(Point const & p, double dx, double dy)
+    : p_(p),
+      dx_(dx),
+      dy_(dy)
+    {}
 
-    for(int ys=0; ys<2; ++ys)
+    template <class Element>
+    bool operator()(Element const & maximum) const
     {
-        for(int xs=0; xs<2; ++xs)
-        {
-            int xx = xi + xs*dxi;
-            int yy = yi + ys*dyi;
-            if(!image_.isInside(xx,yy))
-                continue;
-            int index = maxImage_(xx,yy);
-            if(index > 0)
-            {
-                diff = maxima_[index] - p;
-                double sd = diff.magnitude();
-                if(sd < dist && diff[0]*dx + diff[1]*dy >= 0)
-                {
-                    dist = sd;
-                    resindex = index;
-                }
-            }
-            else if(index < 0)
-            {
-                diff = maxima_[-index] - p;
-                double sd = diff.magnitude();
-                if(sd < dist && diff[0]*dx + diff[1]*dy >= 0)
-                {
-                    dist = sd;
-                    resindex = -index;
-                }
-                diff = maxima_[-index+1] - p; // assumes that points from the same facet are consecutive
-                sd = diff.magnitude();
-                if(sd < dist && diff[0]*dx + diff[1]*dy >= 0)
-                {
-                    dist = sd;
-                    resindex = -index+1;
-                }
-            }
-        }
+        return (maximum.position[0] - p_[0])*dx_ +
+               (maximum.position[1] - p_[1])*dy_ >= 0;
     }
 
-    return dist;
+    Point p_;
+    double dx_, dy_;
+};
+
+} // namespace detail
+
+template <class SplineImageView>
+double
+SubPixelWatersheds<SplineImageView>::nearestMaximum(double x, double y, double dx, double dy,
+                                      int & resindex) const
+{
+    PointType p(x,y);
+    typename GridHash2D<PointType, int>::value_type const * maximum =
+        maximaIndex_.nearest(
+            p, sq(initialStep_),
+            detail::MaximumInDirection<PointType>(p, dx, dy));
+    if(!maximum)
+        return NumericTraits<double>::max();
+
+    resindex = maximum->payload;
+    return (maximum->position - p).magnitude();
 }
 
 template <class SplineImageView>
@@ -1635,14 +2583,25 @@ typename SubPixelWatersheds<SplineImageView>::RungeKuttaResult
 SubPixelWatersheds<SplineImageView>::rungeKuttaStepSecondOrder(
                   double x0, double y0, double dx, double dy, double h,
                   double *xx, double *yy)
+{
+    return rungeKuttaStepSecondOrder(image_, x0, y0, dx, dy, h, xx, yy);
+}
+
+template <class SplineImageView>
+template <class IMAGEVIEW>
+typename SubPixelWatersheds<SplineImageView>::RungeKuttaResult
+SubPixelWatersheds<SplineImageView>::rungeKuttaStepSecondOrder(
+                  IMAGEVIEW const & image,
+                  double x0, double y0, double dx, double dy, double h,
+                  double *xx, double *yy) const
 {
     double x1 = x0 + 0.5*h*dx;
     double y1 = y0 + 0.5*h*dy;
-    if(!image_.isInside(x1, y1))
+    if(!image.isInside(x1, y1))
         return Outside;
 
-    double dx2 = image_.dx(x1, y1);
-    double dy2 = image_.dy(x1, y1);
+    double dx2 = image.dx(x1, y1);
+    double dy2 = image.dy(x1, y1);
     double norm = hypot(dx, dy);
     if(!norm) // critical point?
     {
@@ -1664,7 +2623,7 @@ SubPixelWatersheds<SplineImageView>::rungeKuttaStepSecondOrder(
 
     double x2 = x0 + h*dx/norm;
     double y2 = y0 + h*dy/norm;
-    if(!image_.isInside(x2, y2))
+    if(!image.isInside(x2, y2))
         return Outside;
 
     *xx = x2;
@@ -1678,18 +2637,31 @@ SubPixelWatersheds<SplineImageView>::rungeKuttaDoubleStepSecondOrder(
                   double x0, double y0, double dx, double dy,
                   double *h, double *xx, double *yy,
                   double epsilon)
+{
+    return rungeKuttaDoubleStepSecondOrder(
+        image_, x0, y0, dx, dy, h, xx, yy, epsilon);
+}
+
+template <class SplineImageView>
+template <class IMAGEVIEW>
+typename SubPixelWatersheds<SplineImageView>::RungeKuttaResult
+SubPixelWatersheds<SplineImageView>::rungeKuttaDoubleStepSecondOrder(
+                  IMAGEVIEW const & image,
+                  double x0, double y0, double dx, double dy,
+                  double *h, double *xx, double *yy,
+                  double epsilon) const
 {
     double x1, x2, y1, y2;
 
-    if(rungeKuttaStepSecondOrder(x0, y0, dx, dy, 2.0 * (*h), &x1, &y1) == Outside ||
-       rungeKuttaStepSecondOrder(x0, y0, dx, dy, (*h), &x2, &y2) == Outside)
+    if(rungeKuttaStepSecondOrder(image, x0, y0, dx, dy, 2.0 * (*h), &x1, &y1) == Outside ||
+       rungeKuttaStepSecondOrder(image, x0, y0, dx, dy, (*h), &x2, &y2) == Outside)
     {
         *h /= 4.0;
         return Outside;
     }
 
-    dx = image_.dx(x2, y2);
-    dy = image_.dy(x2, y2);
+    dx = image.dx(x2, y2);
+    dy = image.dy(x2, y2);
     double norm = hypot(dx, dy);
     if(!norm) // critical point
     {
@@ -1701,7 +2673,7 @@ SubPixelWatersheds<SplineImageView>::rungeKuttaDoubleStepSecondOrder(
     dx /= norm;
     dy /= norm;
 
-    if(rungeKuttaStepSecondOrder(x2, y2, dx, dy, (*h), &x2, &y2) == Outside)
+    if(rungeKuttaStepSecondOrder(image, x2, y2, dx, dy, (*h), &x2, &y2) == Outside)
     {
         *h /= 4.0;
         return Outside;
@@ -1709,7 +2681,7 @@ SubPixelWatersheds<SplineImageView>::rungeKuttaDoubleStepSecondOrder(
 
     // FIXME: is this a hack?
     // check that we don't jump too far (next step shall not go backwards)
-    if((x2-x0)*image_.dx(x2, y2) + (y2-y0)*image_.dy(x2, y2) <= 0.0)
+    if((x2-x0)*image.dx(x2, y2) + (y2-y0)*image.dy(x2, y2) <= 0.0)
     {
         *h /= 2.0;
         return StepTooLarge;
@@ -1736,7 +2708,7 @@ SubPixelWatersheds<SplineImageView>::rungeKuttaDoubleStepSecondOrder(
 #ifndef EXTRA_SPEED
     x1 = x2 + dx / 3.0;
     y1 = y2 + dy / 3.0;
-    if(image_.isValid(x1, y1))
+    if(image.isValid(x1, y1))
     {
         *xx = x1;
         *yy = y1;
@@ -1755,12 +2727,23 @@ template <class SplineImageView>
 int
 SubPixelWatersheds<SplineImageView>::flowLine(double x, double y, bool forward, double epsilon,
                                 PointArray & curve)
+{
+    return flowLine(SharedSplineImageView<SplineImageView>(image_),
+                    x, y, forward, epsilon, curve);
+}
+
+template <class SplineImageView>
+template <class IMAGEVIEW>
+int
+SubPixelWatersheds<SplineImageView>::flowLine(IMAGEVIEW const & image,
+                                double x, double y, bool forward, double epsilon,
+                                PointArray & curve) const
 {
     curve.push_back(PointType(x, y));
     double h = initialStep_;
-    double dxx = image_.dxx(x, y);
-    double dxy = image_.dxy(x, y);
-    double dyy = image_.dyy(x, y);
+    double dxx = image.dxx(x, y);
+    double dxy = image.dxy(x, y);
+    double dyy = image.dyy(x, y);
     double a = 0.5*VIGRA_CSTD::atan2(-2.0*dxy, dxx-dyy);
     double dx = forward
                  ?  h*VIGRA_CSTD::cos(a)
@@ -1768,7 +2751,6 @@ SubPixelWatersheds<SplineImageView>::flowLine(double x, double y, bool forward,
     double dy = forward
                  ? -h*VIGRA_CSTD::sin(a)
                  :  h*VIGRA_CSTD::sin(a);
-    int failReason = 0; // gave up / too many steps
     if(DEBUG) std::cerr << "x, y, dx, dy " << x << ' ' << y << ' ' << dx << ' ' << dy << '\n';
     int index;
     if(nearestMaximum(x, y, dx, dy, index) < initialStep_)
@@ -1778,12 +2760,21 @@ SubPixelWatersheds<SplineImageView>::flowLine(double x, double y, bool forward,
         return index;
     }
 
-    x = x + dx;
-    y = y + dy;
+    return continueFlowLine(image, x + dx, y + dy, epsilon, curve);
+}
 
+template <class SplineImageView>
+template <class IMAGEVIEW>
+int
+SubPixelWatersheds<SplineImageView>::continueFlowLine(
+    IMAGEVIEW const & image,
+    double x, double y, double epsilon, PointArray & curve) const
+{
     curve.push_back(PointType(x, y));
-    dx = image_.dx(x, y);
-    dy = image_.dy(x, y);
+    double h = initialStep_;
+    int failReason = 0; // gave up / too many steps
+    double dx = image.dx(x, y);
+    double dy = image.dy(x, y);
     double norm = hypot(dx, dy);
     if(norm) // critical point?
     {
@@ -1792,6 +2783,7 @@ SubPixelWatersheds<SplineImageView>::flowLine(double x, double y, bool forward,
     }
 if(DEBUG) std::cerr << "x, y, dx, dy " << x << ' ' << y << ' ' << dx << ' ' << dy << '\n';
     // check if near a maximum in direction dx/dy
+    int index;
     if(nearestMaximum(x, y, dx, dy, index) < initialStep_)
     {
         curve.push_back(maxima_[index]);
@@ -1799,19 +2791,22 @@ if(DEBUG) std::cerr << "stop index, x, y " << index << ' ' << curve.back()[0] <<
         return index;
     }
 
+    if(flowLineIntegrator_ == DormandPrince45)
+        return flowLineDormandPrince(image, x, y, epsilon, curve);
+
     for(int k = 0; k < 100000; ++k)
     {
         double xn, yn;
         RungeKuttaResult rungeKuttaResult(
-            rungeKuttaDoubleStepSecondOrder(x, y, dx, dy, &h, &xn, &yn, epsilon));
+            rungeKuttaDoubleStepSecondOrder(image, x, y, dx, dy, &h, &xn, &yn, epsilon));
 
         if(rungeKuttaResult == Success)
         {
             x = xn;
             y = yn;
             curve.push_back(PointType(x, y));
-            dx = image_.dx(x, y);
-            dy = image_.dy(x, y);
+            dx = image.dx(x, y);
+            dy = image.dy(x, y);
             double norm = hypot(dx, dy);
             if(norm) // critical point?
             {
@@ -1846,6 +2841,125 @@ if(DEBUG) std::cerr << "stop index, x, y " << index << ' ' << curve.back()[0] <<
     return failReason-3;
 }
 
+    // Continues a flow line from (x, y) (already in curve) with the
+    // Dormand-Prince 4(5) pair, whose step size adapts to the local
+    // error estimate (epsilon per step), so that straight parts are
+    // crossed in few large steps.  The polyline is thinned on the fly
+    // to flowLineTolerance_, using the continuous extension of the
+    // scheme to check the curve between steps.  The result codes are
+    // those of flowLine().
+template <class SplineImageView>
+template <class IMAGEVIEW>
+int
+SubPixelWatersheds<SplineImageView>::flowLineDormandPrince(
+    IMAGEVIEW const & image, double x, double y, double epsilon,
+    PointArray & curve) const
+{
+    static const double
+        a21 = 1.0/5.0,
+        a31 = 3.0/40.0, a32 = 9.0/40.0,
+        a41 = 44.0/45.0, a42 = -56.0/15.0, a43 = 32.0/9.0,
+        a51 = 19372.0/6561.0, a52 = -25360.0/2187.0, a53 = 64448.0/6561.0,
+        a54 = -212.0/729.0,
+        a61 = 9017.0/3168.0, a62 = -355.0/33.0, a63 = 46732.0/5247.0,
+        a64 = 49.0/176.0, a65 = -5103.0/18656.0,
+        b1 = 35.0/384.0, b3 = 500.0/1113.0, b4 = 125.0/192.0,
+        b5 = -2187.0/6784.0, b6 = 11.0/84.0,
+        // difference between 5th and embedded 4th order solution:
+        e1 = 71.0/57600.0, e3 = -71.0/16695.0, e4 = 71.0/1920.0,
+        e5 = -17253.0/339200.0, e6 = 22.0/525.0, e7 = -1.0/40.0,
+        // continuous extension (dense output):
+        d1 = -12715105075.0/11282082432.0, d3 = 87487479700.0/32700410799.0,
+        d4 = -10690763975.0/1880347072.0, d5 = 701980252875.0/199316789632.0,
+        d6 = -1453857185.0/822651844.0, d7 = 69997945.0/29380423.0;
+
+    // don't take steps larger than the critical point search radius
+    // (maxima must not be jumped over unnoticed)
+    const double maxStep = criticalPointSearchRadius;
+
+    detail::FlowLinePolyline<PointArray> polyline(curve, flowLineTolerance_);
+
+    PointType p(x, y), p5, k1, k2, k3, k4, k5, k6, k7;
+    detail::flowLineDirection(image, p, k1);
+
+    double h = initialStep_;
+    int failReason = 0; // gave up / too many steps
+    int index;
+    for(int k = 0; k < 100000; ++k)
+    {
+        if(h < epsilon)
+        {
+            if(DEBUG) std::cerr << "give up\n";
+            polyline.flush();
+            return failReason; // give up
+        }
+
+        bool inside =
+            detail::flowLineDirection(image, p + h*a21*k1, k2) &&
+            detail::flowLineDirection(image, p + h*(a31*k1 + a32*k2), k3) &&
+            detail::flowLineDirection(image, p + h*(a41*k1 + a42*k2 + a43*k3), k4) &&
+            detail::flowLineDirection(image, p + h*(a51*k1 + a52*k2 + a53*k3 + a54*k4), k5) &&
+            detail::flowLineDirection(image, p + h*(a61*k1 + a62*k2 + a63*k3 + a64*k4 + a65*k5), k6);
+        if(inside)
+        {
+            p5 = p + h*(b1*k1 + b3*k3 + b4*k4 + b5*k5 + b6*k6);
+            inside = detail::flowLineDirection(image, p5, k7);
+        }
+        if(!inside)
+        {
+            if(DEBUG) std::cerr << "outside image\n";
+            failReason = -1; // signal "outside image", curve might still be useful?!
+            h /= 4.0;
+            continue;
+        }
+
+        PointType e = h*(e1*k1 + e3*k3 + e4*k4 + e5*k5 + e6*k6 + e7*k7);
+        double error = std::max(std::abs(e[0]), std::abs(e[1]));
+        double scale = error
+                       ? 0.9 * VIGRA_CSTD::pow(epsilon / error, 0.2)
+                       : 5.0;
+        if(error > epsilon)
+        {
+            h *= std::max(0.2, scale);
+            continue;
+        }
+
+        // do not jump across a ridge or maximum (the next step would
+        // go backwards):
+        if(dot(p5 - p, k7) <= 0.0)
+        {
+            h /= 2.0;
+            continue;
+        }
+
+        // curve point in the middle of the step (dense output):
+        PointType r2 = p5 - p, r3 = h*k1 - r2, r4 = r2 - h*k7 - r3,
+            r5 = h*(d1*k1 + d3*k3 + d4*k4 + d5*k5 + d6*k6 + d7*k7);
+        PointType mid = p + 0.5*(r2 + 0.5*(r3 + 0.5*(r4 + 0.5*r5)));
+
+        polyline.addStep(mid, p5);
+        p = p5;
+        k1 = k7; // first same as last
+        if(DEBUG) std::cerr << "x, y, h " << p[0] << ' ' << p[1] << ' ' << h << '\n';
+
+        // check if near a maximum
+        if(nearestMaximum(p[0], p[1], k1[0], k1[1], index) < initialStep_)
+        {
+            polyline.flush();
+            curve.push_back(maxima_[index]);
+            if(DEBUG) std::cerr
+                << "stop index, x, y " << index << ' '
+                << curve.back()[0] << ' ' << curve.back()[1]<< '\n';
+            return index;
+        }
+
+        h = std::min(maxStep, h * std::min(5.0, scale));
+    }
+    polyline.flush();
+    std::cerr << "flowLine(): too many steps, h = " << h << "\n";
+    return failReason-3;
+}
+
 template <class SplineImageView>
 pair<int, int>
 SubPixelWatersheds<SplineImageView>::findEdge(
@@ -1866,6 +2980,166 @@ SubPixelWatersheds<SplineImageView>::findEdge(
     return pair<int, int>(findex, bindex);
 }
 
+template <class SplineImageView>
+void
+SubPixelWatersheds<SplineImageView>::traceEdge(
+    unsigned int index, double epsilon, TracedEdge & edge)
+{
+    vigra_precondition(index > 0 && index < saddles_.size(),
+        "traceEdge(): invalid saddle index");
+    vigra_precondition(!isRemoved(saddles_[index]),
+        "traceEdge(): saddle has been removed by updateCriticalPoints()");
+    traceEdge(SharedSplineImageView<SplineImageView>(image_),
+              index, epsilon, edge);
+}
+
+template <class SplineImageView>
+template <class IMAGEVIEW>
+void
+SubPixelWatersheds<SplineImageView>::traceEdge(
+    IMAGEVIEW const & image,
+    unsigned int index, double epsilon, TracedEdge & edge) const
+{
+    double x = saddles_[index][0];
+    double y = saddles_[index][1];
+
+    PointArray forwardCurve, backwardCurve;
+
+    edge.forwardIndex = flowLine(image, x, y, true, epsilon, forwardCurve);
+    edge.backwardIndex = flowLine(image, x, y, false, epsilon, backwardCurve);
+
+    edge.points.clear();
+    edge.points.reserve(forwardCurve.size() + backwardCurve.size() - 1);
+    for(int i = forwardCurve.size() - 1; i >= 0; --i)
+        edge.points.push_back(forwardCurve[i]);
+    for(int i = 1; i < (int)backwardCurve.size(); ++i)
+        edge.points.push_back(backwardCurve[i]);
+
+    edge.saddlePosition = forwardCurve.size() - 1;
+    edge.traced = true;
+}
+
+template <class SplineImageView>
+void
+SubPixelWatersheds<SplineImageView>::traceAllEdges(
+    double threshold, unsigned int threadCount,
+    TracedEdges & edges, double epsilon) const
+{
+    vigra_precondition(saddles_.size() > 0,
+        "traceAllEdges(): findCriticalPoints() must be called first");
+
+    int saddleCount = saddles_.size();
+    edges.clear();
+    edges.resize(saddleCount);
+
+    std::vector<int> indices;
+    indices.reserve(saddleCount);
+    for(int i = 1; i < saddleCount; ++i)
+        indices.push_back(i);
+    traceEdges(indices, threshold, threadCount, edges, epsilon);
+}
+
+template <class SplineImageView>
+unsigned int
+SubPixelWatersheds<SplineImageView>::updateEdges(
+    CriticalPointUpdate const & update,
+    double threshold, unsigned int threadCount,
+    TracedEdges & edges, double epsilon) const
+{
+    vigra_precondition(edges.size() > 0 && edges.size() <= saddles_.size(),
+        "updateEdges(): edges must stem from traceAllEdges()");
+    if(update.changedRect.isEmpty())
+        return 0;
+
+    std::vector<char> retrace(saddles_.size(), 0);
+    for(unsigned int k = 0; k < update.saddles.size(); ++k)
+        retrace[update.saddles[k]] = 1;
+    for(unsigned int i = edges.size(); i < saddles_.size(); ++i)
+        retrace[i] = 1;
+    edges.resize(saddles_.size());
+
+    // flow lines may be affected where the spline changed (including
+    // those ending at a changed maximum, which lies there, too):
+    PointType ul(update.changedRect.left() - 0.5 - initialStep_,
+                 update.changedRect.top() - 0.5 - initialStep_),
+              lr(update.changedRect.right() - 0.5 + initialStep_,
+                 update.changedRect.bottom() - 0.5 + initialStep_);
+    std::vector<int> indices;
+    for(unsigned int i = 1; i < edges.size(); ++i)
+    {
+        if(retrace[i] ||
+           (edges[i].traced && detail::polylineMayCrossBox(edges[i].points, ul, lr)))
+            indices.push_back(i);
+    }
+
+    traceEdges(indices, threshold, threadCount, edges, epsilon);
+    return indices.size();
+}
+
+template <class SplineImageView>
+void
+SubPixelWatersheds<SplineImageView>::traceEdges(
+    std::vector<int> const & indices,
+    double threshold, unsigned int threadCount,
+    TracedEdges & edges, double epsilon) const
+{
+    // All threads evaluate the spline via SharedSplineImageViews of
+    // image_ (which only need their own position cache, not a copy
+    // of the coefficients); the single-threaded case uses one, too,
+    // so that the results do not depend on threadCount.
+    typedef SharedSplineImageView<SplineImageView> ThreadImage;
+
+    int count = indices.size();
+    threadCount = ::detail::resolveThreadCount(threadCount);
+    if(threadCount == 1)
+    {
+        ThreadImage image(image_);
+        for(int k = 0; k < count; ++k)
+        {
+            int i = indices[k];
+            edges[i] = TracedEdge();
+            if(!isRemoved(saddles_[i]) &&
+               image(saddles_[i][0], saddles_[i][1]) >= threshold)
+                traceEdge(image, i, epsilon, edges[i]);
+        }
+        return;
+    }
+
+    // The lengths of the flow lines vary by orders of magnitude, so
+    // the saddles are handed out one by one to whichever thread is
+    // idle; each result goes to its saddle's slot, so the order does
+    // not depend on the scheduling.
+    ::detail::ParallelErrors errors;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threadCount)
+#endif
+    {
+        ThreadImage threadImage(image_);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 1)
+#endif
+        for(int k = 0; k < count; ++k)
+        {
+            if(errors.failed())
+                continue;
+            try
+            {
+                int i = indices[k];
+                edges[i] = TracedEdge();
+                if(!isRemoved(saddles_[i]) &&
+                   threadImage(saddles_[i][0], saddles_[i][1]) >= threshold)
+                    traceEdge(threadImage, i, epsilon, edges[i]);
+            }
+            catch(std::exception &e)
+            {
+                errors.capture(e);
+            }
+        }
+    }
+    errors.rethrow();
+}
+
 } // namespace vigra
 
 #endif // VIGRA_SUBPIXEL_WATERSHED_HXX
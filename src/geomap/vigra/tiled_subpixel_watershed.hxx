@@ -0,0 +1,752 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2007-2019 by Hans Meine                      */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef VIGRA_TILED_SUBPIXEL_WATERSHED_HXX
+#define VIGRA_TILED_SUBPIXEL_WATERSHED_HXX
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "subpixel_watershed.hxx"
+#include "../threading.hxx"
+
+namespace vigra {
+
+/** Subpixel watersheds of images too large for a single
+    SubPixelWatersheds object.
+
+    The image is split into square tiles; each tile is processed by a
+    SubPixelWatersheds object on the tile's core rectangle plus an
+    overlap margin, so that the spline prefilter only ever sees one
+    (extended) tile at a time and memory is bounded by the tile size
+    times the number of threads (plus tileCacheSize_, see below).
+
+    Each critical point belongs to the tile whose core contains its
+    facet; seeds are taken from the core plus the Newton search radius,
+    so that no critical point is missed.  Flow lines are traced in the
+    tile of their saddle.  If a flow line fails to reach a maximum
+    after having left the tile's trusted rectangle (the core plus half
+    of the overlap, where the boundary treatment of the prefilter does
+    not matter), it is cut at that point and continued within the tile
+    containing the next point, until it ends like in
+    SubPixelWatersheds::flowLine().
+
+    Since the prefilter of neighbouring tiles differs slightly near
+    the seams, the same critical point may be found by two tiles at
+    positions that round to different facets.  Critical points within
+    minCPDist_ of a seam are therefore deduplicated across tiles (the
+    one of the tile with the lower index is kept), like
+    SubPixelWatersheds does within an image.  The remaining
+    differences to SubPixelWatersheds are below the prefilter's
+    boundary error (see test_tiled_watersheds.py).
+
+    Each continuation round processes the tiles that flow lines
+    entered in the previous round.  Up to tileCacheSize_ prefiltered
+    tiles are kept between the rounds (least recently used ones are
+    dropped), so that a tile visited again is not prefiltered again.
+
+    Tiles are processed in parallel (threadCount, 0 meaning all
+    available threads); the results do not depend on the number of
+    threads.  The source image is read via its iterator/accessor
+    range, which must stay valid during findCriticalPoints() and
+    traceAllEdges().
+*/
+template <class SPLINEIMAGEVIEW>
+class TiledSubPixelWatersheds
+{
+  public:
+    typedef SPLINEIMAGEVIEW SplineImageView;
+    typedef SubPixelWatersheds<SplineImageView> TileWatersheds;
+    typedef typename TileWatersheds::PointType PointType;
+    typedef typename TileWatersheds::PointArray PointArray;
+    typedef typename TileWatersheds::TracedEdge TracedEdge;
+    typedef typename TileWatersheds::TracedEdges TracedEdges;
+
+    TiledSubPixelWatersheds(Size2D imageSize,
+                            int tileSize = 512, int overlap = 32)
+    : imageSize_(imageSize),
+      tileSize_(tileSize),
+      overlap_(overlap),
+      initialStep_(0.1),
+      minCPDist_(1e-3),
+      stepEpsilon_(1e-4),
+      cpOversampling_(2),
+      flowLineIntegrator_(SecondOrderDoubleStep),
+      flowLineTolerance_(0.0),
+      tileCacheSize_(16)
+    {
+        vigra_precondition(tileSize > 0,
+            "TiledSubPixelWatersheds(): tileSize must be positive");
+        vigra_precondition(overlap >= 2 * seedMargin(),
+            "TiledSubPixelWatersheds(): overlap too small");
+        tilesX_ = (imageSize.x + tileSize - 1) / tileSize;
+        tilesY_ = (imageSize.y + tileSize - 1) / tileSize;
+    }
+
+    int width() const { return imageSize_.x; }
+    int height() const { return imageSize_.y; }
+
+    int tileCount() const { return tilesX_ * tilesY_; }
+        /// the critical points within this rectangle belong to tile
+    Rect2D tileRect(int tile) const;
+        /// the part of the image the spline of tile is computed on
+    Rect2D extendedTileRect(int tile) const;
+        /// the part of the extended rectangle flow lines are kept in
+    Rect2D trustedTileRect(int tile) const;
+        /// index of the tile whose core contains the facet of p
+    int tileAt(PointType const & p) const;
+
+        /// Find the critical points of all tiles (minima_, saddles_,
+        /// maxima_ are 1-based and ordered by tile).
+    template <class SrcIterator, class SrcAccessor>
+    void findCriticalPoints(
+        triple<SrcIterator, SrcIterator, SrcAccessor> src,
+        unsigned int threadCount = 0);
+
+        /// Trace the edges of all saddles whose value is >= threshold.
+        /// As with SubPixelWatersheds::traceAllEdges(), edges[i]
+        /// belongs to saddles_[i] and the end indices refer to
+        /// maxima_ (all in image coordinates).
+    template <class SrcIterator, class SrcAccessor>
+    void traceAllEdges(
+        triple<SrcIterator, SrcIterator, SrcAccessor> src,
+        double threshold, unsigned int threadCount,
+        TracedEdges & edges, double epsilon = 1e-4) const;
+
+    Size2D imageSize_;
+    int tileSize_, overlap_;
+    PointArray minima_, saddles_, maxima_;
+        // dedup queries / hits of the last findCriticalPoints() (all tiles)
+    GridHash2DCounters cpDedupCounters_;
+    double initialStep_, minCPDist_, stepEpsilon_;
+    unsigned int cpOversampling_;
+    FlowLineIntegrator flowLineIntegrator_;
+    double flowLineTolerance_;
+        // prefiltered tiles kept between the rounds of traceAllEdges()
+        // (in addition to the ones currently traced by the threads)
+    unsigned int tileCacheSize_;
+
+  protected:
+        // a flow line of a saddle (index 2*saddle for the forward,
+        // 2*saddle+1 for the backward direction)
+    struct FlowLine
+    {
+        FlowLine()
+        : end(0),
+          nextTile(-1),
+          hops(0)
+        {}
+
+        PointArray points;
+        int end, nextTile, hops;
+    };
+    typedef std::vector<FlowLine> FlowLines;
+
+        // a prefiltered tile together with the global indices of its
+        // maxima_ (see setTileMaxima())
+    struct TracingTile
+    {
+        std::auto_ptr<TileWatersheds> watersheds;
+        std::vector<int> globalMaxima;
+    };
+
+        // Newton iterations started from pixels up to this distance
+        // outside the core may converge to critical points inside
+    static int seedMargin()
+    {
+        return (int)VIGRA_CSTD::ceil(criticalPointSearchRadius) + 1;
+    }
+
+    template <class SrcIterator, class SrcAccessor>
+    std::auto_ptr<TileWatersheds> makeTile(
+        triple<SrcIterator, SrcIterator, SrcAccessor> src, int tile) const;
+    template <class SrcIterator, class SrcAccessor>
+    std::auto_ptr<TracingTile> makeTracingTile(
+        triple<SrcIterator, SrcIterator, SrcAccessor> src, int tile) const;
+    void dedupSeamPoints(int tile, PointArray & points,
+                         GridHash2D<PointType, int> & seamPoints) const;
+    void setTileMaxima(int tile, TileWatersheds & tileWS,
+                       std::vector<int> & globalMaxima) const;
+    void finishFlowLine(int tile, Point2D const & offset,
+                        std::vector<int> const & globalMaxima,
+                        PointArray const & curve, int end,
+                        FlowLine & flowLine) const;
+
+    int tilesX_, tilesY_;
+        // the critical points of tile t have the indices
+        // [xxxBegin_[t], xxxBegin_[t+1])
+    std::vector<int> saddlesBegin_, maximaBegin_;
+};
+
+template <class SplineImageView>
+Rect2D
+TiledSubPixelWatersheds<SplineImageView>::tileRect(int tile) const
+{
+    int x = (tile % tilesX_) * tileSize_;
+    int y = (tile / tilesX_) * tileSize_;
+    return Rect2D(x, y,
+                  std::min(x + tileSize_, imageSize_.x),
+                  std::min(y + tileSize_, imageSize_.y));
+}
+
+template <class SplineImageView>
+Rect2D
+TiledSubPixelWatersheds<SplineImageView>::extendedTileRect(int tile) const
+{
+    Rect2D result(tileRect(tile));
+    result.addBorder(overlap_);
+    return result & Rect2D(imageSize_);
+}
+
+template <class SplineImageView>
+Rect2D
+TiledSubPixelWatersheds<SplineImageView>::trustedTileRect(int tile) const
+{
+    Rect2D result(tileRect(tile));
+    result.addBorder(overlap_ / 2);
+    return result & Rect2D(imageSize_);
+}
+
+template <class SplineImageView>
+int
+TiledSubPixelWatersheds<SplineImageView>::tileAt(PointType const & p) const
+{
+    int x = (int)VIGRA_CSTD::floor(p[0] + 0.5);
+    int y = (int)VIGRA_CSTD::floor(p[1] + 0.5);
+    x = std::max(0, std::min(x, imageSize_.x - 1));
+    y = std::max(0, std::min(y, imageSize_.y - 1));
+    return (y / tileSize_) * tilesX_ + x / tileSize_;
+}
+
+template <class SplineImageView>
+template <class SrcIterator, class SrcAccessor>
+std::auto_ptr<typename TiledSubPixelWatersheds<SplineImageView>::TileWatersheds>
+TiledSubPixelWatersheds<SplineImageView>::makeTile(
+    triple<SrcIterator, SrcIterator, SrcAccessor> src, int tile) const
+{
+    Rect2D ext(extendedTileRect(tile));
+    std::auto_ptr<TileWatersheds> result(new TileWatersheds(
+        src.first + ext.upperLeft(), src.first + ext.lowerRight(), src.third));
+    result->initialStep_ = initialStep_;
+    result->minCPDist_ = minCPDist_;
+    result->stepEpsilon_ = stepEpsilon_;
+    result->cpOversampling_ = cpOversampling_;
+    result->flowLineIntegrator_ = flowLineIntegrator_;
+    result->flowLineTolerance_ = flowLineTolerance_;
+    return result;
+}
+
+template <class SplineImageView>
+template <class SrcIterator, class SrcAccessor>
+std::auto_ptr<typename TiledSubPixelWatersheds<SplineImageView>::TracingTile>
+TiledSubPixelWatersheds<SplineImageView>::makeTracingTile(
+    triple<SrcIterator, SrcIterator, SrcAccessor> src, int tile) const
+{
+    std::auto_ptr<TracingTile> result(new TracingTile);
+    result->watersheds = makeTile(src, tile);
+    setTileMaxima(tile, *result->watersheds, result->globalMaxima);
+    return result;
+}
+
+template <class SplineImageView>
+template <class SrcIterator, class SrcAccessor>
+void
+TiledSubPixelWatersheds<SplineImageView>::findCriticalPoints(
+    triple<SrcIterator, SrcIterator, SrcAccessor> src,
+    unsigned int threadCount)
+{
+    vigra_precondition(src.second - src.first == imageSize_,
+        "TiledSubPixelWatersheds::findCriticalPoints(): image size mismatch");
+
+    int tileCount = this->tileCount();
+    std::vector<PointArray>
+        tileMinima(tileCount), tileSaddles(tileCount), tileMaxima(tileCount);
+    std::vector<GridHash2DCounters> tileCounters(tileCount);
+
+    threadCount = ::detail::resolveThreadCount(threadCount);
+    ::detail::ParallelErrors errors;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threadCount)
+#endif
+    for(int tile = 0; tile < tileCount; ++tile)
+    {
+        if(errors.failed())
+            continue;
+        try
+        {
+            std::auto_ptr<TileWatersheds> tileWS(makeTile(src, tile));
+
+            Rect2D core(tileRect(tile)), ext(extendedTileRect(tile));
+            Rect2D seedRect(core);
+            seedRect.addBorder(seedMargin());
+            seedRect &= ext;
+            seedRect.moveBy(-ext.upperLeft());
+            tileWS->findCriticalPoints(seedRect, CriticalPointsNoProgress());
+            tileCounters[tile] = tileWS->cpDedupCounters_;
+
+            // keep the critical points owned by this tile:
+            PointType offset(ext.left(), ext.top());
+            PointArray const * found[3] = {
+                &tileWS->minima_, &tileWS->saddles_, &tileWS->maxima_ };
+            PointArray * owned[3] = {
+                &tileMinima[tile], &tileSaddles[tile], &tileMaxima[tile] };
+            for(int k = 0; k < 3; ++k)
+            {
+                for(unsigned int i = 1; i < found[k]->size(); ++i)
+                {
+                    PointType p((*found[k])[i] + offset);
+                    if(tileAt(p) == tile)
+                        owned[k]->push_back(p);
+                }
+            }
+        }
+        catch(std::exception &e)
+        {
+            errors.capture(e);
+        }
+    }
+    errors.rethrow();
+
+    // concatenate in tile order (1-based like SubPixelWatersheds),
+    // dropping duplicates found by two tiles at a seam:
+    GridHash2D<PointType, int> seamPoints(
+        detail::criticalPointHashCellSize(minCPDist_));
+    minima_.clear();
+    saddles_.clear();
+    maxima_.clear();
+    minima_.push_back(PointType());
+    saddles_.push_back(PointType());
+    maxima_.push_back(PointType());
+    saddlesBegin_.resize(tileCount + 1);
+    maximaBegin_.resize(tileCount + 1);
+    cpDedupCounters_ = GridHash2DCounters();
+    for(int tile = 0; tile < tileCount; ++tile)
+    {
+        cpDedupCounters_ += tileCounters[tile];
+        dedupSeamPoints(tile, tileMinima[tile], seamPoints);
+        dedupSeamPoints(tile, tileSaddles[tile], seamPoints);
+        dedupSeamPoints(tile, tileMaxima[tile], seamPoints);
+        saddlesBegin_[tile] = saddles_.size();
+        maximaBegin_[tile] = maxima_.size();
+        minima_.insert(minima_.end(),
+                       tileMinima[tile].begin(), tileMinima[tile].end());
+        saddles_.insert(saddles_.end(),
+                        tileSaddles[tile].begin(), tileSaddles[tile].end());
+        maxima_.insert(maxima_.end(),
+                       tileMaxima[tile].begin(), tileMaxima[tile].end());
+    }
+    saddlesBegin_[tileCount] = saddles_.size();
+    maximaBegin_[tileCount] = maxima_.size();
+    cpDedupCounters_ += seamPoints.counters();
+}
+
+    // Remove the points of tile that lie within minCPDist_ of a seam
+    // and within minCPDist_ of one of seamPoints (found by a tile with
+    // a lower index); add the remaining ones near a seam to seamPoints.
+template <class SplineImageView>
+void
+TiledSubPixelWatersheds<SplineImageView>::dedupSeamPoints(
+    int tile, PointArray & points,
+    GridHash2D<PointType, int> & seamPoints) const
+{
+    if(minCPDist_ <= 0.0)
+        return;
+
+    // the facets of the core span [left - 0.5, right - 0.5):
+    Rect2D core(tileRect(tile));
+    double left = core.left() - 0.5 + minCPDist_,
+          right = core.right() - 0.5 - minCPDist_,
+            top = core.top() - 0.5 + minCPDist_,
+         bottom = core.bottom() - 0.5 - minCPDist_;
+    double squareMinCPDist = minCPDist_ * minCPDist_;
+
+    unsigned int kept = 0;
+    for(unsigned int i = 0; i < points.size(); ++i)
+    {
+        PointType p(points[i]);
+        if(p[0] < left || p[0] >= right || p[1] < top || p[1] >= bottom)
+        {
+            if(seamPoints.nearest(p, squareMinCPDist))
+                continue;
+            seamPoints.insert(p, tile);
+        }
+        points[kept++] = p;
+    }
+    points.erase(points.begin() + kept, points.end());
+}
+
+namespace detail {
+
+template <class Point>
+struct TiledMaximum
+{
+    TiledMaximum(Point const & p, int i)
+    : position(p),
+      index(i)
+    {}
+
+    bool operator<(TiledMaximum const & other) const
+    {
+        return position[0] < other.position[0] ||
+            (position[0] == other.position[0] &&
+             position[1] < other.position[1]);
+    }
+
+    Point position;
+    int index;
+};
+
+    // Owns up to capacity entries per tile index, dropping the least
+    // recently put ones.  take() and put() may be called concurrently.
+template <class T>
+class TileCache
+{
+  public:
+    TileCache(unsigned int capacity)
+    : capacity_(capacity)
+    {}
+
+    ~TileCache()
+    {
+        for(typename Entries::iterator it = entries_.begin();
+            it != entries_.end(); ++it)
+            delete it->second;
+    }
+
+    bool contains(int tile) const
+    {
+        for(typename Entries::const_iterator it = entries_.begin();
+            it != entries_.end(); ++it)
+            if(it->first == tile)
+                return true;
+        return false;
+    }
+
+        // remove the entry of tile and hand it over to the caller
+        // (NULL if tile is not cached)
+    std::auto_ptr<T> take(int tile)
+    {
+        std::auto_ptr<T> result;
+#ifdef _OPENMP
+#pragma omp critical(geomap_tile_cache)
+#endif
+        {
+            for(typename Entries::iterator it = entries_.begin();
+                it != entries_.end(); ++it)
+            {
+                if(it->first == tile)
+                {
+                    result.reset(it->second);
+                    entries_.erase(it);
+                    break;
+                }
+            }
+        }
+        return result;
+    }
+
+    void put(int tile, std::auto_ptr<T> entry)
+    {
+        T * dropped = NULL;
+#ifdef _OPENMP
+#pragma omp critical(geomap_tile_cache)
+#endif
+        {
+            if(capacity_ > 0)
+            {
+                entries_.push_front(std::make_pair(tile, entry.release()));
+                if(entries_.size() > capacity_)
+                {
+                    dropped = entries_.back().second;
+                    entries_.pop_back();
+                }
+            }
+        }
+        delete dropped; // outside of the critical section
+    }
+
+  private:
+    typedef std::list<std::pair<int, T *> > Entries;
+    Entries entries_;
+    unsigned int capacity_;
+};
+
+} // namespace detail
+
+    // Let tileWS know all maxima within its extended rectangle (so
+    // that flow lines stop there) and store the global index of each
+    // of its maxima_ in globalMaxima.
+template <class SplineImageView>
+void
+TiledSubPixelWatersheds<SplineImageView>::setTileMaxima(
+    int tile, TileWatersheds & tileWS, std::vector<int> & globalMaxima) const
+{
+    typedef detail::TiledMaximum<PointType> Maximum;
+
+    Rect2D ext(extendedTileRect(tile));
+    PointType offset(ext.left(), ext.top());
+    Rect2D facets(ext.size());
+    int tx0 = ext.left() / tileSize_, tx1 = (ext.right() - 1) / tileSize_,
+        ty0 = ext.top() / tileSize_, ty1 = (ext.bottom() - 1) / tileSize_;
+
+    std::vector<Maximum> maxima;
+    for(int ty = ty0; ty <= ty1; ++ty)
+    {
+        for(int tx = tx0; tx <= tx1; ++tx)
+        {
+            int t = ty * tilesX_ + tx;
+            for(int i = maximaBegin_[t]; i < maximaBegin_[t+1]; ++i)
+            {
+                PointType p(maxima_[i] - offset);
+                if(facets.contains(Point2D(
+                       (int)VIGRA_CSTD::floor(p[0] + 0.5),
+                       (int)VIGRA_CSTD::floor(p[1] + 0.5))))
+                    maxima.push_back(Maximum(p, i));
+            }
+        }
+    }
+
+    tileWS.maxima_.clear();
+    tileWS.maxima_.push_back(PointType());
+    for(unsigned int i = 0; i < maxima.size(); ++i)
+        tileWS.maxima_.push_back(maxima[i].position);
+    tileWS.updateMaxImage(); // re-orders maxima_
+
+    std::sort(maxima.begin(), maxima.end());
+    globalMaxima.resize(tileWS.maxima_.size());
+    globalMaxima[0] = 0;
+    for(unsigned int i = 1; i < tileWS.maxima_.size(); ++i)
+    {
+        globalMaxima[i] = std::lower_bound(
+            maxima.begin(), maxima.end(),
+            Maximum(tileWS.maxima_[i], 0))->index;
+    }
+}
+
+    // Append curve (traced within tile, starting with the last point
+    // of flowLine) to flowLine.  If it failed to reach a maximum after
+    // leaving the trusted rectangle, only the part before is kept, and
+    // nextTile tells where to continue.
+template <class SplineImageView>
+void
+TiledSubPixelWatersheds<SplineImageView>::finishFlowLine(
+    int tile, Point2D const & offset, std::vector<int> const & globalMaxima,
+    PointArray const & curve, int end, FlowLine & flowLine) const
+{
+    PointType poffset(offset.x, offset.y);
+    Rect2D trusted(trustedTileRect(tile));
+
+    unsigned int size = curve.size();
+    flowLine.nextTile = -1;
+    if(end > 0)
+    {
+        end = globalMaxima[end];
+    }
+    else
+    {
+        for(unsigned int i = 1; i < size; ++i)
+        {
+            PointType p(curve[i] + poffset);
+            if(p[0] < trusted.left() - 0.5 || p[0] >= trusted.right() - 0.5 ||
+               p[1] < trusted.top() - 0.5 || p[1] >= trusted.bottom() - 0.5)
+            {
+                flowLine.nextTile = tileAt(p);
+                size = i;
+                break;
+            }
+        }
+    }
+
+    // the first point of curve is already there:
+    if(flowLine.points.size() == 0)
+        flowLine.points.push_back(curve[0] + poffset);
+    for(unsigned int i = 1; i < size; ++i)
+        flowLine.points.push_back(curve[i] + poffset);
+    flowLine.end = end;
+}
+
+template <class SplineImageView>
+template <class SrcIterator, class SrcAccessor>
+void
+TiledSubPixelWatersheds<SplineImageView>::traceAllEdges(
+    triple<SrcIterator, SrcIterator, SrcAccessor> src,
+    double threshold, unsigned int threadCount,
+    TracedEdges & edges, double epsilon) const
+{
+    vigra_precondition(saddles_.size() > 0,
+        "TiledSubPixelWatersheds::traceAllEdges(): "
+        "findCriticalPoints() must be called first");
+    vigra_precondition(src.second - src.first == imageSize_,
+        "TiledSubPixelWatersheds::traceAllEdges(): image size mismatch");
+
+    int tileCount = this->tileCount();
+    int saddleCount = saddles_.size();
+    FlowLines flowLines(2 * saddleCount);
+    std::vector<char> traced(saddleCount, false); // not vector<bool>: written concurrently
+
+    threadCount = ::detail::resolveThreadCount(threadCount);
+    ::detail::ParallelErrors errors;
+    detail::TileCache<TracingTile> cache(tileCacheSize_);
+
+    // work list per tile: indices into flowLines (empty for the first
+    // round, which traces the flow lines of the tile's own saddles)
+    std::vector<std::vector<int> > pending(tileCount);
+    std::vector<int> activeTiles;
+    for(int tile = 0; tile < tileCount; ++tile)
+        if(saddlesBegin_[tile] < saddlesBegin_[tile+1])
+            activeTiles.push_back(tile);
+
+    for(int round = 0; activeTiles.size() > 0; ++round)
+    {
+        int activeCount = activeTiles.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threadCount)
+#endif
+        for(int k = 0; k < activeCount; ++k)
+        {
+            if(errors.failed())
+                continue;
+            try
+            {
+                int tile = activeTiles[k];
+                std::auto_ptr<TracingTile> tracingTile(cache.take(tile));
+                if(!tracingTile.get())
+                    tracingTile = makeTracingTile(src, tile);
+                TileWatersheds * tileWS = tracingTile->watersheds.get();
+                std::vector<int> const & globalMaxima(
+                    tracingTile->globalMaxima);
+
+                SharedSplineImageView<SplineImageView> image(tileWS->image_);
+                Point2D offset(extendedTileRect(tile).upperLeft());
+                PointType poffset(offset.x, offset.y);
+
+                PointArray curve;
+                if(round == 0)
+                {
+                    for(int i = saddlesBegin_[tile]; i < saddlesBegin_[tile+1]; ++i)
+                    {
+                        PointType s(saddles_[i] - poffset);
+                        if(image(s[0], s[1]) < threshold)
+                            continue;
+                        traced[i] = true;
+                        for(int d = 0; d < 2; ++d)
+                        {
+                            curve.clear();
+                            int end = tileWS->flowLine(
+                                image, s[0], s[1], d == 0, epsilon, curve);
+                            finishFlowLine(tile, offset, globalMaxima,
+                                           curve, end, flowLines[2*i+d]);
+                        }
+                    }
+                }
+                else
+                {
+                    std::vector<int> const & lines(pending[tile]);
+                    for(unsigned int j = 0; j < lines.size(); ++j)
+                    {
+                        FlowLine & flowLine(flowLines[lines[j]]);
+                        PointType s(flowLine.points.back() - poffset);
+                        curve.clear();
+                        int end = tileWS->continueFlowLine(
+                            image, s[0], s[1], epsilon, curve);
+                        finishFlowLine(tile, offset, globalMaxima,
+                                       curve, end, flowLine);
+                    }
+                }
+                cache.put(tile, tracingTile);
+            }
+            catch(std::exception &e)
+            {
+                errors.capture(e);
+            }
+        }
+        errors.rethrow();
+
+        // collect the flow lines to be continued, in a
+        // deterministic order:
+        for(int k = 0; k < activeCount; ++k)
+            pending[activeTiles[k]].clear();
+        for(int i = 0; i < (int)flowLines.size(); ++i)
+        {
+            FlowLine & flowLine(flowLines[i]);
+            if(flowLine.nextTile < 0)
+                continue;
+            if(++flowLine.hops > tileCount)
+            {
+                flowLine.nextTile = -1;
+                flowLine.end = -3; // too many steps
+                continue;
+            }
+            pending[flowLine.nextTile].push_back(i);
+            flowLine.nextTile = -1;
+        }
+        // tiles of the next round, the cached ones first so that they
+        // are taken before being dropped in favour of the others (the
+        // order does not change the results):
+        activeTiles.clear();
+        std::vector<int> uncachedTiles;
+        for(int tile = 0; tile < tileCount; ++tile)
+        {
+            if(!pending[tile].size())
+                continue;
+            if(cache.contains(tile))
+                activeTiles.push_back(tile);
+            else
+                uncachedTiles.push_back(tile);
+        }
+        activeTiles.insert(activeTiles.end(),
+                           uncachedTiles.begin(), uncachedTiles.end());
+    }
+
+    edges.clear();
+    edges.resize(saddleCount);
+    for(int i = 1; i < saddleCount; ++i)
+    {
+        if(!traced[i])
+            continue;
+        PointArray const & forwardCurve(flowLines[2*i].points);
+        PointArray const & backwardCurve(flowLines[2*i+1].points);
+        TracedEdge & edge(edges[i]);
+
+        edge.forwardIndex = flowLines[2*i].end;
+        edge.backwardIndex = flowLines[2*i+1].end;
+        edge.points.reserve(forwardCurve.size() + backwardCurve.size() - 1);
+        for(int j = forwardCurve.size() - 1; j >= 0; --j)
+            edge.points.push_back(forwardCurve[j]);
+        for(int j = 1; j < (int)backwardCurve.size(); ++j)
+            edge.points.push_back(backwardCurve[j]);
+        edge.saddlePosition = forwardCurve.size() - 1;
+        edge.traced = true;
+    }
+}
+
+} // namespace vigra
+
+#endif // VIGRA_TILED_SUBPIXEL_WATERSHED_HXX
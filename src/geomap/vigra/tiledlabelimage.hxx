@@ -0,0 +1,469 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2007-2019 by Hans Meine                      */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef VIGRA_TILEDLABELIMAGE_HXX
+#define VIGRA_TILEDLABELIMAGE_HXX
+
+#include <vigra/error.hxx>
+#include <vigra/multi_array.hxx> // MultiArrayShape
+#include <vigra/accessor.hxx>    // StandardValueAccessor
+#include <vigra/utilities.hxx>   // triple
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#if defined(__unix__) || defined(__APPLE__)
+#  define VIGRA_TILEDLABELIMAGE_MMAP
+#  include <sys/types.h>
+#  include <sys/mman.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+namespace vigra {
+
+/**
+ * Sparse 2D int image made of square tiles (tileSize x tileSize,
+ * tileSize being a power of two) that are only allocated when
+ * written to; unallocated tiles read as the fill value given at
+ * construction.  Optionally, all tiles live in a (sparse) scratch
+ * file that is memory-mapped, such that the OS may page them out.
+ *
+ * The interface mimics the parts of MultiArray<2, int> used for
+ * GeoMap's label image.  Note that the non-const element accessors
+ * allocate the tile containing the pixel, so read through a const
+ * reference where possible.
+ */
+class TiledLabelImage
+{
+  public:
+    typedef int                       value_type;
+    typedef value_type &              reference;
+    typedef value_type                const_reference;
+    typedef MultiArrayShape<2>::type  difference_type;
+    typedef difference_type           size_type;
+
+    enum { DefaultTileSize = 256 };
+
+        /// column iterator (within one row) for fillScannedPoly() et al.
+    class column_iterator
+    {
+      public:
+        column_iterator(TiledLabelImage *image, int x, int y)
+        : image_(image), x_(x), y_(y)
+        {}
+
+        reference operator*() const
+        {
+            return (*image_)(x_, y_);
+        }
+
+        column_iterator &operator++()
+        {
+            ++x_;
+            return *this;
+        }
+
+        column_iterator &operator+=(int diff)
+        {
+            x_ += diff;
+            return *this;
+        }
+
+        bool operator==(const column_iterator &other) const
+        {
+            return x_ == other.x_;
+        }
+
+        bool operator!=(const column_iterator &other) const
+        {
+            return x_ != other.x_;
+        }
+
+      protected:
+        TiledLabelImage *image_;
+        int x_, y_;
+    };
+
+        /// row iterator, compatible with the MultiIterator<2> usage
+        /// in fillScannedPoly() / drawScannedPoly()
+    class traverser
+    {
+      public:
+        typedef column_iterator next_type;
+
+        traverser(TiledLabelImage *image, int y)
+        : image_(image), y_(y)
+        {}
+
+        traverser operator+(int diff) const
+        {
+            return traverser(image_, y_ + diff);
+        }
+
+        traverser &operator++()
+        {
+            ++y_;
+            return *this;
+        }
+
+        next_type begin() const
+        {
+            return next_type(image_, 0, y_);
+        }
+
+        next_type end() const
+        {
+            return next_type(image_, image_->width(), y_);
+        }
+
+        bool operator==(const traverser &other) const
+        {
+            return y_ == other.y_;
+        }
+
+        bool operator!=(const traverser &other) const
+        {
+            return y_ != other.y_;
+        }
+
+      protected:
+        TiledLabelImage *image_;
+        int y_;
+    };
+
+        /**
+         * Create image of the given shape, initially filled with
+         * fill.  If backingFile is non-empty, the tiles are stored in
+         * a memory-mapped scratch file of that name (which will be
+         * created and removed again upon destruction).
+         */
+    TiledLabelImage(const difference_type &shape,
+                    value_type fill = 0,
+                    int tileSize = DefaultTileSize,
+                    const std::string &backingFile = std::string())
+    : shape_(shape),
+      fill_(fill),
+      mapped_(NULL),
+      mappedSize_(0),
+      fd_(-1)
+    {
+        init(tileSize);
+
+        if(!backingFile.empty())
+            mapFile(backingFile);
+    }
+
+        /// deep copy; the copy always keeps its tiles in memory
+    TiledLabelImage(const TiledLabelImage &other)
+    : shape_(other.shape_),
+      fill_(other.fill_),
+      mapped_(NULL),
+      mappedSize_(0),
+      fd_(-1)
+    {
+        init(other.tileSize_);
+
+        for(unsigned int i = 0; i < tiles_.size(); ++i)
+        {
+            if(other.tiles_[i])
+            {
+                tiles_[i] = new value_type[tilePixels_];
+                std::copy(other.tiles_[i], other.tiles_[i] + tilePixels_,
+                          tiles_[i]);
+            }
+        }
+    }
+
+    ~TiledLabelImage()
+    {
+        if(mapped_)
+        {
+#ifdef VIGRA_TILEDLABELIMAGE_MMAP
+            munmap(mapped_, mappedSize_);
+            close(fd_);
+            unlink(backingFile_.c_str());
+#endif
+        }
+        else
+        {
+            for(unsigned int i = 0; i < tiles_.size(); ++i)
+                delete[] tiles_[i];
+        }
+    }
+
+    const difference_type &shape() const
+    {
+        return shape_;
+    }
+
+    MultiArrayIndex size(int dim) const
+    {
+        return shape_[dim];
+    }
+
+    int width() const
+    {
+        return (int)shape_[0];
+    }
+
+    int height() const
+    {
+        return (int)shape_[1];
+    }
+
+    bool isInside(const difference_type &p) const
+    {
+        return p[0] >= 0 && p[1] >= 0 && p[0] < shape_[0] && p[1] < shape_[1];
+    }
+
+    value_type fillValue() const
+    {
+        return fill_;
+    }
+
+    int tileSize() const
+    {
+        return tileSize_;
+    }
+
+    unsigned int tileCount() const
+    {
+        return tiles_.size();
+    }
+
+    unsigned int allocatedTileCount() const
+    {
+        return tiles_.size() -
+            std::count(tiles_.begin(), tiles_.end(), (value_type *)NULL);
+    }
+
+    bool isMemoryMapped() const
+    {
+        return mapped_ != NULL;
+    }
+
+        /// read access, never allocates
+    value_type get(int x, int y) const
+    {
+        const value_type *tile = tiles_[tileIndex(x, y)];
+        return tile ? tile[pixelIndex(x, y)] : fill_;
+    }
+
+    value_type operator()(int x, int y) const
+    {
+        return get(x, y);
+    }
+
+    value_type operator[](const difference_type &p) const
+    {
+        return get((int)p[0], (int)p[1]);
+    }
+
+        /// write access, allocates the pixel's tile if necessary
+    reference operator()(int x, int y)
+    {
+        value_type *&tile = tiles_[tileIndex(x, y)];
+        if(!tile)
+            tile = allocateTile(tileIndex(x, y));
+        return tile[pixelIndex(x, y)];
+    }
+
+    reference operator[](const difference_type &p)
+    {
+        return operator()((int)p[0], (int)p[1]);
+    }
+
+    traverser traverser_begin()
+    {
+        return traverser(this, 0);
+    }
+
+    traverser traverser_end()
+    {
+        return traverser(this, height());
+    }
+
+        /**
+         * Visit the rows [beginRow, endRow) piecewise: for every part
+         * of a row within an allocated tile, f(begin, end) is called
+         * with a (mutable) pixel range, and for parts within
+         * unallocated tiles, f.uniform(fillValue(), pixelCount).
+         */
+    template<class Functor>
+    void forEachSpan(int beginRow, int endRow, Functor &f)
+    {
+        beginRow = std::max(0, beginRow);
+        endRow = std::min(height(), endRow);
+
+        for(int ty = beginRow >> tileShift_;
+            (ty << tileShift_) < endRow; ++ty)
+        {
+            int y0 = std::max(beginRow, ty << tileShift_),
+                y1 = std::min(endRow, (ty + 1) << tileShift_);
+            for(int tx = 0; tx < tilesX_; ++tx)
+            {
+                int x0 = tx << tileShift_,
+                    x1 = std::min(width(), x0 + tileSize_);
+                value_type *tile = tiles_[ty*tilesX_ + tx];
+                if(!tile)
+                {
+                    f.uniform(fill_, (unsigned int)((x1 - x0)*(y1 - y0)));
+                    continue;
+                }
+                for(int y = y0; y < y1; ++y)
+                {
+                    value_type *row = tile + pixelIndex(x0, y);
+                    f(row, row + (x1 - x0));
+                }
+            }
+        }
+    }
+
+        /// replace every value v (including the fill value) with f(v)
+    template<class Functor>
+    void transformValues(const Functor &f)
+    {
+        for(unsigned int i = 0; i < tiles_.size(); ++i)
+        {
+            value_type *tile = tiles_[i];
+            if(tile)
+                for(unsigned int j = 0; j < tilePixels_; ++j)
+                    tile[j] = f(tile[j]);
+        }
+        fill_ = f(fill_);
+    }
+
+  protected:
+    void init(int tileSize)
+    {
+        vigra_precondition(tileSize > 0 && !(tileSize & (tileSize - 1)),
+            "TiledLabelImage: tileSize must be a power of two!");
+        vigra_precondition(shape_[0] >= 0 && shape_[1] >= 0,
+            "TiledLabelImage: invalid shape!");
+
+        tileSize_ = tileSize;
+        for(tileShift_ = 0; (1 << tileShift_) < tileSize_; ++tileShift_)
+            ;
+        tilePixels_ = (unsigned int)tileSize_ * tileSize_;
+        tilesX_ = (int)((shape_[0] + tileSize_ - 1) >> tileShift_);
+        tilesY_ = (int)((shape_[1] + tileSize_ - 1) >> tileShift_);
+        tiles_.resize(tilesX_ * tilesY_, (value_type *)NULL);
+    }
+
+    void mapFile(const std::string &backingFile)
+    {
+#ifdef VIGRA_TILEDLABELIMAGE_MMAP
+        if(tiles_.empty())
+            return;
+
+        mappedSize_ = (size_t)tiles_.size() * tilePixels_ * sizeof(value_type);
+        fd_ = open(backingFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        vigra_precondition(fd_ >= 0,
+            "TiledLabelImage: could not create backing file!");
+        if(ftruncate(fd_, (off_t)mappedSize_) != 0)
+        {
+            close(fd_);
+            unlink(backingFile.c_str());
+            vigra_fail("TiledLabelImage: could not resize backing file!");
+        }
+        void *mapped = mmap(NULL, mappedSize_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, fd_, 0);
+        if(mapped == MAP_FAILED)
+        {
+            close(fd_);
+            unlink(backingFile.c_str());
+            vigra_fail("TiledLabelImage: could not map backing file!");
+        }
+        mapped_ = static_cast<value_type *>(mapped);
+        backingFile_ = backingFile;
+#else
+        vigra_fail("TiledLabelImage: memory-mapped files not supported on this platform!");
+#endif
+    }
+
+    value_type *allocateTile(unsigned int index)
+    {
+        value_type *tile;
+        if(mapped_)
+        {
+            // the file is sparse (all zeros) until written to:
+            tile = mapped_ + (size_t)index * tilePixels_;
+            if(fill_)
+                std::fill(tile, tile + tilePixels_, fill_);
+        }
+        else
+        {
+            tile = new value_type[tilePixels_];
+            std::fill(tile, tile + tilePixels_, fill_);
+        }
+        return tile;
+    }
+
+    unsigned int tileIndex(int x, int y) const
+    {
+        return (y >> tileShift_) * tilesX_ + (x >> tileShift_);
+    }
+
+    unsigned int pixelIndex(int x, int y) const
+    {
+        int mask = tileSize_ - 1;
+        return ((y & mask) << tileShift_) + (x & mask);
+    }
+
+    difference_type shape_;
+    value_type fill_;
+    int tileSize_, tileShift_, tilesX_, tilesY_;
+    unsigned int tilePixels_;
+    std::vector<value_type *> tiles_;
+
+    value_type *mapped_;
+    size_t mappedSize_;
+    int fd_;
+    std::string backingFile_;
+
+  private:
+    TiledLabelImage &operator=(const TiledLabelImage &); // not implemented
+};
+
+inline triple<TiledLabelImage::traverser,
+              TiledLabelImage::difference_type,
+              StandardValueAccessor<int> >
+destMultiArrayRange(TiledLabelImage &image)
+{
+    return triple<TiledLabelImage::traverser,
+                  TiledLabelImage::difference_type,
+                  StandardValueAccessor<int> >(
+                      image.traverser_begin(), image.shape(),
+                      StandardValueAccessor<int>());
+}
+
+} // namespace vigra
+
+#endif // VIGRA_TILEDLABELIMAGE_HXX
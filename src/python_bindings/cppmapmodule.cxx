@@ -33,6 +33,8 @@
 #include "exporthelpers.hxx"
 #include <vigra/copyimage.hxx>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <boost/bind.hpp>
 
 /********************************************************************/
@@ -606,68 +608,139 @@ void GeoMap_setSigmaMapping(GeoMap &map, bp::list pySigmaMapping, bool edgesSort
     map.setSigmaMapping(sigmaMapping, edgesSorted);
 }
 
-struct GeoMapPickleSuite : bp::pickle_suite
+// read-only stream buffer on existing memory, used for loading
+// pickled maps without copying their (possibly huge) data again
+class MemoryStreamBuf : public std::streambuf
 {
-    static bp::tuple getinitargs(GeoMap &map)
+  public:
+    MemoryStreamBuf(const char *begin, const char *end)
     {
-        bp::list nodePositions;
-        for(GeoMap::NodeIterator it = map.nodesBegin(); it.inRange(); ++it)
-        {
-            unsigned int missingNones = (*it)->label() - len(nodePositions);
-            for(unsigned int i = 0; i < missingNones; ++i)
-                nodePositions.append(bp::object());
-            nodePositions.append((*it)->position());
-        }
+        setg(const_cast<char *>(begin), const_cast<char *>(begin),
+             const_cast<char *>(end));
+    }
+};
 
-        bp::list edgeTuples;
-        for(GeoMap::EdgeIterator it = map.edgesBegin(); it.inRange(); ++it)
-        {
-            unsigned int missingNones = (*it)->label() - len(edgeTuples);
-            for(unsigned int i = 0; i < missingNones; ++i)
-                edgeTuples.append(bp::object());
-            edgeTuples.append(
-                bp::make_tuple(
-                    (*it)->startNodeLabel(),
-                    (*it)->endNodeLabel(),
-                    Vector2Polygon(**it)));
-        }
+// the memory of a bytes-like Python object (via the buffer protocol),
+// so that GeoMap(data) reads the pickle payload in place
+class PythonBytes
+{
+  public:
+    PythonBytes(PyObject *obj)
+    {
+        if(PyObject_GetBuffer(obj, &view_, PyBUF_SIMPLE) < 0)
+            bp::throw_error_already_set();
+    }
 
-        return bp::make_tuple(nodePositions, edgeTuples, map.imageSize());
+    ~PythonBytes()
+    {
+        PyBuffer_Release(&view_);
     }
 
-    static bp::tuple getstate(bp::object pyMap)
+    const char *begin() const
     {
-        GeoMap &map((bp::extract<GeoMap &>(pyMap)()));
+        return static_cast<const char *>(view_.buf);
+    }
 
-        bp::list pySigmaMapping = GeoMap_sigmaMapping(map);
+    const char *end() const
+    {
+        return begin() + view_.len;
+    }
 
-        bp::list edgeFlags;
-        for(GeoMap::EdgeIterator it = map.edgesBegin(); it.inRange(); ++it)
-        {
-            edgeFlags.append((*it)->flags());
-        }
+  private:
+    PythonBytes(const PythonBytes &); // not copyable
+    PythonBytes &operator=(const PythonBytes &);
 
-        bp::list faceFlags, faceAnchors, faceLabels;
-        for(GeoMap::FaceIterator it = map.facesBegin(); it.inRange(); ++it)
-        {
-            faceFlags.append((*it)->flags() & ~0xf0000000U);
-            faceAnchors.append((*it)->contour().label());
-            faceLabels.append((*it)->label());
-        }
+    Py_buffer view_;
+};
 
-        return bp::make_tuple(
-            pySigmaMapping,
-            map.edgesSorted(),
-            map.mapInitialized(),
-            map.hasLabelImage(),
-            edgeFlags,
-            faceFlags, faceAnchors, make_tuple(faceLabels, map.maxFaceLabel()),
-            pyMap.attr("__dict__"));
+// only bytes-like objects are converted, so that the other GeoMap
+// constructors are still found for e.g. sizes or lists
+struct PythonBytesFromPython
+{
+    PythonBytesFromPython()
+    {
+        bp::converter::registry::insert(
+            &convertible, &construct, bp::type_id<PythonBytes>());
+    }
+
+    static void *convertible(PyObject *obj)
+    {
+        if(PyBytes_Check(obj) || PyByteArray_Check(obj) ||
+           PyMemoryView_Check(obj))
+            return obj;
+        return NULL;
+    }
+
+    static void construct(
+        PyObject *obj, bp::converter::rvalue_from_python_stage1_data *data)
+    {
+        void *const storage = reinterpret_cast<
+            bp::converter::rvalue_from_python_storage<PythonBytes> *>(
+                data)->storage.bytes;
+        new (storage) PythonBytes(obj);
+        data->convertible = storage;
+    }
+};
+
+bp::object GeoMap_toBytes(const GeoMap &map, bool withLabelImage)
+{
+    std::ostringstream os(std::ios::out | std::ios::binary);
+    map.save(os, withLabelImage);
+    std::string data(os.str());
+    return bp::object(bp::handle<>(
+        PyBytes_FromStringAndSize(data.data(), data.size())));
+}
+
+std::auto_ptr<GeoMap> createGeoMapFromBytes(const PythonBytes &data)
+{
+    MemoryStreamBuf buffer(data.begin(), data.end());
+    std::istream is(&buffer);
+    return GeoMap::load(is);
+}
+
+void GeoMap_save(const GeoMap &map, const std::string &filename,
+                 bool withLabelImage)
+{
+    std::ofstream os(filename.c_str(), std::ios::out | std::ios::binary);
+    vigra_precondition(os.good(), "GeoMap.save(): could not open file");
+    map.save(os, withLabelImage);
+}
+
+GeoMap *GeoMap_load(const std::string &filename)
+{
+    std::ifstream is(filename.c_str(), std::ios::in | std::ios::binary);
+    vigra_precondition(is.good(), "GeoMap.load(): could not open file");
+    return GeoMap::load(is).release();
+}
+
+struct GeoMapPickleSuite : bp::pickle_suite
+{
+    static bp::tuple getinitargs(GeoMap &map)
+    {
+        return bp::make_tuple(GeoMap_toBytes(map, true));
+    }
+
+    static bp::tuple getstate(bp::object pyMap)
+    {
+        return bp::make_tuple(pyMap.attr("__dict__"));
     }
 
     static bool getstate_manages_dict() { return true; }
 
     static void setstate(bp::object pyMap, bp::tuple state)
+    {
+        if(len(state) > 1)
+        {
+            setLegacyState(pyMap, state);
+            return;
+        }
+        bp::extract<bp::dict>(pyMap.attr("__dict__"))().update(state[0]);
+    }
+
+        // state of maps pickled before the binary format was
+        // introduced (created via GeoMap(nodePositions, edgeTuples,
+        // imageSize), whose faces need to be embedded again):
+    static void setLegacyState(bp::object pyMap, bp::tuple state)
     {
         GeoMap &map((bp::extract<GeoMap &>(pyMap)()));
 
@@ -733,6 +806,74 @@ void GeoMap_setEdgePreferences(GeoMap &geomap,
     geomap.setEdgePreferences(cppep);
 }
 
+typedef vigra::NumpyArray<1, npy_uint32> NumpyLabelArray;
+
+NumpyLabelArray
+GeoMap_facesAt(GeoMap const &geoMap, vigra::NumpyArray<2, double> points)
+{
+    if(points.shape(1) != 2)
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "facesAt(): expected an Nx2 array of points");
+        bp::throw_error_already_set();
+    }
+
+    NumpyLabelArray result(NumpyLabelArray::difference_type(points.shape(0)));
+    for(int i = 0; i < points.shape(0); ++i)
+        result(i) = geoMap.faceLabelAt(Vector2(points(i, 0), points(i, 1)));
+    return result;
+}
+
+bp::tuple GeoMap_edgeCoordinates(GeoMap const &geoMap)
+{
+    CellLabel maxEdgeLabel = geoMap.maxEdgeLabel();
+
+    NumpyLabelArray offsets(NumpyLabelArray::difference_type(maxEdgeLabel + 1));
+    offsets(0) = 0;
+    for(CellLabel label = 0; label < maxEdgeLabel; ++label)
+    {
+        GeoMap::ConstEdgePtr edge(geoMap.edge(label));
+        offsets(label + 1) = offsets(label) + (edge ? edge->size() : 0);
+    }
+
+    vigra::NumpyArray<2, double> points(
+        vigra::NumpyArray<2, double>::difference_type(offsets(maxEdgeLabel), 2));
+    for(GeoMap::ConstEdgeIterator it = geoMap.edgesBegin(); it.inRange(); ++it)
+    {
+        const GeoMap::Edge &edge(**it);
+        for(unsigned int i = 0, k = offsets(edge.label()); i < edge.size(); ++i, ++k)
+        {
+            points(k, 0) = edge[i][0];
+            points(k, 1) = edge[i][1];
+        }
+    }
+
+    return bp::make_tuple(points, offsets);
+}
+
+bp::list GeoMap_nearestNodes(
+    GeoMap &geoMap, const Vector2 &position, unsigned int k,
+    double maxSquaredDist)
+{
+    std::vector<GeoMap::NodePtr> nodes;
+    geoMap.nearestNodes(position, k, nodes, maxSquaredDist);
+    bp::list result;
+    for(unsigned int i = 0; i < nodes.size(); ++i)
+        result.append(nodes[i]);
+    return result;
+}
+
+bp::list GeoMap_nodesInRect(
+    GeoMap &geoMap, const Vector2 &upperLeft, const Vector2 &lowerRight)
+{
+    std::vector<GeoMap::NodePtr> nodes;
+    geoMap.nodesInRect(upperLeft, lowerRight, nodes);
+    bp::list result;
+    for(unsigned int i = 0; i < nodes.size(); ++i)
+        result.append(nodes[i]);
+    return result;
+}
+
 bp::object GeoMap_internalSplitInfo(GeoMap &geoMap)
 {
     const detail::PlannedSplits *splitInfo = geoMap.internalSplitInfo();
@@ -816,6 +957,8 @@ void defMap()
 
     CELL_RETURN_POLICY crp;
 
+    PythonBytesFromPython();
+
     {
         scope geoMap(
             class_<GeoMap, boost::noncopyable>(
@@ -842,7 +985,8 @@ void defMap()
                 "  associated with the surrounding face (called with the face as\n"
                 "  first, and a list of Point2Ds as second parameter)\n\n"
                 "GeoMap objects can be pickled, which will preserve most of the GeoMap's\n"
-                "state, e.g. node/edge/face geometry, anchors, labels, and flags.",
+                "state, e.g. node/edge/face geometry, anchors, labels, flags, and the\n"
+                "label image (using the binary format of `save`).",
                 init<vigra::Size2D>(arg("imageSize"),
                     "GeoMap(nodePositions, edges, imageSize)\n\n"
                     "Creates a GeoMap of the given `imageSize`.\n\n"
@@ -866,6 +1010,29 @@ void defMap()
                      (arg("nodePositions") = list(),
                       arg("edgeTuples") = list(),
                       arg("imageSize") = vigra::Size2D(0, 0))))
+            .def("__init__", make_constructor(
+                     &createGeoMapFromBytes, default_call_policies(),
+                     (arg("data"))),
+                 "GeoMap(data)\n\n"
+                 "Restores a GeoMap from bytes (or another bytes-like object) in\n"
+                 "the binary format written by `save` (as used for pickling),\n"
+                 "without copying them.")
+            .def("save", &GeoMap_save,
+                 (arg("filename"), arg("withLabelImage") = true),
+                 "save(filename, withLabelImage = True)\n\n"
+                 "Writes the map to the given file in a compact, versioned binary\n"
+                 "format: node, edge, and face properties are stored as arrays, all\n"
+                 "edge points in one contiguous block, followed by the face\n"
+                 "anchors and (optionally) the label image.  See `load`.")
+            .def("load", &GeoMap_load, arg("filename"),
+                 return_value_policy<manage_new_object>(),
+                 "GeoMap.load(filename) -> GeoMap\n\n"
+                 "Loads a map written by `save`.  The faces (and the label image,\n"
+                 "if saved) are restored directly, i.e. without the expensive\n"
+                 "embedding of contours and rasterization of `initializeMap`.\n"
+                 "(Python attributes of the map are not saved, unlike when\n"
+                 "pickling.)")
+            .staticmethod("load")
             .def("__copy__", &generic__copy__<GeoMap>)
             .def("__deepcopy__", &generic__deepcopy__<GeoMap>)
             .def("node", (GeoMap::NodePtr(GeoMap::*)(CellLabel))&GeoMap::node, crp,
@@ -900,6 +1067,21 @@ void defMap()
                  "(meaning that Darts with negative labels start at the end of\n"
                  "the corresponding edge).")
             .def("faceAt", (GeoMap::FacePtr (GeoMap::*)(const Vector2 &))&GeoMap::faceAt, crp)
+            .def("facesAt", &GeoMap_facesAt, arg("points"),
+                 "facesAt(points) -> array\n\n"
+                 "Vectorized version of faceAt(), returns the labels of the faces\n"
+                 "containing the given points (Nx2 array) as array of length N.\n"
+                 "Without a label image, a bounding box hierarchy is built on the\n"
+                 "first call for point location (and kept up-to-date when merging\n"
+                 "faces).")
+            .def("edgeCoordinates", &GeoMap_edgeCoordinates,
+                 "edgeCoordinates() -> (points, offsets)\n\n"
+                 "Returns the support points of all edges in one Nx2 array,\n"
+                 "such that the points of the edge with label i are\n"
+                 "points[offsets[i]:offsets[i+1]] (empty for removed edges).\n"
+                 "The coordinates are copied in one go without creating Vector2\n"
+                 "objects (since the edges store their points separately, this\n"
+                 "is a bulk copy, whereas Edge.coordinates() returns a view).")
             .add_property("nodeCount", &GeoMap::nodeCount,
                           "Return the number of nodes in this graph/map.")
             .add_property("edgeCount", &GeoMap::edgeCount,
@@ -1022,8 +1204,9 @@ void defMap()
             .def("_internalSplitInfo", &GeoMap_internalSplitInfo,
                  "for debugging / paper writing only\n"
                  "list of (segmentIndex, arcLength, position, dartLabel, sigmaPos, splitGroup)")
-            .def("initializeMap", &GeoMap::initializeMap, (arg("initLabelImage") = true),
-                 "initializeMap(initLabelImage = True) -> None\n\n"
+            .def("initializeMap", &GeoMap::initializeMap,
+                 (arg("initLabelImage") = true, arg("threadCount") = 1),
+                 "initializeMap(initLabelImage = True, threadCount = 1) -> None\n\n"
                  "This finishes the initialization of a GeoMap.  Call this after\n"
                  "setting up the geometry (adding nodes/edges via\n"
                  "`addNode`/`addEdge`) and initializing the sigma orbits\n"
@@ -1036,7 +1219,10 @@ void defMap()
                  "return a label image, and `hasLabelImage()` will return\n"
                  "False.  This is useful e.g. for GeoMaps with Delaunay edges,\n"
                  "where most pixels facets in the label image are crossed by an\n"
-                 "edge (and thus don't contain face labels) anyways.")
+                 "edge (and thus don't contain face labels) anyways.\n\n"
+                 "With threadCount > 1 (0 meaning all available cores), the\n"
+                 "label image is rasterized in parallel row bands (only\n"
+                 "effective if compiled with OpenMP support).")
             .def("mapInitialized", &GeoMap::mapInitialized,
                  "mapInitialized() -> bool\n\n"
                  "Return whether initializeMap() has already been\n"
@@ -1049,9 +1235,10 @@ void defMap()
                  "its initLabelImage parameter set to True (default).  Then,\n"
                  "labelImage() returns a GrayImage, else None.")
             .def("setHasLabelImage", &GeoMap::setHasLabelImage,
-                 arg("onoff"),
-                 "setHasLabelImage(onoff)\n\n"
-                 "Retroactively add/remove a label image from this GeoMap.\n"
+                 (arg("onoff"), arg("threadCount") = 1),
+                 "setHasLabelImage(onoff, threadCount = 1)\n\n"
+                 "Retroactively add/remove a label image from this GeoMap\n"
+                 "(threadCount has the same meaning as for `initializeMap`).\n"
                  "Note that although a `faceLabelLUT()` will also appear, it\n"
                  "will not carry any data on past merge operations.")
             .def("faceLabelLUT", &GeoMap::faceLabelLUT,
@@ -1074,6 +1261,18 @@ void defMap()
                  "Return the nearest node to the given position.  If\n"
                  "`maxSquaredDist` dist is given and no Node is within range, ``None``\n"
                  "is returned instead.")
+            .def("nearestNodes", &GeoMap_nearestNodes,
+                 (arg("position"), arg("k"), arg(
+                      "maxSquaredDist") = vigra::NumericTraits<double>::max()),
+                 "nearestNodes(position, k[, maxSquaredDist]) -> list\n\n"
+                 "Return the (at most) `k` nodes nearest to the given position,\n"
+                 "sorted by increasing distance.  Only nodes within a squared\n"
+                 "distance < `maxSquaredDist` are considered.")
+            .def("nodesInRect", &GeoMap_nodesInRect,
+                 (arg("upperLeft"), arg("lowerRight")),
+                 "nodesInRect(upperLeft, lowerRight) -> list\n\n"
+                 "Return all nodes whose positions lie within the rectangle\n"
+                 "[upperLeft, lowerRight) (in no particular order).")
             .def("checkConsistency", &GeoMap::checkConsistency,
                  "checkConsistency() -> bool\n\n"
                  "Performs a series of consistency/sanity checks and returns\n"
@@ -1081,6 +1280,20 @@ void defMap()
             .def_pickle(GeoMapPickleSuite())
             );
 
+#ifdef USE_TILED_LABEL_IMAGE
+        def("setLabelImageStorage", &GeoMap::setLabelImageStorage,
+            (arg("self"),
+             arg("tileSize") = (int)vigra::TiledLabelImage::DefaultTileSize,
+             arg("backingFile") = std::string()),
+            "setLabelImageStorage(tileSize = 256, backingFile = '')\n\n"
+            "Configure the tiled label image created by subsequent calls of\n"
+            "`initializeMap` / `setHasLabelImage`.  Tiles (of tileSize^2\n"
+            "pixels, tileSize being a power of two) are only allocated where\n"
+            "faces or edges are rasterized.  If backingFile is given, they are\n"
+            "kept in a memory-mapped scratch file of that name (removed when\n"
+            "the label image is destroyed).");
+#endif
+
         RangeIterWrapper<GeoMap::NodeIterator, CELL_RETURN_POLICY>("_NodeIterator");
         RangeIterWrapper<GeoMap::EdgeIterator, CELL_RETURN_POLICY>("_EdgeIterator");
         RangeIterWrapper<GeoMap::FaceIterator, CELL_RETURN_POLICY>("_FaceIterator");
@@ -1201,6 +1414,7 @@ void defMap()
             .def("holeContours", &faceHoleContours)
             .def("holeCount", &GeoMap::Face::holeCount)
             .def("scanLines", &GeoMap::Face::scanLines)
+            .def("flatScanLines", &GeoMap::Face::flatScanLines)
             .def("flags", &GeoMap::Face::flags)
             .def("flag", &GeoMap::Face::flag, arg("which"))
             .def("setFlag", &GeoMap::Face::setFlag,
@@ -30,6 +30,7 @@
 #define NO_IMPORT_ARRAY
 #include <vigra/numpy_array.hxx>
 #include "facestatistics.hxx"
+#include "regionmerger.hxx"
 #include "exporthelpers.hxx"
 #include <cmath>
 
@@ -55,6 +56,8 @@ class FaceColorStatisticsWrapper
   public:
     typedef FaceColorStatistics<OriginalImage> Statistics;
     typedef typename Statistics::Functor StatsFunctor;
+    typedef FaceStatisticsCostMeasure<Statistics> CostMeasure;
+    typedef AutomaticRegionMerger<CostMeasure> RegionMerger;
 
     FaceColorStatisticsWrapper(const char *name)
     : bp::class_<Statistics, boost::noncopyable>(name, bp::no_init)
@@ -101,7 +104,24 @@ class FaceColorStatisticsWrapper
         this->def("minSampleCount", &Statistics::minSampleCount);
         this->def("checkConsistency", &Statistics::checkConsistency);
 
-        bp::scope parent(*this); // Functor shall become a nested class
+        this->def("automaticRegionMerger", &createRegionMerger,
+                  (bp::arg("costMeasure") = "faceMeanDiff",
+                   bp::arg("completeMerge") = true,
+                   bp::arg("updateNeighborHood") = true),
+                  // the merger references these statistics:
+                  bp::return_value_policy<
+                      bp::manage_new_object,
+                      bp::with_custodian_and_ward_postcall<0, 1> >(),
+            "automaticRegionMerger(costMeasure = 'faceMeanDiff', completeMerge = True,\n"
+            "                      updateNeighborHood = True) -> AutomaticRegionMerger\n\n"
+            "Returns a native region merger operating on the map of these\n"
+            "statistics, using one of the measures 'faceMeanDiff',\n"
+            "'faceHomogeneity', or 'faceAreaHomogeneity' as merge costs.\n"
+            "This is equivalent to maputils.AutomaticRegionMerger with the\n"
+            "corresponding bound method, but does not call back into Python\n"
+            "for every cost evaluation.");
+
+        bp::scope parent(*this); // nested classes follow
 
         bp::class_<StatsFunctor>("Functor")
             .def("pixelCount", &StatsFunctor::count)
@@ -122,6 +142,76 @@ class FaceColorStatisticsWrapper
                  &StatsFunctor::operator(),
                  bp::args("sample"))
         ;
+
+        bp::class_<RegionMerger, boost::noncopyable>(
+            "AutomaticRegionMerger",
+            "Merges faces in order of increasing costs, cf.\n"
+            "maputils.AutomaticRegionMerger.  Use the\n"
+            "automaticRegionMerger() method of the statistics for creation.",
+            bp::no_init)
+            .def("step", &RegionMerger::step)
+            .def("hasNext", &RegionMerger::hasNext)
+            .def("__nonzero__", &RegionMerger::hasNext)
+            .def("nextCost", &mergerNextCost)
+            .def("nextLabel", &mergerNextLabel)
+            .def("mergeStep", &RegionMerger::mergeStep,
+                 "mergeStep() -> Face or None\n\n"
+                 "Fetch next edge from cost queue and remove it from the map.\n"
+                 "If the edge is protected or nonexistent, do nothing and return\n"
+                 "None (i.e. not every call results in a merge step!).  Else,\n"
+                 "return the surviving Face and increment the step counter.")
+            .def("merge", &RegionMerger::merge)
+            .def("mergeSteps", &RegionMerger::mergeSteps, bp::arg("count"))
+            .def("mergeToStep", &RegionMerger::mergeToStep, bp::arg("targetStep"))
+            .def("mergeToCost", &RegionMerger::mergeToCost, bp::arg("maxCost"))
+            .def("map", &RegionMerger::map)
+        ;
+    }
+
+    static RegionMerger *createRegionMerger(
+        Statistics const &stats, std::string const &costMeasure,
+        bool completeMerge, bool updateNeighborHood)
+    {
+        typename CostMeasure::Measure measure = 0;
+        if(costMeasure == "faceMeanDiff")
+            measure = &Statistics::faceMeanDiff;
+        else if(costMeasure == "faceHomogeneity")
+            measure = &Statistics::faceHomogeneity;
+        else if(costMeasure == "faceAreaHomogeneity")
+            measure = &Statistics::faceAreaHomogeneity;
+        else
+        {
+            PyErr_SetString(PyExc_ValueError,
+                            "unknown cost measure.");
+            bp::throw_error_already_set();
+        }
+        return new RegionMerger(stats.map(), CostMeasure(stats, measure),
+                                completeMerge, updateNeighborHood);
+    }
+
+    static void
+    checkNotEmpty(RegionMerger &merger)
+    {
+        if(!merger.ensureValidNext())
+        {
+            PyErr_SetString(PyExc_IndexError,
+                            "no more edges to be removed.");
+            bp::throw_error_already_set();
+        }
+    }
+
+    static double
+    mergerNextCost(RegionMerger &merger)
+    {
+        checkNotEmpty(merger);
+        return merger.nextCost();
+    }
+
+    static CellLabel
+    mergerNextLabel(RegionMerger &merger)
+    {
+        checkNotEmpty(merger);
+        return merger.nextLabel();
     }
 
     // generic__deepcopy__ not applicable - we need to recursively deepcopy the GeoMap
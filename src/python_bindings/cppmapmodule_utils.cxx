@@ -32,6 +32,7 @@
 #include "cppmap_utils.hxx"
 #include "exporthelpers.hxx"
 #include "labellut.hxx"
+#include "dynamiccostqueue.hxx"
 
 #include <vigra/copyimage.hxx>
 
@@ -79,6 +80,79 @@ std::string EdgeProtection__repr__(EdgeProtection const &cb)
 
 /********************************************************************/
 
+typedef DynamicCostQueue<double> PyDynamicCostQueue;
+
+static void checkQueueNotEmpty(PyDynamicCostQueue const &queue)
+{
+    if(queue.empty())
+    {
+        PyErr_SetString(PyExc_IndexError, "DynamicCostQueue is empty.");
+        bp::throw_error_already_set();
+    }
+}
+
+static void checkQueueIndex(PyDynamicCostQueue const &queue,
+                            PyDynamicCostQueue::IndexType index)
+{
+    if(index >= queue.maxIndex())
+    {
+        PyErr_SetString(PyExc_IndexError,
+                        "DynamicCostQueue: index out of range.");
+        bp::throw_error_already_set();
+    }
+}
+
+bp::tuple DynamicCostQueue_top(PyDynamicCostQueue const &queue)
+{
+    checkQueueNotEmpty(queue);
+    PyDynamicCostQueue::value_type result(queue.top());
+    return bp::make_tuple(result.first, result.second);
+}
+
+bp::tuple DynamicCostQueue_pop(PyDynamicCostQueue &queue)
+{
+    checkQueueNotEmpty(queue);
+    PyDynamicCostQueue::value_type result(queue.pop());
+    return bp::make_tuple(result.first, result.second);
+}
+
+void DynamicCostQueue_insert(PyDynamicCostQueue &queue,
+                             PyDynamicCostQueue::IndexType index, double cost)
+{
+    checkQueueIndex(queue, index);
+    if(queue.contains(index))
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "DynamicCostQueue.insert(): index already in queue.");
+        bp::throw_error_already_set();
+    }
+    queue.insert(index, cost);
+}
+
+void DynamicCostQueue_setCost(PyDynamicCostQueue &queue,
+                              PyDynamicCostQueue::IndexType index, double cost)
+{
+    checkQueueIndex(queue, index);
+    queue.setCost(index, cost);
+}
+
+void DynamicCostQueue_build(PyDynamicCostQueue &queue,
+                            vigra::NumpyArray<1, npy_uint32> indices,
+                            vigra::NumpyArray<1, double> costs)
+{
+    if(indices.shape(0) != costs.shape(0))
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "DynamicCostQueue.build(): indices and costs must have the same length.");
+        bp::throw_error_already_set();
+    }
+    for(int i = 0; i < indices.shape(0); ++i)
+        checkQueueIndex(queue, indices(i));
+    queue.build(indices.begin(), indices.end(), costs.begin());
+}
+
+/********************************************************************/
+
 #include <vigra/crackconnections.hxx>
 typedef NumpyFImage::difference_type Shape;
 
@@ -122,6 +196,20 @@ pyCrackEdgeGraph(NumpyIImage const &labels, bool eightConnectedRegions)
     return cemg.result;
 }
 
+std::auto_ptr<GeoMap>
+pyStreamingCrackEdgeGraph(NumpyIImage const &labels, bool eightConnectedRegions,
+                          unsigned int threadCount)
+{
+    if(threadCount != 1)
+    {
+        ParallelCrackEdgeMapGenerator pcemg(srcImageRange(labels), eightConnectedRegions,
+                                            threadCount);
+        return pcemg.result;
+    }
+    StreamingCrackEdgeMapGenerator scemg(srcImageRange(labels), eightConnectedRegions);
+    return scemg.result;
+}
+
 unsigned int pyRemoveEdges(GeoMap &map, bp::list edgeLabels)
 {
     std::vector<CellLabel> cppel(len(edgeLabels));
@@ -170,6 +258,41 @@ void defMapUtils()
         RangeIterWrapper<LabelLUT::MergedIterator>("_MergedIterator");
     }
 
+    class_<PyDynamicCostQueue>(
+        "DynamicCostQueue",
+        "Priority queue of (index, cost) pairs for indices in the range\n"
+        "[0, maxIndex), e.g. edge or face labels.  In contrast to a\n"
+        "standard heap, the cost of an index that is already in the\n"
+        "queue may be changed (setCost) or the index may be removed\n"
+        "(erase) in O(log n).  top() and pop() return the (index, cost)\n"
+        "pair with the lowest cost.",
+        init<unsigned int>(arg("maxIndex")))
+        .def("insert", &DynamicCostQueue_insert, args("index", "cost"))
+        .def("setCost", &DynamicCostQueue_setCost, args("index", "cost"),
+             "setCost(index, cost)\n\n"
+             "Changes the cost of the given index, inserting it if necessary.")
+        .def("erase", &PyDynamicCostQueue::erase, arg("index"),
+             "erase(index) -> bool\n\n"
+             "Removes the given index from the queue, returns False if it\n"
+             "was not contained.")
+        .def("build", &DynamicCostQueue_build, args("indices", "costs"),
+             "build(indices, costs)\n\n"
+             "Bulk insertion of the given indices (uint32 array) with the\n"
+             "corresponding costs (float64 array).  Indices already in the\n"
+             "queue get their costs changed.  The heap is re-built once\n"
+             "afterwards, which is much faster than individual insertions.")
+        .def("top", &DynamicCostQueue_top)
+        .def("pop", &DynamicCostQueue_pop)
+        .def("cost", &PyDynamicCostQueue::cost, arg("index"))
+        .def("clear", &PyDynamicCostQueue::clear)
+        .def("empty", &PyDynamicCostQueue::empty)
+        .def("__len__", &PyDynamicCostQueue::size)
+        .def("__contains__", &PyDynamicCostQueue::contains)
+        .def("maxIndex", &PyDynamicCostQueue::maxIndex)
+        .def("__copy__", &generic__copy__<PyDynamicCostQueue>)
+        .def("__deepcopy__", &generic__deepcopy__<PyDynamicCostQueue>)
+    ;
+
     class_<EdgeProtection, boost::noncopyable>(
         "EdgeProtection",
         "Protects GeoMap Edges which have a protection flag set.\n"
@@ -203,6 +326,17 @@ void defMapUtils()
         "(Bit 1: connected to the right, bit 2: connected downwards)");
     def("crackEdgeGraph", &pyCrackEdgeGraph,
         (arg("labelImage"), arg("eightConnectedRegions") = true));
+    def("streamingCrackEdgeGraph", &pyStreamingCrackEdgeGraph,
+        (arg("labelImage"), arg("eightConnectedRegions") = true,
+         arg("threadCount") = 1),
+        "streamingCrackEdgeGraph(labelImage, eightConnectedRegions = True, threadCount = 1) -> GeoMap\n\n"
+        "Like crackEdgeGraph(), but scans the label image two rows at a time\n"
+        "instead of building full-size crack connection / node images first.\n"
+        "Node and edge labels (and edge directions) may differ from those\n"
+        "of crackEdgeGraph().\n\n"
+        "With threadCount > 1 (0 meaning all available cores), horizontal\n"
+        "strips of the image are traced in parallel and the edges crossing\n"
+        "strip borders are stitched together afterwards.");
 
     def("removeEdges", &pyRemoveEdges,
         args("map", "edgeLabels"));
@@ -41,6 +41,7 @@
 
 void defDiff2D();
 void defPolygon();
+void defPolygonBatch();
 void defMap();
 void defMapStats();
 void defMapUtils();
@@ -60,6 +61,7 @@ BOOST_PYTHON_MODULE_INIT(geomap)
     _import_numpy_array();
     defDiff2D();
     defPolygon();
+    defPolygonBatch();
     defMap();
     defMapStats();
     defMapUtils();
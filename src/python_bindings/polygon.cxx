@@ -116,6 +116,39 @@ Scanlines__getitem__(Scanlines const & s, int i)
     return s[i];
 }
 
+// same indexing, but the lines of FlatScanlines are views into one
+// segment array, so copies of their segments are returned
+list
+FlatScanlines__getitem__(FlatScanlines const & s, int i)
+{
+    if(i < s.startIndex() || i >= s.endIndex())
+    {
+        PyErr_SetString(PyExc_IndexError,
+            "scanline index out of bounds.");
+        throw_error_already_set();
+    }
+    list result;
+    FlatScanlines::Scanline scanline(s[i]);
+    for(unsigned int j = 0; j < scanline.size(); ++j)
+        result.append(scanline[j]);
+    return result;
+}
+
+std::auto_ptr<FlatScanlines>
+pyMergeScanlines(list scanlines, list directions)
+{
+    std::vector<ScanlinesSource> sources;
+    for(int i = 0; i < len(scanlines); ++i)
+    {
+        int direction = 1;
+        if(i < len(directions))
+            direction = extract<int>(directions[i])();
+        sources.push_back(ScanlinesSource(
+            extract<const Scanlines &>(scanlines[i])(), direction));
+    }
+    return std::auto_ptr<FlatScanlines>(new FlatScanlines(sources));
+}
+
 template<class Polygon>
 struct PolygonFromPython
 {
@@ -209,6 +242,52 @@ std::string Polygon__repr__(Polygon const &polygon)
     return s.str();
 }
 
+// destructor of the capsules used as base objects of coordinate views
+static void deletePointArrayViewOwner(PyObject *capsule)
+{
+    delete (boost::shared_ptr<std::vector<Vector2> > *)
+        PyCapsule_GetPointer(capsule, NULL);
+}
+
+// Returns a read-only Nx2 numpy view onto the coordinates of the
+// points of the given PointArray<Vector2>.  The array's base object
+// holds a reference to the memory (see PointArray::viewOwner()), so
+// the view stays valid when the array is modified (e.g. by Euler
+// operations on a GeoMap edge) or destroyed, and then shows the points
+// at the time of the call.
+template<class Array>
+object PointArray__coordinates__(const Array &a)
+{
+    if(!a.size())
+    {
+        npy_intp shape[2] = { 0, 2 };
+        return object(handle<>(PyArray_SimpleNew(2, shape, NPY_DOUBLE)));
+    }
+
+    typedef typename Array::InternalVector InternalVector;
+    PyObject *owner = PyCapsule_New(
+        new boost::shared_ptr<InternalVector>(a.viewOwner()),
+        NULL, &deletePointArrayViewOwner);
+    if(!owner)
+        throw_error_already_set();
+    handle<> ownerHandle(owner);
+
+    npy_intp shape[2] = { (npy_intp)a.size(), 2 };
+    npy_intp strides[2] = {
+        sizeof(typename Array::value_type), sizeof(double) };
+    PyObject *array = PyArray_New(
+        &PyArray_Type, 2, shape, NPY_DOUBLE, strides,
+        (void *)&a[0], 0, NPY_ARRAY_CARRAY_RO, NULL);
+    if(!array)
+        throw_error_already_set();
+    object result((handle<>(array)));
+
+    if(PyArray_SetBaseObject((PyArrayObject *)array,
+                             ownerHandle.release()) < 0)
+        throw_error_already_set();
+    return result;
+}
+
 template<class Iterator>
 void defIter(const char *name)
 {
@@ -346,72 +425,15 @@ list curvatureList(const Array &p, int dx = 5, unsigned int skip = 0)
         throw_error_already_set();
     }
 
-    double pos = 0.0;
-    for(unsigned int i = 0; i < dx + skip - 1; ++i)
-        pos += (p[i+1]-p[i]).magnitude();
+    PointArray<Vector2> curvatures;
+    polygonCurvatureList(p, dx, skip, curvatures);
 
     list result;
-
-    for(unsigned int i = skip; i < p.size() - 2*dx - skip; ++i)
-    {
-        typename Array::value_type
-            s1(p[i+  dx] - p[i]),
-            s2(p[i+2*dx] - p[i+dx]),
-            s3(p[i+2*dx] - p[i]);
-
-        double
-            a2 = s1.squaredMagnitude(),
-            b2 = s2.squaredMagnitude(),
-            c2 = s3.squaredMagnitude(),
-            a = sqrt(a2),
-            b = sqrt(b2);
-
-        pos += (p[i+dx] - p[i+dx-1]).magnitude();
-
-        static const double eps = 1e-8;
-        if(a < eps || b < eps)
-            continue;
-
-        double gamma = (a2+b2-c2) / (2*a*b), delta;
-        if(gamma > -1.0)
-        {
-            delta = M_PI - acos(gamma);
-            if((s1[0]*s3[1] - s3[0]*s1[1]) < 0)
-                result.append(make_tuple(pos, -2*delta / (a+b)));
-            else
-                result.append(make_tuple(pos,  2*delta / (a+b)));
-        }
-        else
-            result.append(make_tuple(pos, 0.0));
-    }
-
+    for(unsigned int i = 0; i < curvatures.size(); ++i)
+        result.append(make_tuple(curvatures[i][0], curvatures[i][1]));
     return result;
 }
 
-struct ContinuousDirection
-{
-    double prevAngle, offset;
-
-    ContinuousDirection(double startAngle = 0.0)
-    : prevAngle(startAngle),
-      offset(0.0)
-    {}
-
-    double operator()(double angle)
-    {
-        angle += offset;
-        double diff = angle - prevAngle;
-        if(fabs(diff) > M_PI)
-        {
-            double delta = -floor((diff + M_PI)/(M_PI*2.0))*M_PI*2.0;
-            offset += delta;
-            angle  += delta;
-        }
-        prevAngle = angle;
-        return angle;
-    }
-};
-
 template<class Array>
 list tangentList(const Array &p, int dx = 5, unsigned int skip = 0)
 {
@@ -429,28 +451,12 @@ list tangentList(const Array &p, int dx = 5, unsigned int skip = 0)
         throw_error_already_set();
     }
 
-    double pos = 0.0;
-    for(unsigned int i = 0; i < dx + skip - 1; ++i)
-        pos += (p[i+1]-p[i]).magnitude();
+    PointArray<Vector2> tangents;
+    polygonTangentList(p, dx, skip, tangents);
 
     list result;
-    ContinuousDirection makeContinuous;
-
-    for(unsigned int i = skip; i < p.size() - 2*dx - skip; ++i)
-    {
-        typename Array::value_type
-            s(p[i+2*dx] - p[i]);
-
-        pos += (p[i+dx] - p[i+dx-1]).magnitude();
-
-        static const double eps = 1e-14;
-        if(s.squaredMagnitude() < eps)
-            continue;
-
-        result.append(
-            make_tuple(pos, makeContinuous(VIGRA_CSTD::atan2(s[1], s[0]))));
-    }
-
+    for(unsigned int i = 0; i < tangents.size(); ++i)
+        result.append(make_tuple(tangents[i][0], tangents[i][1]));
     return result;
 }
 
@@ -1842,6 +1848,11 @@ void defPolygon()
         .def(self * double())
         .def(self + Vector2())
         .def("roundToInteger", &Vector2Array::roundToInteger)
+        .def("coordinates", &PointArray__coordinates__<Vector2Array>,
+             "coordinates() -> numpy.ndarray\n\n"
+             "Returns a read-only Nx2 array viewing the point coordinates\n"
+             "(without copying them or creating Vector2 objects).  When the\n"
+             "points are modified later, the array keeps the old ones.")
     ;
     PolygonFromPython<Vector2Array>();
     register_ptr_to_python< std::auto_ptr<Vector2Array> >();
@@ -1952,6 +1963,23 @@ void defPolygon()
 
     register_ptr_to_python< std::auto_ptr<Scanlines> >();
 
+    class_<FlatScanlines>("FlatScanlines", no_init)
+        .def("__len__", &FlatScanlines::size)
+        .def("__getitem__", &FlatScanlines__getitem__)
+        .def("startIndex", &FlatScanlines::startIndex)
+        .def("endIndex", &FlatScanlines::endIndex)
+        .def("segmentCount", &FlatScanlines::segmentCount)
+    ;
+
+    register_ptr_to_python< std::auto_ptr<FlatScanlines> >();
+
+    def("mergeScanlines", &pyMergeScanlines,
+        (arg("scanlines"), arg("directions") = list()),
+        "mergeScanlines(scanlines, directions = []) -> FlatScanlines\n\n"
+        "k-way merge of the given (normalized) Scanlines, whose segment\n"
+        "directions are multiplied with the corresponding `directions`\n"
+        "(default: 1), as done by `Face.flatScanLines`.");
+
     def("scanPoly", (std::auto_ptr<Scanlines>(*)
                      (const PythonPolygon&))&scanPoly,
         args("polygon"));
@@ -0,0 +1,390 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2007-2019 by Hans Meine                      */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#define PY_ARRAY_UNIQUE_SYMBOL geomap_PyArray_API
+#define NO_IMPORT_ARRAY
+#include <vigra/numpy_array.hxx>
+#include "cppmap.hxx"
+#include "polygon.hxx"
+#include "python_types.hxx"
+#include "threading.hxx"
+
+#include <boost/python.hpp>
+#include <list>
+#include <vector>
+
+namespace bp = boost::python;
+
+typedef vigra::NumpyArray<2, double> NumpyPoints;
+typedef vigra::NumpyArray<1, npy_uint32> NumpyOffsets;
+typedef vigra::NumpyArray<1, npy_uint8> NumpyStatus;
+
+/**
+ * The polygons processed by one of the batch*() functions: either
+ * all edges of a GeoMap (indexed by edge label, with NULL entries
+ * for removed edges), or the elements of a Python sequence of
+ * Polygons / point lists.  The polygons are collected while holding
+ * the GIL, so that no Python API is used by the worker threads, which
+ * run without the GIL.  The Python objects are referenced until the
+ * batch is destroyed, and the lazily computed polygon lengths are
+ * computed up front, since the same Polygon may appear repeatedly in
+ * the sequence.
+ */
+class PolygonBatch
+{
+  public:
+    PolygonBatch(bp::object polygons)
+    {
+        bp::extract<GeoMap &> map(polygons);
+        if(map.check())
+        {
+            GeoMap &geomap(map());
+            polygons_.resize(geomap.maxEdgeLabel(), NULL);
+            for(GeoMap::EdgeIterator it = geomap.edgesBegin();
+                it.inRange(); ++it)
+                polygons_[(*it)->label()] = &**it;
+            computeLengths();
+            return;
+        }
+
+        int count = bp::len(polygons);
+        polygons_.resize(count);
+        for(int i = 0; i < count; ++i)
+        {
+            bp::object item(polygons[i]);
+            bp::extract<const Vector2Polygon &> polygon(item);
+            if(polygon.check())
+            {
+                polygons_[i] = &polygon();
+                items_.push_back(item);
+            }
+            else
+            {
+                // other point sequences are converted (and kept
+                // alive until the batch has been processed):
+                converted_.push_back(
+                    Vector2Polygon(bp::extract<Vector2Array>(item)()));
+                polygons_[i] = &converted_.back();
+            }
+        }
+        computeLengths();
+    }
+
+    int size() const
+    {
+        return (int)polygons_.size();
+    }
+
+    const Vector2Polygon *operator[](int i) const
+    {
+        return polygons_[i];
+    }
+
+  protected:
+    void computeLengths() const
+    {
+        for(unsigned int i = 0; i < polygons_.size(); ++i)
+            if(polygons_[i])
+                polygons_[i]->length();
+    }
+
+    std::vector<const Vector2Polygon *> polygons_;
+    std::vector<bp::object> items_;
+    std::list<Vector2Polygon> converted_;
+};
+
+    // Runs op(polygon, result) for all polygons of the batch (in
+    // parallel, cf. threadCount) and returns a ragged array of the
+    // results as (points, offsets, status) tuple: the result for
+    // polygon i is points[offsets[i]:offsets[i+1]], and status[i] is
+    // 1 if it could be computed, 0 for removed edges and polygons for
+    // which op raised a precondition violation (e.g. because they are
+    // too short), whose results are empty.
+template<class Operation>
+bp::tuple processPolygonBatch(
+    const PolygonBatch &batch, const Operation &op, unsigned int threadCount)
+{
+    int count = batch.size();
+    std::vector<Vector2Array> results(count);
+    std::vector<npy_uint8> status(count, 0);
+
+    threadCount = ::detail::resolveThreadCount(threadCount);
+    ::detail::ParallelErrors errors;
+    {
+        ReleaseGIL nogil;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16) num_threads(threadCount)
+#endif
+        for(int i = 0; i < count; ++i)
+        {
+            if(!batch[i] || errors.failed())
+                continue;
+            try
+            {
+                op(*batch[i], results[i]);
+                status[i] = 1;
+            }
+            catch(vigra::PreconditionViolation &)
+            {
+                // this polygon cannot be processed, but the others can:
+                results[i].clear();
+            }
+            catch(std::exception &e)
+            {
+                errors.capture(e);
+            }
+        }
+    }
+    errors.rethrow();
+
+    NumpyOffsets offsets(NumpyOffsets::difference_type(count + 1));
+    NumpyStatus statusArray(NumpyStatus::difference_type(count));
+    offsets(0) = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        offsets(i + 1) = offsets(i) + results[i].size();
+        statusArray(i) = status[i];
+    }
+
+    NumpyPoints points(NumpyPoints::difference_type(offsets(count), 2));
+    for(int i = 0; i < count; ++i)
+    {
+        const Vector2Array &result(results[i]);
+        for(unsigned int j = 0, k = offsets(i); j < result.size(); ++j, ++k)
+        {
+            points(k, 0) = result[j][0];
+            points(k, 1) = result[j][1];
+        }
+    }
+
+    return bp::make_tuple(points, offsets, statusArray);
+}
+
+    // raises a ValueError (for parameters that are invalid for all
+    // polygons of a batch)
+static void checkParameter(bool valid, const char *message)
+{
+    if(!valid)
+    {
+        PyErr_SetString(PyExc_ValueError, message);
+        bp::throw_error_already_set();
+    }
+}
+
+/********************************************************************/
+
+    // Polygons that are too short for dx and skip are handled like in
+    // maputils.statistics.calculateTangentLists(): dx is reduced, and
+    // finally skip is set to zero (for three points or more); a
+    // polygon of two points gets the direction of its only segment.
+struct TangentListOperation
+{
+    int dx;
+    unsigned int skip;
+
+    void operator()(const Vector2Polygon &p, Vector2Array &result) const
+    {
+        unsigned int size = p.size();
+        if(size >= 2*dx + 2*skip + 1)
+        {
+            vigra::polygonTangentList(p, dx, skip, result);
+        }
+        else if(size < 3)
+        {
+            vigra_precondition(size == 2,
+                "batchTangentLists(): polygon has less than two points");
+            Vector2 d(p[1] - p[0]);
+            result.push_back(
+                Vector2(p.length() / 2, VIGRA_CSTD::atan2(d[1], d[0])));
+        }
+        else if(size < 3 + 2*skip)
+            vigra::polygonTangentList(p, 1, 0, result);
+        else
+            vigra::polygonTangentList(p, (size - 2*skip - 1) / 2, skip, result);
+    }
+};
+
+    // with the same fallback for short polygons as TangentListOperation
+    // (but polygons of two points have no curvature)
+struct CurvatureListOperation
+{
+    int dx;
+    unsigned int skip;
+
+    void operator()(const Vector2Polygon &p, Vector2Array &result) const
+    {
+        unsigned int size = p.size();
+        vigra_precondition(size >= 3,
+            "batchCurvatureLists(): polygon has less than three points");
+        if(size >= 2*dx + 2*skip + 1)
+            vigra::polygonCurvatureList(p, dx, skip, result);
+        else if(size < 3 + 2*skip)
+            vigra::polygonCurvatureList(p, 1, 0, result);
+        else
+            vigra::polygonCurvatureList(p, (size - 2*skip - 1) / 2, skip, result);
+    }
+};
+
+struct SimplifyPolygonOperation
+{
+    double epsilon, maxStep;
+
+    void operator()(const Vector2Polygon &p, Vector2Array &result) const
+    {
+        Vector2Polygon simple;
+        if(maxStep > 0.0)
+            vigra::simplifyPolygon(p, simple, epsilon, maxStep);
+        else
+            vigra::simplifyPolygon(p, simple, epsilon);
+        simple.swap(result);
+    }
+};
+
+struct ResampleGaussianOperation
+{
+    double scale, desiredPointDistance;
+
+    void operator()(const Vector2Polygon &p, Vector2Array &result) const
+    {
+        Vector2Polygon resampled;
+        vigra::resamplePolygonGaussianFilter(
+            p, resampled, scale, desiredPointDistance);
+        resampled.swap(result);
+    }
+};
+
+struct SplineControlPointsOperation
+{
+    int segmentCount;
+
+    void operator()(const Vector2Polygon &p, Vector2Array &result) const
+    {
+        Vector2Polygon controlPoints;
+        vigra::polygonSplineControlPoints(p, controlPoints, segmentCount);
+        controlPoints.swap(result);
+    }
+};
+
+bp::tuple batchTangentLists(
+    bp::object polygons, int dx, unsigned int skipPoints,
+    unsigned int threadCount)
+{
+    checkParameter(dx >= 1, "batchTangentLists(): dx must be >= 1");
+    TangentListOperation op = { dx, skipPoints };
+    return processPolygonBatch(PolygonBatch(polygons), op, threadCount);
+}
+
+bp::tuple batchCurvatureLists(
+    bp::object polygons, int dx, unsigned int skipPoints,
+    unsigned int threadCount)
+{
+    checkParameter(dx >= 1, "batchCurvatureLists(): dx must be >= 1");
+    CurvatureListOperation op = { dx, skipPoints };
+    return processPolygonBatch(PolygonBatch(polygons), op, threadCount);
+}
+
+bp::tuple batchSimplifyPolygon(
+    bp::object polygons, double perpendicularDistEpsilon, double maxStep,
+    unsigned int threadCount)
+{
+    checkParameter(perpendicularDistEpsilon >= 0.0,
+        "batchSimplifyPolygon(): perpendicularDistEpsilon must be >= 0");
+    SimplifyPolygonOperation op = { perpendicularDistEpsilon, maxStep };
+    return processPolygonBatch(PolygonBatch(polygons), op, threadCount);
+}
+
+bp::tuple batchResamplePolygonGaussianFilter(
+    bp::object polygons, double scale, double desiredPointDistance,
+    unsigned int threadCount)
+{
+    checkParameter(scale > 0.0,
+        "batchResamplePolygonGaussianFilter(): scale must be > 0");
+    checkParameter(desiredPointDistance > 0.0,
+        "batchResamplePolygonGaussianFilter(): desiredPointDistance must be > 0");
+    ResampleGaussianOperation op = { scale, desiredPointDistance };
+    return processPolygonBatch(PolygonBatch(polygons), op, threadCount);
+}
+
+bp::tuple batchPolygonSplineControlPoints(
+    bp::object polygons, int segmentCount, unsigned int threadCount)
+{
+    checkParameter(segmentCount >= 1,
+        "batchPolygonSplineControlPoints(): segmentCount must be >= 1");
+    SplineControlPointsOperation op = { segmentCount };
+    return processPolygonBatch(PolygonBatch(polygons), op, threadCount);
+}
+
+void defPolygonBatch()
+{
+    using namespace bp;
+
+    def("batchTangentLists", &batchTangentLists,
+        (arg("polygons"), arg("dx") = 5, arg("skipPoints") = 1,
+         arg("threadCount") = 0),
+        "batchTangentLists(polygons, dx = 5, skipPoints = 1, threadCount = 0)\n\n"
+        "Runs tangentList() on each of the given polygons, which may be\n"
+        "a list of Polygons (or point lists) or a GeoMap (meaning all\n"
+        "its edges).  Polygons that are too short for dx and skipPoints\n"
+        "are handled like in maputils.statistics.calculateTangentLists()\n"
+        "(with reduced dx, or finally skipPoints = 0).  The polygons are\n"
+        "processed in C++ by threadCount threads (0 meaning all available\n"
+        "cores, without holding the GIL), and the results are returned as a ragged array, i.e. a\n"
+        "tuple (points, offsets, status) of an Nx2 array of (arcLength,\n"
+        "angle) pairs, an array of offsets, such that the result for\n"
+        "polygon i is points[offsets[i]:offsets[i+1]], and an array whose\n"
+        "status[i] is 1 if that result could be computed.  For a GeoMap,\n"
+        "i is the edge label.\n\n"
+        "In all batch*() functions, polygons that cannot be processed\n"
+        "(e.g. because they are too short) and removed edges get empty\n"
+        "results and status 0; invalid parameters raise a ValueError.");
+    def("batchCurvatureLists", &batchCurvatureLists,
+        (arg("polygons"), arg("dx") = 5, arg("skipPoints") = 1,
+         arg("threadCount") = 0),
+        "batchCurvatureLists(polygons, dx = 5, skipPoints = 1, threadCount = 0)\n\n"
+        "Like batchTangentLists(), but returns the (arcLength, curvature)\n"
+        "pairs of curvatureList() (with the same handling of short\n"
+        "polygons, which need at least three points, though).");
+    def("batchSimplifyPolygon", &batchSimplifyPolygon,
+        (arg("polygons"), arg("perpendicularDistEpsilon"),
+         arg("maxStep") = 0.0, arg("threadCount") = 0),
+        "batchSimplifyPolygon(polygons, perpendicularDistEpsilon, maxStep = 0.0, threadCount = 0)\n\n"
+        "Like batchTangentLists(), but returns the points of\n"
+        "simplifyPolygon() (with maxStep only if it is > 0).");
+    def("batchResamplePolygonGaussianFilter",
+        &batchResamplePolygonGaussianFilter,
+        (arg("polygons"), arg("scale"), arg("desiredPointDistance"),
+         arg("threadCount") = 0),
+        "batchResamplePolygonGaussianFilter(polygons, scale, desiredPointDistance, threadCount = 0)\n\n"
+        "Like batchTangentLists(), but returns the points of\n"
+        "resamplePolygonGaussianFilter().");
+    def("batchPolygonSplineControlPoints", &batchPolygonSplineControlPoints,
+        (arg("polygons"), arg("segmentCount"), arg("threadCount") = 0),
+        "batchPolygonSplineControlPoints(polygons, segmentCount, threadCount = 0)\n\n"
+        "Like batchTangentLists(), but returns the points of\n"
+        "polygonSplineControlPoints().");
+}
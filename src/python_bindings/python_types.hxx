@@ -43,4 +43,22 @@ namespace vigra
   typedef NumpyArray<2, Singleband<int> >                     NumpyIImage;
 }
 
+    // releases the GIL for its lifetime, so that other Python threads
+    // can run during long computations that touch no Python objects
+class ReleaseGIL
+{
+  public:
+    ReleaseGIL()
+    : state_(PyEval_SaveThread())
+    {}
+
+    ~ReleaseGIL()
+    {
+        PyEval_RestoreThread(state_);
+    }
+
+  protected:
+    PyThreadState *state_;
+};
+
 #endif /* PYTHON_TYPES_HXX_ */
@@ -27,6 +27,8 @@
 /************************************************************************/
 
 #include "vigra/subpixel_watershed.hxx"
+#include "vigra/tiled_subpixel_watershed.hxx"
+#include "subpixelwatershedmap.hxx"
 
 #include "python_types.hxx"
 #include <boost/python.hpp>
@@ -34,6 +36,39 @@ namespace python = boost::python;
 
 using namespace vigra;
 
+    // forwards the progress of findCriticalPoints() to a Python
+    // callable, or to stderr if None was given
+class PythonCriticalPointsProgress
+{
+  public:
+    PythonCriticalPointsProgress(python::object callback, const char *name)
+    : callback_(callback),
+      stream_(name)
+    {}
+
+    void operator()(int percent) const
+    {
+        if(callback_.ptr() == Py_None)
+            stream_(percent);
+        else
+            callback_(percent);
+    }
+
+  protected:
+    python::object callback_;
+    CriticalPointsProgressStream stream_;
+};
+
+    // The parallel critical point search re-raises exceptions from its
+    // worker loop as runtime errors.  If the progress callback (always
+    // called from the calling thread) failed, its Python exception is
+    // still set and is raised unchanged instead.
+inline void rethrowPythonError()
+{
+    if(PyErr_Occurred())
+        python::throw_error_already_set();
+}
+
 template <class SPWSType>
 class SPWSWrapper : public SPWSType
 {
@@ -41,13 +76,40 @@ class SPWSWrapper : public SPWSType
     typedef Vector2 Coordinate;
 
     SPWSWrapper(NumpyFImage const & img)
-    : SPWSType(srcImageRange(img))
+    : SPWSType(srcImageRange(img)),
+      tracedThreshold_(0.0)
     {}
 
     void
-    findCriticalPointsIf(NumpyFImage const & mask)
+    findCriticalPointsIf(NumpyFImage const & mask, python::object progress)
     {
-        this->findCriticalPoints(srcImage(mask));
+        try
+        {
+            this->findCriticalPoints(
+                srcImage(mask), PythonCriticalPointsProgress(
+                    progress, "findCriticalPointsNewtonMethodIf()"));
+        }
+        catch(std::exception &)
+        {
+            rethrowPythonError();
+            throw;
+        }
+    }
+
+    void
+    findCriticalPointsWithProgress(python::object progress)
+    {
+        try
+        {
+            this->findCriticalPoints(
+                PythonCriticalPointsProgress(
+                    progress, "findCriticalPointsNewtonMethod()"));
+        }
+        catch(std::exception &)
+        {
+            rethrowPythonError();
+            throw;
+        }
     }
 
     python::list
@@ -59,7 +121,10 @@ class SPWSWrapper : public SPWSType
         plist.append(python::object());
         for(unsigned int i=1; i<this->saddles_.size(); ++i)
         {
-            plist.append(Coordinate(this->saddles_[i][0], this->saddles_[i][1]));
+            if(SPWSType::isRemoved(this->saddles_[i]))
+                plist.append(python::object());
+            else
+                plist.append(Coordinate(this->saddles_[i][0], this->saddles_[i][1]));
         }
         return plist;
     }
@@ -73,7 +138,10 @@ class SPWSWrapper : public SPWSType
         plist.append(python::object());
         for(unsigned int i=1; i<this->maxima_.size(); ++i)
         {
-            plist.append(Coordinate(this->maxima_[i][0], this->maxima_[i][1]));
+            if(SPWSType::isRemoved(this->maxima_[i]))
+                plist.append(python::object());
+            else
+                plist.append(Coordinate(this->maxima_[i][0], this->maxima_[i][1]));
         }
         return plist;
     }
@@ -87,48 +155,160 @@ class SPWSWrapper : public SPWSType
         plist.append(python::object());
         for(unsigned int i=1; i<this->minima_.size(); ++i)
         {
-            plist.append(Coordinate(this->minima_[i][0], this->minima_[i][1]));
+            if(SPWSType::isRemoved(this->minima_[i]))
+                plist.append(python::object());
+            else
+                plist.append(Coordinate(this->minima_[i][0], this->minima_[i][1]));
         }
         return plist;
     }
 
-    python::object
-    edge(int index)
+    static python::object
+    edgeTuple(typename SPWSType::TracedEdge const & edge)
     {
-        double x = this->saddles_[index][0];
-        double y = this->saddles_[index][1];
-
-        typename SPWSType::PointArray
-            forwardCurve, backwardCurve;
-
-        int findex = this->flowLine(x, y, true, 1e-4, forwardCurve);
-        int bindex = this->flowLine(x, y, false, 1e-4, backwardCurve);
-
         python::list ppoints;
-        for(int i = forwardCurve.size() - 1; i >= 0; --i)
-            ppoints.append(forwardCurve[i]);
-        for(int i = 1; i < (int)backwardCurve.size(); ++i)
-            ppoints.append(backwardCurve[i]);
+        for(unsigned int i = 0; i < edge.points.size(); ++i)
+            ppoints.append(edge.points[i]);
+
+        return python::make_tuple(edge.forwardIndex, edge.backwardIndex,
+                                  ppoints, edge.saddlePosition);
+    }
 
-        return python::make_tuple(findex, bindex, ppoints, forwardCurve.size() - 1);
+    python::object
+    edge(int index)
+    {
+        typename SPWSType::TracedEdge edge;
+        this->traceEdge(index, 1e-4, edge);
+        return edgeTuple(edge);
     }
 
     python::list
-    edges(double threshold)
+    edges(double threshold, unsigned int threadCount)
     {
         if(this->saddles_.size() == 0)
             this->findCriticalPoints();
+
+        {
+            ReleaseGIL nogil;
+            this->traceAllEdges(threshold, threadCount, tracedEdges_);
+        }
+        tracedThreshold_ = threshold;
+        pendingUpdate_ = CriticalPointUpdate();
+
         python::list plist;
-        for(unsigned int i=1; i<this->saddles_.size(); ++i)
+        for(unsigned int i=1; i<tracedEdges_.size(); ++i)
         {
-            if(this->image_(this->saddles_[i][0], this->saddles_[i][1]) >= threshold)
-                plist.append(edge(i));
+            if(tracedEdges_[i].traced)
+                plist.append(edgeTuple(tracedEdges_[i]));
             else
                 plist.append(python::object());
         }
         return plist;
     }
 
+    python::dict
+    updateCriticalPoints(NumpyFImage const & image, Rect2D const & dirtyRect)
+    {
+        CriticalPointUpdate update;
+        SPWSType::updateCriticalPoints(srcImageRange(image), dirtyRect, update);
+        pendingUpdate_ |= update;
+
+        python::dict result;
+        result["changedRect"] = update.changedRect;
+        result["minima"] = indexList(update.minima);
+        result["saddles"] = indexList(update.saddles);
+        result["maxima"] = indexList(update.maxima);
+        return result;
+    }
+
+    python::dict
+    updateEdges(unsigned int threadCount)
+    {
+        vigra_precondition(tracedEdges_.size() > 0,
+            "updateEdges(): edges() / traceAllEdges() must be called first");
+
+        std::vector<typename SPWSType::TracedEdge> oldEdges(tracedEdges_);
+        {
+            ReleaseGIL nogil;
+            SPWSType::updateEdges(pendingUpdate_, tracedThreshold_, threadCount,
+                                  tracedEdges_);
+        }
+        pendingUpdate_ = CriticalPointUpdate();
+
+        // report the edges that actually changed:
+        python::dict result;
+        for(unsigned int i=1; i<tracedEdges_.size(); ++i)
+        {
+            typename SPWSType::TracedEdge const & edge = tracedEdges_[i];
+            if(i < oldEdges.size() && sameEdge(edge, oldEdges[i]))
+                continue;
+            if(edge.traced)
+                result[i] = edgeTuple(edge);
+            else
+                result[i] = python::object();
+        }
+        return result;
+    }
+
+    std::auto_ptr<GeoMap>
+    map(double threshold, unsigned int threadCount,
+        double borderConnectionDist, double ssStepDist, double ssMinDist,
+        bool performBorderClosing, bool performEdgeSplits, bool cleanup)
+    {
+        if(this->saddles_.size() == 0)
+            this->findCriticalPoints();
+
+        typename SPWSType::TracedEdges edges;
+        {
+            ReleaseGIL nogil;
+            this->traceAllEdges(threshold, threadCount, edges);
+        }
+        return subpixelWatershedMapFromData(
+            this->maxima_, edges, Size2D(this->width(), this->height()),
+            borderConnectionDist, ssStepDist, ssMinDist,
+            performBorderClosing, performEdgeSplits, cleanup);
+    }
+
+    python::dict
+    counters() const
+    {
+        python::dict result;
+        result["cpDedupQueries"] = this->cpDedupCounters_.queries;
+        result["cpDedupHits"] = this->cpDedupCounters_.hits;
+        result["maximumQueries"] = this->maximaIndex_.counters().queries;
+        result["maximumHits"] = this->maximaIndex_.counters().hits;
+        return result;
+    }
+
+  protected:
+    typedef typename SPWSType::CriticalPointUpdate CriticalPointUpdate;
+
+    static python::list
+    indexList(std::vector<int> const & indices)
+    {
+        python::list result;
+        for(unsigned int i=0; i<indices.size(); ++i)
+            result.append(indices[i]);
+        return result;
+    }
+
+    static bool
+    sameEdge(typename SPWSType::TracedEdge const & a,
+             typename SPWSType::TracedEdge const & b)
+    {
+        return a.traced == b.traced &&
+            a.forwardIndex == b.forwardIndex &&
+            a.backwardIndex == b.backwardIndex &&
+            a.saddlePosition == b.saddlePosition &&
+            a.points.size() == b.points.size() &&
+            std::equal(a.points.begin(), a.points.end(), b.points.begin());
+    }
+
+    typename SPWSType::TracedEdges tracedEdges_;
+    double tracedThreshold_;
+    CriticalPointUpdate pendingUpdate_;
+
+  public:
     python::tuple
     debugCP()
     {
@@ -219,24 +399,238 @@ defSubPixelWS(char const * name)
         .def("minima", &SPWS::minima)
         .def("debugCP", &SPWS::debugCP)
         .def("edge", &SPWS::edge)
-        .def("edges", &SPWS::edges)
-        .def("findCriticalPoints", (void(SPWS::*)())&SPWS::findCriticalPoints)
-        .def("findCriticalPoints", &SPWS::findCriticalPointsIf)
+        .def("edges", &SPWS::edges,
+             (python::arg("threshold"), python::arg("threadCount") = 1))
+        .def("traceAllEdges", &SPWS::edges,
+             (python::arg("threshold"), python::arg("threadCount") = 0),
+             "traceAllEdges(threshold, threadCount = 0)\n\n"
+             "Like edges(), but tracing the flow lines of the saddles in parallel\n"
+             "(by default with as many threads as available).  The result is\n"
+             "ordered like saddles() (without the leading None).  The GIL is\n"
+             "released while tracing (also in edges(), updateEdges() and map()).")
+        .def("findCriticalPoints", &SPWS::findCriticalPointsWithProgress,
+             (python::arg("progress") = python::object()),
+             "findCriticalPoints(progress = None)\n\n"
+             "Find the critical points (with cpThreadCount threads).  If given,\n"
+             "progress is called with the percentage of processed rows\n"
+             "(and finally with 100) instead of printing it to stderr.")
+        .def("findCriticalPoints", &SPWS::findCriticalPointsIf,
+             (python::arg("mask"), python::arg("progress") = python::object()),
+             "findCriticalPoints(mask, progress = None)\n\n"
+             "Like above, but only search from pixels where mask is non-zero.")
+        .def("map", &SPWS::map,
+             (python::arg("threshold"), python::arg("threadCount") = 0,
+              python::arg("borderConnectionDist") = 0.1,
+              python::arg("ssStepDist") = 0.2, python::arg("ssMinDist") = 0.12,
+              python::arg("performBorderClosing") = true,
+              python::arg("performEdgeSplits") = true,
+              python::arg("cleanup") = true),
+             "map(threshold, threadCount = 0, borderConnectionDist = 0.1,\n"
+             "    ssStepDist = 0.2, ssMinDist = 0.12, performBorderClosing = True,\n"
+             "    performEdgeSplits = True, cleanup = True) -> GeoMap\n\n"
+             "Trace all edges and build the initialized GeoMap in C++, like\n"
+             "maputils.subpixelWatershedMapFromData() (without statistics).\n"
+             "Nodes are labelled like maxima(), edges like saddles(); border\n"
+             "edges carry the BORDER_PROTECTION flag, but no EdgeProtection\n"
+             "is attached.")
+        .def("updateCriticalPoints", &SPWS::updateCriticalPoints,
+             (python::arg("image"), python::arg("dirtyRect")),
+             "updateCriticalPoints(image, dirtyRect) -> dict\n\n"
+             "Take over the edited image within dirtyRect (a Rect2D), recomputing\n"
+             "the spline and the critical points only around it.  Untouched\n"
+             "points keep their indices; removed ones become None in saddles()\n"
+             "etc.  Returns the 'changedRect' and the indices of the changed\n"
+             "'minima', 'saddles', and 'maxima'.  maxima() is not resorted.")
+        .def("updateEdges", &SPWS::updateEdges,
+             (python::arg("threadCount") = 0),
+             "updateEdges(threadCount = 0) -> dict\n\n"
+             "Retrace the edges of the last edges() / traceAllEdges() call that\n"
+             "are affected by the updateCriticalPoints() calls since (with the\n"
+             "same threshold).  Returns the changed edges by saddle index\n"
+             "(i.e. edges()[index-1]); removed or too low ones map to None.")
+        .def("counters", &SPWS::counters,
+             "counters() -> dict\n\n"
+             "Numbers of point set queries (and hits) of the critical point\n"
+             "deduplication (last findCriticalPoints()) and of the maximum\n"
+             "lookups of the flow line tracing (since findCriticalPoints()).")
         .def_readwrite("initialStep", &SPWS::initialStep_)
         .def_readwrite("minCPDist", &SPWS::minCPDist_)
         .def_readwrite("cpOversampling", &SPWS::cpOversampling_)
+        .def_readwrite("cpThreadCount", &SPWS::cpThreadCount_)
+        .def_readwrite("cpFusedDerivatives", &SPWS::cpFusedDerivatives_)
+        .def_readwrite("flowLineIntegrator", &SPWS::flowLineIntegrator_)
+        .def_readwrite("flowLineTolerance", &SPWS::flowLineTolerance_)
+        .def_readwrite("coefficientHalo", &SPWS::coefficientHalo_)
         //.def("findCriticalPointsInFacet", &SPWS::findCriticalPointsInFacet)
     ;
 
     return theclass;
 }
 
+template <class TiledType>
+class TiledSPWSWrapper : public TiledType
+{
+  public:
+    typedef Vector2 Coordinate;
+    typedef SPWSWrapper<typename TiledType::TileWatersheds> SPWS;
+
+    TiledSPWSWrapper(NumpyFImage const & img, int tileSize, int overlap)
+    : TiledType(Size2D(img.shape(0), img.shape(1)), tileSize, overlap),
+      source_(img)
+    {}
+
+    void
+    findCriticalPoints(unsigned int threadCount)
+    {
+        TiledType::findCriticalPoints(srcImageRange(source_), threadCount);
+    }
+
+    static python::list
+    pointList(typename TiledType::PointArray const & points)
+    {
+        python::list plist;
+        plist.append(python::object());
+        for(unsigned int i=1; i<points.size(); ++i)
+        {
+            plist.append(Coordinate(points[i][0], points[i][1]));
+        }
+        return plist;
+    }
+
+    python::list
+    saddles()
+    {
+        if(this->saddles_.size() == 0)
+            findCriticalPoints(0);
+        return pointList(this->saddles_);
+    }
+
+    python::list
+    maxima()
+    {
+        if(this->maxima_.size() == 0)
+            findCriticalPoints(0);
+        return pointList(this->maxima_);
+    }
+
+    python::list
+    minima()
+    {
+        if(this->minima_.size() == 0)
+            findCriticalPoints(0);
+        return pointList(this->minima_);
+    }
+
+    python::list
+    edges(double threshold, unsigned int threadCount)
+    {
+        if(this->saddles_.size() == 0)
+            findCriticalPoints(threadCount);
+
+        typename TiledType::TracedEdges edges;
+        {
+            ReleaseGIL nogil;
+            this->traceAllEdges(srcImageRange(source_), threshold, threadCount, edges);
+        }
+
+        python::list plist;
+        for(unsigned int i=1; i<edges.size(); ++i)
+        {
+            if(edges[i].traced)
+                plist.append(SPWS::edgeTuple(edges[i]));
+            else
+                plist.append(python::object());
+        }
+        return plist;
+    }
+
+    std::auto_ptr<GeoMap>
+    map(double threshold, unsigned int threadCount,
+        double borderConnectionDist, double ssStepDist, double ssMinDist,
+        bool performBorderClosing, bool performEdgeSplits, bool cleanup)
+    {
+        if(this->saddles_.size() == 0)
+            findCriticalPoints(threadCount);
+
+        typename TiledType::TracedEdges edges;
+        {
+            ReleaseGIL nogil;
+            this->traceAllEdges(srcImageRange(source_), threshold, threadCount, edges);
+        }
+        return subpixelWatershedMapFromData(
+            this->maxima_, edges, this->imageSize_,
+            borderConnectionDist, ssStepDist, ssMinDist,
+            performBorderClosing, performEdgeSplits, cleanup);
+    }
+
+  protected:
+    NumpyFImage source_;
+};
+
+template <class TiledType>
+void
+defTiledSubPixelWS(char const * name)
+{
+    typedef TiledSPWSWrapper<TiledType> TiledSPWS;
+
+    python::class_<TiledSPWS>(
+        name,
+        "Subpixel watersheds computed tile by tile, with the spline of only\n"
+        "as many tiles (plus overlap) in memory as there are threads, plus\n"
+        "up to tileCacheSize tiles cached between the rounds of flow line\n"
+        "continuations.  Flow lines that leave a tile are continued in the\n"
+        "neighboring tiles.",
+        python::init<NumpyFImage const &, int, int>(
+            (python::arg("image"), python::arg("tileSize") = 512,
+             python::arg("overlap") = 32)))
+        .def("width", &TiledSPWS::width)
+        .def("height", &TiledSPWS::height)
+        .def("tileCount", &TiledSPWS::tileCount)
+        .def("saddles", &TiledSPWS::saddles)
+        .def("maxima", &TiledSPWS::maxima)
+        .def("minima", &TiledSPWS::minima)
+        .def("findCriticalPoints", &TiledSPWS::findCriticalPoints,
+             (python::arg("threadCount") = 0))
+        .def("edges", &TiledSPWS::edges,
+             (python::arg("threshold"), python::arg("threadCount") = 0),
+             "edges(threshold, threadCount = 0)\n\n"
+             "Like SubPixelWatersheds.edges(), with coordinates and maximum\n"
+             "indices referring to the whole image.")
+        .def("map", &TiledSPWS::map,
+             (python::arg("threshold"), python::arg("threadCount") = 0,
+              python::arg("borderConnectionDist") = 0.1,
+              python::arg("ssStepDist") = 0.2, python::arg("ssMinDist") = 0.12,
+              python::arg("performBorderClosing") = true,
+              python::arg("performEdgeSplits") = true,
+              python::arg("cleanup") = true),
+             "map(threshold, threadCount = 0, ...) -> GeoMap\n\n"
+             "Like SubPixelWatersheds.map(), with the edges stitched across\n"
+             "the tiles.")
+        .def_readwrite("initialStep", &TiledSPWS::initialStep_)
+        .def_readwrite("minCPDist", &TiledSPWS::minCPDist_)
+        .def_readwrite("cpOversampling", &TiledSPWS::cpOversampling_)
+        .def_readwrite("flowLineIntegrator", &TiledSPWS::flowLineIntegrator_)
+        .def_readwrite("flowLineTolerance", &TiledSPWS::flowLineTolerance_)
+        .def_readwrite("tileCacheSize", &TiledSPWS::tileCacheSize_)
+    ;
+}
+
 void defSPWS()
 {
+    python::enum_<FlowLineIntegrator>("FlowLineIntegrator")
+        .value("SecondOrderDoubleStep", SecondOrderDoubleStep)
+        .value("DormandPrince45", DormandPrince45)
+    ;
+
     defSubPixelWS<SubPixelWatersheds<SplineImageView<2, GrayValue> > >(
         "SubPixelWatersheds2");
     defSubPixelWS<SubPixelWatersheds<SplineImageView<3, GrayValue> > >(
         "SubPixelWatersheds3");
     defSubPixelWS<SubPixelWatersheds<SplineImageView<5, GrayValue> > >(
         "SubPixelWatersheds5");
+
+    defTiledSubPixelWS<TiledSubPixelWatersheds<SplineImageView<3, GrayValue> > >(
+        "TiledSubPixelWatersheds3");
+    defTiledSubPixelWS<TiledSubPixelWatersheds<SplineImageView<5, GrayValue> > >(
+        "TiledSubPixelWatersheds5");
 }